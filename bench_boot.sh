@@ -0,0 +1,77 @@
+#!/bin/bash
+# Boots the boot-benchmark build headless N times (default 10) and prints
+# the distribution of every milestone and command time, in microseconds.
+# Needs only QEMU: ./bench_boot.sh [runs]
+set -e
+
+RUNS=${1:-10}
+QEMU_CMD=${QEMU_CMD:-qemu-system-x86_64}
+OUT=build/bootbench
+mkdir -p $OUT
+rm -f $OUT/*.log
+
+# Put the normal kernel back however this ends, so run.sh is never left
+# with the benchmark one
+restore_kernel() {
+    ./build.sh > $OUT/build.log
+}
+trap restore_kernel EXIT
+
+echo "Building benchmark kernel..."
+TACOS_BOOTBENCH=1 ./build.sh > $OUT/build.log
+
+for i in $(seq 1 $RUNS); do
+    # A fresh disk each time, so every run formats the same way
+    qemu-img create -q -f raw $OUT/disk.img 10M
+    set +e
+    # The same devices as run.sh, with the sound going nowhere
+    timeout 120 $QEMU_CMD -display none -no-reboot -m 128M \
+        -cdrom build/tacos_os.iso -boot d \
+        -drive file=$OUT/disk.img,format=raw,index=0,media=disk \
+        -audiodev none,id=snd0 -machine pcspk-audiodev=snd0 \
+        -device sb16,audiodev=snd0 \
+        -device isa-debug-exit,iobase=0xf4,iosize=0x04 \
+        -serial file:$OUT/run$i.log
+    rc=$?
+    set -e
+    # isa-debug-exit turns the kernel's 0 into exit status 1
+    if [ $rc -ne 1 ] || ! grep -q "^bootbench done" $OUT/run$i.log; then
+        echo "Run $i failed (exit status $rc), see $OUT/run$i.log"
+        exit 1
+    fi
+    echo "Run $i/$RUNS done"
+done
+
+trap - EXIT
+restore_kernel
+
+echo ""
+cat $OUT/run*.log | tr -d '\r' | awk '
+$1 == "bootbench" && $3 ~ /^us=/ {
+    key = $2
+    if (!(key in count))
+        order[n++] = key
+    v[key, count[key]++] = substr($3, 4) + 0
+}
+function pct(key, p,   i) {
+    i = int((count[key] - 1) * p + 0.5)
+    return s[i]
+}
+END {
+    printf "%-24s %5s %10s %10s %10s %10s\n", "us", "runs", "min", \
+        "median", "p90", "max"
+    for (k = 0; k < n; k++) {
+        key = order[k]
+        for (i = 0; i < count[key]; i++)
+            s[i] = v[key, i]
+        # Insertion sort; a run count is small
+        for (i = 1; i < count[key]; i++) {
+            x = s[i]
+            for (j = i - 1; j >= 0 && s[j] > x; j--)
+                s[j + 1] = s[j]
+            s[j + 1] = x
+        }
+        printf "%-24s %5d %10d %10d %10d %10d\n", key, count[key], s[0], \
+            pct(key, 0.5), pct(key, 0.9), s[count[key] - 1]
+    }
+}'
@@ -6,30 +6,133 @@ echo "Building Minimal TacosOS..."
 mkdir -p build
 
 # Compiler flags
-CFLAGS="-ffreestanding -O2 -Wall -Wextra -m64 -fno-stack-protector -fno-exceptions -fno-rtti -mno-red-zone -mcmodel=kernel -fno-pic -mno-sse -mno-mmx -mno-sse2"
+CFLAGS="-ffreestanding -std=gnu++20 -O2 -Wall -Wextra -m64 -fno-stack-protector -fno-exceptions -fno-rtti -mno-red-zone -mcmodel=kernel -fno-pic -mno-sse -mno-mmx -mno-sse2"
 INCLUDES="-I src"
 
+# TACOS_BOOTBENCH=1 builds the boot benchmark used by bench_boot.sh
+if [ "$TACOS_BOOTBENCH" = "1" ]; then
+    CFLAGS="$CFLAGS -DTACOS_BOOTBENCH"
+fi
+
 # Assemble boot code
 echo "Assembling boot code..."
 nasm -f elf64 src/arch/x86_64/multiboot_header.asm -o build/multiboot_header.o
 nasm -f elf64 src/arch/x86_64/boot.asm -o build/boot.o
+nasm -f elf64 src/arch/x86_64/interrupts.asm -o build/interrupts_asm.o
+nasm -f elf64 src/arch/x86_64/syscall.asm -o build/syscall_asm.o
 
 # Compile kernel sources
 echo "Compiling kernel..."
 gcc -c src/kernel/main.cpp -o build/main.o $CFLAGS $INCLUDES
+gcc -c src/kernel/cmd.cpp -o build/cmd.o $CFLAGS $INCLUDES
+gcc -c src/kernel/fs.cpp -o build/fs.o $CFLAGS $INCLUDES
+gcc -c src/kernel/ata.cpp -o build/ata.o $CFLAGS $INCLUDES
+gcc -c src/kernel/block.cpp -o build/block.o $CFLAGS $INCLUDES
+gcc -c src/kernel/acpi.cpp -o build/acpi.o $CFLAGS $INCLUDES
+gcc -c src/kernel/co.cpp -o build/co.o $CFLAGS $INCLUDES
 gcc -c src/kernel/interrupts.cpp -o build/interrupts.o $CFLAGS $INCLUDES
+gcc -c src/kernel/softirq.cpp -o build/softirq.o $CFLAGS $INCLUDES
 gcc -c src/kernel/dma.cpp -o build/dma.o $CFLAGS $INCLUDES
 gcc -c src/kernel/sb16.cpp -o build/sb16.o $CFLAGS $INCLUDES
+gcc -c src/kernel/cpu.cpp -o build/cpu.o $CFLAGS $INCLUDES
+gcc -c src/kernel/idle.cpp -o build/idle.o $CFLAGS $INCLUDES
+gcc -c src/kernel/paging.cpp -o build/paging.o $CFLAGS $INCLUDES
+gcc -c src/kernel/tlb.cpp -o build/tlb.o $CFLAGS $INCLUDES
+gcc -c src/kernel/mixer.cpp -o build/mixer.o $CFLAGS $INCLUDES
+gcc -c src/kernel/synth.cpp -o build/synth.o $CFLAGS $INCLUDES
+gcc -c src/kernel/pit.cpp -o build/pit.o $CFLAGS $INCLUDES
+gcc -c src/kernel/timer.cpp -o build/timer.o $CFLAGS $INCLUDES
+gcc -c src/kernel/speaker.cpp -o build/speaker.o $CFLAGS $INCLUDES
+gcc -c src/kernel/wav.cpp -o build/wav.o $CFLAGS $INCLUDES
+gcc -c src/kernel/gdt.cpp -o build/gdt.o $CFLAGS $INCLUDES
+gcc -c src/kernel/pmm.cpp -o build/pmm.o $CFLAGS $INCLUDES
+gcc -c src/kernel/syscall.cpp -o build/syscall.o $CFLAGS $INCLUDES
+gcc -c src/kernel/process.cpp -o build/process.o $CFLAGS $INCLUDES
+gcc -c src/kernel/vdso.cpp -o build/vdso.o $CFLAGS $INCLUDES
+gcc -c src/kernel/rtc.cpp -o build/rtc.o $CFLAGS $INCLUDES
+gcc -c src/kernel/pipe.cpp -o build/pipe.o $CFLAGS $INCLUDES
+gcc -c src/kernel/textutil.cpp -o build/textutil.o $CFLAGS $INCLUDES
+gcc -c src/kernel/ksyms.cpp -o build/ksyms.o $CFLAGS $INCLUDES
+gcc -c src/kernel/profile.cpp -o build/profile.o $CFLAGS $INCLUDES
+gcc -c src/kernel/serial.cpp -o build/serial.o $CFLAGS $INCLUDES
+gcc -c src/kernel/trace.cpp -o build/trace.o $CFLAGS $INCLUDES
+gcc -c src/kernel/lock.cpp -o build/lock.o $CFLAGS $INCLUDES
+gcc -c src/kernel/kstring.cpp -o build/kstring.o $CFLAGS $INCLUDES
+gcc -c src/kernel/bench.cpp -o build/bench.o $CFLAGS $INCLUDES
+gcc -c src/kernel/bootbench.cpp -o build/bootbench.o $CFLAGS $INCLUDES
+
+# Build the ring 3 programs. They are linked into the kernel as raw files
+# and installed into /system at boot. The kernel doesn't enable or save
+# SSE state, so user code is built without it too.
+echo "Building user programs..."
+USER_CFLAGS="-ffreestanding -O2 -Wall -Wextra -m64 -fno-stack-protector -fno-exceptions -fno-rtti -fno-asynchronous-unwind-tables -fpie -mno-sse -mno-mmx -mno-sse2"
+mkdir -p build/user
+gcc -c src/user/crt0.cpp -o build/user/crt0.o $USER_CFLAGS $INCLUDES
+gcc -c src/user/hello.cpp -o build/user/hello.o $USER_CFLAGS $INCLUDES
+gcc -c src/user/sysbench.cpp -o build/user/sysbench.o $USER_CFLAGS $INCLUDES
+gcc -c src/user/clock.cpp -o build/user/clock.o $USER_CFLAGS $INCLUDES
+ld -n -static -T src/user/user.ld -o build/user/hello \
+    build/user/crt0.o build/user/hello.o -z max-page-size=0x1000
+ld -n -static -T src/user/user.ld -o build/user/sysbench \
+    build/user/crt0.o build/user/sysbench.o -z max-page-size=0x1000
+ld -n -static -T src/user/user.ld -o build/user/clock \
+    build/user/crt0.o build/user/clock.o -z max-page-size=0x1000
+# Symbols are named after the file: _binary_hello_start, ...
+(cd build/user && ld -r -b binary -o ../programs.o hello sysbench clock)
 
 # Link
+KERNEL_OBJS="
+    build/multiboot_header.o
+    build/boot.o
+    build/interrupts_asm.o
+    build/syscall_asm.o
+    build/main.o
+    build/cmd.o
+    build/fs.o
+    build/ata.o
+    build/block.o
+    build/acpi.o
+    build/co.o
+    build/interrupts.o
+    build/softirq.o
+    build/dma.o
+    build/sb16.o
+    build/cpu.o
+    build/idle.o
+    build/paging.o
+    build/tlb.o
+    build/mixer.o
+    build/synth.o
+    build/pit.o
+    build/timer.o
+    build/speaker.o
+    build/wav.o
+    build/gdt.o
+    build/pmm.o
+    build/syscall.o
+    build/process.o
+    build/vdso.o
+    build/rtc.o
+    build/pipe.o
+    build/textutil.o
+    build/ksyms.o
+    build/profile.o
+    build/serial.o
+    build/trace.o
+    build/lock.o
+    build/kstring.o
+    build/bench.o
+    build/bootbench.o
+    build/programs.o"
+
+# The kernel is linked twice: the first image has no symbol table and
+# gives the function addresses, which the second embeds in .ksyms.
 echo "Linking..."
-ld -n -o build/tacos_os.bin -T linker.ld \
-    build/multiboot_header.o \
-    build/boot.o \
-    build/main.o \
-    build/interrupts.o \
-    build/dma.o \
-    build/sb16.o \
+ld -n -o build/tacos_os.bin -T linker.ld $KERNEL_OBJS -z max-page-size=0x1000
+nm -n -C --defined-only build/tacos_os.bin | awk -f tools/ksyms.awk \
+    > build/ksyms_table.asm
+nasm -f elf64 build/ksyms_table.asm -o build/ksyms_table.o
+ld -n -o build/tacos_os.bin -T linker.ld $KERNEL_OBJS build/ksyms_table.o \
     -z max-page-size=0x1000
 
 # Generate ISO
@@ -0,0 +1,30 @@
+#!/bin/bash
+set -e
+
+# Builds the kernel units that don't depend on hardware (file system,
+# block queue, string helpers, synthesizer) for the host, against an
+# in-memory disk. TACOS_HOST swaps out what can't run in user mode.
+#   build/host/unit_tests  sanitizer build of the unit tests, run here
+#   build/host/fs_bench    optimized build with tables of 10^6 files
+
+echo "Building host units..."
+mkdir -p build/host
+
+UNITS="src/kernel/block.cpp src/kernel/co.cpp src/kernel/fs.cpp \
+    src/kernel/kstring.cpp src/kernel/lock.cpp src/kernel/synth.cpp \
+    src/host/mock_ata.cpp src/host/stubs.cpp"
+HOST_CFLAGS="-std=gnu++20 -Wall -Wextra -fno-exceptions -fno-rtti -pthread \
+    -DTACOS_HOST -I src"
+SANITIZE="-O1 -g -fsanitize=address,undefined -fno-omit-frame-pointer \
+    -fno-sanitize-recover=all"
+
+g++ $HOST_CFLAGS $SANITIZE -o build/host/unit_tests $UNITS \
+    src/host/unit_tests.cpp
+g++ $HOST_CFLAGS -O2 -DMAX_FILES=1000000 -DMAX_DIRS=1024 \
+    -o build/host/fs_bench $UNITS src/host/fs_bench.cpp
+
+echo "Running unit tests..."
+build/host/unit_tests
+
+echo ""
+echo "Benchmark: build/host/fs_bench"
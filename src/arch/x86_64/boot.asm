@@ -1,13 +1,20 @@
 global start
 extern long_mode_start
 
-section .text
+KERNEL_VMA equ 0xFFFFFFFF80000000
+
+; Physical address of a higher-half symbol, for use before paging is on
+%define PHYS(sym) ((sym) - KERNEL_VMA)
+
+; The entry code runs at its load address, so it lives in a section that
+; linker.ld keeps out of the higher half
+section .boot.text progbits alloc exec nowrite align=16
 bits 32
 start:
-    mov esp, stack_top
+    mov esp, PHYS(stack_top)
     
     ; Save multiboot info pointer (ebx contains it from GRUB)
-    mov [multiboot_info_ptr], ebx
+    mov [PHYS(multiboot_info_ptr)], ebx
 
     call check_multiboot
     call check_cpuid
@@ -19,7 +26,7 @@ start:
     ; Load the 64-bit GDT
     lgdt [gdt64.pointer]
 
-    jmp gdt64.code_segment:long_mode_start
+    jmp gdt64.code_segment:long_mode_trampoline
 
 check_multiboot:
     cmp eax, 0x36d76289
@@ -63,32 +70,33 @@ check_long_mode:
     jmp error
 
 set_up_page_tables:
-    ; Map first P4 entry to P3 table
-    mov eax, p3_table
-    or eax, 0b11 ; present + writable
-    mov [p4_table], eax
-    mov dword [p4_table + 4], 0
-
-    ; Map first four P3 entries to P2 tables (4 * 1GB = 4GB)
-    mov eax, p2_table
-    or eax, 0b11 ; present + writable
-    mov [p3_table], eax
-    mov dword [p3_table + 4], 0
-
-    mov eax, p2_table + 4096
+    ; P4 entry 0 (identity, for this code) and entry 256 (the direct map
+    ; at 0xFFFF800000000000) share one P3 table covering 4GB
+    mov eax, PHYS(p3_table)
     or eax, 0b11 ; present + writable
-    mov [p3_table + 8], eax
-    mov dword [p3_table + 12], 0
-
-    mov eax, p2_table + 8192
-    or eax, 0b11 ; present + writable
-    mov [p3_table + 16], eax
-    mov dword [p3_table + 20], 0
-
-    mov eax, p2_table + 12288
-    or eax, 0b11 ; present + writable
-    mov [p3_table + 24], eax
-    mov dword [p3_table + 28], 0
+    mov [PHYS(p4_table)], eax
+    mov [PHYS(p4_table) + 256 * 8], eax
+
+    ; P4 entry 511 -> P3 whose entry 510 maps KERNEL_VMA to the first 1GB
+    mov eax, PHYS(p3_high_table)
+    or eax, 0b11
+    mov [PHYS(p4_table) + 511 * 8], eax
+    mov eax, PHYS(p2_table)
+    or eax, 0b11
+    mov [PHYS(p3_high_table) + 510 * 8], eax
+
+    ; Map the first four P3 entries to P2 tables (4 * 1GB = 4GB)
+    mov ecx, 0
+.map_p3_table:
+    mov eax, ecx
+    shl eax, 12        ; 4K * ecx
+    add eax, PHYS(p2_table)
+    or eax, 0b11       ; present + writable
+    mov [PHYS(p3_table) + ecx * 8], eax
+
+    inc ecx
+    cmp ecx, 4
+    jne .map_p3_table
 
     ; Map each P2 entry to a huge 2MB page (4 * 512 * 2MB = 4GB)
     mov ecx, 0         ; counter
@@ -97,18 +105,20 @@ set_up_page_tables:
     mov eax, 0x200000  ; 2MB
     mul ecx            ; start address of ecx-th page
     or eax, 0b10000011 ; present + writable + huge
-    mov [p2_table + ecx * 8], eax ; map lower 32 bits
-    mov dword [p2_table + ecx * 8 + 4], 0 ; zero upper 32 bits
+    mov [PHYS(p2_table) + ecx * 8], eax ; map lower 32 bits
+    mov dword [PHYS(p2_table) + ecx * 8 + 4], 0 ; zero upper 32 bits
 
     inc ecx            ; increase counter
     cmp ecx, 512 * 4   ; if counter == 2048, 4GB are mapped
     jne .map_p2_table  ; else map the next entry
 
+    ; These tables only last until paging_init() builds the real ones
+    ; from the memory map
     ret
 
 enable_paging:
     ; Load P4 to cr3
-    mov eax, p4_table
+    mov eax, PHYS(p4_table)
     mov cr3, eax
 
     ; Enable PAE-flag in cr4 (Physical Address Extension)
@@ -137,19 +147,28 @@ error:
     mov byte  [0xb800a], al
     hlt
 
+bits 64
+long_mode_trampoline:
+    ; Still running at the load address; continue in the higher half
+    mov rax, long_mode_start
+    jmp rax
+
 section .bss
 align 4096
 p4_table:
     resb 4096
 p3_table:
     resb 4096
+p3_high_table:
+    resb 4096
 p2_table:
     resb 4096 * 4
 stack_bottom:
     resb 4096 * 4
 stack_top:
 
-section .rodata
+; Loaded in 32-bit mode, so it must sit at a physical address too
+section .boot.rodata progbits alloc noexec nowrite align=8
 gdt64:
     dq 0 ; zero entry
 .code_segment: equ $ - gdt64
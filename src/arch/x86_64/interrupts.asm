@@ -0,0 +1,199 @@
+; CPU exception (vectors 0x00 - 0x1F) and hardware IRQ (PIC vectors
+; 0x20 - 0x2F) entry points.
+; Each IRQ stub pushes its IRQ number and jumps to irq_common_stub, which
+; saves the caller-saved registers and calls irq_handler(irq, frame).
+; Exception stubs push a zero error code where the CPU doesn't push one,
+; then the vector, and call exception_handler(vector, error, frame).
+
+section .text
+bits 64
+extern irq_handler
+extern exception_handler
+global irq_common_stub
+
+%macro ISR_NOERR 1
+isr_stub_%1:
+    push qword 0
+    push qword %1
+    jmp isr_common_stub
+%endmacro
+
+%macro ISR_ERR 1
+isr_stub_%1:
+    push qword %1
+    jmp isr_common_stub
+%endmacro
+
+ISR_NOERR 0
+ISR_NOERR 1
+ISR_NOERR 2
+ISR_NOERR 3
+ISR_NOERR 4
+ISR_NOERR 5
+ISR_NOERR 6
+ISR_NOERR 7
+ISR_ERR   8
+ISR_NOERR 9
+ISR_ERR   10
+ISR_ERR   11
+ISR_ERR   12
+ISR_ERR   13
+ISR_ERR   14
+ISR_NOERR 15
+ISR_NOERR 16
+ISR_ERR   17
+ISR_NOERR 18
+ISR_NOERR 19
+ISR_NOERR 20
+ISR_ERR   21
+ISR_NOERR 22
+ISR_NOERR 23
+ISR_NOERR 24
+ISR_NOERR 25
+ISR_NOERR 26
+ISR_NOERR 27
+ISR_NOERR 28
+ISR_ERR   29
+ISR_ERR   30
+ISR_NOERR 31
+
+isr_common_stub:
+    ; Frame (5) + error code + vector + 9 registers = 16 qwords, so the
+    ; stack is already 16-byte aligned for the call
+    push rax
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push r8
+    push r9
+    push r10
+    push r11
+
+    mov rdi, [rsp + 9 * 8]       ; Vector
+    mov rsi, [rsp + 10 * 8]      ; Error code
+    lea rdx, [rsp + 11 * 8]      ; Hardware frame
+    cld
+    call exception_handler
+
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rax
+    add rsp, 16                  ; Drop vector and error code
+    iretq
+
+%macro IRQ_STUB 1
+irq_stub_%1:
+    push qword %1
+    jmp irq_common_stub
+%endmacro
+
+IRQ_STUB 0
+IRQ_STUB 1
+IRQ_STUB 2
+IRQ_STUB 3
+IRQ_STUB 4
+IRQ_STUB 5
+IRQ_STUB 6
+IRQ_STUB 7
+IRQ_STUB 8
+IRQ_STUB 9
+IRQ_STUB 10
+IRQ_STUB 11
+IRQ_STUB 12
+IRQ_STUB 13
+IRQ_STUB 14
+IRQ_STUB 15
+
+irq_common_stub:
+    ; The CPU aligned rsp to 16 before pushing the 5-qword frame, so after
+    ; the IRQ number and 9 registers we are 8 bytes off; pad with sub rsp, 8
+    push rax
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push r8
+    push r9
+    push r10
+    push r11
+    sub rsp, 8
+
+    mov rdi, [rsp + 8 + 9 * 8]   ; IRQ number
+    lea rsi, [rsp + 8 + 10 * 8]  ; Hardware frame (rip, cs, rflags, rsp, ss)
+    cld
+    call irq_handler
+
+    add rsp, 8
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rax
+    add rsp, 8                   ; Drop the IRQ number
+    iretq
+
+section .rodata
+global isr_stub_table
+isr_stub_table:
+    dq isr_stub_0
+    dq isr_stub_1
+    dq isr_stub_2
+    dq isr_stub_3
+    dq isr_stub_4
+    dq isr_stub_5
+    dq isr_stub_6
+    dq isr_stub_7
+    dq isr_stub_8
+    dq isr_stub_9
+    dq isr_stub_10
+    dq isr_stub_11
+    dq isr_stub_12
+    dq isr_stub_13
+    dq isr_stub_14
+    dq isr_stub_15
+    dq isr_stub_16
+    dq isr_stub_17
+    dq isr_stub_18
+    dq isr_stub_19
+    dq isr_stub_20
+    dq isr_stub_21
+    dq isr_stub_22
+    dq isr_stub_23
+    dq isr_stub_24
+    dq isr_stub_25
+    dq isr_stub_26
+    dq isr_stub_27
+    dq isr_stub_28
+    dq isr_stub_29
+    dq isr_stub_30
+    dq isr_stub_31
+
+global irq_stub_table
+irq_stub_table:
+    dq irq_stub_0
+    dq irq_stub_1
+    dq irq_stub_2
+    dq irq_stub_3
+    dq irq_stub_4
+    dq irq_stub_5
+    dq irq_stub_6
+    dq irq_stub_7
+    dq irq_stub_8
+    dq irq_stub_9
+    dq irq_stub_10
+    dq irq_stub_11
+    dq irq_stub_12
+    dq irq_stub_13
+    dq irq_stub_14
+    dq irq_stub_15
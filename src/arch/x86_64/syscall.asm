@@ -0,0 +1,95 @@
+; SYSCALL entry point and the ring 0 <-> ring 3 transitions used by
+; process.cpp. There is one process at a time, so the stacks and the saved
+; user rsp are plain globals rather than per-CPU data.
+
+section .text
+bits 64
+extern syscall_dispatch
+extern syscall_kernel_rsp
+global syscall_entry
+global user_enter
+global user_return
+
+; MSR_LSTAR points here. rcx = user rip, r11 = user rflags; SFMASK has
+; cleared IF, so nothing can interrupt the stack switch.
+syscall_entry:
+    mov [rel syscall_user_rsp], rsp
+    mov rsp, [rel syscall_kernel_rsp]
+    push qword [rel syscall_user_rsp]
+    push rcx
+    push r11
+
+    ; Caller-saved registers the ABI promises to preserve
+    push rdi
+    push rsi
+    push rdx
+    push r10
+    push r8
+    push r9
+    sub rsp, 8                   ; 9 pushes: realign to 16 for the call
+
+    ; syscall_dispatch(a0, a1, a2, a3, a4, nr)
+    mov rcx, r10
+    mov r9, rax
+    call syscall_dispatch
+
+    add rsp, 8
+    pop r9
+    pop r8
+    pop r10
+    pop rdx
+    pop rsi
+    pop rdi
+    pop r11
+    pop rcx
+    pop rsp
+    o64 sysret
+
+; uint64_t user_enter(uint64_t entry, uint64_t user_rsp, kernel_context *ctx)
+; Saves the kernel's callee-saved state in ctx and drops to ring 3. It
+; "returns" when user_return(ctx, status) is called, with rax = status.
+user_enter:
+    mov [rdx + 0], rbx
+    mov [rdx + 8], rbp
+    mov [rdx + 16], r12
+    mov [rdx + 24], r13
+    mov [rdx + 32], r14
+    mov [rdx + 40], r15
+    mov [rdx + 48], rsp          ; Points at our return address
+
+    cli                          ; No interrupts while rsp is the user's
+    mov rcx, rdi                 ; SYSRET target
+    mov r11, 0x202               ; RFLAGS: IF set
+    mov rsp, rsi
+
+    ; Don't leak kernel values into ring 3
+    xor eax, eax
+    xor ebx, ebx
+    xor edx, edx
+    xor esi, esi
+    xor edi, edi
+    xor ebp, ebp
+    xor r8d, r8d
+    xor r9d, r9d
+    xor r10d, r10d
+    xor r12d, r12d
+    xor r13d, r13d
+    xor r14d, r14d
+    xor r15d, r15d
+    o64 sysret
+
+; void user_return(kernel_context *ctx, uint64_t status)
+user_return:
+    mov rbx, [rdi + 0]
+    mov rbp, [rdi + 8]
+    mov r12, [rdi + 16]
+    mov r13, [rdi + 24]
+    mov r14, [rdi + 32]
+    mov r15, [rdi + 40]
+    mov rsp, [rdi + 48]
+    mov rax, rsi
+    ret
+
+section .bss
+syscall_user_rsp:
+    resq 1
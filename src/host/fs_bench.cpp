@@ -0,0 +1,98 @@
+// Host benchmark of the file system at 10^3 to 10^6 entries. Prints one
+// line per measurement in the format of the kernel's `bench -m`.
+#include "host/mock_ata.h"
+#include "kernel/fs.h"
+#include "kernel/synth.h"
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_DIRS 1000
+#define LOOKUPS 1000
+
+static uint64_t now_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void report(const char *name, int files, uint64_t ns, int ops) {
+  printf("fsbench name=%s files=%d ns_per_op=%llu\n", name, files,
+         (unsigned long long)(ns / ops));
+}
+
+// A fresh disk with `files` files spread over BENCH_DIRS directories
+static void populate(int files) {
+  mock_ata_reset(MAX_FILES / 2 + MAX_DIRS / 16 + 128);
+  fs_init();
+  char path[FS_PATH_MAX], name[FS_PATH_MAX];
+  for (int d = 0; d < BENCH_DIRS && fs_dir_count() < MAX_DIRS; d++) {
+    snprintf(path, sizeof(path), "/home/d%d", d);
+    fs_mkdir(path);
+  }
+  for (int i = 0; i < files; i++) {
+    snprintf(path, sizeof(path), "/home/d%d", i % BENCH_DIRS);
+    snprintf(name, sizeof(name), "file%d", i);
+    fs_create(name, path);
+  }
+}
+
+static void bench_fs(int files) {
+  populate(files);
+
+  uint64_t t = now_ns();
+  fs_save();
+  report("fs_save", files, now_ns() - t, 1);
+
+  t = now_ns();
+  fs_init();
+  report("fs_load", files, now_ns() - t, 1);
+
+  char name[FS_PATH_MAX];
+  volatile int sink = 0;
+  t = now_ns();
+  for (int i = 0; i < LOOKUPS; i++) {
+    int n = (int)((uint64_t)i * files / LOOKUPS);
+    snprintf(name, sizeof(name), "file%d", n);
+    char dir[FS_PATH_MAX];
+    snprintf(dir, sizeof(dir), "/home/d%d", n % BENCH_DIRS);
+    sink = sink + find_file(name, dir);
+  }
+  report("find_file_hit", files, now_ns() - t, LOOKUPS);
+
+  t = now_ns();
+  for (int i = 0; i < LOOKUPS; i++)
+    sink = sink + find_file("missing", "/home");
+  report("find_file_miss", files, now_ns() - t, LOOKUPS);
+
+  // Every directory holds 1/BENCH_DIRS of the files
+  t = now_ns();
+  fs_remove_tree("/home/d0");
+  report("rm_dir", files, now_ns() - t, 1);
+
+  t = now_ns();
+  fs_remove_tree("/home");
+  report("rm_tree", files, now_ns() - t, 1);
+  (void)sink;
+}
+
+static void bench_synth() {
+  static const Note song[] = {{415, 4}, {466, 4}, {494, 4}, {0, 2},
+                              {740, 8}, {0, 0}};
+  static int16_t out[1 << 20];
+  const int reps = 20;
+  uint64_t t = now_ns();
+  uint32_t n = 0;
+  for (int i = 0; i < reps; i++)
+    n = synth_render_song(song, 50000, 10000, WAVE_SINE, 12000, 44100, out,
+                          sizeof(out) / sizeof(out[0]));
+  uint64_t ns = now_ns() - t;
+  printf("fsbench name=synth_render frames=%u ns_per_frame=%.2f\n", n,
+         (double)ns / reps / n);
+}
+
+int main() {
+  for (int files = 1000; files <= MAX_FILES; files *= 10)
+    bench_fs(files);
+  bench_synth();
+  return 0;
+}
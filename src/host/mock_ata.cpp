@@ -0,0 +1,75 @@
+#include "host/mock_ata.h"
+#include "kernel/ata.h"
+#include "kernel/block.h"
+#include "kernel/fs.h"
+#include <stdlib.h>
+#include <string.h>
+
+mock_ata_stats mock_ata;
+mock_ata_run mock_ata_log[MOCK_ATA_LOG];
+static uint8_t *disk = nullptr;
+static uint32_t disk_sectors = 0;
+static bool failing = false;
+
+static blk_request *on_drive; // Run waiting for mock_ata_interrupt()
+
+bool ata_read_sector(uint32_t lba, uint16_t *buffer) {
+  if (failing || lba >= disk_sectors)
+    return false;
+  memcpy(buffer, mock_ata_sector(lba), FS_SECTOR_SIZE);
+  mock_ata.reads++;
+  return true;
+}
+
+bool ata_write_sector(uint32_t lba, uint16_t *buffer) {
+  if (failing || lba >= disk_sectors)
+    return false;
+  memcpy(mock_ata_sector(lba), buffer, FS_SECTOR_SIZE);
+  mock_ata.writes++;
+  return true;
+}
+
+uint32_t ata_sector_count() { return failing ? 0 : disk_sectors; }
+
+static bool mock_transfer(blk_request *r) {
+  return r->write ? ata_write_sector(r->lba, r->buffer)
+                  : ata_read_sector(r->lba, r->buffer);
+}
+
+static bool mock_start(blk_request *r) {
+  if (mock_ata.runs < MOCK_ATA_LOG)
+    mock_ata_log[mock_ata.runs] = {r->lba, r->count, r->write};
+  mock_ata.runs++;
+  on_drive = r;
+  return true;
+}
+
+static const blk_driver mock_blk = {mock_start, mock_transfer};
+
+void mock_ata_interrupt() {
+  blk_request *run = on_drive;
+  if (!run)
+    return;
+  on_drive = nullptr;
+  // Like the drive, stop at the first sector that fails
+  uint32_t done = 0;
+  for (blk_request *r = run; r && mock_transfer(r); r = r->next)
+    done++;
+  blk_complete(done);
+}
+
+void mock_ata_reset(uint32_t sectors) {
+  free(disk);
+  // calloc leaves untouched sectors as shared zero pages
+  disk = (uint8_t *)calloc(sectors, FS_SECTOR_SIZE);
+  disk_sectors = disk ? sectors : 0;
+  mock_ata = {};
+  failing = false;
+  blk_register(&mock_blk);
+}
+
+void mock_ata_fail(bool fail) { failing = fail; }
+
+uint8_t *mock_ata_sector(uint32_t lba) {
+  return disk + (uint64_t)lba * FS_SECTOR_SIZE;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+
+// In-memory disk that stands in for the ATA driver in host builds. It
+// registers with the real block queue as its driver. A run handed to it
+// waits on the "drive" until mock_ata_interrupt(), which the host idle
+// stub calls, so code that sleeps on the queue still completes.
+
+struct mock_ata_stats {
+  uint64_t reads;
+  uint64_t writes;
+  uint64_t runs; // Commands the block queue issued
+};
+
+extern mock_ata_stats mock_ata;
+
+// A command as the block queue issued it
+struct mock_ata_run {
+  uint32_t lba;
+  uint32_t count;
+  bool write;
+};
+
+// The first MOCK_ATA_LOG runs since the last reset, in issue order
+#define MOCK_ATA_LOG 64
+extern mock_ata_run mock_ata_log[MOCK_ATA_LOG];
+
+// Replaces the disk with `sectors` zeroed sectors, clears the stats and
+// the log, and registers the mock with the block queue
+void mock_ata_reset(uint32_t sectors);
+// Makes every following read or write fail, as with no drive
+void mock_ata_fail(bool fail);
+uint8_t *mock_ata_sector(uint32_t lba);
+
+// Transfers the run on the drive, if any, and reports it to the queue,
+// which may start the next one
+void mock_ata_interrupt();
@@ -0,0 +1,33 @@
+#include "host/mock_ata.h"
+#include "kernel/idle.h"
+#include "kernel/lock.h"
+#include "kernel/term.h"
+#include "kernel/trace.h"
+#include <sched.h>
+
+// Kernel services the hosted units reference but the host doesn't need
+
+void trace_emit(tracepoint *, uint8_t, uint32_t, uint64_t) {}
+
+void term_putc(char, uint8_t) {}
+void term_puts(const char *, uint8_t) {}
+void term_put_uint(uint64_t, uint8_t) {}
+void term_put_column(uint64_t, int) {}
+
+// Tests advance the clock by hand
+volatile uint64_t pit_ticks;
+
+// The mock disk is the only interrupt source, so an idle CPU lets it
+// finish its run. Other waits are short; give the CPU to whichever thread
+// will signal.
+void event_signal(event *) {}
+void idle_wait(const event *, uint32_t) {
+  mock_ata_interrupt();
+  sched_yield();
+}
+
+// linker.ld bounds the lock table in the kernel; here it is empty
+extern "C" {
+lock_stats lock_table_start[1];
+extern lock_stats lock_table_end[] [[gnu::alias("lock_table_start")]];
+}
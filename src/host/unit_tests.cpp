@@ -0,0 +1,431 @@
+// Host unit tests for the hosted kernel units; run by build_host.sh
+#include "host/mock_ata.h"
+#include "kernel/block.h"
+#include "kernel/co.h"
+#include "kernel/fs.h"
+#include "kernel/kstring.h"
+#include "kernel/lock.h"
+#include "kernel/pit.h"
+#include "kernel/synth.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                          \
+  do {                                                                       \
+    if (!(cond)) {                                                           \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);       \
+      failures++;                                                            \
+    }                                                                        \
+  } while (0)
+
+#define DISK_SECTORS 4096
+
+static void test_kstring() {
+  CHECK(kstrlen("") == 0);
+  CHECK(kstrlen("taco") == 4);
+  CHECK(kstrcmp("taco", "taco") == 0);
+  CHECK(kstrcmp("tacos", "taco") > 0);
+  CHECK(kstrcmp("a", "b") < 0);
+  CHECK(kstrncmp("/home/x", "/home", 5) == 0);
+  CHECK(kstrncmp("/hom", "/home", 5) == 0); // Shorter s1 matches
+  CHECK(kstrncmp("/homz", "/home", 5) != 0);
+
+  char buf[16];
+  kstrcpy(buf, "ab");
+  kstrcat(buf, "cd");
+  CHECK(strcmp(buf, "abcd") == 0);
+
+  uint8_t src[100], dst[100];
+  for (int i = 0; i < 100; i++)
+    src[i] = i;
+  kmemset(dst, 0xAA, sizeof(dst));
+  kmemcpy(dst + 1, src, 98);
+  CHECK(dst[0] == 0xAA && dst[99] == 0xAA);
+  CHECK(memcmp(dst + 1, src, 98) == 0);
+}
+
+// Copy of file `idx`, zeroed if there is none
+static MockFile file_at(int idx) {
+  MockFile f = {};
+  fs_get_file(idx, &f);
+  return f;
+}
+
+static bool in_dir(const char *path) {
+  char dir[FS_PATH_MAX];
+  fs_current_dir(dir);
+  return strcmp(dir, path) == 0;
+}
+
+static void test_fs_format() {
+  mock_ata_reset(DISK_SECTORS);
+  CHECK(fs_init());
+  CHECK(fs_dir_count() == 5);
+  CHECK(find_dir("/home") >= 0);
+  CHECK(fs_file_count() == 0);
+  CHECK(in_dir("/"));
+  CHECK(memcmp(mock_ata_sector(0), "TACOSFS", 8) == 0);
+
+  mock_ata_reset(DISK_SECTORS);
+  mock_ata_fail(true);
+  CHECK(!fs_init());
+}
+
+static void test_fs_round_trip() {
+  mock_ata_reset(DISK_SECTORS);
+  fs_init();
+  CHECK(fs_mkdir("/home/docs"));
+  int a = fs_create("a.txt", "/home");
+  int b = fs_create("b.txt", "/home/docs");
+  CHECK(a >= 0 && b >= 0);
+  MockFile f = file_at(b);
+  kstrcpy(f.content, "hello");
+  uint32_t lba = fs_alloc_data(8);
+  CHECK(lba >= 64);
+  f.data_lba = lba;
+  f.data_size = 4000;
+  CHECK(fs_set_file(b, &f));
+  CHECK(!fs_set_file(2, &f) && !fs_get_file(-1, &f));
+  mock_ata = {};
+  fs_save();
+  // Whole sectors built in memory: one batch each for the directories,
+  // the files and the header, with nothing read back
+  CHECK(mock_ata.reads == 0);
+  CHECK(mock_ata.writes == 3);
+  CHECK(mock_ata.runs == 3);
+
+  fs_init();
+  CHECK(fs_file_count() == 2);
+  CHECK(fs_dir_count() == 6);
+  int idx = find_file("b.txt", "/home/docs");
+  CHECK(idx >= 0);
+  CHECK(strcmp(file_at(idx).content, "hello") == 0);
+  CHECK(file_at(idx).data_lba == lba);
+  CHECK(find_file("b.txt", "/home") == -1);
+  // The allocator resumes after the saved extent
+  CHECK(fs_alloc_data(1) == lba + 8);
+  CHECK(fs_alloc_data(DISK_SECTORS) == 0);
+}
+
+static void test_fs_table_limits() {
+  mock_ata_reset(DISK_SECTORS);
+  fs_init();
+  char name[16];
+  for (int i = 0; i < MAX_FILES; i++) {
+    snprintf(name, sizeof(name), "f%d", i);
+    CHECK(fs_create(name, "/") == i);
+  }
+  CHECK(fs_create("extra", "/") == -1);
+  fs_remove(0);
+  CHECK(fs_file_count() == MAX_FILES - 1);
+  CHECK(strcmp(file_at(0).name, "f1") == 0);
+
+  while (fs_dir_count() < MAX_DIRS)
+    CHECK(fs_mkdir("/d"));
+  CHECK(!fs_mkdir("/d"));
+}
+
+static void test_fs_resolve() {
+  mock_ata_reset(DISK_SECTORS);
+  fs_init();
+  char path[FS_PATH_MAX];
+  CHECK(fs_resolve("home", path) && strcmp(path, "/home") == 0);
+  CHECK(fs_resolve("/tacos", path) && strcmp(path, "/tacos") == 0);
+  fs_set_current_dir("/home");
+  CHECK(fs_resolve("docs", path) && strcmp(path, "/home/docs") == 0);
+  CHECK(!fs_resolve("a_name_that_is_much_too_long_to_fit", path));
+
+  // A current directory of the longest length leaves no room for the '/'
+  char deep[FS_PATH_MAX];
+  memset(deep, 'd', FS_PATH_MAX - 1);
+  deep[0] = '/';
+  deep[FS_PATH_MAX - 1] = '\0';
+  CHECK(fs_mkdir(deep));
+  fs_set_current_dir(deep);
+  CHECK(!fs_resolve("x", path));
+  CHECK(fs_resolve("/x", path) && strcmp(path, "/x") == 0);
+  deep[FS_PATH_MAX - 2] = '\0';
+  fs_set_current_dir(deep);
+  CHECK(!fs_resolve("x", path));
+}
+
+static void test_fs_remove_tree() {
+  mock_ata_reset(DISK_SECTORS);
+  fs_init();
+  fs_mkdir("/home/a");
+  fs_mkdir("/home/a/b");
+  fs_mkdir("/homework");
+  fs_create("1", "/home");
+  fs_create("2", "/home/a");
+  fs_create("3", "/home/a/b");
+  fs_create("4", "/homework");
+  fs_create("5", "/");
+  fs_set_current_dir("/home/a/b");
+
+  CHECK(fs_remove_tree("/home/a"));
+  CHECK(find_dir("/home/a") == -1 && find_dir("/home/a/b") == -1);
+  CHECK(find_dir("/home") >= 0 && find_dir("/homework") >= 0);
+  CHECK(fs_file_count() == 3);
+  // Survivors keep their order
+  CHECK(strcmp(file_at(0).name, "1") == 0);
+  CHECK(strcmp(file_at(1).name, "4") == 0);
+  CHECK(strcmp(file_at(2).name, "5") == 0);
+  CHECK(in_dir("/"));
+  CHECK(!fs_remove_tree("/home/a"));
+}
+
+static void test_synth_render() {
+  static const Note song[] = {{440, 2}, {0, 1}, {880, 1}, {0, 0}};
+  static int16_t out[4096];
+  // 1 ms units at 8 kHz: 4 units of notes and rests, 1 ms gap after each
+  uint32_t n = synth_render_song(song, 1000, 1000, WAVE_SQUARE, 8000, 8000,
+                                 out, 4096);
+  CHECK(n == (2 + 1 + 1) * 8 + 3 * 8);
+  bool loud = false;
+  for (uint32_t i = 0; i < n; i++) {
+    CHECK(out[i] <= 8000 && out[i] >= -8000);
+    loud |= out[i] != 0;
+  }
+  CHECK(loud);
+  // The rest is silent
+  for (uint32_t i = 24; i < 32; i++)
+    CHECK(out[i] == 0);
+  // Output is cut at the buffer size
+  CHECK(synth_render_song(song, 1000, 1000, WAVE_SQUARE, 8000, 8000, out,
+                          10) == 10);
+}
+
+// The irqsave variants execute cli, which user mode may not, so these
+// exercise the plain paths from several threads
+#define LOCK_THREADS 4
+#define LOCK_ROUNDS 2000
+
+static spinlock test_spin = SPINLOCK_INIT;
+static uint64_t spin_total;
+
+static void *spin_worker(void *) {
+  for (int i = 0; i < LOCK_ROUNDS; i++) {
+    spin_lock(&test_spin);
+    spin_total++;
+    spin_unlock(&test_spin);
+  }
+  return nullptr;
+}
+
+static rwlock test_rw = RWLOCK_INIT;
+static uint64_t rw_a, rw_b; // Equal whenever the lock is free
+static bool rw_torn;
+
+static void *rw_worker(void *arg) {
+  bool writer = arg != nullptr;
+  for (int i = 0; i < LOCK_ROUNDS; i++) {
+    if (writer) {
+      write_lock(&test_rw);
+      rw_a++;
+      rw_b++;
+      write_unlock(&test_rw);
+    } else {
+      read_lock(&test_rw);
+      if (__atomic_load_n(&rw_a, __ATOMIC_RELAXED) !=
+          __atomic_load_n(&rw_b, __ATOMIC_RELAXED))
+        rw_torn = true;
+      read_unlock(&test_rw);
+    }
+  }
+  return nullptr;
+}
+
+static void test_locks() {
+  pthread_t threads[LOCK_THREADS];
+  for (int i = 0; i < LOCK_THREADS; i++)
+    pthread_create(&threads[i], nullptr, spin_worker, nullptr);
+  for (int i = 0; i < LOCK_THREADS; i++)
+    pthread_join(threads[i], nullptr);
+  CHECK(spin_total == (uint64_t)LOCK_THREADS * LOCK_ROUNDS);
+  CHECK(test_spin.next == test_spin.owner);
+
+  // Half writers, half readers
+  for (int i = 0; i < LOCK_THREADS; i++)
+    pthread_create(&threads[i], nullptr, rw_worker,
+                   i % 2 ? (void *)1 : nullptr);
+  for (int i = 0; i < LOCK_THREADS; i++)
+    pthread_join(threads[i], nullptr);
+  CHECK(!rw_torn);
+  CHECK(rw_a == (uint64_t)LOCK_THREADS / 2 * LOCK_ROUNDS);
+  CHECK(test_rw.state == 0);
+
+  // A read that overlaps a write is retried
+  seqlock seq = SEQLOCK_INIT;
+  uint32_t start = read_seqbegin(&seq);
+  CHECK(!read_seqretry(&seq, start));
+  seq.seq += 2; // What a completed write leaves
+  CHECK(read_seqretry(&seq, start));
+
+  percpu_counter counter = {};
+  percpu_add(&counter, 3);
+  percpu_add(&counter, 4);
+  CHECK(percpu_sum(&counter) == 7);
+}
+
+// A thread stands in for the interrupt handler that completes I/O
+static void *late_arrive(void *arg) {
+  usleep(10000);
+  ((co_latch *)arg)->arrive();
+  return nullptr;
+}
+
+// Lets the tests use task<int>; -1 marks a child that never ran
+template <> struct co_error<int> {
+  static constexpr int value = -1;
+};
+
+static task<int> co_child(int v) { co_return v * 2; }
+
+static task<int> co_relay(int v) {
+  int r = co_await co_child(v);
+  co_return r;
+}
+
+static task<int> co_parent(co_latch *late) {
+  int a = co_await co_child(1);
+  int b = co_await co_child(2);
+  co_latch ready(2);
+  ready.arrive();
+  ready.arrive();
+  co_await ready; // Done before the await
+  co_await *late; // Suspends until the thread arrives
+  co_return a + b;
+}
+
+static void test_coroutines() {
+  co_latch late(1);
+  pthread_t thread;
+  pthread_create(&thread, nullptr, late_arrive, &late);
+  CHECK(co_run(co_parent(&late)) == 6);
+  pthread_join(thread, nullptr);
+
+  // Every frame went back to the pool
+  task<int> tasks[CO_FRAMES];
+  for (int i = 0; i < CO_FRAMES - 1; i++)
+    tasks[i] = co_child(i);
+  CHECK(tasks[CO_FRAMES - 2].handle());
+  // The last frame goes to the relay; its child can't run and reports so
+  CHECK(co_run(co_relay(1)) == -1);
+  tasks[CO_FRAMES - 1] = co_child(1);
+  CHECK(tasks[CO_FRAMES - 1].handle());
+  // An empty pool gives a task that completes with the error value
+  CHECK(!co_child(1).handle());
+  CHECK(co_run(co_child(1)) == -1);
+}
+
+static bool ran(int i, uint32_t lba, uint32_t count, bool write) {
+  const mock_ata_run &r = mock_ata_log[i];
+  return r.lba == lba && r.count == count && r.write == write;
+}
+
+static void test_block_queue() {
+  mock_ata_reset(DISK_SECTORS);
+  for (uint32_t lba = 0; lba < 64; lba++)
+    memset(mock_ata_sector(lba), lba, BLK_SECTOR_SIZE);
+  static uint16_t buf[8][BLK_SECTOR_SIZE / 2];
+  // Leaves the head just past sector 0
+  CHECK(blk_transfer(0, 1, buf[0], false));
+  CHECK(mock_ata.runs == 1 && ((uint8_t *)buf[0])[0] == 0);
+  mock_ata = {};
+
+  // Adjacent requests in one direction merge at either end; runs go out
+  // upward from the head
+  blk_request r[8];
+  co_latch done(6);
+  const uint32_t lbas[] = {50, 10, 11, 9, 30, 12};
+  blk_plug();
+  for (int i = 0; i < 6; i++) {
+    r[i] = BLK_REQUEST_INIT(lbas[i], buf[i], i == 5, &done);
+    blk_submit(&r[i]);
+  }
+  CHECK(mock_ata.runs == 0);
+  blk_unplug();
+  CHECK(mock_ata.runs == 1 && ran(0, 9, 3, false));
+  mock_ata_interrupt();
+  CHECK(done.count == 3);
+  CHECK(r[1].ok && r[2].ok && r[3].ok);
+  CHECK(((uint8_t *)buf[3])[0] == 9 && ((uint8_t *)buf[2])[511] == 11);
+  CHECK(mock_ata.runs == 2 && ran(1, 12, 1, true));
+  mock_ata_interrupt();
+  CHECK(memcmp(mock_ata_sector(12), buf[5], BLK_SECTOR_SIZE) == 0);
+  mock_ata_interrupt();
+  mock_ata_interrupt();
+  CHECK(mock_ata.runs == 4 && ran(2, 30, 1, false) && ran(3, 50, 1, false));
+  CHECK(done.count == 0 && r[0].ok && r[4].ok);
+  mock_ata_interrupt(); // Idle: nothing on the drive
+
+  // Past the highest request the elevator wraps to the lowest
+  co_latch wrap(3);
+  r[0] = BLK_REQUEST_INIT(100, buf[0], false, &wrap);
+  r[1] = BLK_REQUEST_INIT(40, buf[1], false, &wrap);
+  r[2] = BLK_REQUEST_INIT(200, buf[2], false, &wrap);
+  for (int i = 0; i < 3; i++)
+    blk_submit(&r[i]);
+  CHECK(mock_ata.runs == 5 && ran(4, 100, 1, false));
+  for (int i = 0; i < 3; i++)
+    mock_ata_interrupt();
+  CHECK(ran(5, 200, 1, false) && ran(6, 40, 1, false));
+  CHECK(wrap.count == 0);
+
+  // A run that has waited out its deadline goes before one nearer the
+  // head; without the wait, the elevator order holds
+  for (int late = 0; late < 2; late++) {
+    uint64_t first = mock_ata.runs;
+    co_latch order(3);
+    r[0] = BLK_REQUEST_INIT(20, buf[0], false, &order);
+    r[1] = BLK_REQUEST_INIT(5, buf[1], false, &order);
+    r[2] = BLK_REQUEST_INIT(60, buf[2], false, &order);
+    blk_submit(&r[0]);
+    blk_submit(&r[1]);
+    if (late)
+      pit_ticks = pit_ticks + BLK_DEADLINE_MS * PIT_TICK_HZ / 1000 + 1;
+    blk_submit(&r[2]);
+    for (int i = 0; i < 3; i++)
+      mock_ata_interrupt();
+    CHECK(order.count == 0);
+    CHECK(ran(first + 1, late ? 5 : 60, 1, false));
+    CHECK(ran(first + 2, late ? 60 : 5, 1, false));
+  }
+
+  // A run that crosses the end of the disk fails from there on
+  co_latch end(3);
+  blk_plug();
+  for (uint32_t i = 0; i < 3; i++) {
+    r[i] = BLK_REQUEST_INIT(DISK_SECTORS - 2 + i, buf[i], false, &end);
+    blk_submit(&r[i]);
+  }
+  blk_unplug();
+  mock_ata_interrupt();
+  CHECK(end.count == 0 && r[0].ok && r[1].ok && !r[2].ok);
+  CHECK(!blk_transfer(DISK_SECTORS - 2, 3, buf, false));
+  CHECK(blk_transfer(8, 8, buf, false));
+  CHECK(((uint8_t *)buf[7])[0] == 15);
+}
+
+int main() {
+  test_kstring();
+  test_coroutines();
+  test_block_queue();
+  test_fs_format();
+  test_fs_round_trip();
+  test_fs_table_limits();
+  test_fs_resolve();
+  test_fs_remove_tree();
+  test_synth_render();
+  test_locks();
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All host unit tests passed\n");
+  return 0;
+}
@@ -0,0 +1,562 @@
+#include "acpi.h"
+#include "cmd.h"
+#include "cpu.h"
+#include "io.h"
+#include "kstring.h"
+#include "multiboot.h"
+#include "paging.h"
+#include "term.h"
+#include "timer.h"
+
+struct acpi_rsdp {
+  char signature[8]; // "RSD PTR "
+  uint8_t checksum;  // Over the first 20 bytes
+  char oem_id[6];
+  uint8_t revision;
+  uint32_t rsdt;
+  // Revision 2 and later
+  uint32_t length;
+  uint64_t xsdt;
+  uint8_t ext_checksum; // Over `length` bytes
+  uint8_t reserved[3];
+} __attribute__((packed));
+
+struct acpi_header {
+  char signature[4];
+  uint32_t length; // Including this header
+  uint8_t revision;
+  uint8_t checksum;
+  char oem_id[6];
+  char oem_table_id[8];
+  uint32_t oem_revision;
+  uint32_t creator_id;
+  uint32_t creator_revision;
+} __attribute__((packed));
+
+// Generic address structure
+struct acpi_gas {
+  uint8_t space; // 0 memory, 1 I/O port
+  uint8_t bit_width;
+  uint8_t bit_offset;
+  uint8_t access_size;
+  uint64_t addr;
+} __attribute__((packed));
+
+#define GAS_SPACE_IO 1
+
+// The FADT fields used here, at their fixed offsets. Older tables are
+// shorter; what they lack stays zero.
+struct acpi_fadt {
+  acpi_header h;
+  uint32_t firmware_ctrl;
+  uint32_t dsdt; // 0x28
+  uint8_t reserved0;
+  uint8_t pm_profile;
+  uint16_t sci_int; // 0x2E
+  uint32_t smi_cmd;
+  uint8_t acpi_enable; // 0x34
+  uint8_t acpi_disable;
+  uint8_t s4bios_req;
+  uint8_t pstate_cnt;
+  uint32_t pm1a_evt_blk;
+  uint32_t pm1b_evt_blk;
+  uint32_t pm1a_cnt_blk; // 0x40
+  uint32_t pm1b_cnt_blk;
+  uint32_t pm2_cnt_blk;
+  uint32_t pm_tmr_blk; // 0x4C
+  uint8_t unused0[0x6D - 0x50];
+  uint16_t iapc_boot_arch; // 0x6D
+  uint8_t reserved1;
+  uint32_t flags; // 0x70
+  uint8_t unused1[0x8C - 0x74];
+  uint64_t x_dsdt; // 0x8C
+  uint8_t unused2[0xAC - 0x94];
+  acpi_gas x_pm1a_cnt_blk; // 0xAC
+  acpi_gas x_pm1b_cnt_blk;
+} __attribute__((packed));
+
+static_assert(sizeof(acpi_fadt) == 0xC4, "FADT layout");
+
+// PM1 control register bits
+#define PM1_SCI_EN (1 << 0)
+#define PM1_SLP_TYP_SHIFT 10
+#define PM1_SLP_EN (1 << 13)
+
+// How long the firmware gets to switch to ACPI mode, and the machine to
+// turn off once asked
+#define ACPI_ENABLE_TIMEOUT_US 300000
+#define ACPI_POWEROFF_TIMEOUT_US 1000000
+// Largest table length believed. Real DSDTs stay well under this; a
+// corrupt header must not get gigabytes mapped and summed.
+#define ACPI_MAX_TABLE_LENGTH (4u << 20)
+
+static acpi_info info;
+
+const acpi_info *acpi_get_info() { return &info; }
+
+static bool checksum_ok(const void *p, uint64_t len) {
+  uint8_t sum = 0;
+  for (uint64_t i = 0; i < len; i++)
+    sum = (uint8_t)(sum + ((const uint8_t *)p)[i]);
+  return sum == 0;
+}
+
+// Maps the table at `phys` and returns it if its checksum is good. Only
+// the header is mapped until its length has been checked.
+static const acpi_header *map_table(uint64_t phys) {
+  const acpi_header *h = (const acpi_header *)paging_map_mmio(
+      phys, sizeof(acpi_header), MEM_WB);
+  if (!h)
+    return nullptr;
+  uint32_t length = h->length;
+  if (length < sizeof(acpi_header) || length > ACPI_MAX_TABLE_LENGTH)
+    return nullptr;
+  if (!paging_map_mmio(phys, length, MEM_WB))
+    return nullptr;
+  return checksum_ok(h, length) ? h : nullptr;
+}
+
+static const acpi_rsdp *find_rsdp() {
+  // The tag holds a copy of the RSDP; ACPI 2.0+ firmware gets the new tag
+  const mb2_tag *tag = mb2_find_tag(MB2_TAG_ACPI_NEW);
+  if (!tag)
+    tag = mb2_find_tag(MB2_TAG_ACPI_OLD);
+  if (!tag || tag->size < sizeof(mb2_tag) + 20)
+    return nullptr;
+  const acpi_rsdp *rsdp = (const acpi_rsdp *)(tag + 1);
+  if (kstrncmp("RSD PTR ", rsdp->signature, 8) != 0 ||
+      !checksum_ok(rsdp, 20))
+    return nullptr;
+  if (rsdp->revision >= 2 &&
+      (tag->size < sizeof(mb2_tag) + sizeof(acpi_rsdp) ||
+       rsdp->length > tag->size - sizeof(mb2_tag) ||
+       !checksum_ok(rsdp, rsdp->length)))
+    return nullptr;
+  return rsdp;
+}
+
+// --- MADT ---
+
+#define MADT_LAPIC 0
+#define MADT_IOAPIC 1
+#define MADT_OVERRIDE 2
+#define MADT_LAPIC_ADDR 5
+#define MADT_X2APIC 9
+
+#define MADT_PCAT_COMPAT (1 << 0)
+#define MADT_CPU_ENABLED (1 << 0)
+#define MADT_CPU_ONLINE_CAPABLE (1 << 1)
+
+static uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  kmemcpy(&v, p, 4);
+  return v;
+}
+
+static uint64_t read64(const uint8_t *p) {
+  uint64_t v;
+  kmemcpy(&v, p, 8);
+  return v;
+}
+
+static void add_cpu(uint32_t apic_id, uint32_t uid, uint32_t flags) {
+  // Neither enabled nor online capable: the entry is a placeholder
+  if (!(flags & (MADT_CPU_ENABLED | MADT_CPU_ONLINE_CAPABLE)))
+    return;
+  if (info.cpu_count >= ACPI_MAX_CPUS)
+    return;
+  acpi_cpu *c = &info.cpus[info.cpu_count++];
+  c->apic_id = apic_id;
+  c->uid = uid;
+  c->enabled = flags & MADT_CPU_ENABLED;
+}
+
+static void parse_madt(const acpi_header *h) {
+  const uint8_t *p = (const uint8_t *)(h + 1);
+  const uint8_t *end = (const uint8_t *)h + h->length;
+  if (p + 8 > end)
+    return;
+  info.lapic_addr = read32(p);
+  info.legacy_pics = read32(p + 4) & MADT_PCAT_COMPAT;
+
+  for (p += 8; p + 2 <= end && p[1] >= 2 && p + p[1] <= end; p += p[1]) {
+    uint8_t len = p[1];
+    if (p[0] == MADT_LAPIC && len >= 8) {
+      add_cpu(p[3], p[2], read32(p + 4));
+    } else if (p[0] == MADT_X2APIC && len >= 16) {
+      add_cpu(read32(p + 4), read32(p + 12), read32(p + 8));
+    } else if (p[0] == MADT_IOAPIC && len >= 12) {
+      if (info.ioapic_count >= ACPI_MAX_IOAPICS)
+        continue;
+      acpi_ioapic *io = &info.ioapics[info.ioapic_count++];
+      io->id = p[2];
+      io->addr = read32(p + 4);
+      io->gsi_base = read32(p + 8);
+    } else if (p[0] == MADT_OVERRIDE && len >= 10) {
+      if (info.override_count >= ACPI_MAX_OVERRIDES)
+        continue;
+      acpi_override *o = &info.overrides[info.override_count++];
+      o->irq = p[3];
+      o->gsi = read32(p + 4);
+      o->flags = (uint16_t)(p[8] | (p[9] << 8));
+    } else if (p[0] == MADT_LAPIC_ADDR && len >= 12) {
+      info.lapic_addr = read64(p + 4);
+    }
+  }
+}
+
+// --- HPET ---
+
+#define HPET_GCAP_ID 0x00
+#define HPET_GCAP_64BIT (1u << 13)
+
+static void parse_hpet(const acpi_header *h) {
+  const uint8_t *p = (const uint8_t *)(h + 1);
+  // Event timer block ID, then the base address as a GAS
+  if (h->length < sizeof(acpi_header) + 4 + sizeof(acpi_gas))
+    return;
+  acpi_gas base;
+  kmemcpy(&base, p + 4, sizeof(base));
+  if (base.space != 0 || !base.addr)
+    return;
+  volatile uint64_t *regs =
+      (volatile uint64_t *)paging_map_mmio(base.addr, 1024, MEM_UC);
+  if (!regs)
+    return;
+  // The period is the authoritative part of the capabilities register;
+  // the table's copy of the rest is only a hint
+  uint64_t gcap = regs[HPET_GCAP_ID / 8];
+  uint32_t period = (uint32_t)(gcap >> 32);
+  if (!period || period > 100000000) // The spec caps it at 100ns
+    return;
+  info.hpet_addr = base.addr;
+  info.hpet_period_fs = period;
+  info.hpet_comparators = (uint8_t)(((gcap >> 8) & 0x1F) + 1);
+  info.hpet_64bit = gcap & HPET_GCAP_64BIT;
+}
+
+// --- MCFG ---
+
+static void parse_mcfg(const acpi_header *h) {
+  // Eight reserved bytes, then 16-byte allocation entries
+  const uint8_t *p = (const uint8_t *)(h + 1) + 8;
+  const uint8_t *end = (const uint8_t *)h + h->length;
+  for (; p + 16 <= end && info.ecam_count < ACPI_MAX_ECAM; p += 16) {
+    acpi_ecam *e = &info.ecam[info.ecam_count++];
+    e->base = read64(p);
+    e->segment = (uint16_t)(p[8] | (p[9] << 8));
+    e->bus_start = p[10];
+    e->bus_end = p[11];
+  }
+}
+
+// --- FADT and \_S5_ ---
+
+// 32-bit block if set, else the extended one when it is in I/O space
+static uint32_t pm_port(uint32_t blk, const acpi_gas &x) {
+  if (blk)
+    return blk;
+  return x.space == GAS_SPACE_IO ? (uint32_t)x.addr : 0;
+}
+
+static uint64_t parse_fadt(const acpi_header *h) {
+  acpi_fadt f;
+  kmemset(&f, 0, sizeof(f));
+  kmemcpy(&f, h, h->length < sizeof(f) ? h->length : sizeof(f));
+  info.fadt = true;
+  info.sci_irq = f.sci_int;
+  info.smi_cmd = f.smi_cmd;
+  info.acpi_enable = f.acpi_enable;
+  info.pm1a_cnt = pm_port(f.pm1a_cnt_blk, f.x_pm1a_cnt_blk);
+  info.pm1b_cnt = pm_port(f.pm1b_cnt_blk, f.x_pm1b_cnt_blk);
+  info.pm_timer = f.pm_tmr_blk;
+  info.boot_arch = f.iapc_boot_arch;
+  return f.x_dsdt ? f.x_dsdt : f.dsdt;
+}
+
+#define AML_ZERO 0x00
+#define AML_ONE 0x01
+#define AML_NAME 0x08
+#define AML_BYTE 0x0A
+#define AML_WORD 0x0B
+#define AML_DWORD 0x0C
+#define AML_PACKAGE 0x12
+
+// Reads a small integer package element at `*p` into `out`. Only the
+// forms firmware uses for sleep types are accepted.
+static bool aml_int(const uint8_t **p, const uint8_t *end, uint8_t *out) {
+  const uint8_t *q = *p;
+  if (q >= end)
+    return false;
+  switch (*q) {
+  case AML_ZERO:
+  case AML_ONE:
+    *out = *q;
+    *p = q + 1;
+    return true;
+  case AML_BYTE:
+  case AML_WORD:
+  case AML_DWORD: {
+    int size = *q == AML_BYTE ? 1 : *q == AML_WORD ? 2 : 4;
+    if (q + 1 + size > end)
+      return false;
+    *out = q[1]; // SLP_TYP is three bits; the low byte holds it
+    *p = q + 1 + size;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+// Looks through an AML definition block for
+//   Name (\_S5_, Package (n) { SLP_TYPa, SLP_TYPb, ... })
+// by its encoding rather than by interpreting the block
+static bool find_s5(const acpi_header *h) {
+  const uint8_t *aml = (const uint8_t *)(h + 1);
+  const uint8_t *end = (const uint8_t *)h + h->length;
+  for (const uint8_t *p = aml; p + 4 <= end; p++) {
+    if (kstrncmp("_S5_", (const char *)p, 4) != 0)
+      continue;
+    // NameOp, possibly followed by the root prefix
+    const uint8_t *op = p - 1;
+    if (op >= aml && *op == '\\')
+      op--;
+    if (op < aml || *op != AML_NAME)
+      continue;
+
+    const uint8_t *q = p + 4;
+    if (q >= end || *q != AML_PACKAGE)
+      continue;
+    q++;
+    // PkgLength: the top two bits of the lead byte count the bytes after it
+    if (q >= end)
+      continue;
+    q += 1 + ((*q >> 6) & 3);
+    q++; // NumElements
+    uint8_t a, b;
+    if (!aml_int(&q, end, &a) || !aml_int(&q, end, &b))
+      continue;
+    info.s5 = true;
+    info.slp_typa = a;
+    info.slp_typb = b;
+    return true;
+  }
+  return false;
+}
+
+// --- Discovery ---
+
+static void add_table(uint64_t phys) {
+  if (info.table_count >= ACPI_MAX_TABLES)
+    return;
+  const acpi_header *h = (const acpi_header *)paging_map_mmio(
+      phys, sizeof(acpi_header), MEM_WB);
+  if (!h)
+    return;
+  acpi_table_ref *t = &info.tables[info.table_count++];
+  kmemcpy(t->signature, h->signature, 4);
+  t->signature[4] = '\0';
+  t->phys = phys;
+  t->length = h->length;
+  t->valid = map_table(phys) != nullptr;
+}
+
+static bool is(const acpi_table_ref *t, const char *sig) {
+  return t->valid && kstrncmp(sig, t->signature, 4) == 0;
+}
+
+bool acpi_init() {
+  const acpi_rsdp *rsdp = find_rsdp();
+  if (!rsdp)
+    return false;
+  info.revision = rsdp->revision;
+  kmemcpy(info.oem_id, rsdp->oem_id, 6);
+  info.oem_id[6] = '\0';
+
+  // ACPI 1.0 firmware (SeaBIOS among it) only has the RSDT
+  bool xsdt = rsdp->revision >= 2 && rsdp->xsdt;
+  const acpi_header *root = map_table(xsdt ? rsdp->xsdt : rsdp->rsdt);
+  if (!root)
+    return false;
+  const uint8_t *entries = (const uint8_t *)(root + 1);
+  uint32_t entry_size = xsdt ? 8 : 4;
+  uint32_t count = (root->length - sizeof(acpi_header)) / entry_size;
+  for (uint32_t i = 0; i < count; i++) {
+    const uint8_t *e = entries + i * entry_size;
+    add_table(xsdt ? read64(e) : read32(e));
+  }
+
+  uint64_t dsdt = 0;
+  for (uint32_t i = 0; i < info.table_count; i++) {
+    const acpi_table_ref *t = &info.tables[i];
+    const acpi_header *h = (const acpi_header *)phys_to_virt(t->phys);
+    if (is(t, "APIC"))
+      parse_madt(h);
+    else if (is(t, "HPET"))
+      parse_hpet(h);
+    else if (is(t, "MCFG"))
+      parse_mcfg(h);
+    else if (is(t, "FACP"))
+      dsdt = parse_fadt(h);
+  }
+
+  // The DSDT isn't listed in the root table, only in the FADT
+  if (dsdt) {
+    const acpi_header *h = map_table(dsdt);
+    if (h && kstrncmp("DSDT", h->signature, 4) == 0)
+      find_s5(h);
+  }
+  for (uint32_t i = 0; i < info.table_count && !info.s5; i++)
+    if (is(&info.tables[i], "SSDT"))
+      find_s5((const acpi_header *)phys_to_virt(info.tables[i].phys));
+  return true;
+}
+
+// --- Power off ---
+
+// Hands power management from SMM firmware to the OS, which is what
+// makes PM1 control writes take effect
+static bool enter_acpi_mode() {
+  if (inw(info.pm1a_cnt) & PM1_SCI_EN)
+    return true;
+  if (!info.smi_cmd || !info.acpi_enable)
+    return false;
+  outb(info.smi_cmd, info.acpi_enable);
+  uint64_t deadline = deadline_us(ACPI_ENABLE_TIMEOUT_US);
+  while (!(inw(info.pm1a_cnt) & PM1_SCI_EN)) {
+    if (deadline_passed(deadline))
+      return false;
+  }
+  return true;
+}
+
+void acpi_poweroff() {
+  if (!info.fadt || !info.pm1a_cnt) {
+    term_puts("No ACPI power management ports.\n", COLOR_ERROR);
+    return;
+  }
+  if (!info.s5) {
+    term_puts("No \\_S5_ sleep state in the ACPI tables.\n", COLOR_ERROR);
+    return;
+  }
+  if (!enter_acpi_mode()) {
+    term_puts("Firmware did not switch to ACPI mode.\n", COLOR_ERROR);
+    return;
+  }
+
+  uint64_t flags = irq_save();
+  // SLP_TYP goes in with SLP_EN; the rest of the register is preserved
+  uint16_t a = inw(info.pm1a_cnt) & ~(7 << PM1_SLP_TYP_SHIFT);
+  outw(info.pm1a_cnt, a | (info.slp_typa << PM1_SLP_TYP_SHIFT) | PM1_SLP_EN);
+  if (info.pm1b_cnt) {
+    uint16_t b = inw(info.pm1b_cnt) & ~(7 << PM1_SLP_TYP_SHIFT);
+    outw(info.pm1b_cnt,
+         b | (info.slp_typb << PM1_SLP_TYP_SHIFT) | PM1_SLP_EN);
+  }
+  uint64_t deadline = deadline_us(ACPI_POWEROFF_TIMEOUT_US);
+  while (!deadline_passed(deadline))
+    asm volatile("pause");
+  irq_restore(flags);
+  term_puts("The machine did not power off.\n", COLOR_ERROR);
+}
+
+// --- Shell ---
+
+static void put_hex_field(const char *label, uint64_t v) {
+  term_puts(label);
+  term_put_hex(v);
+}
+
+static void cmd_acpi(char *) {
+  if (!info.table_count) {
+    term_puts("No ACPI tables found.\n", COLOR_ERROR);
+    return;
+  }
+  term_puts("RSDP revision ");
+  term_put_uint(info.revision);
+  term_puts(", OEM ");
+  term_puts(info.oem_id);
+  term_putc('\n');
+  for (uint32_t i = 0; i < info.table_count; i++) {
+    const acpi_table_ref *t = &info.tables[i];
+    term_puts("  ");
+    term_puts(t->signature);
+    put_hex_field(" at ", t->phys);
+    term_puts(", ");
+    term_put_uint(t->length);
+    term_puts(" bytes");
+    if (!t->valid)
+      term_puts(" (bad checksum)", COLOR_ERROR);
+    term_putc('\n');
+  }
+
+  term_puts("CPUs:      ");
+  term_put_uint(info.cpu_count);
+  term_puts(" (APIC IDs");
+  for (uint32_t i = 0; i < info.cpu_count; i++) {
+    term_putc(' ');
+    term_put_uint(info.cpus[i].apic_id);
+    if (!info.cpus[i].enabled)
+      term_putc('*');
+  }
+  put_hex_field("), local APIC at ", info.lapic_addr);
+  term_puts(info.legacy_pics ? ", 8259s present\n" : "\n");
+  for (uint32_t i = 0; i < info.ioapic_count; i++) {
+    term_puts("IOAPIC ");
+    term_put_uint(info.ioapics[i].id);
+    put_hex_field(":  at ", info.ioapics[i].addr);
+    term_puts(", GSI base ");
+    term_put_uint(info.ioapics[i].gsi_base);
+    term_putc('\n');
+  }
+  for (uint32_t i = 0; i < info.override_count; i++) {
+    term_puts("Override:  IRQ ");
+    term_put_uint(info.overrides[i].irq);
+    term_puts(" -> GSI ");
+    term_put_uint(info.overrides[i].gsi);
+    put_hex_field(", flags ", info.overrides[i].flags);
+    term_putc('\n');
+  }
+
+  if (info.hpet_addr) {
+    put_hex_field("HPET:      at ", info.hpet_addr);
+    term_puts(", ");
+    term_put_uint(info.hpet_comparators);
+    term_puts(" comparators, ");
+    term_put_uint(info.hpet_period_fs);
+    term_puts(info.hpet_64bit ? " fs period, 64-bit\n" : " fs period\n");
+  }
+  for (uint32_t i = 0; i < info.ecam_count; i++) {
+    put_hex_field("ECAM:      at ", info.ecam[i].base);
+    term_puts(", segment ");
+    term_put_uint(info.ecam[i].segment);
+    term_puts(", buses ");
+    term_put_uint(info.ecam[i].bus_start);
+    term_putc('-');
+    term_put_uint(info.ecam[i].bus_end);
+    term_putc('\n');
+  }
+
+  if (info.fadt) {
+    term_puts("FADT:      SCI IRQ ");
+    term_put_uint(info.sci_irq);
+    put_hex_field(", PM1a ", info.pm1a_cnt);
+    if (info.pm1b_cnt)
+      put_hex_field(", PM1b ", info.pm1b_cnt);
+    put_hex_field(", PM timer ", info.pm_timer);
+    term_putc('\n');
+  }
+  if (info.s5) {
+    term_puts("S5:        SLP_TYP ");
+    term_put_uint(info.slp_typa);
+    term_putc('/');
+    term_put_uint(info.slp_typb);
+    term_putc('\n');
+  } else {
+    term_puts("S5:        not found\n", COLOR_ERROR);
+  }
+}
+
+COMMAND(acpi, "acpi", "Show ACPI tables, CPUs, interrupts and timers", 0, 0,
+        cmd_acpi);
@@ -0,0 +1,105 @@
+#pragma once
+#include <stdint.h>
+
+// ACPI tables, found through the RSDP copy in the Multiboot2 ACPI tag.
+// acpi_init() walks the XSDT (or the RSDT on ACPI 1.0 firmware) once at
+// boot, checks every table's checksum and keeps what the kernel uses in
+// acpi_info, so nothing rescans firmware memory later:
+//   MADT  CPUs, IOAPICs and ISA interrupt overrides
+//   HPET  the event timer block
+//   MCFG  PCIe ECAM windows
+//   FADT  power management ports, and the DSDT, whose \_S5_ package gives
+//         the sleep type for soft-off
+// There is no AML interpreter; \_S5_ is found by matching its byte
+// pattern, which is how firmware encodes it in practice.
+
+#define ACPI_MAX_TABLES 32
+#define ACPI_MAX_CPUS 64
+#define ACPI_MAX_IOAPICS 8
+#define ACPI_MAX_OVERRIDES 16
+#define ACPI_MAX_ECAM 4
+
+struct acpi_table_ref {
+  char signature[5];
+  uint64_t phys;
+  uint32_t length;
+  bool valid; // Checksum matched; tables that fail it are not parsed
+};
+
+struct acpi_cpu {
+  uint32_t apic_id;
+  uint32_t uid; // ACPI processor UID
+  bool enabled; // False for a CPU that can be brought online later
+};
+
+struct acpi_ioapic {
+  uint8_t id;
+  uint32_t addr;
+  uint32_t gsi_base; // First global system interrupt it serves
+};
+
+// ISA IRQ `irq` arrives on `gsi` instead of the identity-mapped line
+struct acpi_override {
+  uint8_t irq;
+  uint32_t gsi;
+  uint16_t flags; // MPS INTI flags: polarity in bits 0-1, trigger in 2-3
+};
+
+struct acpi_ecam {
+  uint64_t base; // Configuration space of bus `bus_start`
+  uint16_t segment;
+  uint8_t bus_start;
+  uint8_t bus_end;
+};
+
+struct acpi_info {
+  uint8_t revision; // RSDP revision: 0 for ACPI 1.0, 2 with an XSDT
+  char oem_id[7];
+  acpi_table_ref tables[ACPI_MAX_TABLES];
+  uint32_t table_count;
+
+  // MADT
+  uint64_t lapic_addr;
+  bool legacy_pics; // 8259s present alongside the APICs
+  acpi_cpu cpus[ACPI_MAX_CPUS];
+  uint32_t cpu_count;
+  acpi_ioapic ioapics[ACPI_MAX_IOAPICS];
+  uint32_t ioapic_count;
+  acpi_override overrides[ACPI_MAX_OVERRIDES];
+  uint32_t override_count;
+
+  // HPET
+  uint64_t hpet_addr; // 0 without one
+  uint32_t hpet_period_fs; // Counter period, read from the block itself
+  uint8_t hpet_comparators;
+  bool hpet_64bit;
+
+  // MCFG
+  acpi_ecam ecam[ACPI_MAX_ECAM];
+  uint32_t ecam_count;
+
+  // FADT
+  bool fadt;
+  uint16_t sci_irq;
+  uint32_t smi_cmd; // 0 if the firmware is always in ACPI mode
+  uint8_t acpi_enable;
+  uint32_t pm1a_cnt;
+  uint32_t pm1b_cnt; // 0 without a second block
+  uint32_t pm_timer;
+  uint16_t boot_arch; // IA-PC boot architecture flags
+
+  // \_S5_ from the DSDT or an SSDT
+  bool s5;
+  uint8_t slp_typa;
+  uint8_t slp_typb;
+};
+
+// Finds and parses the tables. Needs paging_init() first, as tables
+// outside RAM are mapped on demand. Returns false if there is no RSDP.
+bool acpi_init();
+
+const acpi_info *acpi_get_info();
+
+// Enters S5 (soft-off) through PM1 control, switching the firmware to
+// ACPI mode first if needed. Only returns if that failed.
+void acpi_poweroff();
@@ -0,0 +1,286 @@
+#include "ata.h"
+#include "block.h"
+#include "cpu.h"
+#include "idle.h"
+#include "idt.h"
+#include "io.h"
+#include "lock.h"
+#include "softirq.h"
+#include "timer.h"
+#include "trace.h"
+
+#define ATA_PRIMARY_DATA 0x1F0
+#define ATA_PRIMARY_ERR 0x1F1
+#define ATA_PRIMARY_SECCOUNT 0x1F2
+#define ATA_PRIMARY_LBA_LO 0x1F3
+#define ATA_PRIMARY_LBA_MID 0x1F4
+#define ATA_PRIMARY_LBA_HI 0x1F5
+#define ATA_PRIMARY_DRIVE_SEL 0x1F6
+#define ATA_PRIMARY_COMMAND 0x1F7
+#define ATA_PRIMARY_STATUS 0x1F7
+#define ATA_PRIMARY_CONTROL 0x3F6 // Device control; bit 1 masks INTRQ
+
+#define ATA_SR_BSY 0x80
+#define ATA_SR_DF 0x20
+#define ATA_SR_DRQ 0x08
+#define ATA_SR_ERR 0x01
+
+#define ATA_CMD_READ 0x20
+#define ATA_CMD_WRITE 0x30
+#define ATA_CMD_IDENTIFY 0xEC
+
+#define ATA_IRQ 14
+// Longest wait on BSY or DRQ before giving up on the drive
+#define ATA_TIMEOUT_US 100000
+// Longest wait for each interrupt of a run
+#define ATA_IRQ_TIMEOUT_MS 1000
+
+// Returns true if successful, false on timeout
+static bool ata_wait_bsy() {
+  uint64_t deadline = deadline_us(ATA_TIMEOUT_US);
+  while (inb(ATA_PRIMARY_STATUS) & ATA_SR_BSY) {
+    if (deadline_passed(deadline))
+      return false;
+  }
+  return true;
+}
+
+// Returns true if successful, false on timeout
+static bool ata_wait_drq() {
+  uint64_t deadline = deadline_us(ATA_TIMEOUT_US);
+  while (!(inb(ATA_PRIMARY_STATUS) & ATA_SR_DRQ)) {
+    if (deadline_passed(deadline))
+      return false;
+  }
+  return true;
+}
+
+// A count of 0 means 256 sectors
+static void issue(uint32_t lba, uint8_t count, uint8_t command) {
+  outb(ATA_PRIMARY_DRIVE_SEL, 0xE0 | ((lba >> 24) & 0x0F));
+  outb(ATA_PRIMARY_SECCOUNT, count);
+  outb(ATA_PRIMARY_LBA_LO, (uint8_t)lba);
+  outb(ATA_PRIMARY_LBA_MID, (uint8_t)(lba >> 8));
+  outb(ATA_PRIMARY_LBA_HI, (uint8_t)(lba >> 16));
+  outb(ATA_PRIMARY_COMMAND, command);
+}
+
+// --- Block queue driver ---
+
+static blk_request *run;   // Run on the drive
+static blk_request *cur;   // Its request being transferred
+static uint32_t run_done;  // Sectors of the run finished
+static bool irq_seen;      // An interrupt for `cur` arrived
+static uint8_t irq_status; // Status read by the top half
+
+// Guards the run state against the bottom half and the timeout
+DEFINE_SPINLOCK(ata_lock);
+
+static void ata_timeout(timer *t);
+static timer ata_timer = TIMER_INIT(ata_timeout);
+
+static void wait_idle() {
+  wait_until([] { return !__atomic_load_n(&run, __ATOMIC_ACQUIRE); });
+}
+
+// Waits out any run and takes the lock with the drive idle, so a run
+// dispatched from a bottom half can't start between the check and a
+// synchronous command. Returns the flags for spin_unlock_irqrestore().
+static uint64_t claim_drive() {
+  while (1) {
+    wait_idle();
+    uint64_t flags = spin_lock_irqsave(&ata_lock);
+    if (!run)
+      return flags;
+    spin_unlock_irqrestore(&ata_lock, flags);
+  }
+}
+
+TRACEPOINT(ata_read);
+TRACEPOINT(ata_write);
+
+static bool read_sector(uint32_t lba, uint16_t *buffer) {
+  issue(lba, 1, ATA_CMD_READ);
+
+  if (!ata_wait_bsy())
+    return false;
+  if (!ata_wait_drq())
+    return false;
+
+  for (int i = 0; i < 256; i++) {
+    buffer[i] = inw(ATA_PRIMARY_DATA);
+  }
+  return true;
+}
+
+bool ata_read_sector(uint32_t lba, uint16_t *buffer) {
+  TRACE_SCOPE(ata_read, lba, 0);
+  uint64_t flags = claim_drive();
+  bool ok = read_sector(lba, buffer);
+  spin_unlock_irqrestore(&ata_lock, flags);
+  return ok;
+}
+
+static bool write_sector(uint32_t lba, uint16_t *buffer) {
+  issue(lba, 1, ATA_CMD_WRITE);
+
+  if (!ata_wait_bsy())
+    return false;
+  if (!ata_wait_drq())
+    return false;
+
+  for (int i = 0; i < 256; i++) {
+    outw(ATA_PRIMARY_DATA, buffer[i]);
+  }
+  // Flush
+  if (!ata_wait_bsy())
+    return false;
+  return true;
+}
+
+bool ata_write_sector(uint32_t lba, uint16_t *buffer) {
+  TRACE_SCOPE(ata_write, lba, 0);
+  uint64_t flags = claim_drive();
+  bool ok = write_sector(lba, buffer);
+  spin_unlock_irqrestore(&ata_lock, flags);
+  return ok;
+}
+
+static uint32_t identify() {
+  uint16_t id[256];
+  outb(ATA_PRIMARY_DRIVE_SEL, 0xA0);
+  outb(ATA_PRIMARY_SECCOUNT, 0);
+  outb(ATA_PRIMARY_LBA_LO, 0);
+  outb(ATA_PRIMARY_LBA_MID, 0);
+  outb(ATA_PRIMARY_LBA_HI, 0);
+  outb(ATA_PRIMARY_COMMAND, ATA_CMD_IDENTIFY);
+  if (inb(ATA_PRIMARY_STATUS) == 0)
+    return 0; // No drive
+  if (!ata_wait_bsy())
+    return 0;
+  if (!ata_wait_drq())
+    return 0;
+  for (int i = 0; i < 256; i++)
+    id[i] = inw(ATA_PRIMARY_DATA);
+  return id[60] | ((uint32_t)id[61] << 16);
+}
+
+// Returns the drive's LBA28 sector count from IDENTIFY, or 0
+uint32_t ata_sector_count() {
+  uint64_t flags = claim_drive();
+  uint32_t sectors = identify();
+  spin_unlock_irqrestore(&ata_lock, flags);
+  return sectors;
+}
+
+static void read_data(uint16_t *buffer) {
+  for (int i = 0; i < 256; i++)
+    buffer[i] = inw(ATA_PRIMARY_DATA);
+}
+
+static void write_data(const uint16_t *buffer) {
+  for (int i = 0; i < 256; i++)
+    outw(ATA_PRIMARY_DATA, buffer[i]);
+}
+
+// Issues the run as one command. A write's first sector goes out here
+// and each interrupt asks for the next; a read interrupts as each
+// sector's data is ready.
+static bool ata_start(blk_request *r) {
+  spin_guard guard(&ata_lock);
+  if (!ata_wait_bsy())
+    return false;
+  irq_seen = false;
+  issue(r->lba, (uint8_t)r->count, r->write ? ATA_CMD_WRITE : ATA_CMD_READ);
+  if (r->write) {
+    if (!ata_wait_drq())
+      return false;
+    write_data(r->buffer);
+  }
+  run = cur = r;
+  run_done = 0;
+  timer_start(&ata_timer, ATA_IRQ_TIMEOUT_MS);
+  return true;
+}
+
+static bool ata_transfer(blk_request *r) {
+  return r->write ? ata_write_sector(r->lba, r->buffer)
+                  : ata_read_sector(r->lba, r->buffer);
+}
+
+static const blk_driver ata_blk = {ata_start, ata_transfer};
+
+// Ends the run and returns how many sectors made it. Called with the
+// lock held; the caller hands the count to blk_complete() once it is
+// dropped.
+static uint32_t end_run() {
+  timer_cancel(&ata_timer);
+  __atomic_store_n(&run, nullptr, __ATOMIC_RELEASE);
+  return run_done;
+}
+
+static void ata_finish(irq_work *) {
+  bool ended = false;
+  uint32_t sectors_ok = 0;
+  uint64_t flags = spin_lock_irqsave(&ata_lock);
+  if (run && irq_seen) {
+    irq_seen = false;
+    bool ok = !(irq_status & (ATA_SR_ERR | ATA_SR_DF));
+    if (ok && !run->write) {
+      ok = irq_status & ATA_SR_DRQ;
+      if (ok)
+        read_data(cur->buffer);
+    }
+    if (ok) {
+      run_done++;
+      cur = cur->next;
+    }
+    if (ok && cur && run->write) {
+      ok = ata_wait_drq();
+      if (ok)
+        write_data(cur->buffer);
+    }
+    if (!ok || !cur) {
+      ended = true;
+      sectors_ok = end_run();
+    } else {
+      timer_start(&ata_timer, ATA_IRQ_TIMEOUT_MS);
+    }
+  }
+  spin_unlock_irqrestore(&ata_lock, flags);
+  if (ended)
+    blk_complete(sectors_ok);
+}
+
+static irq_work ata_work = IRQ_WORK_INIT(ata_finish, ATA_IRQ);
+
+// Reading the status acknowledges the interrupt. Synchronous transfers
+// interrupt too, but have no run.
+static void ata_irq(interrupt_frame *) {
+  uint8_t status = inb(ATA_PRIMARY_STATUS);
+  if (!run || (status & ATA_SR_BSY))
+    return;
+  irq_status = status;
+  irq_seen = true;
+  irq_work_queue(&ata_work);
+}
+
+// The drive stopped answering; end the run with what it finished
+static void ata_timeout(timer *) {
+  bool ended = false;
+  uint32_t sectors_ok = 0;
+  uint64_t flags = spin_lock_irqsave(&ata_lock);
+  if (run && !irq_seen) {
+    ended = true;
+    sectors_ok = end_run();
+  }
+  spin_unlock_irqrestore(&ata_lock, flags);
+  if (ended)
+    blk_complete(sectors_ok);
+}
+
+void ata_init() {
+  outb(ATA_PRIMARY_CONTROL, 0); // Clear nIEN
+  irq_install(ATA_IRQ, ata_irq);
+  blk_register(&ata_blk);
+}
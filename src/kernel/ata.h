@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+
+// Primary ATA bus, master drive, 28-bit LBA PIO (ata.cpp)
+bool ata_read_sector(uint32_t lba, uint16_t *buffer);
+bool ata_write_sector(uint32_t lba, uint16_t *buffer);
+// LBA28 sector count from IDENTIFY, or 0 if there is no drive
+uint32_t ata_sector_count();
+
+// Registers the drive as the block queue's driver (block.h) and enables
+// its interrupt. Queued runs go out as one multi-sector command; the
+// drive interrupts once per sector, and the bottom half moves the data.
+// The synchronous calls above wait for the running command to finish.
+void ata_init();
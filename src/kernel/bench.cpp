@@ -0,0 +1,367 @@
+#include "ata.h"
+#include "cmd.h"
+#include "cpu.h"
+#include "fs.h"
+#include "idt.h"
+#include "kstring.h"
+#include "paging.h"
+#include "pipe.h"
+#include "pmm.h"
+#include "term.h"
+#include "timer.h"
+#include "tlb.h"
+
+// Microbenchmarks of kernel primitives. Each case is warmed up, then
+// calibrated to a batch of calls that takes at least BENCH_SAMPLE_CYCLES,
+// then sampled BENCH_SAMPLES times. Results are TSC cycles per call.
+
+#define BENCH_SAMPLES 100
+#define BENCH_WARMUP 5
+#define BENCH_SAMPLE_CYCLES 20000
+#define BENCH_MAX_BATCH 65536
+#define BENCH_MAX_RESULTS 24
+// First vector above the PIC range, for the interrupt round trip
+#define BENCH_VECTOR 0x30
+#define BENCH_DIR "/bench"
+// Direct map range walked by tlb_walk: one line in each of up to 16384
+// pages, far more than the TLB holds unless the range is on huge pages
+#define TLB_WALK_BASE 0x1000000ull
+#define TLB_WALK_SPAN 0x4000000ull
+// Pages in the scratch address space used by the switch and unmap cases
+#define SPACE_PAGES 16
+#define SPACE_UNMAP_BASE (USER_SPACE_START + 0x100000)
+// Timers left pending on the wheel while one more is started and
+// cancelled. Spaced 16 ms apart; they are cancelled after the case.
+#define BENCH_TIMERS 4096
+#define BENCH_TIMER_SPACING_MS 16
+
+struct bench_result {
+  const char *name;
+  uint32_t param; // File count for the fs cases, else 0
+  uint32_t batch;
+  uint64_t min, median, p99;
+};
+
+struct bench_case {
+  const char *name;
+  bool console; // Draws on the screen, which is cleared afterwards
+  bool slow;    // Milliseconds per call: no batching, fewer samples
+  void (*setup)();
+  void (*run)();
+  void (*teardown)() = nullptr; // Undoes what setup left behind
+};
+
+static bench_result results[BENCH_MAX_RESULTS];
+static int result_count;
+static uint64_t samples[BENCH_SAMPLES];
+
+// Times `batch` calls and returns the cycles per call
+static uint64_t time_batch(void (*run)(), uint32_t batch) {
+  uint64_t start = rdtsc();
+  for (uint32_t i = 0; i < batch; i++)
+    run();
+  return (rdtsc() - start) / batch;
+}
+
+static void sort(uint64_t *v, int n) {
+  for (int i = 1; i < n; i++) {
+    uint64_t x = v[i];
+    int j = i;
+    for (; j > 0 && v[j - 1] > x; j--)
+      v[j] = v[j - 1];
+    v[j] = x;
+  }
+}
+
+static void measure(const bench_case &c, uint32_t param) {
+  if (result_count == BENCH_MAX_RESULTS)
+    return;
+  if (c.setup)
+    c.setup();
+  int n = c.slow ? BENCH_SAMPLES / 4 : BENCH_SAMPLES;
+  uint32_t batch = 1;
+  for (int i = 0; i < BENCH_WARMUP; i++)
+    time_batch(c.run, 1);
+  while (!c.slow && batch < BENCH_MAX_BATCH &&
+         time_batch(c.run, batch) * batch < BENCH_SAMPLE_CYCLES)
+    batch *= 2;
+  for (int i = 0; i < n; i++)
+    samples[i] = time_batch(c.run, batch);
+  if (c.teardown)
+    c.teardown();
+  sort(samples, n);
+
+  bench_result &r = results[result_count++];
+  r.name = c.name;
+  r.param = param;
+  r.batch = batch;
+  r.min = samples[0];
+  r.median = samples[n / 2];
+  r.p99 = samples[(n * 99 + 99) / 100 - 1]; // Nearest rank
+}
+
+// --- Cases ---
+static uint8_t copy_src[4096], copy_dst[4096];
+static char str_a[32], str_b[32];
+static uint16_t sector[FS_SECTOR_SIZE / 2];
+
+static void str_setup() {
+  for (int i = 0; i < 31; i++)
+    str_a[i] = str_b[i] = 'a' + i % 26;
+}
+
+static void line_setup() {
+  // Park the cursor on the last row so every newline scrolls
+  for (int i = 0; i < TERM_HEIGHT; i++)
+    term_putc('\n');
+}
+
+static const char line80[] =
+    "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+    "0123456789abcdefg";
+
+[[gnu::naked]] static void bench_int_stub() { asm volatile("iretq"); }
+
+static idt_entry_t saved_gate; // BENCH_VECTOR's gate outside the case
+
+static void int_setup() {
+  saved_gate = idt_get_entry(BENCH_VECTOR);
+  idt_set_gate(BENCH_VECTOR, (void *)bench_int_stub, 0x8E);
+}
+
+static uint64_t tlb_walk_span;
+
+// Stops at the first unmapped page, so small machines walk less
+static void tlb_walk_setup() {
+  uint64_t base = (uint64_t)phys_to_virt(TLB_WALK_BASE);
+  tlb_walk_span = 0;
+  while (tlb_walk_span < TLB_WALK_SPAN &&
+         paging_page_size(base + tlb_walk_span))
+    tlb_walk_span += PAGE_SIZE;
+}
+
+// Each read uses a different cache set, so the cost is the page walks
+static void tlb_walk() {
+  const volatile uint8_t *base =
+      (const volatile uint8_t *)phys_to_virt(TLB_WALK_BASE);
+  for (uint64_t off = 0; off < tlb_walk_span; off += PAGE_SIZE + 64)
+    (void)base[off];
+}
+
+// Created on first use and kept, so repeated runs don't leak
+static uint64_t space;
+static int space_pages;
+
+static void space_setup() {
+  if (space)
+    return;
+  space = vm_create();
+  for (; space && space_pages < SPACE_PAGES; space_pages++) {
+    uint64_t frame = pmm_alloc();
+    if (!frame)
+      return;
+    if (!vm_map(space, USER_SPACE_START + space_pages * PAGE_SIZE, frame,
+                PTE_WRITABLE)) {
+      pmm_free(frame);
+      return;
+    }
+  }
+}
+
+// Visits the scratch space and touches its pages, which refill the TLB
+// unless the space's PCID kept them
+static void space_switch() {
+  if (!space)
+    return;
+  uint64_t kernel_cr3 = read_cr3();
+  tlb_switch(space);
+  for (int i = 0; i < space_pages; i++)
+    (void)*(volatile uint8_t *)(USER_SPACE_START + i * PAGE_SIZE);
+  tlb_switch(kernel_cr3);
+}
+
+// Maps fresh pages, then unmaps them with one batched flush
+static void space_unmap() {
+  if (!space)
+    return;
+  for (int i = 0; i < SPACE_PAGES; i++) {
+    uint64_t frame = pmm_alloc();
+    if (frame &&
+        !vm_map(space, SPACE_UNMAP_BASE + i * PAGE_SIZE, frame, PTE_WRITABLE))
+      pmm_free(frame);
+  }
+  vm_unmap(space, SPACE_UNMAP_BASE, SPACE_PAGES);
+}
+
+static timer bench_timers[BENCH_TIMERS];
+static timer bench_timer = TIMER_INIT([](timer *) {});
+
+static void timers_setup() {
+  for (int i = 0; i < BENCH_TIMERS; i++) {
+    bench_timers[i].fn = [](timer *) {};
+    timer_start(&bench_timers[i], (i + 1) * BENCH_TIMER_SPACING_MS);
+  }
+}
+
+static void timers_teardown() {
+  for (int i = 0; i < BENCH_TIMERS; i++)
+    timer_cancel(&bench_timers[i]);
+}
+
+static const bench_case cases[] = {
+    {"kmemcpy_4k", false, false, nullptr,
+     [] { kmemcpy(copy_dst, copy_src, sizeof(copy_dst)); }},
+    {"kstrcmp_32", false, false, str_setup,
+     [] {
+       volatile int r = kstrcmp(str_a, str_b);
+       (void)r;
+     }},
+    {"int_roundtrip", false, false, int_setup,
+     [] { asm volatile("int %0" : : "i"(BENCH_VECTOR) : "memory"); },
+     [] { idt_set_entry(BENCH_VECTOR, saved_gate); }},
+    {"tlb_walk", false, false, tlb_walk_setup, tlb_walk},
+    {"cr3_switch", false, false, space_setup, space_switch},
+    {"map_unmap_16", false, false, space_setup, space_unmap},
+    {"timer_start_cancel", false, false, timers_setup,
+     [] {
+       timer_start(&bench_timer, 1000);
+       timer_cancel(&bench_timer);
+     },
+     timers_teardown},
+    {"term_puts_80", true, false, line_setup, [] { term_puts(line80); }},
+    {"vga_fill_screen", true, false, nullptr,
+     [] { vga_fill(0, TERM_WIDTH * TERM_HEIGHT, 0x1F30); }},
+    {"scroll", true, false, line_setup, [] { term_putc('\n'); }},
+    {"ata_read", false, true, nullptr, [] { ata_read_sector(0, sector); }},
+    // Writes the FS header sector back unchanged
+    {"ata_write", false, true, [] { ata_read_sector(0, sector); },
+     [] { ata_write_sector(0, sector); }},
+};
+
+static const bench_case fs_cases[] = {
+    {"find_file_miss", false, false, nullptr,
+     [] {
+       volatile int r = find_file("no_such_file", BENCH_DIR);
+       (void)r;
+     }},
+    {"fs_save", false, true, nullptr, fs_save},
+};
+
+static bool selected(const char *filter, const char *name) {
+  return !filter[0] || kstrncmp(filter, name, kstrlen(filter)) == 0;
+}
+
+// Runs the fs cases with the table holding a growing number of files,
+// padded with scratch files that are removed again afterwards
+static void run_fs_cases(const char *filter) {
+  bool any = false;
+  for (const bench_case &c : fs_cases)
+    any |= selected(filter, c.name);
+  if (!any)
+    return;
+  int created = 0;
+  int targets[] = {fs_file_count(), MAX_FILES / 2, MAX_FILES};
+  int done = -1; // File count last measured
+  for (int target : targets) {
+    while (fs_file_count() < target) {
+      char name[] = "bench00";
+      name[5] = '0' + created / 10;
+      name[6] = '0' + created % 10;
+      if (fs_create(name, BENCH_DIR) < 0)
+        break;
+      created++;
+    }
+    if (fs_file_count() <= done)
+      continue;
+    done = fs_file_count();
+    for (const bench_case &c : fs_cases)
+      if (selected(filter, c.name))
+        measure(c, done);
+  }
+  MockFile f;
+  for (int i = fs_file_count() - 1; i >= 0 && created; i--) {
+    if (fs_get_file(i, &f) && kstrcmp(f.parent_dir, BENCH_DIR) == 0) {
+      fs_remove(i);
+      created--;
+    }
+  }
+  fs_save();
+}
+
+static void print_table() {
+  term_puts("benchmark           files   batch       min    median"
+            "       p99\n",
+            COLOR_PROMPT);
+  for (int i = 0; i < result_count; i++) {
+    const bench_result &r = results[i];
+    int len = kstrlen(r.name);
+    term_puts(r.name);
+    while (len++ < 18)
+      term_putc(' ');
+    if (r.param)
+      term_put_column(r.param, 7);
+    else
+      term_puts("       ");
+    term_put_column(r.batch, 8);
+    term_put_column(r.min, 10);
+    term_put_column(r.median, 10);
+    term_put_column(r.p99, 10);
+    term_putc('\n');
+  }
+  term_puts("Cycles per call at ");
+  term_put_uint(tsc_hz / 1000000);
+  term_puts(" MHz TSC\n");
+}
+
+// One line per result, for scripts comparing builds and hosts
+static void print_machine() {
+  for (int i = 0; i < result_count; i++) {
+    const bench_result &r = results[i];
+    term_puts("bench name=");
+    term_puts(r.name);
+    term_puts(" files=");
+    term_put_uint(r.param);
+    term_puts(" batch=");
+    term_put_uint(r.batch);
+    term_puts(" min=");
+    term_put_uint(r.min);
+    term_puts(" median=");
+    term_put_uint(r.median);
+    term_puts(" p99=");
+    term_put_uint(r.p99);
+    term_puts(" tsc_hz=");
+    term_put_uint(tsc_hz);
+    term_putc('\n');
+  }
+}
+
+static void cmd_bench(char *args) {
+  bool machine = args[0] == '-' && args[1] == 'm' &&
+                 (args[2] == ' ' || args[2] == '\0');
+  const char *filter = machine ? args + 2 + (args[2] == ' ') : args;
+
+  result_count = 0;
+  bool drew = false;
+  // Console cases must reach the screen even when output is piped
+  void *saved = pipe_suspend();
+  for (const bench_case &c : cases) {
+    if (selected(filter, c.name)) {
+      measure(c, 0);
+      drew |= c.console;
+    }
+  }
+  pipe_resume(saved);
+  run_fs_cases(filter);
+  if (drew)
+    clear_screen();
+
+  if (result_count == 0)
+    term_puts("Error: No benchmark matches.\n", COLOR_ERROR);
+  else if (machine)
+    print_machine();
+  else
+    print_table();
+}
+
+COMMAND(bench, "bench [-m] [name]", "Time kernel primitives (-m: for "
+        "scripts)", 0, 2, cmd_bench);
@@ -0,0 +1,282 @@
+#include "block.h"
+#include "cmd.h"
+#include "cpu.h"
+#include "kstring.h"
+#include "lock.h"
+#include "pit.h"
+#include "term.h"
+
+// Deadline in ticks
+#define BLK_DEADLINE_TICKS ((BLK_DEADLINE_MS * PIT_TICK_HZ + 999) / 1000)
+
+static const blk_driver *driver;
+static blk_request *runs;   // Queued runs, oldest first
+static blk_request *active; // Run on the drive
+static uint32_t head_lba;   // Where the last dispatched run ended
+static uint32_t plugged;
+static uint32_t depth; // Queued requests, not counting the active run
+
+struct blk_stats {
+  uint64_t submitted;
+  uint64_t sync;        // Transferred synchronously by blk_submit()
+  uint64_t back_merges; // Joined the end of a run
+  uint64_t front_merges;
+  uint64_t runs;      // Commands dispatched
+  uint64_t sectors;   // In those commands
+  uint64_t deadlines; // Runs dispatched for their deadline
+  uint64_t errors;    // Requests that failed
+  uint64_t depth_sum; // Queue depth seen by each submit, summed
+  uint32_t peak_depth;
+};
+
+static blk_stats stats;
+
+// Guards the queue and the stats
+DEFINE_SPINLOCK(blk_lock);
+
+void blk_register(const blk_driver *d) { driver = d; }
+
+static bool try_merge(blk_request *r) {
+  for (blk_request **link = &runs; *link; link = &(*link)->run_next) {
+    blk_request *run = *link;
+    if (run->write != r->write || run->count >= BLK_MAX_SECTORS)
+      continue;
+    if (run->lba + run->count == r->lba) {
+      r->next = nullptr;
+      run->run_last->next = r;
+      run->run_last = r;
+      run->count++;
+      stats.back_merges++;
+      return true;
+    }
+    if (r->lba + 1 == run->lba) {
+      // `r` takes over as the first request, keeping the run's place
+      r->next = run;
+      r->run_next = run->run_next;
+      r->run_last = run->run_last;
+      r->count = run->count + 1;
+      r->queued = run->queued;
+      *link = r;
+      stats.front_merges++;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void enqueue(blk_request *r) {
+  stats.submitted++;
+  stats.depth_sum += depth;
+  if (++depth > stats.peak_depth)
+    stats.peak_depth = depth;
+  if (try_merge(r))
+    return;
+
+  r->next = nullptr;
+  r->run_next = nullptr;
+  r->run_last = r;
+  r->count = 1;
+  r->queued = pit_ticks;
+  blk_request **link = &runs;
+  while (*link)
+    link = &(*link)->run_next;
+  *link = r;
+}
+
+// Unlinks and returns the run to dispatch next
+static blk_request *pick() {
+  blk_request **chosen = &runs;
+  // The first run is the oldest
+  if (pit_ticks - runs->queued >= BLK_DEADLINE_TICKS) {
+    stats.deadlines++;
+  } else {
+    blk_request **lowest = &runs;
+    blk_request **ahead = nullptr; // Lowest at or above head_lba
+    for (blk_request **link = &runs; *link; link = &(*link)->run_next) {
+      uint32_t lba = (*link)->lba;
+      if (lba < (*lowest)->lba)
+        lowest = link;
+      if (lba >= head_lba && (!ahead || lba < (*ahead)->lba))
+        ahead = link;
+    }
+    chosen = ahead ? ahead : lowest;
+  }
+  blk_request *run = *chosen;
+  *chosen = run->run_next;
+  return run;
+}
+
+// Marks the run's requests and chains the run onto `*done`, whose latches
+// are arrived at once the lock is dropped
+static void finish(blk_request *run, uint32_t sectors_ok,
+                   blk_request **done) {
+  uint32_t i = 0;
+  for (blk_request *r = run; r; r = r->next, i++)
+    r->ok = i < sectors_ok;
+  if (sectors_ok < run->count)
+    stats.errors += run->count - sectors_ok;
+  run->run_next = *done;
+  *done = run;
+}
+
+// Starts queued runs until one is on the drive. Called with the lock held.
+static void dispatch(blk_request **done) {
+  while (!active && runs && !plugged) {
+    blk_request *run = pick();
+    depth -= run->count;
+    head_lba = run->lba + run->count;
+    stats.runs++;
+    stats.sectors += run->count;
+    active = run;
+    if (!driver->start(run)) {
+      active = nullptr;
+      finish(run, 0, done);
+    }
+  }
+}
+
+// Called without the lock: a waiter may free its request once it runs
+static void arrive_all(blk_request *done) {
+  while (done) {
+    blk_request *run_next = done->run_next;
+    for (blk_request *r = done; r;) {
+      blk_request *next = r->next;
+      r->done->arrive();
+      r = next;
+    }
+    done = run_next;
+  }
+}
+
+void blk_complete(uint32_t sectors_ok) {
+  blk_request *done = nullptr;
+  uint64_t flags = spin_lock_irqsave(&blk_lock);
+  blk_request *run = active;
+  active = nullptr;
+  if (run)
+    finish(run, sectors_ok, &done);
+  dispatch(&done);
+  spin_unlock_irqrestore(&blk_lock, flags);
+  arrive_all(done);
+}
+
+void blk_submit(blk_request *r) {
+  if (!driver || !irqs_enabled()) {
+    r->ok = driver && driver->transfer(r);
+    uint64_t flags = spin_lock_irqsave(&blk_lock);
+    stats.submitted++;
+    stats.sync++;
+    if (!r->ok)
+      stats.errors++;
+    spin_unlock_irqrestore(&blk_lock, flags);
+    r->done->arrive();
+    return;
+  }
+
+  blk_request *done = nullptr;
+  uint64_t flags = spin_lock_irqsave(&blk_lock);
+  enqueue(r);
+  dispatch(&done);
+  spin_unlock_irqrestore(&blk_lock, flags);
+  arrive_all(done);
+}
+
+void blk_plug() {
+  uint64_t flags = spin_lock_irqsave(&blk_lock);
+  plugged++;
+  spin_unlock_irqrestore(&blk_lock, flags);
+}
+
+void blk_unplug() {
+  blk_request *done = nullptr;
+  uint64_t flags = spin_lock_irqsave(&blk_lock);
+  plugged--;
+  dispatch(&done);
+  spin_unlock_irqrestore(&blk_lock, flags);
+  arrive_all(done);
+}
+
+// Requests for blk_io()
+static blk_request xfer[BLK_MAX_SECTORS];
+
+task<bool> blk_io(uint32_t lba, uint32_t sectors, void *buffer, bool write) {
+  bool ok = true;
+  for (uint32_t s = 0; s < sectors; s += BLK_MAX_SECTORS) {
+    uint32_t n = sectors - s;
+    if (n > BLK_MAX_SECTORS)
+      n = BLK_MAX_SECTORS;
+    co_latch done(n);
+    blk_plug();
+    for (uint32_t i = 0; i < n; i++) {
+      uint16_t *sector =
+          (uint16_t *)((uint8_t *)buffer + (s + i) * BLK_SECTOR_SIZE);
+      xfer[i] = BLK_REQUEST_INIT(lba + s + i, sector, write, &done);
+      blk_submit(&xfer[i]);
+    }
+    blk_unplug();
+    co_await done;
+    for (uint32_t i = 0; i < n; i++)
+      ok = ok && xfer[i].ok;
+  }
+  co_return ok;
+}
+
+bool blk_transfer(uint32_t lba, uint32_t sectors, void *buffer, bool write) {
+  return co_run(blk_io(lba, sectors, buffer, write));
+}
+
+static void put_tenths(uint64_t num, uint64_t den) {
+  uint64_t tenths = den ? num * 10 / den : 0;
+  term_put_uint(tenths / 10);
+  term_putc('.');
+  term_put_uint(tenths % 10);
+}
+
+static void cmd_blkstat(char *args) {
+  if (kstrcmp(args, "reset") == 0) {
+    uint64_t flags = spin_lock_irqsave(&blk_lock);
+    stats = blk_stats();
+    spin_unlock_irqrestore(&blk_lock, flags);
+    term_puts("Block queue statistics cleared.\n", COLOR_SUCCESS);
+    return;
+  }
+  if (args[0]) {
+    term_puts("Usage: blkstat [reset]\n", COLOR_ERROR);
+    return;
+  }
+
+  uint64_t flags = spin_lock_irqsave(&blk_lock);
+  blk_stats s = stats;
+  uint32_t now = depth;
+  spin_unlock_irqrestore(&blk_lock, flags);
+
+  term_puts("Requests:  ");
+  term_put_uint(s.submitted);
+  term_puts(" (");
+  term_put_uint(s.sync);
+  term_puts(" synchronous, ");
+  term_put_uint(s.errors);
+  term_puts(" failed)\nDepth:     ");
+  term_put_uint(now);
+  term_puts(" now, ");
+  term_put_uint(s.peak_depth);
+  term_puts(" peak, ");
+  put_tenths(s.depth_sum, s.submitted - s.sync);
+  term_puts(" average at submit\nMerges:    ");
+  term_put_uint(s.back_merges);
+  term_puts(" back, ");
+  term_put_uint(s.front_merges);
+  term_puts(" front\nCommands:  ");
+  term_put_uint(s.runs);
+  term_puts(" for ");
+  term_put_uint(s.sectors);
+  term_puts(" sectors (");
+  put_tenths(s.sectors, s.runs);
+  term_puts(" per command, ");
+  term_put_uint(s.deadlines);
+  term_puts(" by deadline)\n");
+}
+
+COMMAND(blkstat, "blkstat [reset]",
+        "Show block queue merges, depth and commands issued", 0, 1,
+        cmd_blkstat);
@@ -0,0 +1,74 @@
+#pragma once
+#include "co.h"
+#include <stdint.h>
+
+// Block request queue between disk users and the driver backing the disk.
+// Submitters queue single-sector requests. A request for the sector just
+// after (or before) a queued run in the same direction joins that run, up
+// to BLK_MAX_SECTORS, and the driver issues each run as one command.
+//
+// The next run is picked with a one-way elevator (C-LOOK): the lowest LBA
+// at or above where the last run ended, else the lowest LBA. A run whose
+// oldest request has waited BLK_DEADLINE_MS goes first instead, so a
+// stream of requests near the head can't starve the rest of the disk.
+//
+// Requests queue, and merge, while the drive is busy with a run and while
+// the queue is plugged. Requests in flight together may complete in any
+// order, so don't queue two that overlap. Only foreground code submits.
+// `blkstat` shows merge counts and queue depth.
+
+#define BLK_SECTOR_SIZE 512
+#define BLK_MAX_SECTORS 128
+#define BLK_DEADLINE_MS 100
+
+struct blk_request {
+  blk_request *next; // Next request of the run; owned by the queue
+  uint32_t lba;
+  uint16_t *buffer; // One sector
+  bool write;
+  bool ok;        // Set before `done` is arrived at
+  co_latch *done; // Arrived at once the transfer has finished or failed
+  // Set by the queue on the first request of a run
+  blk_request *run_next; // Next queued run
+  blk_request *run_last;
+  uint32_t count;  // Requests in the run
+  uint64_t queued; // PIT tick the run's oldest request was queued at
+};
+
+#define BLK_REQUEST_INIT(lba, buffer, write, done)                          \
+  {nullptr, lba, buffer, write, false, done, nullptr, nullptr, 0, 0}
+
+// What the driver backing the disk provides
+struct blk_driver {
+  // Issues the run `r`: r->count sectors from r->lba, one request each,
+  // linked through `next`. Called with interrupts disabled. Returns false
+  // if the device refused the command; otherwise the driver calls
+  // blk_complete() once the run has ended.
+  bool (*start)(blk_request *r);
+  // Transfers one request synchronously, for when interrupts are off
+  bool (*transfer)(blk_request *r);
+};
+
+void blk_register(const blk_driver *driver);
+
+// Ends the running run, whose first `sectors_ok` requests succeeded, and
+// starts the next. Called by the driver, from a bottom half.
+void blk_complete(uint32_t sectors_ok);
+
+// Queues `r`, which must stay put until `done` is arrived at. Without a
+// driver, or with interrupts off, transfers synchronously.
+void blk_submit(blk_request *r);
+
+// Holds dispatch until the matching blk_unplug(), so a batch queued in
+// between can merge before any of it reaches the drive. Nests.
+void blk_plug();
+void blk_unplug();
+
+// Transfers `sectors` consecutive sectors from `lba` to or from `buffer`
+// through the queue, BLK_MAX_SECTORS at a time, each batch plugged so it
+// reaches the drive as one run. Completes to false if any sector failed.
+// Not reentrant; only one may be in progress.
+task<bool> blk_io(uint32_t lba, uint32_t sectors, void *buffer, bool write);
+
+// blk_io() for ordinary code: sleeps until it is done
+bool blk_transfer(uint32_t lba, uint32_t sectors, void *buffer, bool write);
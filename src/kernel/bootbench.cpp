@@ -0,0 +1,86 @@
+#include "bootbench.h"
+
+#ifdef TACOS_BOOTBENCH
+#include "cpu.h"
+#include "io.h"
+#include "kstring.h"
+#include "serial.h"
+
+#define BOOTBENCH_MAX_MARKS 16
+// QEMU `-device isa-debug-exit,iobase=0xf4,iosize=0x04`: writing v exits
+// with status (v << 1) | 1, so 0 gives 1, which bench_boot.sh expects
+#define DEBUG_EXIT_PORT 0xF4
+
+struct boot_mark {
+  const char *name;
+  uint64_t tsc;
+};
+
+static boot_mark marks[BOOTBENCH_MAX_MARKS];
+static int mark_count = 0;
+
+// Commands run after the first prompt, in order
+static const char *const script[] = {
+    "help",         "ls",      "echo bootbench", "new bench.txt",
+    "cat bench.txt", "ls | wc", "rm bench.txt",   "sysinfo",
+};
+
+void bootbench_mark(const char *name) {
+  if (mark_count < BOOTBENCH_MAX_MARKS)
+    marks[mark_count++] = {name, rdtsc()};
+}
+
+static void serial_puts(const char *s) { serial_write(s, kstrlen(s)); }
+
+static void serial_put_uint(uint64_t n) {
+  char buf[21];
+  int i = sizeof(buf);
+  do {
+    buf[--i] = '0' + n % 10;
+    n /= 10;
+  } while (n);
+  serial_write(buf + i, sizeof(buf) - i);
+}
+
+static uint64_t tsc_to_us(uint64_t cycles) {
+  return tsc_hz ? cycles * 1000000 / tsc_hz : 0;
+}
+
+// `key=value` with spaces in the value turned into underscores
+static void put_word(const char *s) {
+  for (; *s; s++)
+    serial_putc(*s == ' ' ? '_' : *s);
+}
+
+void bootbench_run(void (*execute)(char *cmd)) {
+  // Time since reset; QEMU starts the TSC at zero
+  for (int i = 0; i < mark_count; i++) {
+    serial_puts("bootbench mark=");
+    put_word(marks[i].name);
+    serial_puts(" us=");
+    serial_put_uint(tsc_to_us(marks[i].tsc));
+    serial_puts("\n");
+  }
+
+  char line[81];
+  for (const char *cmd : script) {
+    kstrcpy(line, cmd);
+    uint64_t start = rdtsc();
+    execute(line);
+    uint64_t cycles = rdtsc() - start;
+    serial_puts("bootbench cmd=");
+    put_word(cmd);
+    serial_puts(" us=");
+    serial_put_uint(tsc_to_us(cycles));
+    serial_puts("\n");
+  }
+  serial_puts("bootbench tsc_hz=");
+  serial_put_uint(tsc_hz);
+  serial_puts("\nbootbench done\n");
+
+  outb(DEBUG_EXIT_PORT, 0);
+  serial_puts("bootbench: no isa-debug-exit device, halting\n");
+  while (1)
+    asm volatile("cli; hlt");
+}
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+// Boot benchmark mode, built with `TACOS_BOOTBENCH=1 ./build.sh` and
+// driven by bench_boot.sh. The kernel stamps the TSC at boot milestones,
+// times a fixed list of shell commands, prints the results on COM1 and
+// exits QEMU through the isa-debug-exit device. In normal builds the
+// macros compile to nothing.
+
+#ifdef TACOS_BOOTBENCH
+void bootbench_mark(const char *name);
+// Never returns: QEMU exits, or the CPU halts if it can't
+[[noreturn]] void bootbench_run(void (*execute)(char *cmd));
+
+#define BOOTBENCH_MARK(name) bootbench_mark(name)
+#define BOOTBENCH_RUN(execute) bootbench_run(execute)
+#else
+#define BOOTBENCH_MARK(name)                                                 \
+  do {                                                                       \
+  } while (0)
+#define BOOTBENCH_RUN(execute)                                               \
+  do {                                                                       \
+  } while (0)
+#endif
@@ -0,0 +1,127 @@
+#include "cmd.h"
+#include "term.h"
+
+// Bounds of the .tacos_cmds section, from linker.ld
+extern "C" const command cmd_table_start[], cmd_table_end[];
+
+// Command names use lowercase letters and digits
+#define CMD_TRIE_FANOUT 36
+#define CMD_TRIE_NODES 256
+#define CMD_HELP_COLUMN 16
+
+struct trie_node {
+  uint16_t child[CMD_TRIE_FANOUT]; // 0 = none; node 0 is the root
+  const command *cmd;
+};
+
+static trie_node trie[CMD_TRIE_NODES];
+static int trie_used = 1;
+
+static int trie_slot(char c) {
+  if (c >= 'a' && c <= 'z')
+    return c - 'a';
+  if (c >= '0' && c <= '9')
+    return 26 + (c - '0');
+  return -1;
+}
+
+static bool trie_insert(const command *c) {
+  int node = 0;
+  for (const char *p = c->name; *p; p++) {
+    int slot = trie_slot(*p);
+    if (slot < 0)
+      return false;
+    if (!trie[node].child[slot]) {
+      if (trie_used == CMD_TRIE_NODES)
+        return false;
+      trie[node].child[slot] = trie_used++;
+    }
+    node = trie[node].child[slot];
+  }
+  if (node == 0 || trie[node].cmd) // Empty or duplicate name
+    return false;
+  trie[node].cmd = c;
+  return true;
+}
+
+// Looks up the command named by the first `len` characters of `name`
+static const command *trie_find(const char *name, int len) {
+  int node = 0;
+  for (int i = 0; i < len; i++) {
+    int slot = trie_slot(name[i]);
+    if (slot < 0 || !trie[node].child[slot])
+      return nullptr;
+    node = trie[node].child[slot];
+  }
+  return trie[node].cmd;
+}
+
+int cmd_init() {
+  int count = 0;
+  for (const command *c = cmd_table_start; c < cmd_table_end; c++) {
+    if (trie_insert(c)) {
+      count++;
+    } else {
+      term_puts("Cannot register command: ", COLOR_ERROR);
+      term_puts(c->name, COLOR_ERROR);
+      term_putc('\n');
+    }
+  }
+  return count;
+}
+
+static int count_words(const char *s) {
+  int words = 0;
+  bool in_word = false;
+  for (; *s; s++) {
+    if (*s == ' ') {
+      in_word = false;
+    } else if (!in_word) {
+      in_word = true;
+      words++;
+    }
+  }
+  return words;
+}
+
+const command *cmd_find(char *line, char **args) {
+  int len = 0;
+  while (line[len] && line[len] != ' ')
+    len++;
+  *args = line + len;
+  if (**args == ' ')
+    (*args)++;
+  return trie_find(line, len);
+}
+
+bool cmd_args_ok(const command *c, const char *args) {
+  int words = count_words(args);
+  if (words >= c->min_args &&
+      (c->max_args == CMD_ARGS_ANY || words <= c->max_args))
+    return true;
+  term_puts("Usage: ", COLOR_ERROR);
+  term_puts(c->usage, COLOR_ERROR);
+  term_putc('\n');
+  return false;
+}
+
+// Children are visited in slot order, so names come out sorted
+static void print_node(int node) {
+  const command *c = trie[node].cmd;
+  if (c) {
+    int len = 0;
+    term_puts("  ");
+    for (const char *p = c->usage; *p; p++, len++)
+      term_putc(*p);
+    do
+      term_putc(' ');
+    while (++len < CMD_HELP_COLUMN);
+    term_puts(c->help);
+    term_putc('\n');
+  }
+  for (int slot = 0; slot < CMD_TRIE_FANOUT; slot++)
+    if (trie[node].child[slot])
+      print_node(trie[node].child[slot]);
+}
+
+void cmd_print_help() { print_node(0); }
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+
+// Shell command registry. Each command is a constant descriptor placed in
+// the .tacos_cmds section by COMMAND(), so any translation unit can add
+// commands without main.cpp knowing about them. cmd_init() indexes the
+// section into a trie, making lookup O(length of the command name).
+
+// Arguments are the rest of the line after the name and one space
+typedef void (*cmd_handler_t)(char *args);
+
+// Commands that read piped input register a filter instead (pipe.h)
+struct cmd_filter;
+
+// max_args value for commands taking free text
+#define CMD_ARGS_ANY 0xFF
+
+struct command {
+  const char *name;
+  const char *usage; // Shown in help and on argument errors
+  const char *help;
+  uint8_t min_args; // Space-separated words accepted after the name
+  uint8_t max_args;
+  cmd_handler_t handler;
+  const cmd_filter *filter;
+};
+
+// Registers the command `name`, which must be a bare identifier made of
+// lowercase letters and digits. `handler` may be a captureless lambda.
+#define COMMAND(name, usage, help, min_args, max_args, handler)              \
+  [[gnu::used, gnu::section(".tacos_cmds"), gnu::aligned(8)]]                \
+  static constexpr command command_##name = {                                \
+      #name, usage, help, min_args, max_args, handler, nullptr}
+
+// Registers a command that consumes the output of the one before it
+#define FILTER_COMMAND(name, usage, help, min_args, max_args, filter)        \
+  [[gnu::used, gnu::section(".tacos_cmds"), gnu::aligned(8)]]                \
+  static constexpr command command_##name = {                                \
+      #name, usage, help, min_args, max_args, nullptr, &filter}
+
+// Builds the lookup trie; returns the number of commands registered
+int cmd_init();
+
+// Looks up the command named by the first word of `line` and points
+// *args at the rest. Returns nullptr if there is no such command.
+const command *cmd_find(char *line, char **args);
+
+// Checks the argument count, printing the usage line if it is wrong
+bool cmd_args_ok(const command *c, const char *args);
+
+// Prints usage and help for every command in name order
+void cmd_print_help();
@@ -0,0 +1,135 @@
+#include "co.h"
+#include "cmd.h"
+#include "idle.h"
+#include "term.h"
+
+// Frame pool. Frames are made and destroyed by coroutine code, which
+// only runs from co_run(), never from an interrupt handler.
+union co_frame {
+  co_frame *next_free;
+  alignas(16) uint8_t bytes[CO_FRAME_SIZE];
+};
+
+static co_frame frames[CO_FRAMES];
+static co_frame *free_frames;
+static uint32_t frames_carved; // Frames taken from the array so far
+
+struct co_stats {
+  uint32_t in_use;
+  uint32_t peak;
+  uint64_t alloc_failures;
+  uint64_t resumes;
+  uint64_t sleeps; // Times co_run found nothing ready
+};
+
+static co_stats stats;
+
+void *co_frame_alloc(size_t size) {
+  co_frame *f = nullptr;
+  if (size <= CO_FRAME_SIZE) {
+    if (free_frames) {
+      f = free_frames;
+      free_frames = f->next_free;
+    } else if (frames_carved < CO_FRAMES) {
+      f = &frames[frames_carved++];
+    }
+  }
+  if (!f) {
+    stats.alloc_failures++;
+    term_puts(size > CO_FRAME_SIZE ? "Coroutine frame too big\n"
+                                   : "Coroutine frame pool exhausted\n",
+              COLOR_ERROR);
+    return nullptr;
+  }
+  if (++stats.in_use > stats.peak)
+    stats.peak = stats.in_use;
+  return f;
+}
+
+void co_frame_free(void *frame) {
+  co_frame *f = (co_frame *)frame;
+  f->next_free = free_frames;
+  free_frames = f;
+  stats.in_use--;
+}
+
+// Made-ready coroutines, most recent first
+static co_waiter *ready;
+static event ready_event;
+
+void co_ready(co_waiter *w) {
+  co_waiter *old = __atomic_load_n(&ready, __ATOMIC_RELAXED);
+  do
+    w->next = old;
+  while (!__atomic_compare_exchange_n(&ready, &old, w, true,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  event_signal(&ready_event);
+}
+
+void co_run_until(std::coroutine_handle<> h) {
+  stats.resumes++;
+  h.resume();
+  while (!h.done()) {
+    co_waiter *list = __atomic_exchange_n(&ready, nullptr, __ATOMIC_ACQUIRE);
+    if (!list) {
+      stats.sleeps++;
+      wait_event(&ready_event, [] {
+        return __atomic_load_n(&ready, __ATOMIC_ACQUIRE) != nullptr;
+      });
+      continue;
+    }
+    // Reverse into the order they became ready
+    co_waiter *w = nullptr;
+    while (list) {
+      co_waiter *next = list->next;
+      list->next = w;
+      w = list;
+      list = next;
+    }
+    while (w) {
+      // Resuming may end the awaitable `w` lives in
+      co_waiter *next = w->next;
+      stats.resumes++;
+      w->handle.resume();
+      w = next;
+    }
+  }
+}
+
+// Sentinel for a latch whose count reached zero
+#define CO_LATCH_DONE ((co_waiter *)1)
+
+void co_latch::arrive() {
+  if (__atomic_sub_fetch(&count, 1, __ATOMIC_ACQ_REL))
+    return;
+  co_waiter *w = __atomic_exchange_n(&state, CO_LATCH_DONE, __ATOMIC_ACQ_REL);
+  if (w)
+    co_ready(w);
+}
+
+bool co_latch::await_suspend(std::coroutine_handle<> h) {
+  waiter.handle = h;
+  co_waiter *expected = nullptr;
+  // Fails only if the last arrival came first, so keep running
+  return __atomic_compare_exchange_n(&state, &expected, &waiter, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static void cmd_co(char *) {
+  term_puts("Frames in use: ");
+  term_put_uint(stats.in_use);
+  term_puts(" of ");
+  term_put_uint(CO_FRAMES);
+  term_puts(" (peak ");
+  term_put_uint(stats.peak);
+  term_puts(")\nAlloc failures: ");
+  term_put_uint(stats.alloc_failures);
+  term_puts("\nResumes: ");
+  term_put_uint(stats.resumes);
+  term_puts("\nIdle waits: ");
+  term_put_uint(stats.sleeps);
+  term_putc('\n');
+}
+
+COMMAND(co, "co", "Show coroutine frame pool and executor counts", 0, 0,
+        cmd_co);
@@ -0,0 +1,166 @@
+#pragma once
+#include "timer.h"
+#include <coroutine>
+#include <stddef.h>
+#include <stdint.h>
+
+// Coroutines for kernel I/O. A task<T> is a lazily started coroutine
+// returning T; awaiting one runs it and resumes the awaiter when it ends.
+// Code waiting on a device suspends on an awaitable (a co_latch, co_sleep
+// or a block transfer), and whoever completes the wait, interrupt
+// handlers included, puts the coroutine on the ready list. co_run()
+// drives a task to the end, resuming ready coroutines and sleeping the
+// CPU while none are.
+//
+// GCC 12 miscompiles a co_await in an if condition (the coroutine never
+// starts), so await into a local and test that.
+//
+// Frames come from a fixed pool, not a heap. When it is empty or a frame
+// is too big, the failure is printed and the call returns an empty task.
+// Awaiting that, or passing it to co_run(), gives co_error<T>::value
+// without running anything, so a result type needs an error value that
+// callers check for. bool has one (false); task<void> is not allowed.
+
+#define CO_FRAME_SIZE 1024
+#define CO_FRAMES 32
+
+void *co_frame_alloc(size_t size);
+void co_frame_free(void *frame);
+
+// A suspended coroutine waiting to be made ready. Lives in the awaitable,
+// which stays in the coroutine's frame while it is suspended.
+struct co_waiter {
+  co_waiter *next;
+  std::coroutine_handle<> handle;
+};
+
+// Puts `w` on the ready list. Lock-free; safe from interrupt handlers.
+void co_ready(co_waiter *w);
+
+// Resumes `h`, then ready coroutines until `h` is done
+void co_run_until(std::coroutine_handle<> h);
+
+// What a task that never ran completes with. Specialize for other
+// result types.
+template <typename T> struct co_error;
+template <> struct co_error<bool> {
+  static constexpr bool value = false;
+};
+
+template <typename T> struct co_result {
+  T value{};
+  void return_value(T v) { value = v; }
+  T result() { return value; }
+};
+
+template <typename T> class task {
+public:
+  struct promise_type : co_result<T> {
+    std::coroutine_handle<> continuation;
+
+    task get_return_object() {
+      return task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    static task get_return_object_on_allocation_failure() { return task(); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // Hands the CPU straight to the awaiter, if there is one
+    struct final_awaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<>
+      await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+        if (h.promise().continuation)
+          return h.promise().continuation;
+        return std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    final_awaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() {}
+
+    static void *operator new(size_t size) noexcept {
+      return co_frame_alloc(size);
+    }
+    static void operator delete(void *frame) { co_frame_free(frame); }
+  };
+
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  task() : h(nullptr) {}
+  explicit task(handle_type handle) : h(handle) {}
+  task(task &&other) : h(other.h) { other.h = nullptr; }
+  task(const task &) = delete;
+  task &operator=(task &&other) {
+    if (this != &other) {
+      if (h)
+        h.destroy();
+      h = other.h;
+      other.h = nullptr;
+    }
+    return *this;
+  }
+  ~task() {
+    if (h)
+      h.destroy();
+  }
+
+  bool await_ready() { return !h || h.done(); }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+    h.promise().continuation = caller;
+    return h;
+  }
+  T await_resume() {
+    return h ? h.promise().result() : co_error<T>::value;
+  }
+
+  handle_type handle() const { return h; }
+
+private:
+  handle_type h;
+};
+
+// Runs `t` to the end from ordinary code and returns its result
+template <typename T> T co_run(task<T> t) {
+  if (!t.handle())
+    return co_error<T>::value;
+  co_run_until(t.handle());
+  return t.handle().promise().result();
+}
+
+// Counts down completions; co_await returns once all `count` have
+// arrived. arrive() may be called from interrupt handlers.
+struct co_latch {
+  explicit co_latch(uint32_t n) : count(n), state(nullptr) {}
+
+  void arrive();
+
+  bool await_ready() {
+    return __atomic_load_n(&count, __ATOMIC_ACQUIRE) == 0;
+  }
+  bool await_suspend(std::coroutine_handle<> h);
+  void await_resume() {}
+
+  uint32_t count;
+  // Null, then the waiter once one suspends, then CO_LATCH_DONE
+  co_waiter *state;
+  co_waiter waiter;
+};
+
+// Suspends the coroutine for at least `ms`
+struct co_sleep {
+  explicit co_sleep(uint32_t ms) : t{nullptr, nullptr, 0, 0, fire}, ms(ms) {}
+
+  bool await_ready() { return false; }
+  void await_suspend(std::coroutine_handle<> h) {
+    waiter.handle = h;
+    timer_start(&t, ms);
+  }
+  void await_resume() {}
+
+  // `t` is the first member, so the timer's address is the awaitable's
+  static void fire(timer *t) { co_ready(&((co_sleep *)t)->waiter); }
+
+  timer t;
+  uint32_t ms;
+  co_waiter waiter;
+};
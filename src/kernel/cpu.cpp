@@ -0,0 +1,29 @@
+#include "cpu.h"
+#include "io.h"
+#include "pit.h"
+
+uint64_t tsc_hz = 0;
+
+// Calibration window
+#define CALIBRATE_MS 10
+
+void tsc_calibrate() {
+  // Use PIT channel 2 in one-shot mode; its output is readable on port 0x61
+  // bit 5 without needing any interrupts. Speaker data bit stays off.
+  uint8_t ctrl = inb(0x61);
+  outb(0x61, (ctrl & ~0x02) & ~0x01); // Gate low
+
+  uint16_t count = PIT_HZ * CALIBRATE_MS / 1000;
+  outb(0x43, 0xB0); // Channel 2, lobyte/hibyte, mode 0
+  outb(0x42, (uint8_t)count);
+  outb(0x42, (uint8_t)(count >> 8));
+
+  outb(0x61, (ctrl & ~0x02) | 0x01); // Gate high: start counting
+  uint64_t start = rdtsc();
+  while (!(inb(0x61) & 0x20))
+    ;
+  uint64_t end = rdtsc();
+
+  outb(0x61, ctrl & ~0x03);
+  tsc_hz = (end - start) * (1000 / CALIBRATE_MS);
+}
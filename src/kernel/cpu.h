@@ -0,0 +1,157 @@
+#pragma once
+#include <stdint.h>
+
+// CPUID feature bits used by the kernel
+#define CPUID_1_EDX_TSC (1u << 4)
+#define CPUID_1_EDX_PAT (1u << 16)
+#define CPUID_1_ECX_MONITOR (1u << 3) // MONITOR/MWAIT
+#define CPUID_1_ECX_PCID (1u << 17)
+#define CPUID_7_EBX_INVPCID (1u << 10)
+#define CPUID_80000001_EDX_NX (1u << 20)
+#define CPUID_80000001_EDX_PDPE1GB (1u << 26) // 1GB pages
+
+#define MSR_PAT 0x277
+#define MSR_EFER 0xC0000080
+#define MSR_STAR 0xC0000081
+#define MSR_LSTAR 0xC0000082
+#define MSR_SFMASK 0xC0000084
+
+#define EFER_SCE (1ull << 0)  // SYSCALL/SYSRET enable
+#define EFER_NXE (1ull << 11) // No-execute bit in page table entries
+
+#define CR0_WP (1ull << 16) // Ring 0 honours read-only pages
+
+#define CR4_PGE (1ull << 7)    // Global pages survive CR3 loads
+#define CR4_PCIDE (1ull << 17) // CR3 bits 0-11 tag TLB entries
+
+#define RFLAGS_TF (1ull << 8)
+#define RFLAGS_IF (1ull << 9)
+#define RFLAGS_DF (1ull << 10)
+#define RFLAGS_AC (1ull << 18)
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *a,
+                         uint32_t *b, uint32_t *c, uint32_t *d) {
+  asm volatile("cpuid"
+               : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+               : "a"(leaf), "c"(subleaf));
+}
+
+static inline uint64_t rdmsr(uint32_t msr) {
+  uint32_t lo, hi;
+  asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+  asm volatile("wrmsr"
+               :
+               : "c"(msr), "a"((uint32_t)val), "d"((uint32_t)(val >> 32)));
+}
+
+static inline uint64_t rdtsc() {
+  uint32_t lo, hi;
+  asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t read_cr0() {
+  uint64_t val;
+  asm volatile("mov %%cr0, %0" : "=r"(val));
+  return val;
+}
+
+static inline void write_cr0(uint64_t val) {
+  asm volatile("mov %0, %%cr0" : : "r"(val) : "memory");
+}
+
+static inline uint64_t read_cr3() {
+  uint64_t val;
+  asm volatile("mov %%cr3, %0" : "=r"(val));
+  return val;
+}
+
+static inline void write_cr3(uint64_t val) {
+  asm volatile("mov %0, %%cr3" : : "r"(val) : "memory");
+}
+
+static inline uint64_t read_cr4() {
+  uint64_t val;
+  asm volatile("mov %%cr4, %0" : "=r"(val));
+  return val;
+}
+
+static inline void write_cr4(uint64_t val) {
+  asm volatile("mov %0, %%cr4" : : "r"(val) : "memory");
+}
+
+// INVPCID types
+#define INVPCID_ADDRESS 0 // One page of one PCID
+#define INVPCID_CONTEXT 1 // All non-global entries of one PCID
+
+static inline void invpcid(uint64_t type, uint16_t pcid, uint64_t addr) {
+  struct {
+    uint64_t pcid, addr;
+  } desc = {pcid, addr};
+  asm volatile("invpcid %0, %1" : : "m"(desc), "r"(type) : "memory");
+}
+
+static inline void invlpg(uint64_t addr) {
+  asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+static inline void wbinvd() { asm volatile("wbinvd" : : : "memory"); }
+
+#ifndef TACOS_HOST
+// Disables interrupts and returns the previous RFLAGS for irq_restore()
+static inline uint64_t irq_save() {
+  uint64_t flags;
+  asm volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+  return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+  if (flags & RFLAGS_IF)
+    asm volatile("sti" : : : "memory");
+}
+#else
+// Host unit builds run in ring 3, where cli and sti fault. Their
+// "interrupts" are calls from the test harness, so there is nothing to
+// mask.
+static inline uint64_t irq_save() { return RFLAGS_IF; }
+static inline void irq_restore(uint64_t) {}
+#endif
+
+static inline bool irqs_enabled() {
+  uint64_t flags;
+  asm volatile("pushfq; pop %0" : "=r"(flags));
+  return flags & RFLAGS_IF;
+}
+
+// Arms address monitoring on the cache line holding `addr`
+static inline void monitor(const volatile void *addr) {
+  asm volatile("monitor" : : "a"(addr), "c"(0), "d"(0));
+}
+
+// Enables interrupts and waits for a write to the monitored line or an
+// interrupt. The STI shadow keeps an interrupt from landing in between.
+static inline void sti_mwait(uint32_t hint) {
+  asm volatile("sti; mwait" : : "a"(hint), "c"(0) : "memory");
+}
+
+// Enables interrupts and halts until the next one, with no gap in between
+static inline void sti_hlt() { asm volatile("sti; hlt" : : : "memory"); }
+
+// Spin-wait hint: saves power and lets a sibling hyperthread run
+static inline void cpu_relax() { asm volatile("pause" : : : "memory"); }
+
+// Only the boot CPU runs for now; per-CPU data is sized for more
+#define MAX_CPUS 8
+
+static inline int cpu_id() { return 0; }
+
+// Drains write-combining buffers so stores become visible to the device
+static inline void sfence() { asm volatile("sfence" : : : "memory"); }
+
+// TSC frequency in Hz, measured against the PIT by tsc_calibrate()
+extern uint64_t tsc_hz;
+void tsc_calibrate();
@@ -1,34 +1,128 @@
+#include "dma.h"
 #include "io.h"
+#include "paging.h"
 #include <stdint.h>
 
+// Per-channel register ports (channel 4 is the cascade and never used)
+static const uint8_t addr_port[8] = {0x00, 0x02, 0x04, 0x06,
+                                     0xC0, 0xC4, 0xC8, 0xCC};
+static const uint8_t count_port[8] = {0x01, 0x03, 0x05, 0x07,
+                                      0xC2, 0xC6, 0xCA, 0xCE};
+static const uint8_t page_port[8] = {0x87, 0x83, 0x81, 0x82,
+                                     0x8F, 0x8B, 0x89, 0x8A};
 
-// DMA 8237 Channels for SB16 (usually 16-bit Channel 5)
-// Registers for Page, Address, and Count
-void dma_setup_channel5(void *buffer, uint32_t length) {
-  uint32_t addr = (uint32_t)(uint64_t)buffer;
-  uint16_t count = (uint16_t)(length / 2 - 1); // 16-bit DMA count is in words
-  uint8_t page = (addr >> 16) & 0xFF;
+// Controller-wide registers: mask, mode, clear flip-flop
+#define DMA_MASK_REG(ch) ((ch) < 4 ? 0x0A : 0xD4)
+#define DMA_MODE_REG(ch) ((ch) < 4 ? 0x0B : 0xD6)
+#define DMA_FLIPFLOP_REG(ch) ((ch) < 4 ? 0x0C : 0xD8)
 
-  // Mask channel 5
-  outb(0xD4, 0x01 | 0x04);
+#define DMA_AUTO_INIT 0x10
 
-  // Clear Flip-Flop
-  outb(0xD8, 0x00);
+// Length of the buffer last programmed on each channel
+static uint32_t channel_length[8];
 
-  // Mode: Single, Inc, No Auto, Write (Play), Channel 5 (0x49)
-  outb(0xD6, 0x49);
+// A transfer can't cross one of these: the address counter doesn't carry
+// into the page register
+static uint64_t boundary(uint8_t channel) {
+  return channel >= 4 ? 0x20000 : 0x10000;
+}
+
+// Bounce buffer pool in BSS, which sits in the first few MB
+#define DMA_POOL_SIZE (128 * 1024)
+static uint8_t dma_pool[DMA_POOL_SIZE] __attribute__((aligned(16)));
+static uint32_t pool_used = 0;
+
+void *dma_alloc(uint8_t channel, uint32_t size) {
+  if (channel > 7 || channel == 4)
+    return nullptr;
+  uint64_t limit = boundary(channel);
+  size = (size + 15) & ~15u;
+  if (size == 0 || size > limit)
+    return nullptr;
+
+  uint64_t base = virt_to_phys(dma_pool);
+  uint64_t start = base + pool_used;
+  // Skip to the next boundary if the buffer would straddle one
+  if ((start / limit) != ((start + size - 1) / limit))
+    start = (start + limit - 1) & ~(limit - 1);
+  if (start + size > base + DMA_POOL_SIZE || start + size > DMA_ISA_LIMIT)
+    return nullptr;
+
+  pool_used = (uint32_t)(start + size - base);
+  return dma_pool + (start - base);
+}
+
+void dma_mask(uint8_t channel) {
+  outb(DMA_MASK_REG(channel), 0x04 | (channel & 3));
+}
+
+void dma_unmask(uint8_t channel) { outb(DMA_MASK_REG(channel), channel & 3); }
 
-  // Offset (Address)
-  outb(0xC4, (uint8_t)(addr >> 1)); // 16-bit DMA address is shifted
-  outb(0xC4, (uint8_t)(addr >> 9));
+bool dma_setup(uint8_t channel, void *buffer, uint32_t length, dma_dir dir,
+               dma_mode mode, bool auto_init) {
+  if (channel > 7 || channel == 4 || length == 0)
+    return false;
 
-  // Page
-  outb(0x8B, page);
+  bool wide = channel >= 4;
+  uint64_t phys = virt_to_phys(buffer);
+  uint64_t limit = boundary(channel);
+  if (phys + length > DMA_ISA_LIMIT)
+    return false;
+  if ((phys / limit) != ((phys + length - 1) / limit))
+    return false;
+  if (wide && ((phys | length) & 1))
+    return false;
 
-  // Count
-  outb(0xC6, (uint8_t)count);
-  outb(0xC6, (uint8_t)(count >> 8));
+  // 16-bit channels count words and take a word address within the
+  // 128KB page; the page register then only uses bits 17-23
+  uint32_t addr = wide ? (uint32_t)(phys >> 1) : (uint32_t)phys;
+  uint16_t count = (uint16_t)((wide ? length / 2 : length) - 1);
+  uint8_t page = (uint8_t)((phys >> 16) & 0xFF);
+  if (wide)
+    page &= 0xFE;
+
+  dma_mask(channel);
+  outb(DMA_FLIPFLOP_REG(channel), 0x00);
+  outb(DMA_MODE_REG(channel),
+       mode | (auto_init ? DMA_AUTO_INIT : 0) | dir | (channel & 3));
+
+  outb(addr_port[channel], (uint8_t)addr);
+  outb(addr_port[channel], (uint8_t)(addr >> 8));
+  outb(page_port[channel], page);
+
+  outb(count_port[channel], (uint8_t)count);
+  outb(count_port[channel], (uint8_t)(count >> 8));
+
+  channel_length[channel] = length;
+  dma_unmask(channel);
+  return true;
+}
+
+// The count register holds (units left - 1) and changes under us, so read
+// it until two consecutive reads agree
+static uint16_t read_count(uint8_t channel) {
+  uint16_t prev = 0xFFFF, cur;
+  for (int tries = 0; tries < 4; tries++) {
+    outb(DMA_FLIPFLOP_REG(channel), 0x00);
+    cur = inb(count_port[channel]);
+    cur |= (uint16_t)inb(count_port[channel]) << 8;
+    if (tries > 0 && cur == prev)
+      break;
+    prev = cur;
+  }
+  return cur;
+}
+
+uint32_t dma_get_remaining(uint8_t channel) {
+  if (channel > 7 || channel == 4)
+    return 0;
+  // 0xFFFF means terminal count was reached (nothing left)
+  uint32_t units = (uint16_t)(read_count(channel) + 1);
+  return channel >= 4 ? units * 2 : units;
+}
 
-  // Unmask channel 5
-  outb(0xD4, 0x01);
+uint32_t dma_get_position(uint8_t channel) {
+  uint32_t remaining = dma_get_remaining(channel);
+  uint32_t length = channel_length[channel];
+  return remaining >= length ? 0 : length - remaining;
 }
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+
+// 8237 ISA DMA: channels 0-3 move bytes (controller 1), channels 5-7 move
+// 16-bit words (controller 2). Channel 4 cascades the two controllers.
+// Transfers can only reach the first 16MB and can't cross a 64KB (8-bit)
+// or 128KB (16-bit) boundary.
+#define DMA_ISA_LIMIT 0x1000000
+
+// Direction from the device's point of view
+enum dma_dir {
+  DMA_TO_DEVICE = 0x08,   // Read from memory (playback)
+  DMA_FROM_DEVICE = 0x04, // Write to memory (recording)
+};
+
+enum dma_mode {
+  DMA_MODE_DEMAND = 0x00, // Transfer while the device holds DREQ
+  DMA_MODE_SINGLE = 0x40, // One unit per DREQ
+  DMA_MODE_BLOCK = 0x80,  // Whole count per DREQ
+};
+
+// Allocates a buffer for `channel`: below 16MB and not crossing that
+// channel's 64KB or 128KB boundary. Buffers live as long as the kernel.
+// Returns nullptr for a bad channel, a size the channel can't transfer,
+// or an exhausted pool.
+void *dma_alloc(uint8_t channel, uint32_t size);
+
+// Programs and unmasks a channel. With auto_init the controller reloads
+// address and count at terminal count, looping over the buffer.
+// Returns false if the buffer breaks an ISA DMA constraint.
+bool dma_setup(uint8_t channel, void *buffer, uint32_t length, dma_dir dir,
+               dma_mode mode, bool auto_init);
+
+void dma_mask(uint8_t channel);
+void dma_unmask(uint8_t channel);
+
+// Bytes left in the current cycle, read from the controller's count
+// register
+uint32_t dma_get_remaining(uint8_t channel);
+// Byte offset of the next transfer within the buffer
+uint32_t dma_get_position(uint8_t channel);
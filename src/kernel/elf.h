@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+
+// ELF64 structures used by the program loader
+#define ELF_MAGIC 0x464C457F // "\x7FELF" read little-endian
+#define ELF_CLASS64 2
+#define ELF_DATA_LSB 1
+#define ELF_TYPE_EXEC 2
+#define ELF_MACHINE_X86_64 62
+
+#define ELF_PT_LOAD 1
+#define ELF_PF_X 1
+#define ELF_PF_W 2
+#define ELF_PF_R 4
+
+struct elf64_ehdr {
+  uint32_t magic;
+  uint8_t elf_class;
+  uint8_t data;
+  uint8_t version;
+  uint8_t ident_pad[9];
+  uint16_t type;
+  uint16_t machine;
+  uint32_t elf_version;
+  uint64_t entry;
+  uint64_t phoff;
+  uint64_t shoff;
+  uint32_t flags;
+  uint16_t ehsize;
+  uint16_t phentsize;
+  uint16_t phnum;
+  uint16_t shentsize;
+  uint16_t shnum;
+  uint16_t shstrndx;
+} __attribute__((packed));
+
+struct elf64_phdr {
+  uint32_t type;
+  uint32_t flags;
+  uint64_t offset;
+  uint64_t vaddr;
+  uint64_t paddr;
+  uint64_t filesz;
+  uint64_t memsz;
+  uint64_t align;
+} __attribute__((packed));
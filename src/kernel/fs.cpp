@@ -0,0 +1,388 @@
+#include "fs.h"
+#include "ata.h"
+#include "block.h"
+#include "kstring.h"
+#include "lock.h"
+#include "trace.h"
+
+static MockFile file_system[MAX_FILES];
+static int file_count = 0;
+static char current_dir[FS_PATH_MAX] = "/";
+
+static char valid_dirs[MAX_DIRS][FS_PATH_MAX];
+static int dir_count = 0;
+
+// Guards the tables and the current directory. The public functions take
+// it; the static helpers below expect the caller to hold it.
+DEFINE_RWLOCK(fs_lock);
+
+// --- On-disk layout ---
+#define FS_MAGIC "TACOSFS"
+#define FS_SECTOR_START 0
+#define FS_DIRS_PER_SECTOR 16
+#define FS_FILES_PER_SECTOR 2
+#define FS_DIV_UP(a, b) (((a) + (b) - 1) / (b))
+#define FS_MAX(a, b) ((a) > (b) ? (a) : (b))
+// Directory slots start after the header and file slots after those. The
+// floors of 5 and 64 keep the layout of the default table sizes fixed.
+#define FS_DIR_SECTOR 1
+#define FS_FILE_SECTOR                                                       \
+  FS_MAX(5, FS_DIR_SECTOR + FS_DIV_UP(MAX_DIRS, FS_DIRS_PER_SECTOR))
+// File data extents are bump-allocated from here to the end of the disk
+#define FS_DATA_START                                                        \
+  FS_MAX(64, FS_FILE_SECTOR + FS_DIV_UP(MAX_FILES, FS_FILES_PER_SECTOR))
+
+static uint32_t next_data_lba = FS_DATA_START;
+static uint32_t disk_sectors = 0;
+
+uint32_t fs_alloc_data(uint32_t sectors) {
+  write_guard guard(&fs_lock);
+  if (disk_sectors == 0)
+    disk_sectors = ata_sector_count();
+  if (sectors == 0 || next_data_lba + sectors > disk_sectors)
+    return 0;
+  uint32_t lba = next_data_lba;
+  next_data_lba += sectors;
+  return lba;
+}
+
+TRACEPOINT(fs_save);
+
+// Table sectors pass through here, up to FS_IO_BATCH of them queued to
+// the drive at once. Saves and loads only run from the foreground, one
+// at a time, so the buffer needs no lock of its own.
+#define FS_IO_BATCH 64
+alignas(8) static uint16_t io_buf[FS_IO_BATCH][256];
+
+// Writes `sectors` sectors from `first`, each built by fill(index, buf)
+static task<bool> write_sectors(uint32_t first, int sectors,
+                                void (*fill)(int, uint16_t *)) {
+  for (int s = 0; s < sectors; s += FS_IO_BATCH) {
+    int n = sectors - s < FS_IO_BATCH ? sectors - s : FS_IO_BATCH;
+    for (int i = 0; i < n; i++)
+      fill(s + i, io_buf[i]);
+    bool ok = co_await blk_io(first + s, n, io_buf, true);
+    if (!ok)
+      co_return false;
+  }
+  co_return true;
+}
+
+// Reads `sectors` sectors from `first`, handing each to parse(index,
+// buf). Returns false if a read failed.
+static task<bool> read_sectors(uint32_t first, int sectors,
+                               void (*parse)(int, uint16_t *)) {
+  for (int s = 0; s < sectors; s += FS_IO_BATCH) {
+    int n = sectors - s < FS_IO_BATCH ? sectors - s : FS_IO_BATCH;
+    bool ok = co_await blk_io(first + s, n, io_buf, false);
+    if (!ok)
+      co_return false;
+    for (int i = 0; i < n; i++)
+      parse(s + i, io_buf[i]);
+  }
+  co_return true;
+}
+
+// Header: Magic(7) + file_count(1) + dir_count(1) + next data LBA(4),
+// then the full counts for tables of more than 255 entries
+static void fill_header(int, uint16_t *sector) {
+  kmemset(sector, 0, FS_SECTOR_SIZE);
+  char *hdr = (char *)sector;
+  kstrcpy(hdr, FS_MAGIC);
+  hdr[8] = (char)file_count;
+  hdr[9] = (char)dir_count;
+  sector[6] = (uint16_t)next_data_lba; // Bytes 12..15
+  sector[7] = (uint16_t)(next_data_lba >> 16);
+  sector[8] = (uint16_t)file_count; // Bytes 16..19
+  sector[9] = (uint16_t)(file_count >> 16);
+  sector[10] = (uint16_t)dir_count; // Bytes 20..23
+  sector[11] = (uint16_t)(dir_count >> 16);
+}
+
+// Each directory is a 32-byte slot, 16 slots per sector
+static void fill_dirs(int s, uint16_t *sector) {
+  kmemset(sector, 0, FS_SECTOR_SIZE);
+  for (int slot = 0; slot < FS_DIRS_PER_SECTOR; slot++) {
+    int i = s * FS_DIRS_PER_SECTOR + slot;
+    if (i < dir_count)
+      kstrcpy((char *)sector + (slot * FS_PATH_MAX), valid_dirs[i]);
+  }
+}
+
+static void parse_dirs(int s, uint16_t *sector) {
+  for (int slot = 0; slot < FS_DIRS_PER_SECTOR; slot++) {
+    int i = s * FS_DIRS_PER_SECTOR + slot;
+    if (i >= dir_count)
+      break;
+    char *src = (char *)sector + (slot * FS_PATH_MAX);
+    src[FS_PATH_MAX - 1] = '\0';
+    kstrcpy(valid_dirs[i], src);
+  }
+}
+
+// Each MockFile is 32(name) + 32(parent) + 128(content) + 8(extent)
+// = 200 bytes, in a 256-byte slot. 2 files per sector (512 bytes).
+static void fill_files(int s, uint16_t *sector) {
+  kmemset(sector, 0, FS_SECTOR_SIZE);
+  for (int slot = 0; slot < FS_FILES_PER_SECTOR; slot++) {
+    int i = s * FS_FILES_PER_SECTOR + slot;
+    if (i < file_count)
+      *(MockFile *)((char *)sector + (slot * 256)) = file_system[i];
+  }
+}
+
+static void parse_files(int s, uint16_t *sector) {
+  for (int slot = 0; slot < FS_FILES_PER_SECTOR; slot++) {
+    int i = s * FS_FILES_PER_SECTOR + slot;
+    if (i >= file_count)
+      break;
+    file_system[i] = *(MockFile *)((char *)sector + (slot * 256));
+  }
+}
+
+// Writes whole table sectors built in memory, the header last so a
+// failed save never pairs new counts with old tables
+static task<bool> save_tables() {
+  bool ok = co_await write_sectors(FS_SECTOR_START + FS_DIR_SECTOR,
+                                   FS_DIV_UP(dir_count, FS_DIRS_PER_SECTOR),
+                                   fill_dirs);
+  if (!ok)
+    co_return false;
+  ok = co_await write_sectors(FS_SECTOR_START + FS_FILE_SECTOR,
+                              FS_DIV_UP(file_count, FS_FILES_PER_SECTOR),
+                              fill_files);
+  if (!ok)
+    co_return false;
+  co_return co_await write_sectors(FS_SECTOR_START, 1, fill_header);
+}
+
+// Saving only reads the tables, so lookups can run alongside it
+void fs_save() {
+  read_guard guard(&fs_lock);
+  TRACE_SCOPE(fs_save, file_count, dir_count);
+  co_run(save_tables());
+}
+
+static task<bool> fs_load() {
+  file_count = 0;
+  dir_count = 0;
+  kstrcpy(current_dir, "/");
+  disk_sectors = 0;
+
+  bool ok = co_await blk_io(FS_SECTOR_START, 1, io_buf, false);
+  if (!ok)
+    co_return false;
+  uint16_t *sector = io_buf[0];
+  char *hdr = (char *)sector;
+
+  if (kstrcmp(hdr, FS_MAGIC) != 0) {
+    // Not a tacos disk, initialize defaults
+    next_data_lba = FS_DATA_START;
+    kstrcpy(valid_dirs[dir_count++], "/");
+    kstrcpy(valid_dirs[dir_count++], "/home");
+    kstrcpy(valid_dirs[dir_count++], "/system");
+    kstrcpy(valid_dirs[dir_count++], "/tacos");
+    kstrcpy(valid_dirs[dir_count++], "/dev");
+    TRACE_SCOPE(fs_save, file_count, dir_count);
+    co_await save_tables();
+    co_return true;
+  }
+
+  // Disks written before the full counts existed have zero there
+  file_count = sector[8] | ((uint32_t)sector[9] << 16);
+  dir_count = sector[10] | ((uint32_t)sector[11] << 16);
+  if (file_count == 0 && dir_count == 0) {
+    file_count = (unsigned char)hdr[8];
+    dir_count = (unsigned char)hdr[9];
+  }
+  if (file_count > MAX_FILES)
+    file_count = MAX_FILES;
+  if (dir_count > MAX_DIRS)
+    dir_count = MAX_DIRS;
+  // Disks from before data extents have zero here
+  next_data_lba = sector[6] | ((uint32_t)sector[7] << 16);
+  if (next_data_lba < FS_DATA_START)
+    next_data_lba = FS_DATA_START;
+
+  ok = co_await read_sectors(FS_SECTOR_START + FS_DIR_SECTOR,
+                             FS_DIV_UP(dir_count, FS_DIRS_PER_SECTOR),
+                             parse_dirs);
+  if (ok)
+    ok = co_await read_sectors(FS_SECTOR_START + FS_FILE_SECTOR,
+                               FS_DIV_UP(file_count, FS_FILES_PER_SECTOR),
+                               parse_files);
+  if (!ok) {
+    // Don't keep half-read tables
+    file_count = 0;
+    dir_count = 0;
+  }
+  co_return ok;
+}
+
+bool fs_init() {
+  write_guard guard(&fs_lock);
+  return co_run(fs_load());
+}
+
+int find_file(const char *name, const char *dir) {
+  read_guard guard(&fs_lock);
+  for (int i = 0; i < file_count; i++) {
+    if (kstrcmp(file_system[i].name, name) == 0 &&
+        kstrcmp(file_system[i].parent_dir, dir) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool fs_get_file(int idx, MockFile *out) {
+  read_guard guard(&fs_lock);
+  if (idx < 0 || idx >= file_count)
+    return false;
+  *out = file_system[idx];
+  return true;
+}
+
+bool fs_set_file(int idx, const MockFile *f) {
+  write_guard guard(&fs_lock);
+  if (idx < 0 || idx >= file_count)
+    return false;
+  MockFile *dst = &file_system[idx];
+  *dst = *f;
+  dst->name[sizeof(dst->name) - 1] = '\0';
+  dst->parent_dir[sizeof(dst->parent_dir) - 1] = '\0';
+  dst->content[sizeof(dst->content) - 1] = '\0';
+  return true;
+}
+
+int fs_create(const char *name, const char *dir) {
+  write_guard guard(&fs_lock);
+  if (file_count >= MAX_FILES)
+    return -1;
+  MockFile *f = &file_system[file_count];
+  kstrcpy(f->name, name);
+  kstrcpy(f->parent_dir, dir);
+  kstrcpy(f->content, "Empty taco.");
+  f->data_lba = 0;
+  f->data_size = 0;
+  return file_count++;
+}
+
+int fs_file_count() {
+  read_guard guard(&fs_lock);
+  return file_count;
+}
+
+void fs_remove(int idx) {
+  write_guard guard(&fs_lock);
+  if (idx < 0 || idx >= file_count)
+    return;
+  for (int i = idx; i < file_count - 1; i++)
+    file_system[i] = file_system[i + 1];
+  file_count--;
+}
+
+void fs_current_dir(char *out) {
+  read_guard guard(&fs_lock);
+  kstrcpy(out, current_dir);
+}
+
+void fs_set_current_dir(const char *path) {
+  write_guard guard(&fs_lock);
+  kstrcpy(current_dir, path);
+}
+
+int fs_dir_count() {
+  read_guard guard(&fs_lock);
+  return dir_count;
+}
+
+bool fs_dir(int idx, char *out) {
+  read_guard guard(&fs_lock);
+  if (idx < 0 || idx >= dir_count)
+    return false;
+  kstrcpy(out, valid_dirs[idx]);
+  return true;
+}
+
+static int dir_index(const char *path) {
+  for (int i = 0; i < dir_count; i++)
+    if (kstrcmp(valid_dirs[i], path) == 0)
+      return i;
+  return -1;
+}
+
+int find_dir(const char *path) {
+  read_guard guard(&fs_lock);
+  return dir_index(path);
+}
+
+bool fs_resolve(const char *name, char *path) {
+  read_guard guard(&fs_lock);
+  int len = 0;
+  if (name[0] != '/') {
+    len = kstrlen(current_dir);
+    kmemcpy(path, current_dir, len);
+    if (len > 1) {
+      if (len >= FS_PATH_MAX - 1)
+        return false;
+      path[len++] = '/';
+    }
+  }
+  for (; *name; name++) {
+    if (len >= FS_PATH_MAX - 1)
+      return false;
+    path[len++] = *name;
+  }
+  path[len] = '\0';
+  return true;
+}
+
+bool fs_mkdir(const char *path) {
+  write_guard guard(&fs_lock);
+  if (dir_count >= MAX_DIRS)
+    return false;
+  kstrcpy(valid_dirs[dir_count++], path);
+  return true;
+}
+
+// True if `path` is `dir` or below it. Not kstrncmp, which would also
+// accept a path shorter than `dir`, such as a parent of it.
+static bool within(const char *path, const char *dir, int dir_len) {
+  for (int i = 0; i < dir_len; i++)
+    if (path[i] != dir[i])
+      return false;
+  return path[dir_len] == '\0' || path[dir_len] == '/';
+}
+
+bool fs_remove_tree(const char *path) {
+  write_guard guard(&fs_lock);
+  if (dir_index(path) < 0)
+    return false;
+  int len = kstrlen(path);
+
+  // One compacting pass over each table, keeping the order of the rest
+  int kept = 0;
+  for (int i = 0; i < file_count; i++) {
+    if (within(file_system[i].parent_dir, path, len))
+      continue;
+    if (kept != i)
+      file_system[kept] = file_system[i];
+    kept++;
+  }
+  file_count = kept;
+
+  kept = 0;
+  for (int i = 0; i < dir_count; i++) {
+    if (within(valid_dirs[i], path, len))
+      continue;
+    if (kept != i)
+      kstrcpy(valid_dirs[kept], valid_dirs[i]);
+    kept++;
+  }
+  dir_count = kept;
+
+  if (within(current_dir, path, len))
+    kstrcpy(current_dir, "/");
+  return true;
+}
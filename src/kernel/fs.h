@@ -0,0 +1,79 @@
+#pragma once
+#include <stdint.h>
+
+// Flat file table with a list of directory paths, persisted to the start
+// of the ATA disk. Has no kernel dependencies beyond ata.h, so it also
+// builds on the host against a mock disk (build_host.sh).
+//
+// Each call below takes fs_lock and is atomic with respect to the
+// others. Entries and paths are copied in and out, so nothing outside
+// fs.cpp touches the tables unlocked. Indices are only stable until the
+// next call that adds or removes entries.
+
+// Table sizes; the host benchmark builds with much larger ones
+#ifndef MAX_FILES
+#define MAX_FILES 16
+#endif
+#ifndef MAX_DIRS
+#define MAX_DIRS 8
+#endif
+
+#define FS_PATH_MAX 32
+
+// On-disk file entry, stored in a 256-byte slot. Besides the inline
+// content a file can own a contiguous extent of sectors for bulk data.
+struct MockFile {
+  char name[32];
+  char parent_dir[32];
+  char content[128];
+  uint32_t data_lba;  // First sector of the data extent (0 = none)
+  uint32_t data_size; // Bytes in the extent
+};
+
+#define FS_SECTOR_SIZE 512
+
+// Loads the table from disk, formatting it with the default directories
+// if it holds no file system. Returns false if the disk can't be read.
+bool fs_init();
+void fs_save();
+
+int find_file(const char *name, const char *dir);
+// Copies file `idx` into `out`; returns false if there is no such file
+bool fs_get_file(int idx, MockFile *out);
+// Replaces file `idx`, typically with a copy from fs_get_file() that the
+// caller changed. Returns false if there is no such file. The caller saves.
+bool fs_set_file(int idx, const MockFile *f);
+
+// Creates an empty file in `dir`; returns its index or -1
+int fs_create(const char *name, const char *dir);
+int fs_file_count();
+// Deletes a file from the table; later indices shift down by one. The
+// caller saves.
+void fs_remove(int idx);
+
+// Copies the current directory into `out`, FS_PATH_MAX bytes
+void fs_current_dir(char *out);
+void fs_set_current_dir(const char *path);
+
+int fs_dir_count();
+// Copies directory `idx` into `out`, FS_PATH_MAX bytes; returns false if
+// there is no such directory
+bool fs_dir(int idx, char *out);
+// Returns the index of the directory `path`, or -1
+int find_dir(const char *path);
+
+// Makes `name` absolute relative to the current directory. Returns false
+// if the result doesn't fit in FS_PATH_MAX.
+bool fs_resolve(const char *name, char *path);
+
+// Adds a directory; returns false if the table is full. The caller saves.
+bool fs_mkdir(const char *path);
+
+// Removes the directory `path` with every file and directory below it,
+// moving the current directory to / if it was inside. Returns false if
+// there is no such directory. The caller saves.
+bool fs_remove_tree(const char *path);
+
+// Reserves `sectors` contiguous sectors in the data area and returns the
+// first LBA, or 0 if the disk area is exhausted
+uint32_t fs_alloc_data(uint32_t sectors);
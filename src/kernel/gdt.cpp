@@ -0,0 +1,56 @@
+#include "gdt.h"
+
+struct gdtr_t {
+  uint16_t limit;
+  uint64_t base;
+} __attribute__((packed));
+
+// Long mode ignores base and limit for code/data; what matters is
+// L (code), DPL and present
+static uint64_t gdt[7] = {
+    0,
+    0x00AF9A000000FFFF, // Kernel code: DPL 0, L
+    0x00CF92000000FFFF, // Kernel data
+    0x00CFF2000000FFFF, // User data: DPL 3
+    0x00AFFA000000FFFF, // User code: DPL 3, L
+    0,                  // TSS, filled in by gdt_init()
+    0,
+};
+
+static tss_t tss;
+static gdtr_t gdtr;
+
+void gdt_init() {
+  // No I/O bitmap: ring 3 gets no port access
+  tss.iomap_base = sizeof(tss);
+
+  // 16-byte system descriptor, type 0x9 (available 64-bit TSS)
+  uint64_t base = (uint64_t)&tss;
+  uint64_t limit = sizeof(tss) - 1;
+  gdt[5] = (limit & 0xFFFF) | ((base & 0xFFFFFF) << 16) | (0x89ull << 40) |
+           ((limit & 0xF0000) << 32) | ((base >> 24 & 0xFF) << 56);
+  gdt[6] = base >> 32;
+
+  gdtr.limit = sizeof(gdt) - 1;
+  gdtr.base = (uint64_t)gdt;
+  asm volatile("lgdt %0" : : "m"(gdtr));
+
+  // Reload CS with a far return, then the data segments. Nothing uses
+  // FS or GS, so they get the null selector rather than the boot GDT's.
+  asm volatile("pushq %0\n"
+               "leaq 1f(%%rip), %%rax\n"
+               "pushq %%rax\n"
+               "lretq\n"
+               "1:\n"
+               "movw %w1, %%ss\n"
+               "movw %w1, %%ds\n"
+               "movw %w1, %%es\n"
+               "movw %w2, %%fs\n"
+               "movw %w2, %%gs\n"
+               :
+               : "i"(GDT_KERNEL_CODE), "r"(GDT_KERNEL_DATA), "r"(0)
+               : "rax", "memory");
+  asm volatile("ltr %w0" : : "r"(GDT_TSS));
+}
+
+void tss_set_rsp0(uint64_t rsp) { tss.rsp0 = rsp; }
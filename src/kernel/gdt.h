@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+
+// Segment selectors. The order kernel code, kernel data, user data, user
+// code is what SYSCALL/SYSRET derive from the two bases in MSR_STAR.
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_DATA (0x18 | 3)
+#define GDT_USER_CODE (0x20 | 3)
+#define GDT_TSS 0x28
+
+// 64-bit task state segment: only the ring 0 stack is used
+struct tss_t {
+  uint32_t reserved0;
+  uint64_t rsp0;
+  uint64_t rsp1;
+  uint64_t rsp2;
+  uint64_t reserved1;
+  uint64_t ist[7];
+  uint64_t reserved2;
+  uint16_t reserved3;
+  uint16_t iomap_base;
+} __attribute__((packed));
+
+// Replaces the boot GDT with one that has ring 3 segments and a TSS
+void gdt_init();
+
+// Stack the CPU switches to when an interrupt arrives in ring 3
+void tss_set_rsp0(uint64_t rsp);
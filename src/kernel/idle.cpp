@@ -0,0 +1,113 @@
+#include "idle.h"
+#include "cmd.h"
+#include "cpu.h"
+#include "kstring.h"
+#include "term.h"
+
+static bool mwait_ok = false;
+
+// Residency counters, one cache line per CPU
+struct alignas(64) idle_stats {
+  uint64_t idle_cycles;
+  uint64_t sleeps;
+  uint64_t since; // TSC the counters were last cleared at
+  uint64_t asleep; // TSC the current sleep began at; 0 while awake
+};
+
+static idle_stats stats[MAX_CPUS];
+
+void idle_init() {
+  uint32_t a, b, c, d;
+  cpuid(1, 0, &a, &b, &c, &d);
+  mwait_ok = c & CPUID_1_ECX_MONITOR;
+  uint64_t now = rdtsc();
+  for (int i = 0; i < MAX_CPUS; i++)
+    stats[i].since = now;
+}
+
+void event_signal(event *e) {
+  __atomic_fetch_add(&e->seq, 1, __ATOMIC_RELEASE);
+}
+
+// Ends the sleep in progress, if any. Interrupts are off.
+static void wake(idle_stats *s) {
+  if (s->asleep) {
+    s->idle_cycles += rdtsc() - s->asleep;
+    s->asleep = 0;
+  }
+}
+
+void idle_irq_enter() { wake(&stats[cpu_id()]); }
+
+void idle_wait(const event *e, uint32_t seen) {
+  uint64_t flags = irq_save();
+  if (!(flags & RFLAGS_IF)) {
+    cpu_relax();
+    return;
+  }
+  // Interrupts stay off from the check to the sleep, so a signal can't
+  // slip in between and leave us asleep until the next tick. With MWAIT
+  // the monitor is armed first, so a write after the check also wakes us.
+  bool use_mwait = mwait_ok && e;
+  if (use_mwait)
+    monitor(&e->seq);
+  if (e && __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != seen) {
+    irq_restore(flags);
+    return;
+  }
+
+  idle_stats *s = &stats[cpu_id()];
+  s->asleep = rdtsc();
+  s->sleeps++;
+  if (use_mwait)
+    sti_mwait(0); // C1
+  else
+    sti_hlt();
+  // An interrupt stopped the clock on entry, so neither its handler nor
+  // its bottom halves count as idle. A monitored write wakes MWAIT without
+  // one.
+  flags = irq_save();
+  wake(s);
+  irq_restore(flags);
+}
+
+static void cmd_idle(char *args) {
+  uint64_t now = rdtsc();
+  if (kstrcmp(args, "reset") == 0) {
+    for (int i = 0; i < MAX_CPUS; i++) {
+      stats[i].idle_cycles = stats[i].sleeps = 0;
+      stats[i].since = now;
+    }
+    term_puts("Idle counters cleared.\n", COLOR_SUCCESS);
+    return;
+  }
+  if (args[0]) {
+    term_puts("Usage: idle [reset]\n", COLOR_ERROR);
+    return;
+  }
+
+  term_puts("Idle instruction: ");
+  term_puts(mwait_ok ? "MWAIT (HLT without an event)\n" : "HLT\n");
+  // CPUs that never slept aren't running
+  for (int i = 0; i < MAX_CPUS; i++) {
+    idle_stats *s = &stats[i];
+    if (!s->sleeps)
+      continue;
+    uint64_t total = now - s->since;
+    uint64_t permille = total ? s->idle_cycles * 1000 / total : 0;
+    term_puts("cpu");
+    term_put_uint(i);
+    term_puts(": ");
+    term_put_uint(permille / 10);
+    term_putc('.');
+    term_put_uint(permille % 10);
+    term_puts("% idle, ");
+    term_put_uint(s->sleeps);
+    term_puts(" sleeps, ");
+    term_put_uint(total / (tsc_hz ? tsc_hz : 1));
+    term_puts(" s\n");
+  }
+}
+
+COMMAND(idle, "idle [reset]", "Show idle residency per CPU", 0, 1,
+        cmd_idle);
@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+
+// Idle and wait-for-event. Waits halt the CPU until something can have
+// changed, instead of spinning: with MONITOR/MWAIT the CPU sleeps until
+// the event's word is written or an interrupt arrives, otherwise HLT
+// sleeps until the next interrupt. The 1 ms tick bounds every sleep.
+//
+// With interrupts disabled nothing could wake the CPU, so waits spin
+// instead; that keeps the API usable during boot.
+
+struct event {
+  uint32_t seq; // Bumped by every signal
+};
+
+// Detects MWAIT support and starts the residency clock
+void idle_init();
+
+// Stops the idle clock if the CPU was asleep, so interrupt handling isn't
+// counted as idle. Called first thing on interrupt entry.
+void idle_irq_enter();
+
+// Wakes every waiter on `e`. Safe from interrupt handlers.
+void event_signal(event *e);
+
+// Sleeps until `e` is signaled after the caller read `seen` from e->seq,
+// or until any interrupt. A null `e` just waits for an interrupt.
+void idle_wait(const event *e, uint32_t seen);
+
+// Sleeps until the next interrupt
+static inline void cpu_idle() { idle_wait(nullptr, 0); }
+
+// Blocks until cond() holds, rechecking each time `e` is signaled
+template <typename F> void wait_event(event *e, F cond) {
+  while (1) {
+    uint32_t seen = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+    if (cond())
+      return;
+    idle_wait(e, seen);
+  }
+}
+
+// Blocks until cond() holds, rechecking after every interrupt. For
+// conditions no handler signals, such as a device status bit.
+template <typename F> void wait_until(F cond) {
+  while (!cond())
+    cpu_idle();
+}
@@ -18,3 +18,36 @@ struct idtr_t {
 
 void idt_init();
 void idt_set_gate(uint8_t n, void *handler, uint8_t flags);
+// Raw gate access, to put back a gate borrowed with idt_set_gate()
+idt_entry_t idt_get_entry(uint8_t n);
+void idt_set_entry(uint8_t n, idt_entry_t e);
+
+// Frame pushed by the CPU on interrupt entry
+struct interrupt_frame {
+  uint64_t rip;
+  uint64_t cs;
+  uint64_t rflags;
+  uint64_t rsp;
+  uint64_t ss;
+};
+
+typedef void (*irq_handler_t)(interrupt_frame *frame);
+
+// Exception vectors 0x00 - 0x1F. A fault in ring 3 kills the running
+// process; one in the kernel halts with a panic message.
+const char *exception_name(uint64_t vector);
+
+// PIC IRQs are remapped to vectors 0x20 - 0x2F
+#define IRQ_BASE_VECTOR 0x20
+
+// Registers a handler for a PIC IRQ line and unmasks it. The handler runs
+// with interrupts disabled; EOI is sent after it returns. Handlers should
+// only acknowledge the device and queue the rest as an irq_work
+// (softirq.h).
+void irq_install(uint8_t irq, irq_handler_t handler);
+void irq_mask(uint8_t irq);
+void irq_unmask(uint8_t irq);
+
+// Adds a sample to the line's bottom-half latency histogram: the cycles
+// from queuing the work to its start
+void irq_note_bh_latency(uint8_t irq, uint64_t cycles);
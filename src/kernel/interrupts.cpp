@@ -1,12 +1,51 @@
 #include "idt.h"
+#include "cmd.h"
+#include "idle.h"
 #include "io.h"
+#include "ksyms.h"
+#include "kstring.h"
+#include "lock.h"
+#include "process.h"
+#include "softirq.h"
+#include "term.h"
+#include "trace.h"
 #include <stdint.h>
 
 static idt_entry_t idt[256];
 static idtr_t idtr;
 
-// Primitive handler template
-extern "C" void irq_common_stub();
+// Entry stubs from interrupts.asm, one per CPU exception and PIC IRQ line
+extern "C" void *isr_stub_table[32];
+extern "C" void *irq_stub_table[16];
+
+static irq_handler_t irq_handlers[16];
+static percpu_counter irq_counts[16];
+
+// Log2 histograms of cycles: bucket k counts samples in [2^k, 2^(k+1)),
+// and the last bucket everything above
+#define IRQ_HIST_BUCKETS 24
+
+struct irq_latency {
+  uint64_t top[IRQ_HIST_BUCKETS]; // Handler time, entry to EOI
+  uint64_t bh[IRQ_HIST_BUCKETS];  // Queue to start of the bottom half
+  uint64_t top_cycles;
+  uint64_t bh_cycles;
+  uint64_t bh_count;
+};
+
+static irq_latency latency[16];
+
+static void hist_add(uint64_t *hist, uint64_t cycles) {
+  int k = 63 - __builtin_clzll(cycles | 1);
+  hist[k < IRQ_HIST_BUCKETS ? k : IRQ_HIST_BUCKETS - 1]++;
+}
+
+void irq_note_bh_latency(uint8_t irq, uint64_t cycles) {
+  irq_latency *l = &latency[irq & 15];
+  hist_add(l->bh, cycles);
+  l->bh_cycles += cycles;
+  l->bh_count++;
+}
 
 void idt_set_gate(uint8_t n, void *handler, uint8_t flags) {
   uint64_t addr = (uint64_t)handler;
@@ -19,6 +58,10 @@ void idt_set_gate(uint8_t n, void *handler, uint8_t flags) {
   idt[n].reserved = 0;
 }
 
+idt_entry_t idt_get_entry(uint8_t n) { return idt[n]; }
+
+void idt_set_entry(uint8_t n, idt_entry_t e) { idt[n] = e; }
+
 void pic_remap() {
   // ICW1: Start initialization
   outb(0x20, 0x11);
@@ -36,31 +79,170 @@ void pic_remap() {
   outb(0x21, 0x01);
   outb(0xA1, 0x01);
 
-  // Mask all interrupts except for testing later
+  // Mask everything; lines are unmasked as handlers get installed
   outb(0x21, 0xFF);
   outb(0xA1, 0xFF);
 }
 
-// Stub for assembly to call back into C++
-extern "C" void irq_handler(uint64_t irq) {
-  // SB16 uses IRQ 5 by default
-  if (irq == 5) {
-    // SB16 Interrupt Logic will go here
-  }
+void irq_mask(uint8_t irq) {
+  uint16_t port = irq < 8 ? 0x21 : 0xA1;
+  outb(port, inb(port) | (1 << (irq & 7)));
+}
 
-  // Send EOI
+void irq_unmask(uint8_t irq) {
+  uint16_t port = irq < 8 ? 0x21 : 0xA1;
+  outb(port, inb(port) & ~(1 << (irq & 7)));
+  // Slave lines only arrive through the cascade on IRQ 2
   if (irq >= 8)
-    outb(0xA0, 0x20);
-  outb(0x20, 0x20);
+    outb(0x21, inb(0x21) & ~(1 << 2));
+}
+
+void irq_install(uint8_t irq, irq_handler_t handler) {
+  irq_handlers[irq] = handler;
+  irq_unmask(irq);
+}
+
+// Reads the PIC in-service register to filter spurious IRQ 7 / 15
+static bool pic_in_service(uint8_t irq) {
+  uint16_t port = irq < 8 ? 0x20 : 0xA0;
+  outb(port, 0x0B); // OCW3: read ISR
+  return inb(port) & (1 << (irq & 7));
 }
 
+TRACEPOINT(irq);
+
+// Called from irq_common_stub in interrupts.asm
+extern "C" void irq_handler(uint64_t irq, interrupt_frame *frame) {
+  idle_irq_enter();
+  {
+    TRACE_SCOPE(irq, irq, frame->rip);
+    uint64_t start = rdtsc();
+    if ((irq == 7 || irq == 15) && !pic_in_service(irq)) {
+      // Spurious: the slave still expects its cascade line acknowledged
+      if (irq == 15)
+        outb(0x20, 0x20);
+      return;
+    }
+
+    percpu_add(&irq_counts[irq], 1);
+    if (irq_handlers[irq])
+      irq_handlers[irq](frame);
+
+    // Send EOI
+    if (irq >= 8)
+      outb(0xA0, 0x20);
+    outb(0x20, 0x20);
+
+    uint64_t cycles = rdtsc() - start;
+    hist_add(latency[irq].top, cycles);
+    latency[irq].top_cycles += cycles;
+  }
+  softirq_run();
+}
+
+static const char *exception_names[32] = {
+    "divide error", "debug", "NMI", "breakpoint", "overflow",
+    "bound range", "invalid opcode", "device not available", "double fault",
+    "coprocessor overrun", "invalid TSS", "segment not present",
+    "stack fault", "general protection fault", "page fault", "reserved",
+    "x87 error", "alignment check", "machine check", "SIMD error",
+    "virtualization", "control protection", "reserved", "reserved",
+    "reserved", "reserved", "reserved", "reserved", "hypervisor injection",
+    "VMM communication", "security", "reserved"};
+
+const char *exception_name(uint64_t vector) {
+  return vector < 32 ? exception_names[vector] : "unknown";
+}
+
+// Called from isr_common_stub in interrupts.asm
+extern "C" void exception_handler(uint64_t vector, uint64_t error,
+                                  interrupt_frame *frame) {
+  if ((frame->cs & 3) == 3)
+    process_fault(vector, error, frame);
+
+  uint64_t cr2;
+  asm volatile("mov %%cr2, %0" : "=r"(cr2));
+  term_break_lock();
+  term_puts("\nKERNEL PANIC: ", COLOR_ERROR);
+  term_puts(exception_name(vector), COLOR_ERROR);
+  term_puts(" at rip ", COLOR_ERROR);
+  term_put_hex(frame->rip, COLOR_ERROR);
+  term_putc(' ', COLOR_ERROR);
+  ksym_print(frame->rip, COLOR_ERROR);
+  term_puts(" error ", COLOR_ERROR);
+  term_put_hex(error, COLOR_ERROR);
+  if (vector == 14) {
+    term_puts(" cr2 ", COLOR_ERROR);
+    term_put_hex(cr2, COLOR_ERROR);
+  }
+  term_putc('\n');
+  while (1)
+    asm volatile("cli; hlt");
+}
+
+static void print_histograms(int irq) {
+  irq_latency *l = &latency[irq];
+  term_puts("cycles >=      top half  bottom half\n", COLOR_PROMPT);
+  for (int k = 0; k < IRQ_HIST_BUCKETS; k++) {
+    if (!l->top[k] && !l->bh[k])
+      continue;
+    term_put_column(1ull << k, 9);
+    term_put_column(l->top[k], 14);
+    term_put_column(l->bh[k], 13);
+    term_putc('\n');
+  }
+}
+
+static void cmd_irqstat(char *args) {
+  if (kstrcmp(args, "reset") == 0) {
+    uint64_t flags = irq_save();
+    for (int irq = 0; irq < 16; irq++) {
+      irq_counts[irq] = percpu_counter();
+      latency[irq] = irq_latency();
+    }
+    irq_restore(flags);
+    term_puts("IRQ statistics cleared.\n", COLOR_SUCCESS);
+    return;
+  }
+  if (args[0]) {
+    int irq = 0;
+    for (; *args >= '0' && *args <= '9'; args++)
+      irq = irq * 10 + (*args - '0');
+    if (*args || irq > 15) {
+      term_puts("Usage: irqstat [irq|reset]\n", COLOR_ERROR);
+      return;
+    }
+    print_histograms(irq);
+    return;
+  }
+
+  term_puts("irq     count  avg top  avg bh delay\n", COLOR_PROMPT);
+  for (int irq = 0; irq < 16; irq++) {
+    uint64_t count = percpu_sum(&irq_counts[irq]);
+    if (!count)
+      continue;
+    irq_latency *l = &latency[irq];
+    term_put_column(irq, 3);
+    term_put_column(count, 10);
+    term_put_column(l->top_cycles / count, 9);
+    term_put_column(l->bh_count ? l->bh_cycles / l->bh_count : 0, 14);
+    term_putc('\n');
+  }
+}
+
+COMMAND(irqstat, "irqstat [irq|reset]",
+        "Show interrupt counts and latencies (cycles) per IRQ line", 0, 1,
+        cmd_irqstat);
+
 void idt_init() {
   idtr.limit = (uint16_t)sizeof(idt_entry_t) * 256 - 1;
   idtr.base = (uint64_t)&idt;
 
-  for (int i = 0; i < 256; i++) {
-    // Just fill with nulls initially, or a dummy holder
-  }
+  // Present, DPL 0, 64-bit interrupt gate
+  for (int i = 0; i < 32; i++)
+    idt_set_gate(i, isr_stub_table[i], 0x8E);
+  for (int i = 0; i < 16; i++)
+    idt_set_gate(IRQ_BASE_VECTOR + i, irq_stub_table[i], 0x8E);
 
   pic_remap();
 
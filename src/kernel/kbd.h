@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+
+// PS/2 keyboard (main.cpp). IRQ 1 queues scancodes in a ring, and readers
+// sleep until one arrives instead of polling the controller.
+
+// Enables the controller's keyboard interrupt and installs its handler
+void kbd_init();
+// Takes the next scancode if one is queued
+bool kbd_poll(uint8_t *scancode);
+// Sleeps until a scancode is queued and returns it
+uint8_t kbd_scancode();
+// Drops every queued scancode
+void kbd_flush();
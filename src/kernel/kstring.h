@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+
+// String and memory helpers for freestanding kernel code
+
+int kstrlen(const char *s);
+int kstrcmp(const char *s1, const char *s2);
+// Compares up to `n` characters; a shorter s1 that matches so far is equal
+int kstrncmp(const char *s1, const char *s2, int n);
+void kstrcpy(char *dest, const char *src);
+void kstrcat(char *dest, const char *src);
+
+void kmemcpy(void *dest, const void *src, uint64_t n);
+void kmemset(void *dest, uint8_t value, uint64_t n);
@@ -0,0 +1,46 @@
+#include "ksyms.h"
+#include "term.h"
+
+// Bounds of the .ksyms section, from linker.ld
+extern "C" const uint8_t ksyms_start[], ksyms_end[];
+
+struct ksym_table {
+  uint64_t count;
+  ksym entries[]; // Sorted by address
+};
+
+static const ksym_table *table() {
+  return (const ksym_table *)ksyms_start;
+}
+
+int ksym_count() {
+  return ksyms_end - ksyms_start > 0 ? (int)table()->count : 0;
+}
+
+const ksym *ksym_get(int idx) { return &table()->entries[idx]; }
+
+int ksym_find(uint64_t addr) {
+  int lo = 0, hi = ksym_count() - 1, found = -1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (table()->entries[mid].addr <= addr) {
+      found = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return found;
+}
+
+void ksym_print(uint64_t addr, uint8_t color) {
+  int idx = ksym_find(addr);
+  if (idx < 0)
+    return;
+  const ksym *s = ksym_get(idx);
+  term_putc('<', color);
+  term_puts(s->name, color);
+  term_putc('+', color);
+  term_put_hex(addr - s->addr, color);
+  term_putc('>', color);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+
+// Kernel function names, embedded in the .ksyms section by build.sh from
+// a first link of the image (tools/ksyms.awk). Empty in that first link.
+
+struct ksym {
+  uint64_t addr;
+  const char *name;
+};
+
+int ksym_count();
+const ksym *ksym_get(int idx);
+
+// Index of the function containing `addr`, or -1 if it precedes them all
+int ksym_find(uint64_t addr);
+
+// Prints `<name+0xoffset>` for a code address
+void ksym_print(uint64_t addr, uint8_t color);
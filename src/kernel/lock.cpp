@@ -0,0 +1,146 @@
+#include "lock.h"
+#include "cmd.h"
+#include "kstring.h"
+#include "term.h"
+
+// Bounds of the .tacos_locks section, from linker.ld
+extern "C" lock_stats lock_table_start[], lock_table_end[];
+
+// Called with the lock held, so the counts need no atomics
+static void account(lock_stats *stats, uint64_t wait_start) {
+  if (!stats)
+    return;
+  stats->acquires++;
+  if (wait_start) {
+    stats->contended++;
+    stats->spin_cycles += rdtsc() - wait_start;
+  }
+}
+
+void spin_lock(spinlock *l) {
+  uint16_t ticket = __atomic_fetch_add(&l->next, 1, __ATOMIC_RELAXED);
+  uint64_t wait_start = 0;
+  if (__atomic_load_n(&l->owner, __ATOMIC_ACQUIRE) != ticket) {
+    wait_start = rdtsc();
+    while (__atomic_load_n(&l->owner, __ATOMIC_ACQUIRE) != ticket)
+      cpu_relax();
+  }
+  account(l->stats, wait_start);
+}
+
+void spin_unlock(spinlock *l) {
+  __atomic_store_n(&l->owner, (uint16_t)(l->owner + 1), __ATOMIC_RELEASE);
+}
+
+uint64_t spin_lock_irqsave(spinlock *l) {
+  uint64_t flags = irq_save();
+  spin_lock(l);
+  return flags;
+}
+
+void spin_unlock_irqrestore(spinlock *l, uint64_t flags) {
+  spin_unlock(l);
+  irq_restore(flags);
+}
+
+void read_lock(rwlock *l) {
+  uint64_t wait_start = 0;
+  uint32_t state = __atomic_load_n(&l->state, __ATOMIC_RELAXED);
+  while (1) {
+    if (!(state & RWLOCK_WRITER) &&
+        __atomic_compare_exchange_n(&l->state, &state, state + 1, true,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      break;
+    if (state & RWLOCK_WRITER) {
+      if (!wait_start)
+        wait_start = rdtsc();
+      cpu_relax();
+      state = __atomic_load_n(&l->state, __ATOMIC_RELAXED);
+    }
+  }
+  // Readers share the lock, so only their waiting is counted
+  if (l->stats && wait_start) {
+    __atomic_fetch_add(&l->stats->contended, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&l->stats->spin_cycles, rdtsc() - wait_start,
+                       __ATOMIC_RELAXED);
+  }
+  if (l->stats)
+    __atomic_fetch_add(&l->stats->acquires, 1, __ATOMIC_RELAXED);
+}
+
+void read_unlock(rwlock *l) {
+  __atomic_fetch_sub(&l->state, 1, __ATOMIC_RELEASE);
+}
+
+void write_lock(rwlock *l) {
+  uint64_t wait_start = 0;
+  // Claim the writer bit, then wait for the readers inside to leave
+  uint32_t state = __atomic_load_n(&l->state, __ATOMIC_RELAXED);
+  while (1) {
+    if (!(state & RWLOCK_WRITER) &&
+        __atomic_compare_exchange_n(&l->state, &state,
+                                    state | RWLOCK_WRITER, true,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      break;
+    if (state & RWLOCK_WRITER) {
+      if (!wait_start)
+        wait_start = rdtsc();
+      cpu_relax();
+      state = __atomic_load_n(&l->state, __ATOMIC_RELAXED);
+    }
+  }
+  if (__atomic_load_n(&l->state, __ATOMIC_ACQUIRE) != RWLOCK_WRITER) {
+    if (!wait_start)
+      wait_start = rdtsc();
+    while (__atomic_load_n(&l->state, __ATOMIC_ACQUIRE) != RWLOCK_WRITER)
+      cpu_relax();
+  }
+  account(l->stats, wait_start);
+}
+
+void write_unlock(rwlock *l) {
+  __atomic_fetch_and(&l->state, ~RWLOCK_WRITER, __ATOMIC_RELEASE);
+}
+
+uint64_t write_seqlock_irqsave(seqlock *s) {
+  uint64_t flags = spin_lock_irqsave(&s->lock);
+  __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  return flags;
+}
+
+void write_sequnlock_irqrestore(seqlock *s, uint64_t flags) {
+  __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+  spin_unlock_irqrestore(&s->lock, flags);
+}
+
+#define LOCKSTAT_NAME_WIDTH 16
+
+static void cmd_lockstat(char *args) {
+  if (kstrcmp(args, "reset") == 0) {
+    for (lock_stats *s = lock_table_start; s < lock_table_end; s++)
+      s->acquires = s->contended = s->spin_cycles = 0;
+    term_puts("Lock statistics cleared.\n", COLOR_SUCCESS);
+    return;
+  }
+  if (args[0]) {
+    term_puts("Usage: lockstat [reset]\n", COLOR_ERROR);
+    return;
+  }
+
+  term_puts("lock              acquires contended  avg wait (cycles)\n",
+            COLOR_PROMPT);
+  for (lock_stats *s = lock_table_start; s < lock_table_end; s++) {
+    int len = kstrlen(s->name);
+    term_puts(s->name);
+    while (len++ < LOCKSTAT_NAME_WIDTH)
+      term_putc(' ');
+    term_put_column(s->acquires, 10);
+    term_put_column(s->contended, 10);
+    term_put_column(s->contended ? s->spin_cycles / s->contended : 0, 10);
+    term_putc('\n');
+  }
+}
+
+COMMAND(lockstat, "lockstat [reset]", "Show lock contention counts", 0, 1,
+        cmd_lockstat);
@@ -0,0 +1,149 @@
+#pragma once
+#include "cpu.h"
+#include <stdint.h>
+
+// Synchronization primitives: ticket spinlocks, reader-writer locks,
+// seqlocks and per-CPU counters. There is one CPU today, so what the
+// locks buy now is the _irqsave variants, which keep interrupt handlers
+// out of state the interrupted code is changing. The spinning paths are
+// what the same code will need once there are more CPUs.
+//
+// Locks defined with DEFINE_SPINLOCK()/DEFINE_RWLOCK() count acquisitions
+// and the cycles spent waiting; `lockstat` lists them.
+
+struct lock_stats {
+  const char *name;
+  uint64_t acquires;
+  uint64_t contended;   // Acquisitions that had to wait
+  uint64_t spin_cycles; // TSC cycles spent waiting
+};
+
+// Places the stats of `name` in the .tacos_locks section
+#define LOCK_STATS(name)                                                     \
+  [[gnu::used, gnu::section(".tacos_locks"), gnu::aligned(8)]]               \
+  static lock_stats name##_stats = {#name, 0, 0, 0}
+
+// --- Ticket spinlock: waiters are served in arrival order ---
+
+struct spinlock {
+  uint16_t next;  // Next ticket to hand out
+  uint16_t owner; // Ticket being served
+  lock_stats *stats; // Optional
+};
+
+#define SPINLOCK_INIT {0, 0, nullptr}
+
+#define DEFINE_SPINLOCK(name)                                                \
+  LOCK_STATS(name);                                                          \
+  static spinlock name = {0, 0, &name##_stats}
+
+void spin_lock(spinlock *l);
+void spin_unlock(spinlock *l);
+
+// Disables interrupts, then takes the lock. Returns the RFLAGS to restore.
+uint64_t spin_lock_irqsave(spinlock *l);
+void spin_unlock_irqrestore(spinlock *l, uint64_t flags);
+
+// Holds `l` with interrupts disabled until the end of the scope
+struct spin_guard {
+  spinlock *l;
+  uint64_t flags;
+
+  explicit spin_guard(spinlock *lock)
+      : l(lock), flags(spin_lock_irqsave(lock)) {}
+  ~spin_guard() { spin_unlock_irqrestore(l, flags); }
+  spin_guard(const spin_guard &) = delete;
+  spin_guard &operator=(const spin_guard &) = delete;
+};
+
+// --- Reader-writer spinlock. A waiting writer stops new readers, so a
+// stream of readers can't starve it. ---
+
+struct rwlock {
+  uint32_t state; // RWLOCK_WRITER, plus the number of readers inside
+  lock_stats *stats;
+};
+
+#define RWLOCK_WRITER (1u << 31)
+#define RWLOCK_INIT {0, nullptr}
+
+#define DEFINE_RWLOCK(name)                                                  \
+  LOCK_STATS(name);                                                          \
+  static rwlock name = {0, &name##_stats}
+
+void read_lock(rwlock *l);
+void read_unlock(rwlock *l);
+void write_lock(rwlock *l);
+void write_unlock(rwlock *l);
+
+struct read_guard {
+  rwlock *l;
+
+  explicit read_guard(rwlock *lock) : l(lock) { read_lock(l); }
+  ~read_guard() { read_unlock(l); }
+  read_guard(const read_guard &) = delete;
+  read_guard &operator=(const read_guard &) = delete;
+};
+
+struct write_guard {
+  rwlock *l;
+
+  explicit write_guard(rwlock *lock) : l(lock) { write_lock(l); }
+  ~write_guard() { write_unlock(l); }
+  write_guard(const write_guard &) = delete;
+  write_guard &operator=(const write_guard &) = delete;
+};
+
+// --- Seqlock: readers never block the writer; they retry if a write
+// overlapped their read ---
+//
+//   uint32_t seq;
+//   do {
+//     seq = read_seqbegin(&s);
+//     ... copy the data ...
+//   } while (read_seqretry(&s, seq));
+
+struct seqlock {
+  uint32_t seq; // Odd while a write is in progress
+  spinlock lock; // Serializes writers
+};
+
+#define SEQLOCK_INIT {0, SPINLOCK_INIT}
+
+uint64_t write_seqlock_irqsave(seqlock *s);
+void write_sequnlock_irqrestore(seqlock *s, uint64_t flags);
+
+static inline uint32_t read_seqbegin(const seqlock *s) {
+  uint32_t seq;
+  while ((seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE)) & 1)
+    cpu_relax();
+  return seq;
+}
+
+static inline bool read_seqretry(const seqlock *s, uint32_t seq) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq;
+}
+
+// --- Per-CPU counter: each CPU adds to its own cache line without a
+// locked instruction; reads sum the lines ---
+
+struct alignas(64) percpu_slot {
+  uint64_t value;
+};
+
+struct percpu_counter {
+  percpu_slot slot[MAX_CPUS];
+};
+
+// A single add instruction can't be split by an interrupt on this CPU
+static inline void percpu_add(percpu_counter *c, uint64_t n) {
+  asm volatile("addq %1, %0" : "+m"(c->slot[cpu_id()].value) : "r"(n));
+}
+
+static inline uint64_t percpu_sum(const percpu_counter *c) {
+  uint64_t sum = 0;
+  for (int i = 0; i < MAX_CPUS; i++)
+    sum += __atomic_load_n(&c->slot[i].value, __ATOMIC_RELAXED);
+  return sum;
+}
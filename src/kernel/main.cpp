@@ -1,18 +1,41 @@
+#include "acpi.h"
+#include "ata.h"
+#include "bootbench.h"
+#include "cmd.h"
+#include "cpu.h"
+#include "fs.h"
+#include "gdt.h"
+#include "idle.h"
 #include "idt.h"
 #include "io.h"
+#include "kbd.h"
+#include "kstring.h"
+#include "lock.h"
+#include "mixer.h"
+#include "multiboot.h"
+#include "paging.h"
+#include "pipe.h"
+#include "pit.h"
+#include "pmm.h"
+#include "process.h"
+#include "rtc.h"
 #include "sb16.h"
+#include "serial.h"
+#include "speaker.h"
+#include "synth.h"
+#include "syscall.h"
+#include "term.h"
+#include "timer.h"
+#include "trace.h"
+#include "vdso.h"
+#include "wav.h"
 #include <stdbool.h>
 #include <stdint.h>
 
 // --- VGA Text Mode Constants & State ---
 #define VGA_WIDTH 80
 #define VGA_HEIGHT 25
-#define VGA_BUFFER ((volatile uint16_t *)0xB8000)
-#define COLOR_DEFAULT 0x07 // Light Gray on Black
-#define COLOR_PROMPT 0x0B  // Cyan on Black
-#define COLOR_LOGO 0x0E    // Yellow on Black
-#define COLOR_SUCCESS 0x0A // Light Green on Black
-#define COLOR_ERROR 0x0C   // Light Red on Black
+#define VGA_BUFFER ((volatile uint16_t *)phys_to_virt(0xB8000))
 
 static int cursor_x = 0;
 static int cursor_y = 0;
@@ -25,24 +48,48 @@ void update_cursor() {
   outb(0x3D5, (uint8_t)(pos & 0xFF));
   outb(0x3D4, 0x0E);
   outb(0x3D5, (uint8_t)((pos >> 8) & 0xFF));
+  // Push out anything still sitting in the write-combining buffers
+  sfence();
+}
+
+// Fills `count` cells starting at `start` using 64-bit stores, so that with
+// write-combining each store fills 8 bytes of a WC buffer instead of 2.
+void vga_fill(int start, int count, uint16_t cell) {
+  volatile uint16_t *dst = VGA_BUFFER + start;
+  while (count > 0 && ((uint64_t)dst & 7)) {
+    *dst++ = cell;
+    count--;
+  }
+  uint64_t quad = cell * 0x0001000100010001ull;
+  volatile uint64_t *dst64 = (volatile uint64_t *)dst;
+  for (; count >= 4; count -= 4)
+    *dst64++ = quad;
+  dst = (volatile uint16_t *)dst64;
+  while (count-- > 0)
+    *dst++ = cell;
 }
 
 void scroll() {
   if (cursor_y >= VGA_HEIGHT) {
-    for (int y = 0; y < VGA_HEIGHT - 1; y++) {
-      for (int x = 0; x < VGA_WIDTH; x++) {
-        VGA_BUFFER[y * VGA_WIDTH + x] = VGA_BUFFER[(y + 1) * VGA_WIDTH + x];
-      }
-    }
-    for (int x = 0; x < VGA_WIDTH; x++) {
-      VGA_BUFFER[(VGA_HEIGHT - 1) * VGA_WIDTH + x] =
-          (uint16_t)' ' | (COLOR_DEFAULT << 8);
-    }
+    // A row is 160 bytes, so rows can be moved as 20 quadwords each
+    volatile uint64_t *vga64 = (volatile uint64_t *)VGA_BUFFER;
+    for (int i = 0; i < (VGA_HEIGHT - 1) * VGA_WIDTH / 4; i++)
+      vga64[i] = vga64[i + VGA_WIDTH / 4];
+    vga_fill((VGA_HEIGHT - 1) * VGA_WIDTH, VGA_WIDTH,
+             (uint16_t)' ' | (COLOR_DEFAULT << 8));
     cursor_y = VGA_HEIGHT - 1;
   }
 }
 
-void term_putc(char c, uint8_t color = COLOR_DEFAULT) {
+// Guards the cursor and the screen contents. Taken after the pipe check,
+// since a full pipe runs the next stage, which prints.
+DEFINE_SPINLOCK(term_lock);
+
+void term_putc(char c, uint8_t color) {
+  // Errors stay on the console, like stderr
+  if (color != COLOR_ERROR && pipe_putc(c))
+    return;
+  spin_guard guard(&term_lock);
   if (c == '\n') {
     cursor_x = 0;
     cursor_y++;
@@ -66,241 +113,151 @@ void term_putc(char c, uint8_t color = COLOR_DEFAULT) {
   update_cursor();
 }
 
-void term_puts(const char *s, uint8_t color = COLOR_DEFAULT) {
+void term_puts(const char *s, uint8_t color) {
   for (int i = 0; s[i] != '\0'; i++)
     term_putc(s[i], color);
 }
 
-void clear_screen() {
-  for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) {
-    VGA_BUFFER[i] = (uint16_t)' ' | (COLOR_DEFAULT << 8);
-  }
-  cursor_x = 0;
-  cursor_y = 0;
-  update_cursor();
+void term_put_uint(uint64_t n, uint8_t color) {
+  char buf[21];
+  int i = 0;
+  do {
+    buf[i++] = (n % 10) + '0';
+    n /= 10;
+  } while (n > 0);
+  while (i > 0)
+    term_putc(buf[--i], color);
 }
 
-// --- Keyboard Handling (Polling) ---
-uint8_t kbd_scancode() {
-  while (!(inb(0x64) & 1))
-    ; // Wait for data
-  return inb(0x60);
+void term_put_column(uint64_t n, int width) {
+  int digits = 1;
+  for (uint64_t v = n; v >= 10; v /= 10)
+    digits++;
+  while (digits++ < width)
+    term_putc(' ');
+  term_put_uint(n);
 }
 
-char scancode_to_ascii(uint8_t scancode) {
-  if (scancode & 0x80)
-    return 0; // Ignore release codes
-  static const char kbd_map[] = {
-      0,   27,  '1',  '2',  '3',  '4', '5', '6',  '7', '8', '9', '0',
-      '-', '=', '\b', '\t', 'q',  'w', 'e', 'r',  't', 'y', 'u', 'i',
-      'o', 'p', '[',  ']',  '\n', 0,   'a', 's',  'd', 'f', 'g', 'h',
-      'j', 'k', 'l',  ';',  '\'', '`', 0,   '\\', 'z', 'x', 'c', 'v',
-      'b', 'n', 'm',  ',',  '.',  '/', 0,   '*',  0,   ' '};
-  if (scancode < sizeof(kbd_map))
-    return kbd_map[scancode];
-  return 0;
+void term_put_hex(uint64_t n, uint8_t color) {
+  term_puts("0x", color);
+  int shift = 60;
+  while (shift > 0 && !((n >> shift) & 0xF))
+    shift -= 4;
+  for (; shift >= 0; shift -= 4)
+    term_putc("0123456789ABCDEF"[(n >> shift) & 0xF], color);
 }
 
-// --- Mock Filesystem State ---
-#define MAX_FILES 16
-#define MAX_DIRS 8
-struct MockFile {
-  char name[32];
-  char parent_dir[32];
-  char content[128];
-};
-static MockFile file_system[MAX_FILES];
-static int file_count = 0;
-static char current_dir[32] = "/";
-
-static char valid_dirs[MAX_DIRS][32];
-static int dir_count = 0;
-
-// --- String Helpers ---
-int kstrlen(const char *s) {
-  int i = 0;
-  while (s[i])
-    i++;
-  return i;
-}
+void term_break_lock() { term_lock.owner = term_lock.next; }
 
-int kstrcmp(const char *s1, const char *s2) {
-  while (*s1 && (*s1 == *s2)) {
-    s1++;
-    s2++;
-  }
-  return *(unsigned char *)s1 - *(unsigned char *)s2;
-}
-
-int kstrncmp(const char *s1, const char *s2, int n) {
-  while (n > 0 && *s1 && (*s1 == *s2)) {
-    s1++;
-    s2++;
-    n--;
-  }
-  if (n == 0)
-    return 0;
-  if (*s1 == '\0' && n > 0)
-    return 0; // Fixed: technically kstrncmp doesn't care if s1 is shorter if
-              // match so far
-  return *(unsigned char *)s1 - *(unsigned char *)s2;
+void clear_screen() {
+  spin_guard guard(&term_lock);
+  vga_fill(0, VGA_WIDTH * VGA_HEIGHT, (uint16_t)' ' | (COLOR_DEFAULT << 8));
+  cursor_x = 0;
+  cursor_y = 0;
+  update_cursor();
 }
 
-void kstrcpy(char *dest, const char *src) {
-  while ((*dest++ = *src++))
-    ;
-}
+// Maps the legacy VGA hole and any linear framebuffer as write-combining.
+// Returns false if the CPU has no PAT.
+bool vga_init_memtype() {
+  if (!pat_init())
+    return false;
+  paging_set_memtype((uint64_t)phys_to_virt(0xA0000), 0x20000, MEM_WC);
 
-void kstrcat(char *dest, const char *src) {
-  int i = kstrlen(dest);
-  int j = 0;
-  while (src[j])
-    dest[i++] = src[j++];
-  dest[i] = '\0';
+  const mb2_tag_framebuffer *fb =
+      (const mb2_tag_framebuffer *)mb2_find_tag(MB2_TAG_FRAMEBUFFER);
+  if (fb && fb->fb_type != 2) // EGA text lives in the VGA hole already
+    paging_map_mmio(fb->addr, (uint64_t)fb->pitch * fb->height, MEM_WC);
+  return true;
 }
 
-// --- ATA PIO Driver (Basic) ---
-#define ATA_PRIMARY_DATA 0x1F0
-#define ATA_PRIMARY_ERR 0x1F1
-#define ATA_PRIMARY_SECCOUNT 0x1F2
-#define ATA_PRIMARY_LBA_LO 0x1F3
-#define ATA_PRIMARY_LBA_MID 0x1F4
-#define ATA_PRIMARY_LBA_HI 0x1F5
-#define ATA_PRIMARY_DRIVE_SEL 0x1F6
-#define ATA_PRIMARY_COMMAND 0x1F7
-#define ATA_PRIMARY_STATUS 0x1F7
-
-// --- ATA PIO Driver (Basic) ---
-#define ATA_PRIMARY_DATA 0x1F0
-#define ATA_PRIMARY_ERR 0x1F1
-#define ATA_PRIMARY_SECCOUNT 0x1F2
-#define ATA_PRIMARY_LBA_LO 0x1F3
-#define ATA_PRIMARY_LBA_MID 0x1F4
-#define ATA_PRIMARY_LBA_HI 0x1F5
-#define ATA_PRIMARY_DRIVE_SEL 0x1F6
-#define ATA_PRIMARY_COMMAND 0x1F7
-#define ATA_PRIMARY_STATUS 0x1F7
-
-// Returns true if successful, false on timeout
-bool ata_wait_bsy() {
-  int timeout = 100000;
-  while (inb(ATA_PRIMARY_STATUS) & 0x80) {
-    if (--timeout == 0)
-      return false;
-  }
-  return true;
+// --- Keyboard Handling ---
+#define KBD_DATA 0x60
+#define KBD_STATUS 0x64 // The command register when written
+#define KBD_STATUS_OUT_FULL 0x01
+#define KBD_STATUS_IN_FULL 0x02
+#define KBD_CMD_READ_CONFIG 0x20
+#define KBD_CMD_WRITE_CONFIG 0x60
+#define KBD_CONFIG_IRQ1 0x01
+#define KBD_TIMEOUT_US 10000
+#define KBD_RING_SIZE 64 // Power of two
+
+// Single producer (IRQ 1) / single consumer (foreground) ring.
+// Indices are free-running.
+static uint8_t kbd_ring[KBD_RING_SIZE];
+static volatile uint32_t kbd_head = 0;
+static volatile uint32_t kbd_tail = 0;
+static event kbd_event;
+
+static void kbd_irq(interrupt_frame *) {
+  uint8_t scancode = inb(KBD_DATA);
+  uint32_t head = kbd_head;
+  if (head - kbd_tail == KBD_RING_SIZE)
+    return; // Full: drop the key
+  kbd_ring[head & (KBD_RING_SIZE - 1)] = scancode;
+  asm volatile("" : : : "memory"); // Scancode in place before the head
+  kbd_head = head + 1;
+  event_signal(&kbd_event);
 }
 
-// Returns true if successful, false on timeout
-bool ata_wait_drq() {
-  int timeout = 100000;
-  while (!(inb(ATA_PRIMARY_STATUS) & 0x08)) {
-    if (--timeout == 0)
+// Waits for the controller to take a byte or to have one for us
+static bool kbd_wait_status(uint8_t mask, bool set) {
+  uint64_t deadline = deadline_us(KBD_TIMEOUT_US);
+  while (!!(inb(KBD_STATUS) & mask) != set) {
+    if (deadline_passed(deadline))
       return false;
   }
   return true;
 }
 
-bool ata_read_sector(uint32_t lba, uint16_t *buffer) {
-  outb(ATA_PRIMARY_DRIVE_SEL, 0xE0 | ((lba >> 24) & 0x0F));
-  outb(ATA_PRIMARY_SECCOUNT, 1);
-  outb(ATA_PRIMARY_LBA_LO, (uint8_t)lba);
-  outb(ATA_PRIMARY_LBA_MID, (uint8_t)(lba >> 8));
-  outb(ATA_PRIMARY_LBA_HI, (uint8_t)(lba >> 16));
-  outb(ATA_PRIMARY_COMMAND, 0x20); // Read sectors
-
-  if (!ata_wait_bsy())
-    return false;
-  if (!ata_wait_drq())
-    return false;
-
-  for (int i = 0; i < 256; i++) {
-    buffer[i] = inw(ATA_PRIMARY_DATA);
+void kbd_init() {
+  while (inb(KBD_STATUS) & KBD_STATUS_OUT_FULL)
+    inb(KBD_DATA); // Drop keys pressed during boot
+
+  // The firmware normally leaves the interrupt on; make sure of it
+  if (kbd_wait_status(KBD_STATUS_IN_FULL, false)) {
+    outb(KBD_STATUS, KBD_CMD_READ_CONFIG);
+    if (kbd_wait_status(KBD_STATUS_OUT_FULL, true)) {
+      uint8_t config = inb(KBD_DATA);
+      if (kbd_wait_status(KBD_STATUS_IN_FULL, false)) {
+        outb(KBD_STATUS, KBD_CMD_WRITE_CONFIG);
+        if (kbd_wait_status(KBD_STATUS_IN_FULL, false))
+          outb(KBD_DATA, config | KBD_CONFIG_IRQ1);
+      }
+    }
   }
-  return true;
+  irq_install(1, kbd_irq);
 }
 
-bool ata_write_sector(uint32_t lba, uint16_t *buffer) {
-  outb(ATA_PRIMARY_DRIVE_SEL, 0xE0 | ((lba >> 24) & 0x0F));
-  outb(ATA_PRIMARY_SECCOUNT, 1);
-  outb(ATA_PRIMARY_LBA_LO, (uint8_t)lba);
-  outb(ATA_PRIMARY_LBA_MID, (uint8_t)(lba >> 8));
-  outb(ATA_PRIMARY_LBA_HI, (uint8_t)(lba >> 16));
-  outb(ATA_PRIMARY_COMMAND, 0x30); // Write sectors
-
-  if (!ata_wait_bsy())
-    return false;
-  if (!ata_wait_drq())
-    return false;
-
-  for (int i = 0; i < 256; i++) {
-    outw(ATA_PRIMARY_DATA, buffer[i]);
-  }
-  // Flush
-  if (!ata_wait_bsy())
+bool kbd_poll(uint8_t *scancode) {
+  uint32_t tail = kbd_tail;
+  if (tail == kbd_head)
     return false;
+  *scancode = kbd_ring[tail & (KBD_RING_SIZE - 1)];
+  kbd_tail = tail + 1;
   return true;
 }
 
-// --- RTC (Real-Time Clock) Driver ---
-#define CMOS_ADDRESS 0x70
-#define CMOS_DATA 0x71
-
-uint8_t get_rtc_register(int reg) {
-  outb(CMOS_ADDRESS, reg);
-  return inb(CMOS_DATA);
-}
-
-// Check if RTC "Update In Progress" flag is set
-int get_update_in_progress_flag() {
-  outb(CMOS_ADDRESS, 0x0A);
-  return (inb(CMOS_DATA) & 0x80);
+uint8_t kbd_scancode() {
+  uint8_t scancode;
+  wait_event(&kbd_event, [&] { return kbd_poll(&scancode); });
+  return scancode;
 }
 
-// Convert Binary Coded Decimal to Binary
-uint8_t bcd2bin(uint8_t bcd) { return ((bcd / 16) * 10) + (bcd & 0x0F); }
-
-struct DateTime {
-  uint8_t second;
-  uint8_t minute;
-  uint8_t hour;
-  uint8_t day;
-  uint8_t month;
-  uint16_t year;
-};
-
-// Global startup time for `uptime`
-static DateTime boot_time;
-
-void read_rtc(DateTime *dt) {
-  uint8_t status_b;
-
-  // Wait until RTC is not updating
-  while (get_update_in_progress_flag())
-    ;
+void kbd_flush() { kbd_tail = kbd_head; }
 
-  dt->second = get_rtc_register(0x00);
-  dt->minute = get_rtc_register(0x02);
-  dt->hour = get_rtc_register(0x04);
-  dt->day = get_rtc_register(0x07);
-  dt->month = get_rtc_register(0x08);
-  dt->year = get_rtc_register(0x09);
-
-  // Check if we need BCD conversion
-  outb(CMOS_ADDRESS, 0x0B);
-  status_b = inb(CMOS_DATA);
-
-  if (!(status_b & 0x04)) {
-    dt->second = bcd2bin(dt->second);
-    dt->minute = bcd2bin(dt->minute);
-    dt->hour = bcd2bin(dt->hour);
-    dt->day = bcd2bin(dt->day);
-    dt->month = bcd2bin(dt->month);
-    dt->year = bcd2bin(dt->year);
-  }
-
-  // Adjust year (RTC year is last 2 digits)
-  dt->year += 2000;
+char scancode_to_ascii(uint8_t scancode) {
+  if (scancode & 0x80)
+    return 0; // Ignore release codes
+  static const char kbd_map[] = {
+      0,   27,  '1',  '2',  '3',  '4', '5', '6',  '7', '8', '9', '0',
+      '-', '=', '\b', '\t', 'q',  'w', 'e', 'r',  't', 'y', 'u', 'i',
+      'o', 'p', '[',  ']',  '\n', 0,   'a', 's',  'd', 'f', 'g', 'h',
+      'j', 'k', 'l',  ';',  '\'', '`', 0,   '\\', 'z', 'x', 'c', 'v',
+      'b', 'n', 'm',  ',',  '.',  '/', 0,   '*',  0,   ' '};
+  if (scancode < sizeof(kbd_map))
+    return kbd_map[scancode];
+  return 0;
 }
 
 // --- Utils ---
@@ -312,98 +269,11 @@ int rand() {
 
 // Simple sleep loop (CPU speed dependent)
 void sleep(int count) {
-  for (volatile int i = 0; i < count; i++)
-    ;
+  // The empty asm keeps the loop from being optimized out
+  for (int i = 0; i < count; i++)
+    asm volatile("");
 }
 
-// --- Filesystem Persistence ---
-#define FS_MAGIC "TACOSFS"
-#define FS_SECTOR_START 0
-
-void fs_save() {
-  uint16_t sector[256];
-  // Clear sector
-  for (int i = 0; i < 256; i++)
-    sector[i] = 0;
-
-  // Header: Magic(7) + file_count(1) + dir_count(1)
-  char *hdr = (char *)sector;
-  kstrcpy(hdr, FS_MAGIC);
-  hdr[8] = (char)file_count;
-  hdr[9] = (char)dir_count;
-
-  if (!ata_write_sector(FS_SECTOR_START, sector))
-    return;
-
-  // Write directories (Fixed size slots for simplicity)
-  // Each directory is 32 bytes. Slot size 32. 16 slots per sector.
-  for (int i = 0; i < dir_count; i++) {
-    int sec_off = 1 + (i / 16);
-    int slot = i % 16;
-    if (!ata_read_sector(FS_SECTOR_START + sec_off, sector))
-      continue;
-    kstrcpy((char *)sector + (slot * 32), valid_dirs[i]);
-    ata_write_sector(FS_SECTOR_START + sec_off, sector);
-  }
-
-  // Write files
-  // Each MockFile is 32(name) + 32(parent) + 128(content) = 192 bytes.
-  // 2 files per sector (512 bytes).
-  for (int i = 0; i < file_count; i++) {
-    int sec_off =
-        5 + (i / 2); // Directories take ~4 sectors (MAX_DIRS is small)
-    int slot = i % 2;
-    if (!ata_read_sector(FS_SECTOR_START + sec_off, sector))
-      continue;
-    MockFile *dest = (MockFile *)((char *)sector + (slot * 256));
-    *dest = file_system[i];
-    ata_write_sector(FS_SECTOR_START + sec_off, sector);
-  }
-}
-
-bool fs_load() {
-  uint16_t sector[256];
-  if (!ata_read_sector(FS_SECTOR_START, sector))
-    return false;
-  char *hdr = (char *)sector;
-
-  if (kstrcmp(hdr, FS_MAGIC) != 0) {
-    // Not a tacos disk, initialize defaults
-    kstrcpy(valid_dirs[dir_count++], "/");
-    kstrcpy(valid_dirs[dir_count++], "/home");
-    kstrcpy(valid_dirs[dir_count++], "/system");
-    kstrcpy(valid_dirs[dir_count++], "/tacos");
-    kstrcpy(valid_dirs[dir_count++], "/dev");
-    fs_save();
-    return true;
-  }
-
-  file_count = (unsigned char)hdr[8];
-  dir_count = (unsigned char)hdr[9];
-
-  // Read directories
-  for (int i = 0; i < dir_count; i++) {
-    int sec_off = 1 + (i / 16);
-    int slot = i % 16;
-    if (ata_read_sector(FS_SECTOR_START + sec_off, sector)) {
-      kstrcpy(valid_dirs[i], (char *)sector + (slot * 32));
-    }
-  }
-
-  // Read files
-  for (int i = 0; i < file_count; i++) {
-    int sec_off = 5 + (i / 2);
-    int slot = i % 2;
-    if (ata_read_sector(FS_SECTOR_START + sec_off, sector)) {
-      MockFile *src = (MockFile *)((char *)sector + (slot * 256));
-      file_system[i] = *src;
-    }
-  }
-  return true;
-}
-
-bool fs_init() { return fs_load(); }
-
 // --- Commands ---
 void cmd_logo() {
   term_puts("\n", COLOR_LOGO);
@@ -416,23 +286,15 @@ void cmd_logo() {
   term_puts("\n", COLOR_LOGO);
 }
 
-// Forward declarations
-void play_sound(uint32_t nFrequence);
-void nosound();
-
 void cmd_clear() { clear_screen(); }
 
 void cmd_beep() {
   term_puts("Beep! (1 Second Test)...\n", COLOR_SUCCESS);
 
-  // Play 1000Hz tone
-  play_sound(1000);
-
-  // Wait ~1 second (calibrated roughly for emulation)
-  // Previous 5,000,000 was a bit long/short depending on CPU
-  sleep(20000000);
+  // Play 1000Hz tone for one second, timed by the PIT
+  spkseq_queue(1000, 1000);
+  wait_until([] { return !spkseq_busy(); });
 
-  nosound();
   term_puts("Beep finished.\n", COLOR_DEFAULT);
 }
 
@@ -442,8 +304,9 @@ void cmd_echo(const char *args) {
 }
 
 void cmd_date() {
+  // Kept current by the RTC interrupt; no CMOS access here
   DateTime dt;
-  read_rtc(&dt);
+  unix_to_datetime(vdso_time_unix(vdso), &dt);
 
   // Format: DD/MM/YYYY HH:MM:SS
   // Doing manual int-to-string printing since we don't have printf yet
@@ -482,20 +345,94 @@ void cmd_sysinfo() {
   term_puts("Arch: x86_64\n", COLOR_DEFAULT);
   term_puts("Compiler: GCC\n", COLOR_DEFAULT);
   term_puts("Bootloader: Multiboot2 (GRUB)\n", COLOR_DEFAULT);
+  term_puts("Memory: ", COLOR_DEFAULT);
+  term_put_uint(vdso->mem_pages * PAGE_SIZE / (1024 * 1024));
+  term_puts(" MB\n", COLOR_DEFAULT);
+
+  const paging_info *pi = paging_get_info();
+  term_puts("Direct map: ", COLOR_DEFAULT);
+  term_put_uint(pi->direct_pages[2]);
+  term_puts(" x 1GB, ", COLOR_DEFAULT);
+  term_put_uint(pi->direct_pages[1]);
+  term_puts(" x 2MB, ", COLOR_DEFAULT);
+  term_put_uint(pi->direct_pages[0]);
+  term_puts(" x 4KB pages\n", COLOR_DEFAULT);
+  term_puts(pi->nx ? "NX: enforced\n" : "NX: not supported\n",
+            COLOR_DEFAULT);
 }
 
-void cmd_uptime() {
-  DateTime now;
-  read_rtc(&now);
+// Times full-screen fills of the text buffer under each memory type
+void cmd_vgabench() {
+  static const mem_type types[] = {MEM_UC, MEM_UC_MINUS, MEM_WC, MEM_WB};
+  static const char *names[] = {"UC  ", "UC- ", "WC  ", "WB  "};
+  const int cells = VGA_WIDTH * VGA_HEIGHT;
+  const int reps = 256;
+  const uint64_t bytes = (uint64_t)reps * cells * 2;
+  uint64_t rates[4];
+
+  for (int t = 0; t < 4; t++) {
+    if (!paging_set_memtype((uint64_t)VGA_BUFFER, cells * 2, types[t])) {
+      term_puts("Error: No PAT, or video memory is on a huge page.\n",
+                COLOR_ERROR);
+      return;
+    }
+    uint64_t start = rdtsc();
+    for (int r = 0; r < reps; r++)
+      vga_fill(0, cells, (uint16_t)('0' + r % 10) | (0x1F << 8));
+    sfence();
+    uint64_t cycles = rdtsc() - start;
+    rates[t] = cycles ? bytes * tsc_hz / cycles : 0;
+  }
+  paging_set_memtype((uint64_t)VGA_BUFFER, cells * 2, MEM_WC);
+  clear_screen();
 
-  // Very rough approximation ignoring leap years/days for simplicity
-  long boot_seconds =
-      boot_time.hour * 3600 + boot_time.minute * 60 + boot_time.second;
-  long now_seconds = now.hour * 3600 + now.minute * 60 + now.second;
+  term_puts("Video memory fill (", COLOR_DEFAULT);
+  term_put_uint(bytes);
+  term_puts(" bytes per type):\n", COLOR_DEFAULT);
+  for (int t = 0; t < 4; t++) {
+    term_puts("  ", COLOR_DEFAULT);
+    term_puts(names[t], COLOR_PROMPT);
+    term_put_uint(rates[t]);
+    term_puts(" bytes/s\n", COLOR_DEFAULT);
+  }
+}
 
-  long diff = now_seconds - boot_seconds;
-  if (diff < 0)
-    diff += 24 * 3600; // Handle day rollover
+void cmd_mixer() {
+  mixer_stats st;
+  mixer_get_stats(&st);
+  term_puts("Mixer: ", COLOR_DEFAULT);
+  term_put_uint(MIXER_VOICES);
+  term_puts(" voices, ", COLOR_DEFAULT);
+  term_put_uint(MIXER_BLOCK_FRAMES);
+  term_puts(" frames/block @ ", COLOR_DEFAULT);
+  term_put_uint(MIXER_RATE);
+  term_puts("Hz stereo\n", COLOR_DEFAULT);
+
+  term_puts("  Blocks mixed:  ", COLOR_DEFAULT);
+  term_put_uint(st.blocks);
+  term_puts("\n  Active voices: ", COLOR_DEFAULT);
+  term_put_uint(st.active_voices);
+  term_puts("\n  Cycles/block:  last ", COLOR_DEFAULT);
+  term_put_uint(st.last_cycles);
+  term_puts(", avg ", COLOR_DEFAULT);
+  term_put_uint(st.blocks ? st.total_cycles / st.blocks : 0);
+  term_puts(", max ", COLOR_DEFAULT);
+  term_put_uint(st.max_cycles);
+  term_puts("\n  Budget/block:  ", COLOR_DEFAULT);
+  term_put_uint(st.budget_cycles);
+  term_puts(" cycles (max uses ", COLOR_DEFAULT);
+  term_put_uint(st.budget_cycles ? st.max_cycles * 100 / st.budget_cycles : 0);
+  term_puts("%)\n  SB16 underruns: ", COLOR_DEFAULT);
+  term_put_uint(sb16_underruns);
+  term_puts("\n  DMA position:  sample ", COLOR_DEFAULT);
+  term_put_uint(sb16_dma_position());
+  term_puts(" of ", COLOR_DEFAULT);
+  term_put_uint(SB16_HALF_SAMPLES * 2);
+  term_putc('\n');
+}
+
+void cmd_uptime() {
+  long diff = vdso_clock_ns(vdso) / VDSO_NS_PER_SEC;
 
   term_puts("System uptime: ", COLOR_DEFAULT);
 
@@ -558,21 +495,16 @@ void cmd_color(const char *arg) {
   ;
 }
 
-// Forward declarations for sound
-void play_sound(uint32_t nFrequence);
-void nosound();
-
 void cmd_matrix() {
   term_puts("Press ESC to stop...\n", COLOR_SUCCESS);
 
   // Clear any pending keyboard input first
-  while (inb(0x64) & 1)
-    kbd_scancode();
+  kbd_flush();
 
   while (1) {
     // Check for exit key
-    if (inb(0x64) & 1) {
-      uint8_t sc = kbd_scancode();
+    uint8_t sc;
+    if (kbd_poll(&sc)) {
       // Exit on ESC (0x01)
       if (sc == 0x01) {
         break;
@@ -593,51 +525,18 @@ void cmd_matrix() {
     }
 
     // Sound effects (Digital Rain Bleeps)
-    // 10% chance to start a new sound, 5% chance to stop sound
-    if ((rand() % 10) == 0) {
-      // Random frequency between 200Hz and 2000Hz (wider range)
-      play_sound(200 + (rand() % 1800));
-    } else if ((rand() % 20) == 0) {
-      nosound();
-    }
+    // 10% chance per frame to queue a short bleep between 200Hz and 2000Hz
+    if ((rand() % 10) == 0 && !spkseq_busy())
+      spkseq_queue(200 + (rand() % 1800), 20 + (rand() % 80));
 
     sleep(40000); // Frame delay
   }
 
-  nosound();
+  spkseq_stop();
   // Restore default colors
   clear_screen();
 }
 
-// --- PC Speaker Driver ---
-void play_sound(uint32_t nFrequence) {
-  uint32_t Div;
-  uint8_t tmp;
-
-  // Set the PIT to the desired frequency
-  Div = 1193180 / nFrequence;
-  outb(0x43, 0xb6);
-  outb(0x42, (uint8_t)(Div));
-  outb(0x42, (uint8_t)(Div >> 8));
-
-  // And play the sound using the PC speaker
-  tmp = inb(0x61);
-  if (tmp != (tmp | 3)) {
-    outb(0x61, tmp | 3);
-  }
-
-  // Visual Bell: Show Music Note in top-right corner
-  VGA_BUFFER[79] = (uint16_t)14 | (0x0E << 8); // Yellow Note
-}
-
-void nosound() {
-  uint8_t tmp = inb(0x61) & 0xFC;
-  outb(0x61, tmp);
-
-  // Clear Visual Bell
-  VGA_BUFFER[79] = (uint16_t)' ' | (0x07 << 8);
-}
-
 // Notes for "It's Raining Tacos" (Lower Octave for better 8-bit sound)
 #define NOTE_GS3 208
 #define NOTE_AS3 233
@@ -646,11 +545,8 @@ void nosound() {
 #define NOTE_DS4 311
 #define NOTE_FS4 370
 
-struct Note {
-  int freq;
-  int duration; // relative units
-};
-
+// Durations in units of SONG_UNIT_MS
+#define SONG_UNIT_MS 50
 Note song[] = {
     // It's raining tacos
     {NOTE_GS3, 4},
@@ -702,30 +598,21 @@ void cmd_tacos() {
   term_puts("Catch the Tacos! (Use A/D or Arrows) - Press Any Key to Start",
             COLOR_SUCCESS);
 
-  // Wait for start
-  // Clear buffer
-  for (int i = 0; i < 1000; i++) {
-    if (inb(0x64) & 1)
-      kbd_scancode();
-  }
-
-  // Wait for a valid key down event
-  bool valid_start = false;
-  while (!valid_start) {
-    if (inb(0x64) & 1) {
-      uint8_t c = kbd_scancode();
-      // Ignore break codes (high bit set)
-      if (!(c & 0x80))
-        valid_start = true;
-    }
-  }
+  // Wait for a key down event; break codes have the high bit set
+  kbd_flush();
+  while (kbd_scancode() & 0x80)
+    ;
 
   clear_screen();
 
-  if (sb16_active) {
-    extern void sb16_play_tacos_melody();
-    sb16_play_tacos_melody();
-  }
+  // With the SB16 the melody loops on a mixer voice and catches get their
+  // own sound effect voices on top of it. Otherwise the speaker sequencer
+  // plays song[] from the timer interrupt.
+  int music_voice = -1;
+  if (sb16_active)
+    music_voice = sb16_play_tacos_melody(true);
+  else
+    spkseq_play(song, SONG_UNIT_MS, true);
 
   int width = VGA_WIDTH;
   int height = VGA_HEIGHT - 1; // Reserve bottom line
@@ -740,42 +627,11 @@ void cmd_tacos() {
 
   int loop_tick = 0;
 
-  // Music State
-  int note_idx = 0;
-  int note_time = 0;
-
   while (!game_over) {
-    // 0. Play Music (Only if SB16 isn't already playing background)
-    if (!sb16_active) {
-      if (note_time <= 0) {
-        // Next note
-        if (song[note_idx].freq == 0)
-          note_idx = 0; // Loop
-
-        if (song[note_idx].freq > 0) {
-          play_sound(song[note_idx].freq);
-          VGA_BUFFER[79] = (uint16_t)14 | (0x0E << 8); // Music Note
-        } else {
-          nosound();
-          VGA_BUFFER[79] = (uint16_t)0 | (0x00 << 8); // Black
-        }
-
-        note_time = song[note_idx].duration * 3; // Scale duration
-        note_idx++;
-      } else {
-        if (note_time == 1)
-          nosound(); // Articulation gap
-        note_time--;
-      }
-    } else {
-      // Just show the music note for fun
-      VGA_BUFFER[79] = (uint16_t)14 | (0x0E << 8);
-    }
-
     // 1. Input (Responsive)
     for (int k = 0; k < 500; k++) {
-      if (inb(0x64) & 1) {
-        uint8_t code = kbd_scancode();
+      uint8_t code;
+      if (kbd_poll(&code)) {
         if (code & 0x80)
           continue;
         if (code == 0x1E || code == 0x4B) {
@@ -820,6 +676,9 @@ void cmd_tacos() {
             // Caught!
             score++;
             tacos[i].active = false;
+            if (sb16_active)
+              mixer_play_tone(880 + (score % 4) * 110, 80, 160,
+                              (uint16_t)(player_x * 256 / (width - 1)));
           }
         } else if (tacos[i].y > player_y) {
           // Missed! Just deactivate it
@@ -832,10 +691,11 @@ void cmd_tacos() {
       break;
 
     // 3. Render
-    // Clear screen buffer (fast enough)
-    for (int i = 0; i < width * height; i++) {
-      VGA_BUFFER[i] = (uint16_t)' ' | (0x0F << 8);
-    }
+    // Clear screen buffer (one WC burst per 64 bytes)
+    vga_fill(0, width * height, (uint16_t)' ' | (0x0F << 8));
+
+    // Music note icon (the clear above wiped it)
+    VGA_BUFFER[79] = (uint16_t)14 | (0x0E << 8);
 
     // Draw Player (as 'U')
     VGA_BUFFER[player_y * width + player_x] =
@@ -875,6 +735,10 @@ void cmd_tacos() {
   }
 
   // Game Over
+  if (sb16_active)
+    mixer_stop(music_voice);
+  else
+    spkseq_stop();
   clear_screen();
   term_puts("\n\n      GAME OVER - TACO DROPPED!\n", COLOR_ERROR);
   term_puts("      Final Score: ", COLOR_DEFAULT);
@@ -891,24 +755,11 @@ void cmd_tacos() {
     term_putc(buf[--bi]);
 
   term_puts("\n\n      Press Key...\n", COLOR_DEFAULT);
-  while (inb(0x64) & 1)
-    kbd_scancode();
-  while (!(inb(0x64) & 1))
-    ;
+  kbd_flush();
   kbd_scancode();
   clear_screen();
 }
 
-int find_file(const char *name, const char *dir) {
-  for (int i = 0; i < file_count; i++) {
-    if (kstrcmp(file_system[i].name, name) == 0 &&
-        kstrcmp(file_system[i].parent_dir, dir) == 0) {
-      return i;
-    }
-  }
-  return -1;
-}
-
 void cmd_cp(char *args) {
   // Basic parser for "cp src dest"
   // Limitations: No spaces in filenames supported by this simple parser
@@ -931,14 +782,16 @@ void cmd_cp(char *args) {
     dest[j++] = args[i++];
   dest[j] = '\0';
 
-  int idx = find_file(src, current_dir);
-  if (idx != -1) {
-    if (file_count < MAX_FILES) {
-      file_system[file_count] = file_system[idx];
-      kstrcpy(file_system[file_count].name, dest);
+  char dir[FS_PATH_MAX];
+  fs_current_dir(dir);
+  MockFile f;
+  if (fs_get_file(find_file(src, dir), &f)) {
+    int copy = fs_create(dest, dir);
+    if (copy != -1) {
+      kstrcpy(f.name, dest);
+      fs_set_file(copy, &f);
       // Parent dir remains the same (current_dir) for simplicity
       // unless dest contains ".." or "/" which is too complex for now
-      file_count++;
       fs_save();
       term_puts("File copied.\n", COLOR_SUCCESS);
     } else {
@@ -970,9 +823,13 @@ void cmd_mv(char *args) {
     dest[j++] = args[i++];
   dest[j] = '\0';
 
-  int idx = find_file(src, current_dir);
-  if (idx != -1) {
-    kstrcpy(file_system[idx].name, dest);
+  char dir[FS_PATH_MAX];
+  fs_current_dir(dir);
+  int idx = find_file(src, dir);
+  MockFile f;
+  if (fs_get_file(idx, &f)) {
+    kstrcpy(f.name, dest);
+    fs_set_file(idx, &f);
     fs_save();
     term_puts("File renamed.\n", COLOR_SUCCESS);
   } else {
@@ -994,392 +851,279 @@ void reboot() {
 
 void shutdown() {
   term_puts("Shutting down...\n", COLOR_LOGO);
-  // QEMU/VirtualBox/Bochs power off ports
-  asm volatile("outw %1, %0" : : "dN"(0x604), "a"((uint16_t)0x2000)); // QEMU
-  asm volatile("outw %1, %0"
-               :
-               : "dN"(0x4004), "a"((uint16_t)0x3400)); // VirtualBox
-  asm volatile("outw %1, %0" : : "dN"(0xB004), "a"((uint16_t)0x2000)); // Bochs
-  term_puts("Shutdown failed. Hardware does not support magic port.\n",
-            COLOR_ERROR);
+  // Only returns if the machine stayed on
+  acpi_poweroff();
+  term_puts("Shutdown failed.\n", COLOR_ERROR);
 }
 
 // --- Editing State ---
 static bool is_editing = false;
 static int editing_file_idx = -1;
 
-void execute_command(char *cmd) {
-  if (kstrcmp(cmd, "logo") == 0) {
-    cmd_logo();
-  } else if (kstrcmp(cmd, "help") == 0) {
-    term_puts("Available commands:\n", COLOR_DEFAULT);
-    term_puts("  logo            Show the TacosOS logo\n");
-    term_puts("  ls              List files in the directory\n");
-    term_puts("  cd <path>       Change the current directory\n");
-    term_puts("  mkdir <name>    Create a new directory\n");
-    term_puts("  new <name>      Create a new file\n");
-    term_puts("  open <name>     Open and read a file\n");
-    term_puts("  edit <name>     Edit content of a file\n");
-    term_puts("  rm <name>       Delete a file\n");
-    term_puts("  cp <src> <dst>  Copy a file\n");
-    term_puts("  mv <src> <dst>  Rename a file\n");
-    term_puts("  clear           Clear the screen\n");
-    term_puts("  date            Show current time\n");
-    term_puts("  uptime          Show system uptime\n");
-    term_puts("  sysinfo         Show system info\n");
-    term_puts("  echo <text>     Print text\n");
-    term_puts("  color <hex>     Change screen color (e.g. 0A)\n");
-    term_puts("  matrix          Enter the matrix\n");
-    term_puts("  tacos           Catch falling tacos game\n");
-    term_puts("  reboot          Restart the computer\n");
-    term_puts("  shutdown        Power off the machine\n");
-    term_puts("  beep            Test PC speaker sound\n");
-    term_puts("  help            Show this help message\n");
-    term_puts("\n", COLOR_DEFAULT);
-    term_puts("  Created By YBL (ynbd11)\n", COLOR_LOGO);
-
-  } else if (kstrcmp(cmd, "ls") == 0) {
-    bool empty = true;
-    int curr_len = kstrlen(current_dir);
-
-    // Show subdirectories
-    for (int i = 0; i < dir_count; i++) {
-      if (kstrcmp(valid_dirs[i], current_dir) == 0)
-        continue;
+// --- Shell Commands ---
+static void cmd_ls() {
+  bool empty = true;
+  char current_dir[FS_PATH_MAX];
+  fs_current_dir(current_dir);
+  int curr_len = kstrlen(current_dir);
+
+  // Show subdirectories
+  char dir[FS_PATH_MAX];
+  for (int i = 0; fs_dir(i, dir); i++) {
+    if (kstrcmp(dir, current_dir) == 0)
+      continue;
 
-      bool is_child = false;
-      if (kstrcmp(current_dir, "/") == 0) {
-        // Child of root has exactly one slash at index 0
+    bool is_child = false;
+    if (kstrcmp(current_dir, "/") == 0) {
+      // Child of root has exactly one slash at index 0
+      int slash_count = 0;
+      for (int j = 0; dir[j]; j++)
+        if (dir[j] == '/')
+          slash_count++;
+      if (slash_count == 1)
+        is_child = true;
+    } else {
+      // Child of /X starts with /X/ and has no slashes after that
+      int j = 0;
+      while (current_dir[j] && dir[j] == current_dir[j])
+        j++;
+      if (current_dir[j] == '\0' && dir[j] == '/') {
         int slash_count = 0;
-        for (int j = 0; valid_dirs[i][j]; j++)
-          if (valid_dirs[i][j] == '/')
+        for (int k = j + 1; dir[k]; k++)
+          if (dir[k] == '/')
             slash_count++;
-        if (slash_count == 1)
+        if (slash_count == 0)
           is_child = true;
-      } else {
-        // Child of /X starts with /X/ and has no slashes after that
-        int j = 0;
-        while (current_dir[j] && valid_dirs[i][j] == current_dir[j])
-          j++;
-        if (current_dir[j] == '\0' && valid_dirs[i][j] == '/') {
-          int slash_count = 0;
-          for (int k = j + 1; valid_dirs[i][k]; k++)
-            if (valid_dirs[i][k] == '/')
-              slash_count++;
-          if (slash_count == 0)
-            is_child = true;
-        }
-      }
-
-      if (is_child) {
-        const char *name = valid_dirs[i];
-        // Find start of name after current_dir
-        if (kstrcmp(current_dir, "/") == 0)
-          name += 1;
-        else
-          name += curr_len + 1;
-
-        term_puts(name, COLOR_PROMPT);
-        term_puts("/ ", COLOR_PROMPT);
-        empty = false;
       }
     }
-    // Show files
-    for (int i = 0; i < file_count; i++) {
-      if (kstrcmp(file_system[i].parent_dir, current_dir) == 0) {
-        term_puts(file_system[i].name, COLOR_DEFAULT);
-        term_puts("  ", COLOR_DEFAULT);
-        empty = false;
-      }
+
+    if (is_child) {
+      const char *name = dir;
+      // Find start of name after current_dir
+      if (kstrcmp(current_dir, "/") == 0)
+        name += 1;
+      else
+        name += curr_len + 1;
+
+      term_puts(name, COLOR_PROMPT);
+      term_puts("/ ", COLOR_PROMPT);
+      empty = false;
     }
-    if (empty) {
-      term_puts("Directory empty.\n", COLOR_DEFAULT);
-    } else {
-      term_puts("\n", COLOR_DEFAULT);
+  }
+  // Show files
+  MockFile f;
+  for (int i = 0; fs_get_file(i, &f); i++) {
+    if (kstrcmp(f.parent_dir, current_dir) == 0) {
+      term_puts(f.name, COLOR_DEFAULT);
+      term_puts("  ", COLOR_DEFAULT);
+      empty = false;
     }
+  }
+  if (empty) {
+    term_puts("Directory empty.\n", COLOR_DEFAULT);
+  } else {
+    term_puts("\n", COLOR_DEFAULT);
+  }
+}
 
-  } else if (kstrcmp(cmd, "clear") == 0) {
-    cmd_clear();
-  } else if (kstrcmp(cmd, "date") == 0) {
-    cmd_date();
-  } else if (kstrcmp(cmd, "sysinfo") == 0) {
-    cmd_sysinfo();
-  } else if (kstrcmp(cmd, "uptime") == 0) {
-    cmd_uptime();
-  } else if (kstrcmp(cmd, "matrix") == 0) {
-    cmd_matrix();
-  } else if (kstrcmp(cmd, "tacos") == 0) {
-    cmd_tacos();
-  } else if (kstrncmp(cmd, "echo ", 5) == 0) {
-    cmd_echo(cmd + 5);
-  } else if (kstrncmp(cmd, "cp ", 3) == 0) {
-    cmd_cp(cmd + 3);
-  } else if (kstrncmp(cmd, "mv ", 3) == 0) {
-    cmd_mv(cmd + 3);
-  } else if (kstrncmp(cmd, "color ", 6) == 0) {
-    cmd_color(cmd + 6);
-  } else if (kstrcmp(cmd, "reboot") == 0) {
-    reboot();
-  } else if (kstrcmp(cmd, "shutdown") == 0 ||
-             kstrncmp(cmd, "shutdown ", 9) == 0) {
-    shutdown();
-  } else if (kstrcmp(cmd, "beep") == 0) {
-    cmd_beep();
-  } else if (kstrcmp(cmd, "playpcm") == 0) {
-    extern void cmd_play_test();
-    cmd_play_test();
-  } else if (cmd[0] == 'c' && cmd[1] == 'd' && cmd[2] == ' ') {
-    const char *target = cmd + 3;
-
-    // Handle ".."
-    if (kstrcmp(target, "..") == 0 || kstrcmp(target, "/..") == 0) {
-      if (kstrcmp(current_dir, "/") == 0) {
-        // Already at root
-      } else {
-        // Find last slash
-        int last_slash = 0;
-        for (int i = 0; current_dir[i]; i++)
-          if (current_dir[i] == '/')
-            last_slash = i;
-        if (last_slash == 0) {
-          kstrcpy(current_dir, "/");
-        } else {
-          current_dir[last_slash] = '\0';
-        }
-      }
-      term_puts("Navigated to: ", COLOR_SUCCESS);
-      term_puts(current_dir, COLOR_SUCCESS);
-      term_putc('\n');
+static void cmd_cd(const char *target) {
+  // Handle ".."
+  if (kstrcmp(target, "..") == 0 || kstrcmp(target, "/..") == 0) {
+    char parent[FS_PATH_MAX];
+    fs_current_dir(parent);
+    if (kstrcmp(parent, "/") == 0) {
+      // Already at root
     } else {
-      char full_target[32];
-      if (target[0] == '/') {
-        kstrcpy(full_target, target);
-      } else {
-        kstrcpy(full_target, current_dir);
-        if (kstrcmp(current_dir, "/") != 0)
-          kstrcat(full_target, "/");
-        kstrcat(full_target, target);
-      }
-
-      bool found = false;
-      for (int i = 0; i < dir_count; i++) {
-        if (kstrcmp(valid_dirs[i], full_target) == 0) {
-          found = true;
-          break;
-        }
-      }
-      if (found) {
-        kstrcpy(current_dir, full_target);
-        term_puts("Navigated to: ", COLOR_SUCCESS);
-        term_puts(current_dir, COLOR_SUCCESS);
-        term_putc('\n');
+      // Find last slash
+      int last_slash = 0;
+      for (int i = 0; parent[i]; i++)
+        if (parent[i] == '/')
+          last_slash = i;
+      if (last_slash == 0) {
+        kstrcpy(parent, "/");
       } else {
-        term_puts("Error: Directory not found: ", COLOR_ERROR);
-        term_puts(full_target, COLOR_ERROR);
-        term_putc('\n');
-      }
-    }
-
-  } else if (cmd[0] == 'r' && cmd[1] == 'm' && cmd[2] == ' ') {
-    const char *target = cmd + 3;
-
-    // 1. Try deleting a file in the current directory
-    int file_idx = -1;
-    for (int i = 0; i < file_count; i++) {
-      if (kstrcmp(file_system[i].name, target) == 0 &&
-          kstrcmp(file_system[i].parent_dir, current_dir) == 0) {
-        file_idx = i;
-        break;
+        parent[last_slash] = '\0';
       }
     }
-
-    if (file_idx != -1) {
-      for (int i = file_idx; i < file_count - 1; i++)
-        file_system[i] = file_system[i + 1];
-      file_count--;
-      term_puts("File removed.\n", COLOR_SUCCESS);
-      fs_save();
-      return;
-    }
-
-    // 2. Try deleting a directory
-    char full_target[32];
-    if (target[0] == '/') {
-      kstrcpy(full_target, target);
+    fs_set_current_dir(parent);
+    term_puts("Navigated to: ", COLOR_SUCCESS);
+    term_puts(parent, COLOR_SUCCESS);
+    term_putc('\n');
+  } else {
+    char full_target[FS_PATH_MAX];
+    if (!fs_resolve(target, full_target)) {
+      term_puts("Error: Path too long.\n", COLOR_ERROR);
+    } else if (find_dir(full_target) != -1) {
+      fs_set_current_dir(full_target);
+      term_puts("Navigated to: ", COLOR_SUCCESS);
+      term_puts(full_target, COLOR_SUCCESS);
+      term_putc('\n');
     } else {
-      kstrcpy(full_target, current_dir);
-      if (kstrcmp(current_dir, "/") != 0)
-        kstrcat(full_target, "/");
-      kstrcat(full_target, target);
-    }
-
-    if (kstrcmp(full_target, "/") == 0) {
-      term_puts("Error: Cannot remove root directory.\n", COLOR_ERROR);
-      return;
+      term_puts("Error: Directory not found: ", COLOR_ERROR);
+      term_puts(full_target, COLOR_ERROR);
+      term_putc('\n');
     }
+  }
+}
 
-    int dir_idx = -1;
-    for (int i = 0; i < dir_count; i++) {
-      if (kstrcmp(valid_dirs[i], full_target) == 0) {
-        dir_idx = i;
-        break;
-      }
-    }
+// Removes a file, or a directory and everything below it
+static void cmd_rm(const char *target) {
 
-    if (dir_idx != -1) {
-      // Recursive Cleanup: Remove all files and directories starting with this
-      // path Important: check if target is a prefix + /
-      int target_len = kstrlen(full_target);
-
-      // Remove nested files
-      for (int i = 0; i < file_count; i++) {
-        // Check if parent_dir starts with full_target
-        if (kstrncmp(file_system[i].parent_dir, full_target, target_len) == 0) {
-          // Check if it's the exact dir or followed by /
-          if (file_system[i].parent_dir[target_len] == '\0' ||
-              file_system[i].parent_dir[target_len] == '/') {
-            // Shift files
-            for (int j = i; j < file_count - 1; j++)
-              file_system[j] = file_system[j + 1];
-            file_count--;
-            i--; // Re-check this index
-          }
-        }
-      }
+  // 1. Try deleting a file in the current directory
+  char dir[FS_PATH_MAX];
+  fs_current_dir(dir);
+  int file_idx = find_file(target, dir);
+  if (file_idx != -1) {
+    fs_remove(file_idx);
+    term_puts("File removed.\n", COLOR_SUCCESS);
+    fs_save();
+    return;
+  }
 
-      // Remove nested directories (except the one we are about to remove)
-      for (int i = 0; i < dir_count; i++) {
-        if (i == dir_idx)
-          continue;
-        if (kstrncmp(valid_dirs[i], full_target, target_len) == 0) {
-          if (valid_dirs[i][target_len] == '/') {
-            // Shift dirs
-            for (int j = i; j < dir_count - 1; j++)
-              kstrcpy(valid_dirs[j], valid_dirs[j + 1]);
-            dir_count--;
-            if (i < dir_idx)
-              dir_idx--; // Adjust current dir index if shifted
-            i--;
-          }
-        }
-      }
+  // 2. Try deleting a directory
+  char full_target[FS_PATH_MAX];
+  if (!fs_resolve(target, full_target)) {
+    term_puts("Error: Path too long.\n", COLOR_ERROR);
+    return;
+  }
 
-      // Remove the target directory itself
-      for (int i = dir_idx; i < dir_count - 1; i++)
-        kstrcpy(valid_dirs[i], valid_dirs[i + 1]);
-      dir_count--;
+  if (kstrcmp(full_target, "/") == 0) {
+    term_puts("Error: Cannot remove root directory.\n", COLOR_ERROR);
+    return;
+  }
 
-      // If we just deleted where we are, jump to root
-      if (kstrncmp(current_dir, full_target, target_len) == 0) {
-        if (current_dir[target_len] == '\0' || current_dir[target_len] == '/') {
-          kstrcpy(current_dir, "/");
-          term_puts("Current directory removed. Jumped to /.\n", COLOR_PROMPT);
-        }
-      }
+  bool was_root = kstrcmp(dir, "/") == 0;
+  if (fs_remove_tree(full_target)) {
+    // If we just deleted where we are, fs_remove_tree jumped to root
+    fs_current_dir(dir);
+    if (!was_root && kstrcmp(dir, "/") == 0)
+      term_puts("Current directory removed. Jumped to /.\n", COLOR_PROMPT);
+    term_puts("Directory and its contents removed.\n", COLOR_SUCCESS);
+    fs_save();
+  } else {
+    term_puts("Error: '", COLOR_ERROR);
+    term_puts(target, COLOR_ERROR);
+    term_puts("' not found.\n", COLOR_ERROR);
+  }
+}
 
-      term_puts("Directory and its contents removed.\n", COLOR_SUCCESS);
-      fs_save();
-    } else {
-      term_puts("Error: '", COLOR_ERROR);
-      term_puts(target, COLOR_ERROR);
-      term_puts("' not found.\n", COLOR_ERROR);
-    }
+static void cmd_mkdir(const char *name) {
+  char full_path[FS_PATH_MAX];
+  if (!fs_resolve(name, full_path)) {
+    term_puts("Error: Path too long.\n", COLOR_ERROR);
+  } else if (fs_mkdir(full_path)) {
+    term_puts("Directory created: ", COLOR_SUCCESS);
+    term_puts(full_path, COLOR_SUCCESS);
+    term_putc('\n');
+    fs_save();
+  } else {
+    term_puts("Error: Maximum directory limit reached.\n", COLOR_ERROR);
+  }
+}
 
-  } else if (cmd[0] == 'm' && cmd[1] == 'k' && cmd[2] == 'd' && cmd[3] == 'i' &&
-             cmd[4] == 'r' && cmd[5] == ' ') {
-    const char *name = cmd + 6;
-    if (dir_count < MAX_DIRS) {
-      char full_path[32];
-      if (name[0] == '/') {
-        kstrcpy(full_path, name);
-      } else {
-        kstrcpy(full_path, current_dir);
-        if (kstrcmp(current_dir, "/") != 0)
-          kstrcat(full_path, "/");
-        kstrcat(full_path, name);
-      }
+static void cmd_new(const char *name) {
+  char dir[FS_PATH_MAX];
+  fs_current_dir(dir);
+  if (fs_create(name, dir) != -1) {
+    term_puts("File created.\n", COLOR_SUCCESS);
+    fs_save();
+  } else {
+    term_puts("Error: File system full.\n", COLOR_ERROR);
+  }
+}
 
-      kstrcpy(valid_dirs[dir_count++], full_path);
-      term_puts("Directory created: ", COLOR_SUCCESS);
-      term_puts(full_path, COLOR_SUCCESS);
-      term_putc('\n');
-      fs_save();
-    } else {
-      term_puts("Error: Maximum directory limit reached.\n", COLOR_ERROR);
+static void cmd_open(const char *target) {
+  char dir[FS_PATH_MAX];
+  fs_current_dir(dir);
+  MockFile f;
+  if (fs_get_file(find_file(target, dir), &f)) {
+    term_puts("Content: ", COLOR_DEFAULT);
+    term_puts(f.content, COLOR_DEFAULT);
+    term_putc('\n');
+    if (f.data_size) {
+      term_puts("Data: ", COLOR_DEFAULT);
+      term_put_uint(f.data_size);
+      term_puts(" bytes\n", COLOR_DEFAULT);
     }
+  } else {
+    term_puts("Error: File not found in current directory.\n", COLOR_ERROR);
+  }
+}
 
-  } else if (cmd[0] == 'r' && cmd[1] == 'm' && cmd[2] == ' ') {
-    const char *target = cmd + 3;
-    int found_idx = -1;
-    for (int i = 0; i < file_count; i++) {
-      if (kstrcmp(file_system[i].name, target) == 0 &&
-          kstrcmp(file_system[i].parent_dir, current_dir) == 0) {
-        found_idx = i;
-        break;
-      }
-    }
-    if (found_idx != -1) {
-      for (int i = found_idx; i < file_count - 1; i++) {
-        file_system[i] = file_system[i + 1];
-      }
-      file_count--;
-      term_puts("File removed.\n", COLOR_SUCCESS);
-    } else {
-      term_puts("Error: File not found in current directory.\n", COLOR_ERROR);
-    }
+static void cmd_edit(const char *target) {
+  char dir[FS_PATH_MAX];
+  fs_current_dir(dir);
+  int found_idx = find_file(target, dir);
+  if (found_idx != -1) {
+    term_puts("Editing: ", COLOR_SUCCESS);
+    term_puts(target, COLOR_SUCCESS);
+    term_puts("\nEnter text: ", COLOR_DEFAULT);
+    is_editing = true;
+    editing_file_idx = found_idx;
+  } else {
+    term_puts("Error: File not found in current directory.\n", COLOR_ERROR);
+  }
+}
 
-  } else if (cmd[0] == 'n' && cmd[1] == 'e' && cmd[2] == 'w' && cmd[3] == ' ') {
-    if (file_count < MAX_FILES) {
-      kstrcpy(file_system[file_count].name, cmd + 4);
-      kstrcpy(file_system[file_count].parent_dir, current_dir);
-      kstrcpy(file_system[file_count].content, "Empty taco.");
-      file_count++;
-      term_puts("File created.\n", COLOR_SUCCESS);
-      fs_save();
-    } else {
-      term_puts("Error: File system full.\n", COLOR_ERROR);
-    }
+static void cmd_help() {
+  term_puts("Available commands:\n", COLOR_DEFAULT);
+  cmd_print_help();
+  term_puts("\n", COLOR_DEFAULT);
+  term_puts("  Created By YBL (ynbd11)\n", COLOR_LOGO);
+}
 
-  } else if (cmd[0] == 'o' && cmd[1] == 'p' && cmd[2] == 'e' && cmd[3] == 'n' &&
-             cmd[4] == ' ') {
-    const char *target = cmd + 5;
-    int found_idx = -1;
-    for (int i = 0; i < file_count; i++) {
-      if (kstrcmp(file_system[i].name, target) == 0 &&
-          kstrcmp(file_system[i].parent_dir, current_dir) == 0) {
-        found_idx = i;
-        break;
-      }
-    }
-    if (found_idx != -1) {
-      term_puts("Content: ", COLOR_DEFAULT);
-      term_puts(file_system[found_idx].content, COLOR_DEFAULT);
-      term_putc('\n');
-    } else {
-      term_puts("Error: File not found in current directory.\n", COLOR_ERROR);
-    }
+COMMAND(logo, "logo", "Show the TacosOS logo", 0, 0,
+        [](char *) { cmd_logo(); });
+COMMAND(help, "help", "Show this help message", 0, 0,
+        [](char *) { cmd_help(); });
+COMMAND(ls, "ls", "List files in the directory", 0, 0,
+        [](char *) { cmd_ls(); });
+COMMAND(cd, "cd <path>", "Change the current directory", 1, 1,
+        [](char *args) { cmd_cd(args); });
+COMMAND(mkdir, "mkdir <name>", "Create a new directory", 1, 1,
+        [](char *args) { cmd_mkdir(args); });
+COMMAND(new, "new <name>", "Create a new file", 1, 1,
+        [](char *args) { cmd_new(args); });
+COMMAND(open, "open <name>", "Open and read a file", 1, 1,
+        [](char *args) { cmd_open(args); });
+COMMAND(edit, "edit <name>", "Edit content of a file", 1, 1,
+        [](char *args) { cmd_edit(args); });
+COMMAND(rm, "rm <name>", "Delete a file or directory", 1, 1,
+        [](char *args) { cmd_rm(args); });
+COMMAND(cp, "cp <src> <dst>", "Copy a file", 2, 2, cmd_cp);
+COMMAND(mv, "mv <src> <dst>", "Rename a file", 2, 2, cmd_mv);
+COMMAND(clear, "clear", "Clear the screen", 0, 0,
+        [](char *) { cmd_clear(); });
+COMMAND(date, "date", "Show current time", 0, 0,
+        [](char *) { cmd_date(); });
+COMMAND(uptime, "uptime", "Show system uptime", 0, 0,
+        [](char *) { cmd_uptime(); });
+COMMAND(sysinfo, "sysinfo", "Show system info", 0, 0,
+        [](char *) { cmd_sysinfo(); });
+COMMAND(echo, "echo <text>", "Print text", 0, CMD_ARGS_ANY,
+        [](char *args) { cmd_echo(args); });
+COMMAND(color, "color <hex>", "Change screen color (e.g. 0A)", 1, 1,
+        [](char *args) { cmd_color(args); });
+COMMAND(matrix, "matrix", "Enter the matrix", 0, 0,
+        [](char *) { cmd_matrix(); });
+COMMAND(tacos, "tacos", "Catch falling tacos game", 0, 0,
+        [](char *) { cmd_tacos(); });
+COMMAND(reboot, "reboot", "Restart the computer", 0, 0,
+        [](char *) { reboot(); });
+// As before the registry, trailing words (`shutdown now`) are ignored
+COMMAND(shutdown, "shutdown", "Power off the machine", 0,
+        CMD_ARGS_ANY, [](char *) { shutdown(); });
+COMMAND(beep, "beep", "Test PC speaker sound", 0, 0,
+        [](char *) { cmd_beep(); });
+COMMAND(vgabench, "vgabench", "Benchmark video memory types", 0,
+        0, [](char *) { cmd_vgabench(); });
+COMMAND(mixer, "mixer", "Show audio mixer statistics", 0, 0,
+        [](char *) { cmd_mixer(); });
+COMMAND(wavgen, "wavgen <file>", "Write the tacos song as a WAV file",
+        1, 1, [](char *args) { cmd_wavgen(args, song, SONG_UNIT_MS); });
 
-  } else if (cmd[0] == 'e' && cmd[1] == 'd' && cmd[2] == 'i' && cmd[3] == 't' &&
-             cmd[4] == ' ') {
-    const char *target = cmd + 5;
-    int found_idx = -1;
-    for (int i = 0; i < file_count; i++) {
-      if (kstrcmp(file_system[i].name, target) == 0 &&
-          kstrcmp(file_system[i].parent_dir, current_dir) == 0) {
-        found_idx = i;
-        break;
-      }
-    }
-    if (found_idx != -1) {
-      term_puts("Editing: ", COLOR_SUCCESS);
-      term_puts(target, COLOR_SUCCESS);
-      term_puts("\nEnter text: ", COLOR_DEFAULT);
-      is_editing = true;
-      editing_file_idx = found_idx;
-    } else {
-      term_puts("Error: File not found in current directory.\n", COLOR_ERROR);
-    }
-  } else if (cmd[0] != '\0') {
+void execute_command(char *cmd) {
+  if (!pipeline_run(cmd)) {
     term_puts("Unknown command: ", COLOR_ERROR);
     term_puts(cmd, COLOR_ERROR);
     term_puts(". Type 'help' for options.\n");
@@ -1388,8 +1132,71 @@ void execute_command(char *cmd) {
 
 // --- Main Loop ---
 extern "C" void kmain() {
+  BOOTBENCH_MARK("kmain");
+  gdt_init();
   idt_init();
+  BOOTBENCH_MARK("idt_init");
+  syscall_init();
+  tsc_calibrate();
+  idle_init();
   clear_screen();
+  serial_init();
+
+  term_puts("Scanning physical memory...", COLOR_LOGO);
+  uint64_t pages = pmm_init();
+  vdso_init(pages);
+  if (pages) {
+    term_puts(" [OK] ", COLOR_SUCCESS);
+    term_put_uint(pages * PAGE_SIZE / (1024 * 1024), COLOR_SUCCESS);
+    term_puts(" MB free\n", COLOR_SUCCESS);
+  } else {
+    term_puts(" [FAIL] (No memory map, user programs disabled)\n",
+              COLOR_ERROR);
+  }
+
+  term_puts("Building kernel page tables...", COLOR_LOGO);
+  bool paged = paging_init();
+  if (paged) {
+    const paging_info *pi = paging_get_info();
+    term_puts(" [OK]", COLOR_SUCCESS);
+    if (pi->gb_pages)
+      term_puts(" 1GB pages", COLOR_SUCCESS);
+    if (pi->nx)
+      term_puts(" NX", COLOR_SUCCESS);
+    term_putc('\n');
+  } else {
+    term_puts(" [FAIL] (Staying on the boot tables)\n", COLOR_ERROR);
+  }
+
+  // The boot tables map the VGA hole with the kernel in one 2MB page
+  term_puts("Mapping video memory write-combining...", COLOR_LOGO);
+  if (!paged) {
+    term_puts(" [FAIL] (Boot tables, staying uncached)\n", COLOR_ERROR);
+  } else if (vga_init_memtype()) {
+    term_puts(" [OK]\n", COLOR_SUCCESS);
+  } else {
+    term_puts(" [FAIL] (No PAT, staying uncached)\n", COLOR_ERROR);
+  }
+
+  term_puts("Parsing ACPI tables...", COLOR_LOGO);
+  if (acpi_init()) {
+    const acpi_info *ai = acpi_get_info();
+    term_puts(" [OK] ", COLOR_SUCCESS);
+    term_put_uint(ai->cpu_count, COLOR_SUCCESS);
+    term_puts(ai->cpu_count == 1 ? " CPU" : " CPUs", COLOR_SUCCESS);
+    if (ai->hpet_addr)
+      term_puts(", HPET", COLOR_SUCCESS);
+    if (!ai->s5)
+      term_puts(", no S5", COLOR_ERROR);
+    term_putc('\n');
+  } else {
+    term_puts(" [FAIL] (No RSDP, shutdown disabled)\n", COLOR_ERROR);
+  }
+  BOOTBENCH_MARK("acpi_init");
+
+  // The disk's interrupt only matters once interrupts are on; until then
+  // the block queue transfers synchronously
+  ata_init();
 
   // Initialize Filesystem
   term_puts("Initializing Filesystem...", COLOR_LOGO);
@@ -1398,6 +1205,8 @@ extern "C" void kmain() {
   } else {
     term_puts(" [FAIL] (Disk not ready, using RAM mode)\n", COLOR_ERROR);
   }
+  BOOTBENCH_MARK("fs_init");
+  process_install_builtins();
 
   // Initialize SB16
   term_puts("Initializing SB16 Audio...", COLOR_LOGO);
@@ -1408,6 +1217,21 @@ extern "C" void kmain() {
     term_puts(" [FAIL] (Not detected)\n", COLOR_ERROR);
     sb16_active = false;
   }
+  BOOTBENCH_MARK("sb16_init");
+
+  // System tick and the speaker sequencer that runs from it
+  pit_init();
+  timer_init();
+  speaker_init();
+  kbd_init();
+
+  // Drivers have installed their IRQ handlers; start taking interrupts
+  asm volatile("sti");
+
+  if (sb16_active && !mixer_init()) {
+    term_puts("Audio mixer failed to start.\n", COLOR_ERROR);
+    sb16_active = false;
+  }
 
   term_puts("TacosOS Minimal Terminal initialized.\n", 0x0F);
   term_puts("Display: VGA 80x25 Text Mode\n\n");
@@ -1416,8 +1240,13 @@ extern "C" void kmain() {
   cmd_logo();
   term_puts("Type 'help' for more info.\n\n", COLOR_DEFAULT);
 
-  // Record boot time for uptime command
-  read_rtc(&boot_time);
+  cmd_init();
+
+  // Boot wall-clock time, then once-a-second RTC updates into the vDSO
+  rtc_init();
+
+  BOOTBENCH_MARK("prompt");
+  BOOTBENCH_RUN(execute_command);
 
   char cmd_buffer[81];
   int cmd_pos = 0;
@@ -1427,7 +1256,9 @@ extern "C" void kmain() {
     if (is_editing) {
       term_puts("EDITING > ", COLOR_PROMPT);
     } else {
-      term_puts(current_dir, COLOR_PROMPT);
+      char dir[FS_PATH_MAX];
+      fs_current_dir(dir);
+      term_puts(dir, COLOR_PROMPT);
       term_puts(" > ", COLOR_PROMPT);
     }
 
@@ -1453,7 +1284,11 @@ extern "C" void kmain() {
     }
 
     if (is_editing) {
-      kstrcpy(file_system[editing_file_idx].content, cmd_buffer);
+      MockFile f;
+      if (fs_get_file(editing_file_idx, &f)) {
+        kstrcpy(f.content, cmd_buffer);
+        fs_set_file(editing_file_idx, &f);
+      }
       term_puts("File updated.\n", COLOR_SUCCESS);
       is_editing = false;
       editing_file_idx = -1;
@@ -0,0 +1,304 @@
+#include "mixer.h"
+#include "cpu.h"
+#include "sb16.h"
+#include "synth.h"
+#include "trace.h"
+
+// Peak amplitude of synthesized tone voices before volume/pan
+#define TONE_AMP 8000
+
+enum voice_kind { VOICE_PCM, VOICE_TONE, VOICE_STREAM };
+
+struct Voice {
+  volatile bool active;
+  voice_kind kind;
+  int32_t gain_l; // 0..256
+  int32_t gain_r;
+
+  // PCM: 16.16 fixed-point read position and step for rate conversion
+  const int16_t *samples;
+  uint32_t count;
+  uint64_t pos;
+  uint32_t step;
+  bool loop;
+
+  // Tone: wavetable oscillator with envelope
+  synth_voice osc;
+};
+
+static Voice voices[MIXER_VOICES];
+
+// Streaming voice input: single producer (foreground), consumed here.
+// The voice reuses `pos` for the 16-bit fractional frame position.
+static int16_t stream_ring[MIXER_STREAM_SAMPLES];
+static volatile uint32_t stream_head = 0;
+static volatile uint32_t stream_tail = 0;
+static volatile bool stream_ended = false;
+static uint32_t stream_channels = 1;
+volatile uint32_t mixer_stream_underruns = 0;
+
+// Voices are summed at 32 bits and saturated once per block
+static int32_t acc[MIXER_BLOCK_FRAMES * 2];
+static int16_t out[MIXER_BLOCK_FRAMES * 2];
+
+static mixer_stats stats;
+static bool running = false;
+
+static void set_gains(Voice *v, uint16_t volume, uint16_t pan) {
+  if (volume > MIXER_VOL_MAX)
+    volume = MIXER_VOL_MAX;
+  if (pan > 256)
+    pan = 256;
+  // Center keeps both sides at full volume; panning attenuates one side
+  uint32_t l = (256 - pan) * 2;
+  uint32_t r = pan * 2;
+  v->gain_l = volume * (l > 256 ? 256 : l) >> 8;
+  v->gain_r = volume * (r > 256 ? 256 : r) >> 8;
+}
+
+static void mix_pcm(Voice *v) {
+  int32_t gl = v->gain_l, gr = v->gain_r;
+  uint64_t end = (uint64_t)v->count << 16;
+  for (int i = 0; i < MIXER_BLOCK_FRAMES; i++) {
+    if (v->pos >= end) {
+      if (!v->loop) {
+        v->active = false;
+        return;
+      }
+      // A step longer than the sample can pass its end more than once
+      v->pos %= end;
+    }
+    int32_t s = v->samples[v->pos >> 16];
+    v->pos += v->step;
+    acc[2 * i] += (s * gl) >> 8;
+    acc[2 * i + 1] += (s * gr) >> 8;
+  }
+}
+
+static void mix_tone(Voice *v) {
+  int32_t gl = v->gain_l, gr = v->gain_r;
+  for (int i = 0; i < MIXER_BLOCK_FRAMES; i++) {
+    if (v->osc.frames_left == 0) {
+      v->active = false;
+      return;
+    }
+    int32_t s = synth_next(&v->osc);
+    acc[2 * i] += (s * gl) >> 8;
+    acc[2 * i + 1] += (s * gr) >> 8;
+  }
+}
+
+static void mix_stream(Voice *v) {
+  int32_t gl = v->gain_l, gr = v->gain_r;
+  uint32_t ch = stream_channels;
+  uint32_t tail = stream_tail;
+  for (int i = 0; i < MIXER_BLOCK_FRAMES; i++) {
+    uint32_t avail = (stream_head - tail) / ch;
+    if (avail == 0) {
+      if (stream_ended)
+        v->active = false;
+      else
+        mixer_stream_underruns = mixer_stream_underruns + 1;
+      break;
+    }
+    int32_t l = stream_ring[tail & (MIXER_STREAM_SAMPLES - 1)];
+    int32_t r = ch == 2 ? stream_ring[(tail + 1) & (MIXER_STREAM_SAMPLES - 1)]
+                        : l;
+    acc[2 * i] += (l * gl) >> 8;
+    acc[2 * i + 1] += (r * gr) >> 8;
+
+    v->pos += v->step;
+    uint32_t adv = (uint32_t)(v->pos >> 16);
+    v->pos &= 0xFFFF;
+    tail += (adv < avail ? adv : avail) * ch;
+  }
+  stream_tail = tail;
+}
+
+// Mixes every active voice into one saturated 16-bit stereo block
+static void render_block() {
+  uint64_t start = rdtsc();
+
+  for (int i = 0; i < MIXER_BLOCK_FRAMES * 2; i++)
+    acc[i] = 0;
+
+  uint32_t active = 0;
+  for (int v = 0; v < MIXER_VOICES; v++) {
+    if (!voices[v].active)
+      continue;
+    active++;
+    if (voices[v].kind == VOICE_PCM)
+      mix_pcm(&voices[v]);
+    else if (voices[v].kind == VOICE_TONE)
+      mix_tone(&voices[v]);
+    else
+      mix_stream(&voices[v]);
+  }
+
+  for (int i = 0; i < MIXER_BLOCK_FRAMES * 2; i++) {
+    int32_t s = acc[i];
+    if (s > 32767)
+      s = 32767;
+    else if (s < -32768)
+      s = -32768;
+    out[i] = (int16_t)s;
+  }
+
+  uint64_t cycles = rdtsc() - start;
+  stats.blocks++;
+  stats.active_voices = active;
+  stats.last_cycles = cycles;
+  stats.total_cycles += cycles;
+  if (cycles > stats.max_cycles)
+    stats.max_cycles = cycles;
+}
+
+void mixer_pump() {
+  if (!running)
+    return;
+  while (SB16_RING_SAMPLES - sb16_ring_free() < MIXER_TARGET_SAMPLES) {
+    render_block();
+    sb16_write(out, MIXER_BLOCK_FRAMES * 2);
+  }
+}
+
+bool mixer_init() {
+  for (int v = 0; v < MIXER_VOICES; v++)
+    voices[v].active = false;
+  stats = mixer_stats();
+  stats.budget_cycles = tsc_hz * MIXER_BLOCK_FRAMES / MIXER_RATE;
+
+  running = true;
+  mixer_pump(); // Prefill with silence so the first halves aren't empty
+  sb16_set_refill_hook(mixer_pump);
+  if (!sb16_stream_start(MIXER_RATE, true)) {
+    running = false;
+    sb16_set_refill_hook(nullptr);
+    return false;
+  }
+  return true;
+}
+
+// Claims an idle voice; the caller fills it in and then sets `active`
+static int alloc_voice() {
+  for (int v = 0; v < MIXER_VOICES; v++) {
+    if (!voices[v].active)
+      return v;
+  }
+  return -1;
+}
+
+TRACEPOINT(mixer_play);
+
+int mixer_play_pcm(const int16_t *samples, uint32_t count, uint32_t hz,
+                   uint16_t volume, uint16_t pan, bool loop) {
+  TRACE(mixer_play, count, hz);
+  if (!running || count == 0)
+    return -1;
+  int idx = alloc_voice();
+  if (idx < 0)
+    return -1;
+
+  Voice *v = &voices[idx];
+  v->kind = VOICE_PCM;
+  v->samples = samples;
+  v->count = count;
+  v->pos = 0;
+  v->step = ((uint64_t)hz << 16) / MIXER_RATE;
+  v->loop = loop;
+  set_gains(v, volume, pan);
+  asm volatile("" : : : "memory"); // Publish the voice to the IRQ last
+  v->active = true;
+  return idx;
+}
+
+int mixer_play_tone(uint32_t freq, uint32_t ms, uint16_t volume,
+                    uint16_t pan) {
+  if (!running || freq == 0)
+    return -1;
+  int idx = alloc_voice();
+  if (idx < 0)
+    return -1;
+
+  Voice *v = &voices[idx];
+  v->kind = VOICE_TONE;
+  synth_note_on(&v->osc, WAVE_SQUARE, freq, ms * MIXER_RATE / 1000,
+                MIXER_RATE, TONE_AMP);
+  set_gains(v, volume, pan);
+  asm volatile("" : : : "memory");
+  v->active = true;
+  return idx;
+}
+
+int mixer_stream_start(uint32_t hz, int channels, uint16_t volume,
+                       uint16_t pan) {
+  if (!running || (channels != 1 && channels != 2))
+    return -1;
+  for (int i = 0; i < MIXER_VOICES; i++) {
+    if (voices[i].active && voices[i].kind == VOICE_STREAM)
+      return -1;
+  }
+  int idx = alloc_voice();
+  if (idx < 0)
+    return -1;
+
+  stream_head = 0;
+  stream_tail = 0;
+  stream_ended = false;
+  stream_channels = channels;
+  mixer_stream_underruns = 0;
+
+  Voice *v = &voices[idx];
+  v->kind = VOICE_STREAM;
+  v->pos = 0;
+  v->step = ((uint64_t)hz << 16) / MIXER_RATE;
+  set_gains(v, volume, pan);
+  asm volatile("" : : : "memory");
+  v->active = true;
+  return idx;
+}
+
+uint32_t mixer_stream_queued() { return stream_head - stream_tail; }
+
+uint32_t mixer_stream_write(const int16_t *samples, uint32_t count) {
+  uint32_t free = MIXER_STREAM_SAMPLES - mixer_stream_queued();
+  if (count > free)
+    count = free;
+  uint32_t head = stream_head;
+  for (uint32_t i = 0; i < count; i++)
+    stream_ring[(head + i) & (MIXER_STREAM_SAMPLES - 1)] = samples[i];
+  asm volatile("" : : : "memory");
+  stream_head = head + count;
+  return count;
+}
+
+void mixer_stream_end() { stream_ended = true; }
+
+void mixer_set_volume(int voice, uint16_t volume, uint16_t pan) {
+  if (voice >= 0 && voice < MIXER_VOICES)
+    set_gains(&voices[voice], volume, pan);
+}
+
+void mixer_stop(int voice) {
+  if (voice >= 0 && voice < MIXER_VOICES)
+    voices[voice].active = false;
+}
+
+void mixer_stop_all() {
+  for (int v = 0; v < MIXER_VOICES; v++)
+    voices[v].active = false;
+}
+
+void mixer_stop_samples(const int16_t *samples) {
+  // The mixer only runs in the IRQ5 bottom half on this CPU, so it can't
+  // be partway through a voice that is stopped here
+  for (int v = 0; v < MIXER_VOICES; v++)
+    if (voices[v].kind == VOICE_PCM && voices[v].samples == samples)
+      voices[v].active = false;
+}
+
+bool mixer_voice_active(int voice) {
+  return voice >= 0 && voice < MIXER_VOICES && voices[voice].active;
+}
+
+void mixer_get_stats(mixer_stats *out_stats) { *out_stats = stats; }
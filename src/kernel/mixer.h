@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+
+// Output format: 16-bit signed stereo
+#define MIXER_RATE 44100
+#define MIXER_VOICES 8
+#define MIXER_BLOCK_FRAMES 512
+// Samples kept queued in the SB16 ring (~93ms), bounds added latency
+#define MIXER_TARGET_SAMPLES 8192
+
+// Ring behind the streaming voice, in samples (~0.37s of 44.1kHz stereo)
+#define MIXER_STREAM_SAMPLES 32768
+
+// Volume is 0..256 (unity = 256), pan is 0 (left) .. 128 (center) .. 256
+#define MIXER_VOL_MAX 256
+#define MIXER_PAN_CENTER 128
+
+struct mixer_stats {
+  uint32_t blocks;
+  uint32_t active_voices;
+  uint64_t last_cycles;
+  uint64_t max_cycles;
+  uint64_t total_cycles;
+  uint64_t budget_cycles; // TSC cycles one block lasts in real time
+};
+
+// Starts the SB16 stream and keeps it fed from the IRQ5 bottom half
+bool mixer_init();
+
+// Starts a voice and returns its handle, or -1 if all voices are busy.
+// PCM samples are mono at `hz` and resampled to MIXER_RATE.
+int mixer_play_pcm(const int16_t *samples, uint32_t count, uint32_t hz,
+                   uint16_t volume, uint16_t pan, bool loop);
+int mixer_play_tone(uint32_t freq, uint32_t ms, uint16_t volume,
+                    uint16_t pan);
+
+// Starts the streaming voice: interleaved samples at `hz` are pushed with
+// mixer_stream_write() while it plays. Only one stream plays at a time.
+int mixer_stream_start(uint32_t hz, int channels, uint16_t volume,
+                       uint16_t pan);
+uint32_t mixer_stream_write(const int16_t *samples, uint32_t count);
+uint32_t mixer_stream_queued();
+// No more data is coming; the voice ends once the ring drains
+void mixer_stream_end();
+
+// Blocks in which the streaming voice ran dry before its end
+extern volatile uint32_t mixer_stream_underruns;
+
+void mixer_set_volume(int voice, uint16_t volume, uint16_t pan);
+void mixer_stop(int voice);
+void mixer_stop_all();
+// Stops every PCM voice reading from `samples`, so the caller can reuse
+// the buffer. Once this returns the mixer no longer touches it.
+void mixer_stop_samples(const int16_t *samples);
+bool mixer_voice_active(int voice);
+
+// Renders blocks until MIXER_TARGET_SAMPLES are queued
+void mixer_pump();
+void mixer_get_stats(mixer_stats *out);
@@ -0,0 +1,72 @@
+#pragma once
+#include "paging.h"
+#include <stdint.h>
+
+// Multiboot2 boot information tags (only the ones the kernel reads)
+#define MB2_TAG_END 0
+#define MB2_TAG_MMAP 6
+#define MB2_TAG_FRAMEBUFFER 8
+#define MB2_TAG_ACPI_OLD 14
+#define MB2_TAG_ACPI_NEW 15
+
+struct mb2_tag {
+  uint32_t type;
+  uint32_t size;
+} __attribute__((packed));
+
+struct mb2_tag_framebuffer {
+  uint32_t type;
+  uint32_t size;
+  uint64_t addr;
+  uint32_t pitch;
+  uint32_t width;
+  uint32_t height;
+  uint8_t bpp;
+  uint8_t fb_type; // 0 = indexed, 1 = RGB, 2 = EGA text
+  uint16_t reserved;
+} __attribute__((packed));
+
+struct mb2_mmap_entry {
+  uint64_t base;
+  uint64_t length;
+  uint32_t type; // 1 = available RAM
+  uint32_t reserved;
+} __attribute__((packed));
+
+struct mb2_tag_mmap {
+  uint32_t type;
+  uint32_t size;
+  uint32_t entry_size;
+  uint32_t entry_version;
+  // Followed by entries of entry_size bytes
+} __attribute__((packed));
+
+#define MB2_MMAP_AVAILABLE 1
+#define MB2_MMAP_ACPI 3 // ACPI tables, reclaimable once parsed
+#define MB2_MMAP_NVS 4  // ACPI non-volatile storage
+
+// Physical address, saved from ebx by boot.asm before entering long mode
+extern "C" uint64_t multiboot_info_ptr;
+
+// Size of the whole info block, so it can be kept out of the allocator
+static inline uint32_t mb2_info_size() {
+  return multiboot_info_ptr
+             ? *(uint32_t *)phys_to_virt(multiboot_info_ptr)
+             : 0;
+}
+
+// Returns the first tag of the given type, or nullptr
+static inline const mb2_tag *mb2_find_tag(uint32_t type) {
+  if (!multiboot_info_ptr)
+    return nullptr;
+  // Info block: total_size(4) + reserved(4), then 8-byte aligned tags
+  uint8_t *p = (uint8_t *)phys_to_virt(multiboot_info_ptr) + 8;
+  while (1) {
+    const mb2_tag *tag = (const mb2_tag *)p;
+    if (tag->type == MB2_TAG_END)
+      return nullptr;
+    if (tag->type == type)
+      return tag;
+    p += (tag->size + 7) & ~7u;
+  }
+}
@@ -0,0 +1,374 @@
+#include "paging.h"
+#include "cpu.h"
+#include "multiboot.h"
+#include "pmm.h"
+#include "tlb.h"
+
+// Section bounds of the kernel image, from linker.ld
+extern "C" const uint8_t kernel_text_start[], kernel_rodata_start[],
+    kernel_data_start[], kernel_end[];
+
+// PA0..PA7: WB, WC, UC-, UC, then the same again so the PAT bit is unused.
+// Encodings: UC=0x00, WC=0x01, WB=0x06, UC-=0x07.
+#define PAT_LAYOUT 0x0007010600070106ull
+
+static bool pat_ok = false;
+
+bool pat_init() {
+  uint32_t a, b, c, d;
+  cpuid(1, 0, &a, &b, &c, &d);
+  if (!(d & CPUID_1_EDX_PAT))
+    return false;
+
+  wbinvd();
+  wrmsr(MSR_PAT, PAT_LAYOUT);
+  wbinvd();
+  tlb_flush_all(); // So no entry keeps the old type
+  pat_ok = true;
+  return true;
+}
+
+// Also takes a CR3 value, dropping the PCID
+static uint64_t *table_at(uint64_t phys) {
+  return (uint64_t *)phys_to_virt(phys & PTE_ADDR_MASK);
+}
+
+// Walks the live page tables. Returns the leaf entry for virt and its size.
+static uint64_t *pte_lookup(uint64_t virt, uint64_t *page_size) {
+  uint64_t *table = table_at(read_cr3() & PTE_ADDR_MASK);
+  int shift = 39;
+  for (int level = 4; level >= 1; level--, shift -= 9) {
+    uint64_t *entry = &table[(virt >> shift) & 0x1FF];
+    if (!(*entry & PTE_PRESENT))
+      return nullptr;
+    if (level == 1 || (level <= 3 && (*entry & PTE_HUGE))) {
+      *page_size = 1ull << shift;
+      return entry;
+    }
+    table = table_at(*entry & PTE_ADDR_MASK);
+  }
+  return nullptr;
+}
+
+uint64_t paging_page_size(uint64_t virt) {
+  uint64_t size;
+  return pte_lookup(virt, &size) ? size : 0;
+}
+
+bool paging_set_memtype(uint64_t virt, uint64_t len, mem_type type) {
+  if (!pat_ok)
+    return false;
+
+  uint64_t start = virt & ~0xFFFull;
+  uint64_t end = (virt + len + 0xFFF) & ~0xFFFull;
+  // A page reaching outside the range would change memory that wasn't
+  // asked for, such as kernel data sharing a boot table's 2MB page
+  for (uint64_t addr = start; addr < end;) {
+    uint64_t size;
+    uint64_t *entry = pte_lookup(addr, &size);
+    if (!entry)
+      return false;
+    uint64_t page = addr & ~(size - 1);
+    if (page < start || page + size > end)
+      return false;
+    addr = page + size;
+  }
+
+  uint64_t addr = start;
+  while (addr < end) {
+    uint64_t size;
+    uint64_t *entry = pte_lookup(addr, &size);
+
+    uint64_t pat_bit = (size == 0x1000) ? PTE_PAT_4K : PTE_PAT_HUGE;
+    uint64_t val = *entry & ~(PTE_PWT | PTE_PCD | pat_bit);
+    if (type & 1)
+      val |= PTE_PWT;
+    if (type & 2)
+      val |= PTE_PCD;
+    *entry = val;
+    invlpg(addr);
+
+    addr = (addr & ~(size - 1)) + size;
+  }
+  // Drop lines cached under the old type
+  wbinvd();
+  return true;
+}
+
+#define PML4_USER_FIRST 1
+#define PML4_USER_END 256
+
+static uint64_t alloc_table() {
+  uint64_t phys = pmm_alloc();
+  if (phys) {
+    uint64_t *t = table_at(phys);
+    for (int i = 0; i < 512; i++)
+      t[i] = 0;
+  }
+  return phys;
+}
+
+// Returns the entry for `virt` in the level whose pages are 1 << `shift`
+// bytes, creating missing tables with `table_flags`. Stops early at a
+// huge page that already covers `virt`. Returns nullptr if out of memory.
+static uint64_t *walk(uint64_t pml4, uint64_t virt, int shift,
+                      uint64_t table_flags) {
+  uint64_t *table = table_at(pml4);
+  for (int s = 39; s > shift; s -= 9) {
+    uint64_t *entry = &table[(virt >> s) & 0x1FF];
+    if (!(*entry & PTE_PRESENT)) {
+      uint64_t next = alloc_table();
+      if (!next)
+        return nullptr;
+      *entry = next | table_flags;
+    } else if (*entry & PTE_HUGE) {
+      return entry;
+    }
+    table = table_at(*entry & PTE_ADDR_MASK);
+  }
+  return &table[(virt >> shift) & 0x1FF];
+}
+
+// --- Kernel page tables ---
+
+// Intermediate levels allow everything; the leaf decides
+#define KERNEL_TABLE_FLAGS (PTE_PRESENT | PTE_WRITABLE)
+
+// Everything below 1MB is mapped, RAM or not, for the VGA hole and the
+// BIOS areas
+#define LOW_MEMORY_END 0x100000ull
+
+// The boot page tables map this much at PHYS_MAP_BASE
+#define BOOT_MAP_END 0x100000000ull
+
+static uint64_t kernel_pml4 = 0;
+static uint64_t nx_bit = 0;
+static paging_info info;
+
+// Maps the kernel image range [start, end) with 4K pages
+static bool map_image(const uint8_t *start, const uint8_t *end,
+                      uint64_t flags) {
+  for (uint64_t v = (uint64_t)start; v < (uint64_t)end; v += PAGE_SIZE) {
+    uint64_t *pte = walk(kernel_pml4, v, 12, KERNEL_TABLE_FLAGS);
+    if (!pte)
+      return false;
+    *pte = (v - KERNEL_VMA) | flags | PTE_PRESENT | PTE_GLOBAL;
+  }
+  return true;
+}
+
+// Largest page size (as a shift) that can map `phys` without going past
+// `end`
+static int page_shift(uint64_t phys, uint64_t end) {
+  for (int shift = info.gb_pages ? 30 : 21; shift > 12; shift -= 9) {
+    uint64_t size = 1ull << shift;
+    if (!(phys & (size - 1)) && end - phys >= size)
+      return shift;
+  }
+  return 12;
+}
+
+// Maps [start, end) into the direct map. Pages already mapped are kept,
+// and a range that already has some small pages is filled in with small
+// pages rather than a huge one.
+static bool map_direct(uint64_t start, uint64_t end, uint64_t flags) {
+  uint64_t phys = start & ~(uint64_t)(PAGE_SIZE - 1);
+  end = (end + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+  while (phys < end) {
+    int shift = page_shift(phys, end);
+    uint64_t *entry;
+    while (1) {
+      entry = walk(kernel_pml4, PHYS_MAP_BASE + phys, shift,
+                   KERNEL_TABLE_FLAGS);
+      if (!entry)
+        return false;
+      if (shift == 12 || !(*entry & PTE_PRESENT) || (*entry & PTE_HUGE))
+        break;
+      shift -= 9; // A table is there already
+    }
+    if (!(*entry & PTE_PRESENT)) {
+      *entry = phys | flags | PTE_PRESENT | (shift > 12 ? PTE_HUGE : 0);
+      info.direct_pages[(shift - 12) / 9]++;
+    }
+    phys += 1ull << shift;
+  }
+  return true;
+}
+
+// Maps RAM except the kernel image, so the image's text can't be
+// written through a second mapping
+static bool map_ram(uint64_t start, uint64_t end) {
+  uint64_t image_start = virt_to_phys(kernel_text_start);
+  uint64_t image_end = virt_to_phys(kernel_end);
+  uint64_t flags = PTE_WRITABLE | PTE_GLOBAL | nx_bit;
+  if (start < image_start &&
+      !map_direct(start, end < image_start ? end : image_start, flags))
+    return false;
+  if (end > image_end &&
+      !map_direct(start > image_end ? start : image_end, end, flags))
+    return false;
+  return true;
+}
+
+bool paging_init() {
+  uint32_t a, b, c, d;
+  cpuid(0x80000001, 0, &a, &b, &c, &d);
+  info.gb_pages = d & CPUID_80000001_EDX_PDPE1GB;
+  if (d & CPUID_80000001_EDX_NX) {
+    wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NXE);
+    nx_bit = PTE_NX;
+    info.nx = true;
+  }
+
+  const mb2_tag_mmap *mmap = (const mb2_tag_mmap *)mb2_find_tag(MB2_TAG_MMAP);
+  if (!mmap)
+    return false;
+  kernel_pml4 = alloc_table();
+  if (!kernel_pml4)
+    return false;
+
+  // Running out of memory this early leaves the partial tables behind;
+  // there's nothing else to use them for anyway
+  bool ok = map_image(kernel_text_start, kernel_rodata_start, 0) &&
+            map_image(kernel_rodata_start, kernel_data_start, nx_bit) &&
+            map_image(kernel_data_start, kernel_end, PTE_WRITABLE | nx_bit) &&
+            map_ram(0, LOW_MEMORY_END);
+
+  // ACPI tables live in the reclaimable and NVS ranges
+  const uint8_t *p = (const uint8_t *)(mmap + 1);
+  const uint8_t *end = (const uint8_t *)mmap + mmap->size;
+  for (; ok && p + mmap->entry_size <= end; p += mmap->entry_size) {
+    const mb2_mmap_entry *e = (const mb2_mmap_entry *)p;
+    if (e->type == MB2_MMAP_AVAILABLE || e->type == MB2_MMAP_ACPI ||
+        e->type == MB2_MMAP_NVS)
+      ok = map_ram(e->base, e->base + e->length);
+  }
+  if (!ok) {
+    kernel_pml4 = 0;
+    return false;
+  }
+
+  write_cr3(kernel_pml4);
+  write_cr0(read_cr0() | CR0_WP);
+  tlb_init();
+  return true;
+}
+
+const paging_info *paging_get_info() { return &info; }
+
+void *paging_map_mmio(uint64_t phys, uint64_t len, mem_type type) {
+  if (!kernel_pml4)
+    return phys + len <= BOOT_MAP_END ? phys_to_virt(phys) : nullptr;
+  if (!pat_ok)
+    type = MEM_UC;
+
+  uint64_t flags = PTE_WRITABLE | PTE_GLOBAL | nx_bit |
+                   ((type & 1) ? PTE_PWT : 0) | ((type & 2) ? PTE_PCD : 0);
+  uint64_t end = phys + len;
+  for (uint64_t page = phys & ~0xFFFull; page < end; page += PAGE_SIZE) {
+    uint64_t *pte = walk(kernel_pml4, PHYS_MAP_BASE + page, 12,
+                         KERNEL_TABLE_FLAGS);
+    if (!pte)
+      return nullptr;
+    if (!(*pte & PTE_PRESENT))
+      *pte = page | flags | PTE_PRESENT;
+  }
+  return phys_to_virt(phys);
+}
+
+// --- User address spaces ---
+
+uint64_t vm_create() {
+  uint64_t pml4 = alloc_table();
+  if (!pml4)
+    return 0;
+  // Share every kernel slot; the user slots start empty
+  uint64_t *dst = table_at(pml4);
+  uint64_t *src = table_at(read_cr3());
+  for (int i = 0; i < 512; i++)
+    if (i < PML4_USER_FIRST || i >= PML4_USER_END)
+      dst[i] = src[i];
+  return pml4 | pcid_alloc();
+}
+
+bool vm_map(uint64_t pml4, uint64_t virt, uint64_t phys, uint64_t flags) {
+  if (virt < USER_SPACE_START || virt >= USER_SPACE_END)
+    return false;
+  // Intermediate levels allow everything; the leaf decides
+  uint64_t *leaf =
+      walk(pml4, virt, 12, PTE_PRESENT | PTE_WRITABLE | PTE_USER);
+  if (!leaf || (*leaf & PTE_PRESENT))
+    return false;
+  *leaf = (phys & PTE_ADDR_MASK) | flags | PTE_PRESENT | PTE_USER;
+  return true;
+}
+
+// Frees a table at `level` (3 = PDPT .. 1 = PT) and everything below it
+static void free_table(uint64_t phys, int level) {
+  uint64_t *t = table_at(phys);
+  for (int i = 0; i < 512; i++) {
+    if (!(t[i] & PTE_PRESENT))
+      continue;
+    if (level > 1)
+      free_table(t[i] & PTE_ADDR_MASK, level - 1);
+    else if (!(t[i] & PTE_SHARED))
+      pmm_free(t[i] & PTE_ADDR_MASK);
+  }
+  pmm_free(phys);
+}
+
+void vm_destroy(uint64_t pml4) {
+  uint64_t *t = table_at(pml4);
+  for (int i = PML4_USER_FIRST; i < PML4_USER_END; i++)
+    if (t[i] & PTE_PRESENT)
+      free_table(t[i] & PTE_ADDR_MASK, 3);
+  pmm_free(pml4 & PTE_ADDR_MASK);
+  pcid_free(pml4 & CR3_PCID_MASK);
+}
+
+// Returns the leaf entry for a 4K user page, or nullptr
+static uint64_t *user_pte(uint64_t pml4, uint64_t virt) {
+  uint64_t *table = table_at(pml4);
+  for (int shift = 39; shift > 12; shift -= 9) {
+    uint64_t entry = table[(virt >> shift) & 0x1FF];
+    if (!(entry & PTE_PRESENT))
+      return nullptr;
+    table = table_at(entry & PTE_ADDR_MASK);
+  }
+  return &table[(virt >> 12) & 0x1FF];
+}
+
+void vm_unmap(uint64_t pml4, uint64_t virt, uint64_t pages) {
+  if (virt < USER_SPACE_START || virt >= USER_SPACE_END ||
+      pages > (USER_SPACE_END - virt) / PAGE_SIZE)
+    return;
+  tlb_batch batch;
+  tlb_batch_init(&batch, pml4);
+  for (uint64_t i = 0; i < pages; i++, virt += PAGE_SIZE) {
+    uint64_t *pte = user_pte(pml4, virt);
+    if (!pte || !(*pte & PTE_PRESENT))
+      continue;
+    uint64_t old = *pte;
+    *pte = 0;
+    tlb_batch_add(&batch, virt);
+    // The frame can be reused as soon as no TLB can reach it, which is
+    // after the flush below; nothing runs in this space until then
+    if (!(old & PTE_SHARED))
+      pmm_free(old & PTE_ADDR_MASK);
+  }
+  tlb_batch_flush(&batch);
+}
+
+bool vm_user_range(uint64_t pml4, uint64_t virt, uint64_t len, bool write) {
+  if (virt < USER_SPACE_START || virt >= USER_SPACE_END ||
+      len > USER_SPACE_END - virt)
+    return false;
+  uint64_t need = PTE_PRESENT | PTE_USER | (write ? PTE_WRITABLE : 0);
+  for (uint64_t page = virt & ~0xFFFull; page < virt + len;
+       page += PAGE_SIZE) {
+    uint64_t *pte = user_pte(pml4, page);
+    if (!pte || (*pte & need) != need)
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <stdint.h>
+
+#define PAGE_SIZE 4096
+
+#define PTE_PRESENT (1ull << 0)
+#define PTE_WRITABLE (1ull << 1)
+#define PTE_USER (1ull << 2)
+#define PTE_PWT (1ull << 3)
+#define PTE_PCD (1ull << 4)
+#define PTE_HUGE (1ull << 7)      // PS bit in PDPT/PD entries
+#define PTE_PAT_4K (1ull << 7)    // PAT bit in a 4K PTE
+#define PTE_GLOBAL (1ull << 8)    // Kept across CR3 loads (CR4.PGE)
+#define PTE_SHARED (1ull << 9)    // Software bit: frame not owned by the space
+#define PTE_PAT_HUGE (1ull << 12) // PAT bit in a 2MB/1GB entry
+#define PTE_NX (1ull << 63)       // Only valid once EFER.NXE is set
+#define PTE_ADDR_MASK 0x000FFFFFFFFFF000ull
+
+// User address spaces own PML4 slots 1..255 (512GB up to the top of the
+// lower half). Slot 0 is left unmapped so stray low pointers fault.
+#define USER_SPACE_START 0x0000008000000000ull
+#define USER_SPACE_END 0x0000800000000000ull
+
+// The kernel half. Physical memory is mapped at PHYS_MAP_BASE (the "direct
+// map", PML4 slot 256) and the kernel image is linked at KERNEL_VMA, the
+// top 2GB. Both are shared by every address space.
+#define PHYS_MAP_BASE 0xFFFF800000000000ull
+#define KERNEL_VMA 0xFFFFFFFF80000000ull
+
+// Memory types selectable through the PAT. The value is the PAT index,
+// encoded in a page table entry as PAT:PCD:PWT.
+enum mem_type {
+  MEM_WB = 0,
+  MEM_WC = 1,
+  MEM_UC_MINUS = 2,
+  MEM_UC = 3,
+};
+
+// Programs the PAT MSR with the layout above. Returns false if the CPU has
+// no PAT, in which case memory types can't be changed.
+bool pat_init();
+
+// Works for kernel image and direct map addresses
+static inline uint64_t virt_to_phys(const void *virt) {
+  uint64_t v = (uint64_t)virt;
+  return v >= KERNEL_VMA ? v - KERNEL_VMA : v - PHYS_MAP_BASE;
+}
+
+// Address of `phys` in the direct map. The boot page tables cover the
+// first 4GB; after paging_init() only RAM and paging_map_mmio() ranges.
+static inline void *phys_to_virt(uint64_t phys) {
+  return (void *)(phys + PHYS_MAP_BASE);
+}
+
+// Replaces the boot page tables. The direct map is built from the
+// multiboot memory map with the largest pages each range allows (1GB if
+// the CPU has them, else 2MB, 4K at the edges). The kernel image gets 4K
+// pages: text read-only, rodata read-only and no-execute, data writable
+// and no-execute. Returns false, staying on the boot tables, if there is
+// no memory map or not enough memory.
+bool paging_init();
+
+struct paging_info {
+  bool nx;       // No-execute enforced
+  bool gb_pages; // CPU supports 1GB pages
+  uint64_t direct_pages[3]; // Direct map pages of 4K, 2MB and 1GB
+};
+
+const paging_info *paging_get_info();
+
+// Size of the page mapping `virt` in the current address space, or 0 if
+// it isn't mapped
+uint64_t paging_page_size(uint64_t virt);
+
+// Maps device memory into the direct map with the given type (uncached
+// if the CPU has no PAT) and returns its address there. RAM pages already
+// mapped keep their type. Returns nullptr if out of memory.
+void *paging_map_mmio(uint64_t phys, uint64_t len, mem_type type);
+
+// Changes the memory type of the pages covering [virt, virt + len).
+// Fails, changing nothing, if a page is unmapped or reaches outside the
+// range, as a huge page holding other memory would.
+bool paging_set_memtype(uint64_t virt, uint64_t len, mem_type type);
+
+// User address spaces are named by their CR3 value: the PML4's physical
+// address plus a PCID (tlb.h). Load one with tlb_switch().
+
+// Creates an address space sharing the kernel's mappings. Returns its CR3
+// value, or 0 if out of memory.
+uint64_t vm_create();
+
+// Maps one 4K page in a user address space. `flags` are PTE_* bits;
+// PTE_PRESENT and PTE_USER are implied. Fails if the page is taken.
+bool vm_map(uint64_t pml4, uint64_t virt, uint64_t phys, uint64_t flags);
+
+// Unmaps `pages` 4K user pages from `virt` and frees their frames, except
+// PTE_SHARED ones. The TLB is flushed once for the whole range.
+void vm_unmap(uint64_t pml4, uint64_t virt, uint64_t pages);
+
+// Frees the user half of an address space, its page tables, the PML4 and
+// its PCID. Frames mapped with PTE_SHARED are left alone. The address
+// space must not be loaded in CR3.
+void vm_destroy(uint64_t pml4);
+
+// True if [virt, virt + len) is mapped user-accessible in `pml4` (and
+// writable, if `write`)
+bool vm_user_range(uint64_t pml4, uint64_t virt, uint64_t len, bool write);
@@ -0,0 +1,337 @@
+#include "pipe.h"
+#include "block.h"
+#include "cmd.h"
+#include "fs.h"
+#include "kstring.h"
+#include "paging.h"
+#include "pmm.h"
+#include "term.h"
+
+#define PIPE_MAX_STAGES 4
+// Pages a writer can queue before its reader has to run
+#define PIPE_RING_PAGES 4
+
+enum pipe_sink { SINK_FILTER, SINK_FILE };
+
+struct pipe {
+  pipe_sink sink;
+  // SINK_FILTER: the reading stage, its state page and its own output
+  const cmd_filter *filter;
+  void *state;
+  pipe *next;
+  // SINK_FILE: extent being written, grown one page at a time
+  int file;
+  uint32_t next_lba;
+  bool failed;
+
+  uint8_t *ring[PIPE_RING_PAGES]; // Full pages, oldest first
+  uint32_t ring_len[PIPE_RING_PAGES];
+  uint32_t head, count;
+  uint8_t *fill; // Page being written
+  uint32_t fill_len;
+};
+
+static pipe pipes[PIPE_MAX_STAGES];
+static pipe *out = nullptr; // Where the running stage's output goes
+
+static uint8_t *page_alloc() {
+  uint64_t phys = pmm_alloc();
+  return phys ? (uint8_t *)phys_to_virt(phys) : nullptr;
+}
+
+static void page_free(uint8_t *page) { pmm_free(virt_to_phys(page)); }
+
+static void file_write(pipe *p, const uint8_t *buf, uint32_t len) {
+  uint32_t sectors = (len + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+  MockFile f;
+  uint32_t lba = fs_get_file(p->file, &f) ? fs_alloc_data(sectors) : 0;
+  // The extent must stay contiguous: nothing else allocates mid-pipeline
+  if (lba == 0 || (f.data_size && lba != p->next_lba)) {
+    p->failed = true;
+    return;
+  }
+  if (f.data_size == 0) {
+    f.data_lba = lba;
+    // The start of the text doubles as the file's inline content
+    uint32_t n = len < sizeof(f.content) - 1 ? len : sizeof(f.content) - 1;
+    for (uint32_t i = 0; i < n; i++)
+      f.content[i] = buf[i];
+    f.content[n] = '\0';
+  }
+  // Whole sectors straight from the page; the tail of the last one is
+  // whatever the page held, and data_size says where the file ends
+  if (!blk_transfer(lba, sectors, (void *)buf, true))
+    p->failed = true;
+  p->next_lba = lba + sectors;
+  f.data_size += len;
+  fs_set_file(p->file, &f);
+}
+
+// Hands one page to the reader. The reader's output goes to its own pipe.
+static void deliver(pipe *p, const uint8_t *buf, uint32_t len) {
+  if (p->failed)
+    return;
+  if (p->sink == SINK_FILE) {
+    file_write(p, buf, len);
+    return;
+  }
+  pipe *saved = out;
+  out = p->next;
+  p->filter->data(p->state, buf, len);
+  out = saved;
+}
+
+// With no scheduler, a writer that would block hands the CPU straight to
+// its reader, which consumes everything queued and returns the pages
+static void drain(pipe *p) {
+  while (p->count) {
+    uint8_t *page = p->ring[p->head];
+    deliver(p, page, p->ring_len[p->head]);
+    page_free(page);
+    p->head = (p->head + 1) % PIPE_RING_PAGES;
+    p->count--;
+  }
+}
+
+static void push_fill(pipe *p) {
+  if (!p->fill)
+    return;
+  if (p->fill_len == 0) {
+    page_free(p->fill);
+  } else {
+    if (p->count == PIPE_RING_PAGES)
+      drain(p);
+    p->ring[(p->head + p->count) % PIPE_RING_PAGES] = p->fill;
+    p->ring_len[(p->head + p->count) % PIPE_RING_PAGES] = p->fill_len;
+    p->count++;
+  }
+  p->fill = nullptr;
+  p->fill_len = 0;
+}
+
+// Makes sure there is a page to write into, waiting for the reader to
+// return pages if memory is short
+static bool ensure_fill(pipe *p) {
+  if (p->fill)
+    return true;
+  p->fill = page_alloc();
+  if (!p->fill) {
+    drain(p);
+    p->fill = page_alloc();
+  }
+  if (!p->fill)
+    p->failed = true;
+  return p->fill != nullptr;
+}
+
+bool pipe_putc(char c) {
+  if (!out)
+    return false;
+  if (!ensure_fill(out))
+    return true; // Out of memory: the output is lost, not misdirected
+  out->fill[out->fill_len++] = c;
+  if (out->fill_len == PAGE_SIZE)
+    push_fill(out);
+  return true;
+}
+
+uint8_t *pipe_page() {
+  if (!out)
+    return nullptr;
+  if (out->fill && out->fill_len)
+    push_fill(out); // Keep byte order: earlier output goes first
+  return ensure_fill(out) ? out->fill : nullptr;
+}
+
+void pipe_commit(uint32_t len) {
+  out->fill_len = len;
+  push_fill(out);
+}
+
+void *pipe_suspend() {
+  pipe *saved = out;
+  out = nullptr;
+  return saved;
+}
+
+void pipe_resume(void *saved) { out = (pipe *)saved; }
+
+// Flushes a stage's input and ends it, then does the same downstream
+static void close_pipe(pipe *p) {
+  push_fill(p);
+  drain(p);
+  if (p->sink == SINK_FILTER) {
+    pipe *saved = out;
+    out = p->next;
+    p->filter->end(p->state);
+    out = saved;
+    page_free((uint8_t *)p->state);
+    if (p->next)
+      close_pipe(p->next);
+  } else {
+    fs_save();
+    if (p->failed)
+      term_puts("Error: Could not write the output file.\n", COLOR_ERROR);
+  }
+}
+
+// Frees the pages of a pipeline that couldn't start, and points output
+// back at the console
+static void discard_pipes(int count) {
+  out = nullptr;
+  for (int i = 0; i < count; i++) {
+    pipe *p = &pipes[i];
+    if (p->state)
+      page_free((uint8_t *)p->state);
+    if (p->fill)
+      page_free(p->fill);
+    for (; p->count; p->count--, p->head = (p->head + 1) % PIPE_RING_PAGES)
+      page_free(p->ring[p->head]);
+    *p = pipe();
+  }
+}
+
+static char *trim(char *s) {
+  while (*s == ' ')
+    s++;
+  char *end = s;
+  while (*end)
+    end++;
+  while (end > s && end[-1] == ' ')
+    *--end = '\0';
+  return s;
+}
+
+// Opens `name` in the current directory for writing from the start.
+// Returns its index, or -1 if the table is full.
+static int open_output(const char *name) {
+  char dir[FS_PATH_MAX];
+  fs_current_dir(dir);
+  int idx = find_file(name, dir);
+  if (idx == -1)
+    idx = fs_create(name, dir);
+  MockFile f;
+  if (!fs_get_file(idx, &f))
+    return -1;
+  f.data_lba = 0; // The old extent is abandoned, as with wavgen
+  f.data_size = 0;
+  f.content[0] = '\0';
+  fs_set_file(idx, &f);
+  return idx;
+}
+
+static void run_stage(const command *c, char *args) {
+  if (c->handler) {
+    c->handler(args);
+    return;
+  }
+  // A filter with nothing piped in sees empty input
+  uint8_t *state = page_alloc();
+  if (!state) {
+    term_puts("Error: Out of memory.\n", COLOR_ERROR);
+    return;
+  }
+  kmemset(state, 0, PAGE_SIZE);
+  c->filter->begin(state, args);
+  c->filter->end(state);
+  page_free(state);
+}
+
+bool pipeline_run(char *line) {
+  // Split into stages and an optional `> file` after the last one
+  char *stage[PIPE_MAX_STAGES];
+  int n = 0;
+  char *redirect = nullptr;
+  char *s = line;
+  while (1) {
+    if (n == PIPE_MAX_STAGES) {
+      term_puts("Error: Too many pipeline stages.\n", COLOR_ERROR);
+      return true;
+    }
+    stage[n++] = s;
+    while (*s && *s != '|' && *s != '>')
+      s++;
+    if (*s == '>') {
+      *s++ = '\0';
+      redirect = trim(s);
+      break;
+    }
+    if (*s == '\0')
+      break;
+    *s++ = '\0';
+  }
+
+  const command *cmds[PIPE_MAX_STAGES];
+  char *args[PIPE_MAX_STAGES];
+  for (int i = 0; i < n; i++) {
+    stage[i] = trim(stage[i]);
+    cmds[i] = cmd_find(stage[i], &args[i]);
+    if (!cmds[i]) {
+      if (n == 1 && !redirect) // Let the shell report it
+        return stage[i][0] == '\0';
+      term_puts("Unknown command: ", COLOR_ERROR);
+      term_puts(stage[i], COLOR_ERROR);
+      term_putc('\n');
+      return true;
+    }
+    if (i > 0 && !cmds[i]->filter) {
+      term_puts("Error: ", COLOR_ERROR);
+      term_puts(cmds[i]->name, COLOR_ERROR);
+      term_puts(" does not read piped input.\n", COLOR_ERROR);
+      return true;
+    }
+    if (!cmd_args_ok(cmds[i], args[i]))
+      return true;
+  }
+  if (redirect && (redirect[0] == '\0' || redirect[0] == '>')) {
+    term_puts("Error: Missing output file name.\n", COLOR_ERROR);
+    return true;
+  }
+  if (n == 1 && !redirect) {
+    run_stage(cmds[0], args[0]);
+    return true;
+  }
+
+  // pipes[i] carries stage i's output into stage i + 1, or into the file
+  int count = n - 1 + (redirect ? 1 : 0);
+  for (int i = 0; i < count; i++) {
+    pipe *p = &pipes[i];
+    *p = pipe();
+    p->sink = i + 1 < n ? SINK_FILTER : SINK_FILE;
+    if (p->sink == SINK_FILTER) {
+      p->filter = cmds[i + 1]->filter;
+      p->next = i + 1 < count ? &pipes[i + 1] : nullptr;
+    }
+  }
+  // State pages come first, so running out of memory leaves the output
+  // file as it was and no filter has begun
+  for (int i = 0; i + 1 < n; i++) {
+    uint8_t *state = page_alloc();
+    if (!state) {
+      discard_pipes(count);
+      term_puts("Error: Out of memory.\n", COLOR_ERROR);
+      return true;
+    }
+    kmemset(state, 0, PAGE_SIZE);
+    pipes[i].state = state;
+  }
+  if (redirect) {
+    pipes[count - 1].file = open_output(redirect);
+    if (pipes[count - 1].file < 0) {
+      discard_pipes(count);
+      term_puts("Error: File system full.\n", COLOR_ERROR);
+      return true;
+    }
+  }
+  // Filters start in order, each already writing into its output pipe
+  for (int i = 0; i + 1 < n; i++) {
+    out = pipes[i].next;
+    cmds[i + 1]->filter->begin(pipes[i].state, args[i + 1]);
+  }
+
+  out = &pipes[0];
+  run_stage(cmds[0], args[0]);
+  out = nullptr;
+  close_pipe(&pipes[0]);
+  return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+
+// Shell pipelines: `cmd1 | cmd2 | ... > file`. Output between stages
+// moves in page-sized buffers that are handed over by reference, so bytes
+// are written once by the producer and read in place by the consumer.
+
+// A command that reads piped input, like `wc` in `ls | wc`. Each run gets
+// one zeroed page for `state`. Output written from these callbacks goes
+// to the next stage.
+struct cmd_filter {
+  void (*begin)(void *state, char *args);
+  void (*data)(void *state, const uint8_t *buf, uint32_t len);
+  void (*end)(void *state);
+};
+
+// Parses and runs a command line. Returns false if a command is unknown.
+bool pipeline_run(char *line);
+
+// Console output hook: appends `c` to the current stage's output pipe.
+// Returns false if output goes to the console.
+bool pipe_putc(char c);
+
+// Zero-copy producers: fill up to a page at the returned address and hand
+// it over with pipe_commit(). nullptr means output goes to the console.
+uint8_t *pipe_page();
+void pipe_commit(uint32_t len);
+
+// Sends output to the console until pipe_resume(), for commands that
+// draw on the screen themselves
+void *pipe_suspend();
+void pipe_resume(void *saved);
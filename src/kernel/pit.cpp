@@ -0,0 +1,31 @@
+#include "pit.h"
+#include "io.h"
+
+#define PIT_MAX_HOOKS 8
+
+volatile uint64_t pit_ticks = 0;
+static pit_hook_t hooks[PIT_MAX_HOOKS];
+static int hook_count = 0;
+
+static void pit_irq(interrupt_frame *frame) {
+  pit_ticks = pit_ticks + 1;
+  for (int i = 0; i < hook_count; i++)
+    hooks[i](frame);
+}
+
+void pit_init() {
+  uint16_t divisor = PIT_HZ / PIT_TICK_HZ;
+  outb(0x43, 0x34); // Channel 0, lobyte/hibyte, mode 2 (rate generator)
+  outb(0x40, (uint8_t)divisor);
+  outb(0x40, (uint8_t)(divisor >> 8));
+  irq_install(0, pit_irq);
+}
+
+bool pit_add_tick_hook(pit_hook_t hook) {
+  if (hook_count >= PIT_MAX_HOOKS)
+    return false;
+  hooks[hook_count] = hook;
+  asm volatile("" : : : "memory"); // Hook in place before the count grows
+  hook_count++;
+  return true;
+}
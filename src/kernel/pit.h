@@ -0,0 +1,17 @@
+#pragma once
+#include "idt.h"
+#include <stdint.h>
+
+#define PIT_HZ 1193182
+// System tick rate driven by PIT channel 0 on IRQ 0
+#define PIT_TICK_HZ 1000
+
+typedef void (*pit_hook_t)(interrupt_frame *frame);
+
+// Ticks since pit_init(), one per millisecond
+extern volatile uint64_t pit_ticks;
+
+void pit_init();
+
+// Registers a function to run on every tick, in IRQ context
+bool pit_add_tick_hook(pit_hook_t hook);
@@ -0,0 +1,90 @@
+#include "pmm.h"
+#include "multiboot.h"
+#include "paging.h"
+
+// End of the kernel image, from linker.ld
+extern "C" uint8_t kernel_end[];
+
+#define PMM_MAX_REGIONS 16
+
+// Untouched RAM is handed out from each region in turn. Freed pages go on
+// a list threaded through the pages themselves, so setup never has to
+// touch all of memory.
+struct pmm_region {
+  uint64_t next; // Next never-allocated page
+  uint64_t end;
+};
+
+static pmm_region regions[PMM_MAX_REGIONS];
+static int region_count = 0;
+static int region_cur = 0;
+static uint64_t free_list = 0;
+static uint64_t free_count = 0;
+
+static void add_region(uint64_t start, uint64_t end) {
+  start = (start + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+  end &= ~(uint64_t)(PAGE_SIZE - 1);
+  if (start >= end || region_count == PMM_MAX_REGIONS)
+    return;
+  regions[region_count].next = start;
+  regions[region_count].end = end;
+  region_count++;
+  free_count += (end - start) / PAGE_SIZE;
+}
+
+uint64_t pmm_init() {
+  const mb2_tag_mmap *mmap = (const mb2_tag_mmap *)mb2_find_tag(MB2_TAG_MMAP);
+  if (!mmap)
+    return 0;
+
+  uint64_t low = virt_to_phys(kernel_end);
+  uint64_t info = multiboot_info_ptr;
+  uint64_t info_end = info + mb2_info_size();
+
+  const uint8_t *p = (const uint8_t *)(mmap + 1);
+  const uint8_t *end = (const uint8_t *)mmap + mmap->size;
+  for (; p + mmap->entry_size <= end; p += mmap->entry_size) {
+    const mb2_mmap_entry *e = (const mb2_mmap_entry *)p;
+    if (e->type != MB2_MMAP_AVAILABLE)
+      continue;
+    uint64_t start = e->base < low ? low : e->base;
+    uint64_t stop = e->base + e->length;
+    if (start >= stop)
+      continue;
+    // GRUB leaves the info block in free RAM; split the region around it
+    if (info < stop && info_end > start) {
+      add_region(start, info & ~(uint64_t)(PAGE_SIZE - 1));
+      add_region(info_end, stop);
+    } else {
+      add_region(start, stop);
+    }
+  }
+  return free_count;
+}
+
+uint64_t pmm_alloc() {
+  if (free_list) {
+    uint64_t page = free_list;
+    free_list = *(uint64_t *)phys_to_virt(page);
+    free_count--;
+    return page;
+  }
+  for (; region_cur < region_count; region_cur++) {
+    pmm_region *r = &regions[region_cur];
+    if (r->next < r->end) {
+      uint64_t page = r->next;
+      r->next += PAGE_SIZE;
+      free_count--;
+      return page;
+    }
+  }
+  return 0;
+}
+
+void pmm_free(uint64_t phys) {
+  *(uint64_t *)phys_to_virt(phys) = free_list;
+  free_list = phys;
+  free_count++;
+}
+
+uint64_t pmm_free_pages() { return free_count; }
@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+
+// Physical page allocator over the multiboot memory map. Only RAM above
+// the kernel image is handed out. Pages are reached through the direct
+// map (phys_to_virt); regions are used in address order, so the few
+// pages taken before paging_init() come from low memory that the boot
+// tables cover.
+
+// Scans the memory map; returns the number of usable 4K pages
+uint64_t pmm_init();
+
+// Returns the physical address of a free 4K page, or 0 when out of memory
+uint64_t pmm_alloc();
+void pmm_free(uint64_t phys);
+
+uint64_t pmm_free_pages();
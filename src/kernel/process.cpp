@@ -0,0 +1,243 @@
+#include "process.h"
+#include "block.h"
+#include "cmd.h"
+#include "cpu.h"
+#include "elf.h"
+#include "fs.h"
+#include "gdt.h"
+#include "kstring.h"
+#include "paging.h"
+#include "pmm.h"
+#include "syscall.h"
+#include "term.h"
+#include "tlb.h"
+#include "vdso.h"
+
+extern "C" uint64_t user_enter(uint64_t entry, uint64_t user_rsp,
+                               kernel_context *ctx);
+extern "C" [[noreturn]] void user_return(kernel_context *ctx,
+                                         uint64_t status);
+
+// Programs from src/user, linked in by build.sh with `ld -b binary`
+extern "C" const uint8_t _binary_hello_start[], _binary_hello_end[];
+extern "C" const uint8_t _binary_sysbench_start[], _binary_sysbench_end[];
+extern "C" const uint8_t _binary_clock_start[], _binary_clock_end[];
+
+struct builtin_program {
+  const char *name;
+  const uint8_t *start;
+  const uint8_t *end;
+};
+
+static const builtin_program builtins[] = {
+    {"hello", _binary_hello_start, _binary_hello_end},
+    {"sysbench", _binary_sysbench_start, _binary_sysbench_end},
+    {"clock", _binary_clock_start, _binary_clock_end},
+};
+
+#define PROGRAM_DIR "/system"
+#define EXEC_MAX_BYTES (64 * 1024)
+#define USER_STACK_TOP 0x00007FFFFFFFF000ull
+#define USER_STACK_PAGES 4
+#define KERNEL_STACK_BYTES 16384
+#define STATUS_KILLED (-1)
+
+// The file is read whole before its segments are copied out
+static uint8_t exec_image[EXEC_MAX_BYTES];
+alignas(16) static uint8_t kernel_stack[KERNEL_STACK_BYTES];
+static kernel_context kctx;
+static uint64_t current_pml4 = 0;
+
+void process_install_builtins() {
+  bool changed = false;
+  for (const builtin_program &p : builtins) {
+    uint32_t size = p.end - p.start;
+    int idx = find_file(p.name, PROGRAM_DIR);
+    MockFile f;
+    if (fs_get_file(idx, &f) && f.data_size == size)
+      continue;
+    if (idx == -1)
+      idx = fs_create(p.name, PROGRAM_DIR);
+    // Too big to run anyway
+    if (size > EXEC_MAX_BYTES)
+      continue;
+    uint32_t sectors = (size + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+    uint32_t lba = idx == -1 ? 0 : fs_alloc_data(sectors);
+    if (lba == 0)
+      continue;
+
+    // Staged in exec_image, so the last sector is padded with zeros and
+    // the whole program goes out in one queued batch
+    kmemcpy(exec_image, p.start, size);
+    kmemset(exec_image + size, 0, sectors * FS_SECTOR_SIZE - size);
+    if (!blk_transfer(lba, sectors, exec_image, true))
+      continue;
+
+    if (!fs_get_file(idx, &f))
+      continue;
+    f.data_lba = lba;
+    f.data_size = size;
+    kstrcpy(f.content, "ELF64 executable");
+    fs_set_file(idx, &f);
+    changed = true;
+  }
+  if (changed)
+    fs_save();
+}
+
+static bool read_image(const MockFile *f) {
+  if (f->data_size == 0 || f->data_size > EXEC_MAX_BYTES)
+    return false;
+  uint32_t sectors = (f->data_size + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+  return blk_transfer(f->data_lba, sectors, exec_image, false);
+}
+
+static bool elf_check(const elf64_ehdr *eh, uint32_t size) {
+  return size >= sizeof(elf64_ehdr) && eh->magic == ELF_MAGIC &&
+         eh->elf_class == ELF_CLASS64 && eh->data == ELF_DATA_LSB &&
+         eh->type == ELF_TYPE_EXEC && eh->machine == ELF_MACHINE_X86_64 &&
+         eh->phentsize == sizeof(elf64_phdr) &&
+         eh->phoff + (uint64_t)eh->phnum * sizeof(elf64_phdr) <= size &&
+         eh->entry >= USER_SPACE_START && eh->entry < USER_SPACE_END;
+}
+
+// Allocates a zeroed page and maps it at `virt`
+static uint8_t *map_page(uint64_t pml4, uint64_t virt, uint64_t flags) {
+  uint64_t frame = pmm_alloc();
+  if (!frame)
+    return nullptr;
+  if (!vm_map(pml4, virt, frame, flags)) {
+    pmm_free(frame);
+    return nullptr;
+  }
+  uint64_t *p = (uint64_t *)phys_to_virt(frame);
+  for (int i = 0; i < PAGE_SIZE / 8; i++)
+    p[i] = 0;
+  return (uint8_t *)p;
+}
+
+// Maps a PT_LOAD segment and copies its file bytes; the rest stays zero
+static bool load_segment(uint64_t pml4, const elf64_phdr *ph, uint32_t size) {
+  uint64_t vstart = ph->vaddr;
+  uint64_t vend = ph->vaddr + ph->memsz;
+  if (ph->filesz > ph->memsz || ph->offset + ph->filesz > size ||
+      vstart < USER_SPACE_START || vend > USER_SPACE_END || vend < vstart)
+    return false;
+
+  uint64_t flags = (ph->flags & ELF_PF_W) ? PTE_WRITABLE : 0;
+  for (uint64_t page = vstart & ~0xFFFull; page < vend; page += PAGE_SIZE) {
+    uint8_t *dst = map_page(pml4, page, flags);
+    if (!dst)
+      return false;
+    // Part of [vstart, vstart + filesz) that falls in this page
+    uint64_t from = page > vstart ? page : vstart;
+    uint64_t to = page + PAGE_SIZE;
+    if (to > vstart + ph->filesz)
+      to = vstart + ph->filesz;
+    for (uint64_t va = from; va < to; va++)
+      dst[va - page] = exec_image[ph->offset + (va - vstart)];
+  }
+  return true;
+}
+
+// Builds the address space: segments, the stack below USER_STACK_TOP and
+// the vDSO page above it
+static uint64_t load_program(const elf64_ehdr *eh, uint32_t size) {
+  uint64_t pml4 = vm_create();
+  if (!pml4)
+    return 0;
+  bool ok = true;
+  for (int i = 0; i < eh->phnum && ok; i++) {
+    const elf64_phdr *ph = (const elf64_phdr *)(exec_image + eh->phoff) + i;
+    if (ph->type == ELF_PT_LOAD)
+      ok = load_segment(pml4, ph, size);
+  }
+  for (int i = 1; i <= USER_STACK_PAGES && ok; i++)
+    ok = map_page(pml4, USER_STACK_TOP - i * PAGE_SIZE, PTE_WRITABLE) !=
+         nullptr;
+  // The vDSO page is shared by every process and read-only
+  if (ok)
+    ok = vm_map(pml4, VDSO_USER_ADDR, vdso_phys(), PTE_SHARED);
+  if (!ok) {
+    vm_destroy(pml4);
+    return 0;
+  }
+  return pml4;
+}
+
+bool process_run(const char *name, int64_t *status) {
+  char dir[FS_PATH_MAX];
+  fs_current_dir(dir);
+  int idx = find_file(name, dir);
+  if (idx == -1)
+    idx = find_file(name, PROGRAM_DIR);
+  MockFile f;
+  if (!fs_get_file(idx, &f)) {
+    term_puts("Error: Program not found.\n", COLOR_ERROR);
+    return false;
+  }
+  const elf64_ehdr *eh = (const elf64_ehdr *)exec_image;
+  if (!read_image(&f) || !elf_check(eh, f.data_size)) {
+    term_puts("Error: Not an x86_64 ELF executable.\n", COLOR_ERROR);
+    return false;
+  }
+  uint64_t pml4 = load_program(eh, f.data_size);
+  if (!pml4) {
+    term_puts("Error: Could not load program segments.\n", COLOR_ERROR);
+    return false;
+  }
+
+  // Interrupts and syscalls from ring 3 both land on the top of this stack
+  uint64_t stack_top = (uint64_t)kernel_stack + KERNEL_STACK_BYTES;
+  tss_set_rsp0(stack_top);
+  syscall_kernel_rsp = stack_top;
+
+  uint64_t kernel_cr3 = read_cr3();
+  current_pml4 = pml4;
+  tlb_switch(pml4);
+  *status = (int64_t)user_enter(eh->entry, USER_STACK_TOP, &kctx);
+
+  // Back from user_return() with interrupts disabled
+  tlb_switch(kernel_cr3);
+  asm volatile("sti");
+  current_pml4 = 0;
+  vm_destroy(pml4);
+  return true;
+}
+
+void process_exit(int64_t status) { user_return(&kctx, status); }
+
+void process_fault(uint64_t vector, uint64_t error, interrupt_frame *frame) {
+  term_puts("\nProcess killed: ", COLOR_ERROR);
+  term_puts(exception_name(vector), COLOR_ERROR);
+  term_puts(" at rip ", COLOR_ERROR);
+  term_put_hex(frame->rip, COLOR_ERROR);
+  term_puts(" error ", COLOR_ERROR);
+  term_put_hex(error, COLOR_ERROR);
+  term_putc('\n');
+  user_return(&kctx, STATUS_KILLED);
+}
+
+bool process_user_range(uint64_t addr, uint64_t len, bool write) {
+  return current_pml4 && vm_user_range(current_pml4, addr, len, write);
+}
+
+static void cmd_exec(char *name) {
+  int64_t status;
+  if (!process_run(name, &status) || status == 0)
+    return;
+  term_puts("Exited with status ", COLOR_ERROR);
+  if (status < 0) {
+    term_putc('-', COLOR_ERROR);
+    status = -status;
+  }
+  term_put_uint(status, COLOR_ERROR);
+  term_putc('\n');
+}
+
+COMMAND(exec, "exec <program>", "Run a program in ring 3", 1, 1, cmd_exec);
+COMMAND(sysbench, "sysbench", "Time the SYSCALL round trip", 0, 0,
+        [](char *) {
+          char name[] = "sysbench";
+          cmd_exec(name);
+        });
@@ -0,0 +1,30 @@
+#pragma once
+#include "idt.h"
+#include <stdint.h>
+
+// Ring 3 processes. Programs are ELF64 executables kept in file data
+// extents. Each gets its own address space; one runs at a time and the
+// shell waits for it to exit.
+
+// Callee-saved kernel state saved by user_enter() in syscall.asm
+struct kernel_context {
+  uint64_t rbx, rbp, r12, r13, r14, r15, rsp;
+};
+
+// Writes the programs built into the kernel image to /system, replacing
+// copies whose size changed
+void process_install_builtins();
+
+// Loads `name` from the current directory or /system and runs it until it
+// exits. Returns false, after printing why, if it couldn't be started.
+bool process_run(const char *name, int64_t *status);
+
+// Ends the running process with SYS_EXIT's status
+[[noreturn]] void process_exit(int64_t status);
+
+// Kills the running process after a CPU exception in ring 3
+[[noreturn]] void process_fault(uint64_t vector, uint64_t error,
+                                interrupt_frame *frame);
+
+// True if the running process may access [addr, addr + len)
+bool process_user_range(uint64_t addr, uint64_t len, bool write);
@@ -0,0 +1,166 @@
+#include "profile.h"
+#include "cmd.h"
+#include "ksyms.h"
+#include "pit.h"
+#include "term.h"
+
+// Samples queued between folds; at 1 kHz this is 16 seconds
+#define PROF_RING_SAMPLES 16384
+#define PROF_MAX_SYMS 1024
+#define PROF_TOP 12
+// Recorded instead of the RIP when the tick interrupted ring 3
+#define PROF_USER_RIP 0
+
+// Written by the tick hook, read by the shell. There is one CPU, so one
+// ring; the hook runs with interrupts off and only ever moves `head`.
+struct prof_ring {
+  uint64_t rip[PROF_RING_SAMPLES];
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile uint32_t dropped;
+};
+
+static prof_ring ring;
+static volatile bool running = false;
+static bool hooked = false;
+
+static uint32_t counts[PROF_MAX_SYMS];
+static uint32_t user_samples, unknown_samples, total_samples;
+
+static void prof_tick(interrupt_frame *frame) {
+  if (!running)
+    return;
+  uint32_t head = ring.head;
+  uint32_t next = (head + 1) % PROF_RING_SAMPLES;
+  if (next == ring.tail) {
+    ring.dropped = ring.dropped + 1;
+    return;
+  }
+  ring.rip[head] = (frame->cs & 3) ? PROF_USER_RIP : frame->rip;
+  ring.head = next;
+}
+
+// Moves queued samples into the per-function counts
+static void fold() {
+  uint32_t tail = ring.tail;
+  uint32_t head = ring.head;
+  int syms = ksym_count();
+  for (; tail != head; tail = (tail + 1) % PROF_RING_SAMPLES) {
+    uint64_t rip = ring.rip[tail];
+    int idx = rip == PROF_USER_RIP ? -1 : ksym_find(rip);
+    if (rip == PROF_USER_RIP)
+      user_samples++;
+    else if (idx < 0 || idx >= PROF_MAX_SYMS || idx >= syms)
+      unknown_samples++;
+    else
+      counts[idx]++;
+    total_samples++;
+  }
+  ring.tail = tail;
+}
+
+void prof_start() {
+  running = false;
+  fold();
+  for (int i = 0; i < PROF_MAX_SYMS; i++)
+    counts[i] = 0;
+  user_samples = unknown_samples = total_samples = 0;
+  ring.dropped = 0;
+  if (!hooked && !(hooked = pit_add_tick_hook(prof_tick))) {
+    term_puts("Error: No free timer hook.\n", COLOR_ERROR);
+    return;
+  }
+  running = true;
+}
+
+void prof_stop() {
+  running = false;
+  fold();
+}
+
+// Prints `n` as a percentage of the total with one decimal
+static void put_percent(uint32_t n) {
+  uint64_t tenths = (uint64_t)n * 1000 / total_samples;
+  if (tenths < 1000)
+    term_putc(' ');
+  if (tenths < 100)
+    term_putc(' ');
+  term_put_uint(tenths / 10);
+  term_putc('.');
+  term_put_uint(tenths % 10);
+  term_puts("%  ");
+}
+
+static void put_count(uint32_t n) {
+  for (uint32_t width = 1000000; width > 1 && n < width; width /= 10)
+    term_putc(' ');
+  term_put_uint(n);
+  term_puts("  ");
+}
+
+void prof_report() {
+  fold();
+  term_put_uint(total_samples);
+  term_puts(" samples");
+  if (ring.dropped) {
+    term_puts(", ");
+    term_put_uint(ring.dropped);
+    term_puts(" dropped");
+  }
+  term_puts(running ? " (running)\n" : "\n");
+  if (total_samples == 0)
+    return;
+  if (ksym_count() == 0)
+    term_puts("No symbol table; addresses cannot be named.\n", COLOR_ERROR);
+
+  // Selection of the top entries; the table is small and this is rare
+  static bool shown[PROF_MAX_SYMS];
+  int syms = ksym_count() < PROF_MAX_SYMS ? ksym_count() : PROF_MAX_SYMS;
+  for (int i = 0; i < syms; i++)
+    shown[i] = false;
+  for (int k = 0; k < PROF_TOP; k++) {
+    int best = -1;
+    for (int i = 0; i < syms; i++)
+      if (!shown[i] && counts[i] && (best < 0 || counts[i] > counts[best]))
+        best = i;
+    if (best < 0)
+      break;
+    shown[best] = true;
+    put_count(counts[best]);
+    put_percent(counts[best]);
+    term_puts(ksym_get(best)->name);
+    term_putc('\n');
+  }
+  if (user_samples) {
+    put_count(user_samples);
+    put_percent(user_samples);
+    term_puts("[user]\n");
+  }
+  if (unknown_samples) {
+    put_count(unknown_samples);
+    put_percent(unknown_samples);
+    term_puts("[unknown]\n");
+  }
+}
+
+static bool arg_is(const char *arg, const char *word) {
+  while (*arg && *arg == *word) {
+    arg++;
+    word++;
+  }
+  return *arg == *word;
+}
+
+static void cmd_prof(char *args) {
+  if (arg_is(args, "start"))
+    prof_start();
+  else if (arg_is(args, "stop"))
+    prof_stop();
+  else if (arg_is(args, "report"))
+    prof_report();
+  else
+    term_puts("Usage: prof start|stop|report\n", COLOR_ERROR);
+}
+
+COMMAND(prof, "prof start|stop|report", "Sample kernel hot spots", 1, 1,
+        cmd_prof);
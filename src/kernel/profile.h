@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+
+// Sampling profiler. While running, every PIT tick records the
+// interrupted instruction pointer; `prof report` folds the samples into
+// per-function counts using the embedded symbol table (ksyms.h).
+
+void prof_start();
+void prof_stop();
+void prof_report();
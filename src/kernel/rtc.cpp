@@ -0,0 +1,113 @@
+#include "rtc.h"
+#include "idle.h"
+#include "idt.h"
+#include "io.h"
+#include "vdso.h"
+
+#define CMOS_ADDRESS 0x70
+#define CMOS_DATA 0x71
+#define CMOS_NMI_OFF 0x80 // Keep NMIs masked while reprogramming
+
+#define RTC_IRQ 8
+#define RTC_STATUS_A 0x0A
+#define RTC_STATUS_B 0x0B
+#define RTC_STATUS_C 0x0C
+#define RTC_A_UPDATING 0x80
+#define RTC_B_BINARY 0x04
+#define RTC_B_UPDATE_IRQ 0x10
+#define RTC_C_UPDATE_ENDED 0x10
+
+static uint8_t get_rtc_register(int reg) {
+  outb(CMOS_ADDRESS, reg);
+  return inb(CMOS_DATA);
+}
+
+// Convert Binary Coded Decimal to Binary
+static uint8_t bcd2bin(uint8_t bcd) { return ((bcd / 16) * 10) + (bcd & 0x0F); }
+
+// Reads the time registers. The caller makes sure no update is running.
+static void read_registers(DateTime *dt) {
+  dt->second = get_rtc_register(0x00);
+  dt->minute = get_rtc_register(0x02);
+  dt->hour = get_rtc_register(0x04);
+  dt->day = get_rtc_register(0x07);
+  dt->month = get_rtc_register(0x08);
+  dt->year = get_rtc_register(0x09);
+
+  // Check if we need BCD conversion
+  if (!(get_rtc_register(RTC_STATUS_B) & RTC_B_BINARY)) {
+    dt->second = bcd2bin(dt->second);
+    dt->minute = bcd2bin(dt->minute);
+    dt->hour = bcd2bin(dt->hour);
+    dt->day = bcd2bin(dt->day);
+    dt->month = bcd2bin(dt->month);
+    dt->year = bcd2bin(dt->year);
+  }
+
+  // Adjust year (RTC year is last 2 digits)
+  dt->year += 2000;
+}
+
+void rtc_read(DateTime *dt) {
+  // An update takes about 2 ms; sleep through it between ticks
+  wait_until([] { return !(get_rtc_register(RTC_STATUS_A) & RTC_A_UPDATING); });
+  read_registers(dt);
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned)(y - era * 400);
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t)doe - 719468;
+}
+
+uint64_t datetime_to_unix(const DateTime *dt) {
+  int64_t days = days_from_civil(dt->year, dt->month, dt->day);
+  return days * 86400 + dt->hour * 3600 + dt->minute * 60 + dt->second;
+}
+
+void unix_to_datetime(uint64_t secs, DateTime *dt) {
+  uint64_t days = secs / 86400;
+  uint32_t rem = secs % 86400;
+  dt->hour = rem / 3600;
+  dt->minute = rem % 3600 / 60;
+  dt->second = rem % 60;
+
+  // Inverse of days_from_civil, for dates after 1970
+  uint64_t z = days + 719468;
+  uint64_t era = z / 146097;
+  unsigned doe = z - era * 146097;
+  unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp = (5 * doy + 2) / 153;
+  dt->day = doy - (153 * mp + 2) / 5 + 1;
+  dt->month = mp < 10 ? mp + 3 : mp - 9;
+  dt->year = yoe + era * 400 + (dt->month <= 2);
+}
+
+// Fires right after the once-a-second update, so the registers are stable
+// for almost a second and can be read without polling the UIP flag
+static void rtc_irq(interrupt_frame *) {
+  // Reading C acknowledges the interrupt; without it IRQ 8 stops
+  if (!(get_rtc_register(RTC_STATUS_C) & RTC_C_UPDATE_ENDED))
+    return;
+  DateTime dt;
+  read_registers(&dt);
+  vdso_set_wall(datetime_to_unix(&dt), false);
+}
+
+void rtc_init() {
+  DateTime dt;
+  rtc_read(&dt);
+  vdso_set_wall(datetime_to_unix(&dt), true);
+
+  outb(CMOS_ADDRESS, CMOS_NMI_OFF | RTC_STATUS_B);
+  uint8_t b = inb(CMOS_DATA);
+  outb(CMOS_ADDRESS, CMOS_NMI_OFF | RTC_STATUS_B);
+  outb(CMOS_DATA, b | RTC_B_UPDATE_IRQ);
+  get_rtc_register(RTC_STATUS_C); // Clear anything already pending
+  irq_install(RTC_IRQ, rtc_irq);
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+
+struct DateTime {
+  uint8_t second;
+  uint8_t minute;
+  uint8_t hour;
+  uint8_t day;
+  uint8_t month;
+  uint16_t year;
+};
+
+// Reads the CMOS clock, waiting out an update in progress. Only used at
+// boot; afterwards the time comes from the vDSO page.
+void rtc_read(DateTime *dt);
+
+// Publishes the boot time to the vDSO page and enables the RTC's
+// update-ended interrupt (IRQ 8) to refresh it once a second
+void rtc_init();
+
+uint64_t datetime_to_unix(const DateTime *dt);
+void unix_to_datetime(uint64_t secs, DateTime *dt);
@@ -1,35 +1,51 @@
 #include "sb16.h"
+#include "cmd.h"
+#include "cpu.h"
+#include "dma.h"
+#include "idt.h"
 #include "io.h"
+#include "mixer.h"
+#include "softirq.h"
+#include "synth.h"
+#include "term.h"
+#include "timer.h"
 #include <stdbool.h>
 
+// Longest wait for the DSP to accept or produce a byte
+#define SB16_DSP_TIMEOUT_US 10000
+
 // Helper to wait for DSP
 static bool sb16_dsp_write(uint8_t val) {
-  int timeout = 100000;
-  while ((inb(SB16_DSP_WRITE_STATUS) & 0x80) && timeout--)
-    ;
-  if (timeout <= 0)
-    return false;
+  uint64_t deadline = deadline_us(SB16_DSP_TIMEOUT_US);
+  while (inb(SB16_DSP_WRITE_STATUS) & 0x80) {
+    if (deadline_passed(deadline))
+      return false;
+  }
   outb(SB16_DSP_WRITE, val);
   return true;
 }
 
 static int sb16_dsp_read() {
-  int timeout = 100000;
-  while (!(inb(SB16_DSP_READ_STATUS) & 0x80) && timeout--)
-    ;
-  if (timeout <= 0)
-    return -1;
+  uint64_t deadline = deadline_us(SB16_DSP_TIMEOUT_US);
+  while (!(inb(SB16_DSP_READ_STATUS) & 0x80)) {
+    if (deadline_passed(deadline))
+      return -1;
+  }
   return inb(SB16_DSP_READ);
 }
 
-void dma_setup_channel5(void *buffer, uint32_t length);
+// Double-buffered DMA area from the ISA DMA pool
+#define SB16_DMA_CHANNEL 5
+#define SB16_DMA_BYTES (SB16_HALF_SAMPLES * 2 * sizeof(int16_t))
+static int16_t *dma_buffer = nullptr;
+
+static void sb16_irq(interrupt_frame *frame);
 
 bool sb16_init() {
   // Reset DSP
   outb(SB16_DSP_RESET, 1);
-  // Wait ~3 microseconds
-  for (volatile int i = 0; i < 1000; i++)
-    ;
+  // Hold reset for at least 3 microseconds
+  udelay(3);
   outb(SB16_DSP_RESET, 0);
 
   // Read 0xAA (Reset Success)
@@ -44,70 +60,225 @@ bool sb16_init() {
   if (sb16_dsp_read() == -1)
     return false; // minor
 
+  // Route the card to IRQ 5 and 16-bit DMA channel 5 (8-bit stays on 1)
+  outb(SB16_MIXER_ADDR, 0x80);
+  outb(SB16_MIXER_DATA, 0x02);
+  outb(SB16_MIXER_ADDR, 0x81);
+  outb(SB16_MIXER_DATA, 0x20 | 0x02);
+
+  if (!dma_buffer)
+    dma_buffer = (int16_t *)dma_alloc(SB16_DMA_CHANNEL, SB16_DMA_BYTES);
+  if (!dma_buffer)
+    return false;
+
+  irq_install(SB16_IRQ, sb16_irq);
   return true;
 }
 
-// 64KB static buffer in BSS (DMA safe < 16MB)
-static int16_t sound_buffer[32768];
+// Render target for the melody, played from here by a mixer voice.
+// 11025Hz leaves room for the whole song (~9s).
+#define MELODY_RATE 11025
+#define MELODY_MAX_SAMPLES 131072
+// Only foreground shell commands render into it, one at a time. Each
+// first stops the voices playing it, the mixer being the only reader.
+static int16_t sound_buffer[MELODY_MAX_SAMPLES];
 
-bool sb16_play_pcm(void *buffer, uint32_t length, uint16_t hz) {
-  // 1. Setup DMA
-  dma_setup_channel5(buffer, length);
+// Single producer (foreground) / single consumer (IRQ) ring.
+// Indices are free-running; the ring size is a power of two.
+static int16_t ring[SB16_RING_SAMPLES];
+static volatile uint32_t ring_head = 0;
+static volatile uint32_t ring_tail = 0;
 
-  // 2. Configure SB16 for 16-bit PCM (DSP commands)
-  if (!sb16_dsp_write(0x41))
-    return false; // Set sampling rate
-  if (!sb16_dsp_write(hz >> 8))
-    return false;
-  if (!sb16_dsp_write(hz & 0xFF))
-    return false;
+static volatile bool streaming = false;
+static int next_half = 0;
+static void (*refill_hook)() = nullptr;
+volatile uint32_t sb16_underruns = 0;
+
+// The refill hook renders whole mixer blocks, far too long to run with
+// interrupts off, so the IRQ leaves it to a bottom half
+static void run_refill_hook(irq_work *) {
+  if (refill_hook)
+    refill_hook();
+}
 
-  if (!sb16_dsp_write(0xB6))
-    return false; // 16-bit PCM Output
-  if (!sb16_dsp_write(0x10))
-    return false; // Mode: Mono, Signed
+static irq_work refill_work = IRQ_WORK_INIT(run_refill_hook, SB16_IRQ);
 
-  // Sample count is in samples - 1
-  uint16_t samples = length / 2 - 1;
-  if (!sb16_dsp_write(samples & 0xFF))
-    return false;
-  if (!sb16_dsp_write(samples >> 8))
+void sb16_set_refill_hook(void (*hook)()) { refill_hook = hook; }
+
+uint32_t sb16_ring_free() {
+  return SB16_RING_SAMPLES - (ring_head - ring_tail);
+}
+
+uint32_t sb16_write(const int16_t *samples, uint32_t count) {
+  uint32_t free = sb16_ring_free();
+  if (count > free)
+    count = free;
+  uint32_t head = ring_head;
+  for (uint32_t i = 0; i < count; i++)
+    ring[(head + i) & (SB16_RING_SAMPLES - 1)] = samples[i];
+  // Samples must be in place before the IRQ can see the new head
+  asm volatile("" : : : "memory");
+  ring_head = head + count;
+  return count;
+}
+
+// Copies one half-buffer out of the ring, padding with silence.
+// Returns the number of real samples copied.
+static uint32_t refill_half(int half) {
+  int16_t *dst = dma_buffer + half * SB16_HALF_SAMPLES;
+  uint32_t tail = ring_tail;
+  uint32_t avail = ring_head - tail;
+  uint32_t n = avail < SB16_HALF_SAMPLES ? avail : SB16_HALF_SAMPLES;
+  for (uint32_t i = 0; i < n; i++)
+    dst[i] = ring[(tail + i) & (SB16_RING_SAMPLES - 1)];
+  for (uint32_t i = n; i < SB16_HALF_SAMPLES; i++)
+    dst[i] = 0;
+  ring_tail = tail + n;
+  return n;
+}
+
+// Fires each time the DSP finishes a half. That half is now idle (the DSP
+// has moved on to the other one), so it is refilled in place.
+static void sb16_irq(interrupt_frame *frame) {
+  (void)frame;
+  inb(SB16_DSP_INT16_ACK);
+  if (!streaming)
+    return;
+
+  uint32_t n = refill_half(next_half);
+  next_half ^= 1;
+  if (n < SB16_HALF_SAMPLES)
+    sb16_underruns = sb16_underruns + 1;
+
+  if (refill_hook)
+    irq_work_queue(&refill_work);
+}
+
+// Sets the rate and starts 16-bit auto-init output on the DSP
+static bool dsp_start(uint16_t hz, bool stereo) {
+  // Block length (one half) in samples - 1: an IRQ fires after each block
+  uint16_t samples = SB16_HALF_SAMPLES - 1;
+  return sb16_dsp_write(0x41) && // Set sampling rate
+         sb16_dsp_write(hz >> 8) && sb16_dsp_write(hz & 0xFF) &&
+         sb16_dsp_write(0xB6) && // 16-bit output, auto-init, FIFO on
+         sb16_dsp_write(stereo ? 0x30 : 0x10) && // Signed, mono / stereo
+         sb16_dsp_write(samples & 0xFF) && sb16_dsp_write(samples >> 8);
+}
+
+bool sb16_stream_start(uint16_t hz, bool stereo) {
+  if (!dma_buffer)
     return false;
+  if (streaming)
+    sb16_stream_stop();
 
-  return true;
+  next_half = 0;
+  refill_half(0);
+  refill_half(1);
+  streaming = true;
+
+  // DMA over both halves, auto-init, then the DSP
+  if (dma_setup(SB16_DMA_CHANNEL, dma_buffer, SB16_DMA_BYTES, DMA_TO_DEVICE,
+                DMA_MODE_SINGLE, true) &&
+      dsp_start(hz, stereo))
+    return true;
+
+  // Leave neither the channel nor the DSP running for the IRQ to act on
+  streaming = false;
+  dma_mask(SB16_DMA_CHANNEL);
+  sb16_dsp_write(0xD5); // Pause 16-bit DMA
+  return false;
+}
+
+void sb16_stream_stop() {
+  streaming = false;
+  sb16_dsp_write(0xD5); // Pause 16-bit DMA
+  ring_tail = ring_head;
+}
+
+bool sb16_stream_running() { return streaming; }
+
+uint32_t sb16_dma_position() {
+  return dma_get_position(SB16_DMA_CHANNEL) / sizeof(int16_t);
+}
+
+// Full melody for "It's Raining Tacos", durations in 1/8000s units
+static const Note pcm_melody[] = {
+    {415, 2000}, {466, 2000}, {494, 2000}, {415, 2000}, {466, 2000},
+    {740, 4000}, {415, 2000}, {466, 2000}, {494, 2000}, {554, 2000},
+    {494, 2000}, {466, 4000}, {415, 2000}, {466, 2000}, {494, 4000},
+    {415, 2000}, {466, 2000}, {494, 2000}, {554, 2000}, {494, 2000},
+    {466, 4000}, {415, 2000}, {466, 2000}, {494, 2000}, {554, 2000},
+    {622, 2000}, {554, 2000}, {494, 2000}, {466, 2000}, {415, 4000},
+    {0, 0}};
+#define MELODY_UNIT_US 125
+#define MELODY_GAP_US 12500
+
+int sb16_play_tacos_melody(bool loop) {
+  mixer_stop_samples(sound_buffer);
+  uint32_t count = synth_render_song(pcm_melody, MELODY_UNIT_US, MELODY_GAP_US,
+                                     WAVE_SQUARE, 6000, MELODY_RATE,
+                                     sound_buffer, MELODY_MAX_SAMPLES);
+  return mixer_play_pcm(sound_buffer, count, MELODY_RATE, 192,
+                        MIXER_PAN_CENTER, loop);
 }
 
-// Full melody frequencies for "It's Raining Tacos"
-static int pcm_frequencies[] = {415, 466, 494, 415, 466, 740, 415, 466,
-                                494, 554, 494, 466, 415, 466, 494, 415,
-                                466, 494, 554, 494, 466, 415, 466, 494,
-                                554, 622, 554, 494, 466, 415, 0};
-static int pcm_durations[] = {2000, 2000, 2000, 2000, 2000, 4000, 2000, 2000,
-                              2000, 2000, 2000, 4000, 2000, 2000, 4000, 2000,
-                              2000, 2000, 2000, 2000, 4000, 2000, 2000, 2000,
-                              2000, 2000, 2000, 2000, 2000, 4000, 0};
+COMMAND(playpcm, "playpcm", "Play the PCM melody on the SB16", 0, 0,
+        [](char *) { sb16_play_tacos_melody(false); });
 
-void sb16_play_tacos_melody() {
-  int offset = 0;
-  for (int n = 0; pcm_frequencies[n] != 0 && offset < 32000; n++) {
-    int freq = pcm_frequencies[n];
-    int dur = pcm_durations[n];
+// The melody renderer this driver used before the synth: three integer
+// divisions per sample and an integer period. Kept as a benchmark baseline.
+static uint32_t legacy_render(int16_t *out, uint32_t max) {
+  uint32_t offset = 0;
+  for (int n = 0; pcm_melody[n].duration != 0 && offset < max; n++) {
+    int freq = pcm_melody[n].freq;
+    int dur = pcm_melody[n].duration;
 
-    for (int i = 0; i < dur && offset < 32768; i++) {
+    for (int i = 0; i < dur && offset < max; i++) {
       int period = 8000 / freq;
       if (period == 0)
         period = 1;
-      // Mixed wave for a "fuller" sound
       int16_t sample = ((i / (period / 2)) % 2) ? 6000 : -6000;
-      // Add a bit of decay/envelope
       sample = (sample * (dur - i)) / dur;
-      sound_buffer[offset++] = sample;
+      out[offset++] = sample;
     }
-    // Small gap
-    for (int i = 0; i < 100 && offset < 32768; i++)
-      sound_buffer[offset++] = 0;
+    for (int i = 0; i < 100 && offset < max; i++)
+      out[offset++] = 0;
+  }
+  return offset;
+}
+
+static void print_rate(const char *label, uint64_t samples, uint64_t cycles) {
+  term_puts(label, COLOR_PROMPT);
+  term_put_uint(cycles ? samples * tsc_hz / cycles : 0);
+  term_puts(" samples/s\n", COLOR_DEFAULT);
+}
+
+// Renders the full melody repeatedly with both renderers
+static void cmd_synthbench() {
+  const int reps = 8;
+  // The render target doubles as the melody voice's source
+  mixer_stop_all();
+
+  uint64_t samples = 0;
+  uint64_t start = rdtsc();
+  for (int r = 0; r < reps; r++)
+    samples += legacy_render(sound_buffer, MELODY_MAX_SAMPLES);
+  print_rate("  legacy @8000Hz:  ", samples, rdtsc() - start);
+
+  static const uint32_t rates[] = {8000, 22050, 44100};
+  static const char *labels[] = {"  synth  @8000Hz:  ", "  synth  @22050Hz: ",
+                                 "  synth  @44100Hz: "};
+  for (int k = 0; k < 3; k++) {
+    samples = 0;
+    start = rdtsc();
+    for (int r = 0; r < reps; r++)
+      samples += synth_render_song(pcm_melody, MELODY_UNIT_US, MELODY_GAP_US,
+                                   WAVE_SQUARE, 6000, rates[k], sound_buffer,
+                                   MELODY_MAX_SAMPLES);
+    print_rate(labels[k], samples, rdtsc() - start);
   }
-  sb16_play_pcm(sound_buffer, offset * 2, 8000);
 }
 
-void cmd_play_test() { sb16_play_tacos_melody(); }
+COMMAND(synthbench, "synthbench",
+        "Benchmark the melody synthesizer", 0, 0,
+        [](char *) { cmd_synthbench(); });
@@ -2,6 +2,8 @@
 #include <stdint.h>
 
 #define SB16_BASE 0x220
+#define SB16_MIXER_ADDR (SB16_BASE + 0x4)
+#define SB16_MIXER_DATA (SB16_BASE + 0x5)
 #define SB16_DSP_RESET (SB16_BASE + 0x6)
 #define SB16_DSP_READ (SB16_BASE + 0xA)
 #define SB16_DSP_WRITE (SB16_BASE + 0xC)
@@ -9,5 +11,36 @@
 #define SB16_DSP_READ_STATUS (SB16_BASE + 0xE)
 #define SB16_DSP_INT16_ACK (SB16_BASE + 0xF)
 
+#define SB16_IRQ 5
+
+// Samples (16-bit words) per DMA half-buffer; one IRQ per half
+#define SB16_HALF_SAMPLES 4096
+// Producer ring between foreground code and the IRQ refill, in samples
+#define SB16_RING_SAMPLES 65536
+
 bool sb16_init();
-bool sb16_play_pcm(void *buffer, uint32_t length, uint16_t hz);
+
+// Starts auto-init DMA playback of 16-bit signed samples. The DMA buffer is
+// split in two halves; each half-complete IRQ refills that half from the
+// producer ring (silence if the ring runs dry).
+bool sb16_stream_start(uint16_t hz, bool stereo);
+void sb16_stream_stop();
+bool sb16_stream_running();
+
+// Sample the DSP is playing within the DMA buffer (both halves)
+uint32_t sb16_dma_position();
+
+// Queues interleaved samples into the producer ring. Returns how many
+// samples fit.
+uint32_t sb16_write(const int16_t *samples, uint32_t count);
+uint32_t sb16_ring_free();
+
+// Run as a bottom half after each refill, with interrupts enabled, so a
+// producer can top the ring up
+void sb16_set_refill_hook(void (*hook)());
+
+// Renders the tacos melody and starts it on a mixer voice (or -1)
+int sb16_play_tacos_melody(bool loop);
+
+// Half-buffers filled with silence because the ring was empty
+extern volatile uint32_t sb16_underruns;
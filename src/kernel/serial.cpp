@@ -0,0 +1,56 @@
+#include "serial.h"
+#include "io.h"
+
+#define COM1 0x3F8
+#define UART_DATA 0
+#define UART_IER 1
+#define UART_DIVISOR_LO 0 // With DLAB set
+#define UART_DIVISOR_HI 1
+#define UART_FCR 2
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+
+#define LCR_8N1 0x03
+#define LCR_DLAB 0x80
+#define LSR_THR_EMPTY 0x20
+#define MCR_DTR_RTS_OUT2 0x0B
+#define MCR_LOOPBACK 0x10
+
+#define UART_CLOCK_HZ 115200
+#define SERIAL_BAUD 115200
+
+static bool present = false;
+
+bool serial_init() {
+  uint16_t divisor = UART_CLOCK_HZ / SERIAL_BAUD;
+  outb(COM1 + UART_IER, 0x00); // Polled: no interrupts
+  outb(COM1 + UART_LCR, LCR_DLAB);
+  outb(COM1 + UART_DIVISOR_LO, (uint8_t)divisor);
+  outb(COM1 + UART_DIVISOR_HI, (uint8_t)(divisor >> 8));
+  outb(COM1 + UART_LCR, LCR_8N1);
+  outb(COM1 + UART_FCR, 0xC7); // Enable and clear FIFOs, 14-byte level
+
+  // A byte sent in loopback mode must come straight back
+  outb(COM1 + UART_MCR, MCR_DTR_RTS_OUT2 | MCR_LOOPBACK);
+  outb(COM1 + UART_DATA, 0xAE);
+  present = inb(COM1 + UART_DATA) == 0xAE;
+  outb(COM1 + UART_MCR, MCR_DTR_RTS_OUT2);
+  return present;
+}
+
+bool serial_present() { return present; }
+
+void serial_putc(uint8_t c) {
+  while (!(inb(COM1 + UART_LSR) & LSR_THR_EMPTY))
+    ;
+  outb(COM1 + UART_DATA, c);
+}
+
+void serial_write(const void *buf, uint32_t len) {
+  if (!present)
+    return;
+  const uint8_t *p = (const uint8_t *)buf;
+  for (uint32_t i = 0; i < len; i++)
+    serial_putc(p[i]);
+}
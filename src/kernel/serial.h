@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+
+// Polled driver for the first 16550 UART (COM1), 115200 baud 8N1
+
+// Returns false if no UART answered the loopback test
+bool serial_init();
+bool serial_present();
+
+void serial_putc(uint8_t c);
+void serial_write(const void *buf, uint32_t len);
@@ -0,0 +1,59 @@
+#include "softirq.h"
+#include "cpu.h"
+#include "idt.h"
+#include "trace.h"
+
+// One list head per cache line so CPUs don't share them
+struct alignas(64) softirq_cpu {
+  irq_work *pending; // Most recently queued first
+  bool running;      // A bottom-half pass is on this CPU's stack
+};
+
+static softirq_cpu cpus[MAX_CPUS];
+
+void irq_work_queue(irq_work *w) {
+  if (__atomic_exchange_n(&w->queued, true, __ATOMIC_ACQUIRE))
+    return;
+  w->queued_tsc = rdtsc();
+  irq_work **head = &cpus[cpu_id()].pending;
+  irq_work *old = __atomic_load_n(head, __ATOMIC_RELAXED);
+  do
+    w->next = old;
+  while (!__atomic_compare_exchange_n(head, &old, w, true, __ATOMIC_RELEASE,
+                                      __ATOMIC_RELAXED));
+}
+
+TRACEPOINT(softirq);
+
+void softirq_run() {
+  softirq_cpu *cpu = &cpus[cpu_id()];
+  if (cpu->running)
+    return;
+  cpu->running = true;
+
+  irq_work *list;
+  while ((list = __atomic_exchange_n(&cpu->pending, nullptr,
+                                     __ATOMIC_ACQUIRE))) {
+    // Reverse into queue order
+    irq_work *work = nullptr;
+    while (list) {
+      irq_work *next = list->next;
+      list->next = work;
+      work = list;
+      list = next;
+    }
+
+    asm volatile("sti" : : : "memory");
+    while (work) {
+      irq_work *next = work->next;
+      uint64_t start = rdtsc();
+      irq_note_bh_latency(work->irq, start - work->queued_tsc);
+      __atomic_store_n(&work->queued, false, __ATOMIC_RELEASE);
+      TRACE_SCOPE(softirq, work->irq, start - work->queued_tsc);
+      work->fn(work);
+      work = next;
+    }
+    asm volatile("cli" : : : "memory");
+  }
+  cpu->running = false;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+
+// Deferred interrupt work. A top half (the handler given to irq_install)
+// acknowledges its device and queues an irq_work; the work runs as a
+// bottom half once the IRQ has been EOI'd, with interrupts enabled, so a
+// long refill doesn't hold off the other lines.
+//
+// Each CPU has its own pending list, pushed with a compare-and-swap so a
+// top half never waits on a lock. Bottom halves don't nest: IRQs arriving
+// while one runs queue their work, and the running pass picks it up.
+
+struct irq_work {
+  irq_work *next;
+  void (*fn)(irq_work *w);
+  uint8_t irq;         // Line whose bottom-half latency this counts toward
+  bool queued;         // On a pending list and not yet started
+  uint64_t queued_tsc; // When the top half queued it
+};
+
+#define IRQ_WORK_INIT(fn, irq) {nullptr, fn, irq, false, 0}
+
+// Queues `w` on this CPU. Does nothing if it is already queued; once it
+// has started, queuing it again runs it once more. Safe from top halves.
+void irq_work_queue(irq_work *w);
+
+// Runs the queued work with interrupts enabled. Called by irq_handler
+// after the EOI, with interrupts disabled; returns with them disabled.
+void softirq_run();
@@ -0,0 +1,157 @@
+#include "speaker.h"
+#include "cpu.h"
+#include "io.h"
+#include "paging.h"
+#include "pit.h"
+
+// Visual bell: a music note in the top-right corner while a tone sounds
+#define BELL_CELL ((volatile uint16_t *)phys_to_virt(0xB8000) + 79)
+
+#define QUEUE_SIZE 32
+// Silence at the end of each note so repeated notes stay distinct
+#define ARTICULATION_MAX_MS 30
+
+static void play_sound(uint32_t nFrequence) {
+  uint32_t Div;
+  uint8_t tmp;
+
+  // Set the PIT to the desired frequency
+  Div = PIT_HZ / nFrequence;
+  outb(0x43, 0xb6);
+  outb(0x42, (uint8_t)(Div));
+  outb(0x42, (uint8_t)(Div >> 8));
+
+  // And play the sound using the PC speaker
+  tmp = inb(0x61);
+  if (tmp != (tmp | 3)) {
+    outb(0x61, tmp | 3);
+  }
+
+  *BELL_CELL = (uint16_t)14 | (0x0E << 8); // Yellow Note
+}
+
+static void nosound() {
+  uint8_t tmp = inb(0x61) & 0xFC;
+  outb(0x61, tmp);
+
+  *BELL_CELL = (uint16_t)' ' | (0x07 << 8);
+}
+
+struct QueuedNote {
+  uint32_t freq;
+  uint32_t ms;
+};
+
+// Sequencer state, owned by the tick handler once playing. Foreground
+// updates happen with interrupts off.
+static const Note *volatile song = nullptr;
+static uint32_t song_unit_ms = 0;
+static bool song_loop = false;
+static int song_pos = 0;
+
+static QueuedNote queue[QUEUE_SIZE];
+static uint32_t queue_head = 0; // Next free slot
+static volatile uint32_t queue_tail = 0; // Next note to play
+
+static volatile uint32_t note_left = 0; // ms left in the current note
+static uint32_t gap_at = 0;    // note_left value where the gap starts
+static bool sounding = false;
+
+static void start_note(uint32_t freq, uint32_t ms) {
+  note_left = ms;
+  gap_at = ms / 8 < ARTICULATION_MAX_MS ? ms / 8 : ARTICULATION_MAX_MS;
+  if (freq > 0) {
+    play_sound(freq);
+    sounding = true;
+  } else if (sounding) {
+    nosound();
+    sounding = false;
+  }
+}
+
+// Picks the next note: the song first, then the queue
+static bool next_note() {
+  if (song) {
+    if (song[song_pos].duration == 0) {
+      if (!song_loop) {
+        song = nullptr;
+        return next_note();
+      }
+      song_pos = 0;
+    }
+    const Note &n = song[song_pos++];
+    start_note(n.freq, n.duration * song_unit_ms);
+    return true;
+  }
+  if (queue_tail != queue_head) {
+    QueuedNote &n = queue[queue_tail % QUEUE_SIZE];
+    queue_tail = queue_tail + 1;
+    start_note(n.freq, n.ms);
+    return true;
+  }
+  return false;
+}
+
+static void spkseq_tick(interrupt_frame *frame) {
+  (void)frame;
+  if (note_left == 0 && !next_note()) {
+    if (sounding) {
+      nosound();
+      sounding = false;
+    }
+    return;
+  }
+  note_left = note_left - 1;
+  if (note_left == gap_at && sounding) {
+    nosound();
+    sounding = false;
+  }
+}
+
+void spkseq_play(const Note *new_song, uint32_t unit_ms, bool loop) {
+  // Every note would be zero length; the tick handler needs at least 1ms.
+  // An empty song would loop back onto its terminator.
+  if (unit_ms == 0 || new_song[0].duration == 0) {
+    spkseq_stop();
+    return;
+  }
+  uint64_t flags = irq_save();
+  queue_tail = queue_head;
+  song = new_song;
+  song_unit_ms = unit_ms;
+  song_loop = loop;
+  song_pos = 0;
+  note_left = 0; // Switch on the next tick
+  irq_restore(flags);
+}
+
+bool spkseq_queue(uint32_t freq, uint32_t ms) {
+  if (ms == 0)
+    return false;
+  uint64_t flags = irq_save();
+  bool ok = queue_head - queue_tail < QUEUE_SIZE;
+  if (ok) {
+    queue[queue_head % QUEUE_SIZE] = {freq, ms};
+    queue_head++;
+  }
+  irq_restore(flags);
+  return ok;
+}
+
+void spkseq_stop() {
+  uint64_t flags = irq_save();
+  song = nullptr;
+  queue_tail = queue_head;
+  note_left = 0;
+  if (sounding) {
+    nosound();
+    sounding = false;
+  }
+  irq_restore(flags);
+}
+
+bool spkseq_busy() {
+  return song != nullptr || queue_tail != queue_head || note_left != 0;
+}
+
+void speaker_init() { pit_add_tick_hook(spkseq_tick); }
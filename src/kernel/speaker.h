@@ -0,0 +1,21 @@
+#pragma once
+#include "synth.h"
+#include <stdint.h>
+
+// PC speaker sequencer. Notes are played from the PIT tick interrupt, so
+// tempo doesn't depend on what the foreground is doing. Only this module
+// touches PIT channel 2 and port 0x61.
+
+// Plays a song (zero-duration terminated) with `unit_ms` per duration
+// unit, replacing whatever was playing or queued. An empty song or a
+// `unit_ms` of 0 just stops.
+void spkseq_play(const Note *song, uint32_t unit_ms, bool loop);
+
+// Appends one note (freq 0 = rest) after anything already queued.
+// Returns false if the queue is full or `ms` is 0.
+bool spkseq_queue(uint32_t freq, uint32_t ms);
+
+void spkseq_stop();
+bool spkseq_busy();
+
+void speaker_init();
@@ -0,0 +1,107 @@
+#include "synth.h"
+
+// Full-scale single-cycle waveforms, indexed by the top phase bits
+struct Wavetable {
+  int16_t s[SYNTH_TABLE_SIZE];
+};
+
+static constexpr Wavetable make_square() {
+  Wavetable t = {};
+  for (int i = 0; i < SYNTH_TABLE_SIZE; i++)
+    t.s[i] = i < SYNTH_TABLE_SIZE / 2 ? 32767 : -32767;
+  return t;
+}
+
+static constexpr Wavetable make_saw() {
+  Wavetable t = {};
+  for (int i = 0; i < SYNTH_TABLE_SIZE; i++)
+    t.s[i] = (int16_t)(-32768 + i * (65536 / SYNTH_TABLE_SIZE));
+  return t;
+}
+
+static constexpr Wavetable square_table = make_square();
+static constexpr Wavetable saw_table = make_saw();
+
+// round(32767 * sin(2 * pi * i / 256))
+static const int16_t sine_table[SYNTH_TABLE_SIZE] = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602,
+    6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+    12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+    18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+    23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+    27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+    32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+    32767, 32757, 32728, 32678, 32609, 32521, 32412, 32285,
+    32137, 31971, 31785, 31580, 31356, 31113, 30852, 30571,
+    30273, 29956, 29621, 29268, 28898, 28510, 28105, 27683,
+    27245, 26790, 26319, 25832, 25329, 24811, 24279, 23731,
+    23170, 22594, 22005, 21403, 20787, 20159, 19519, 18868,
+    18204, 17530, 16846, 16151, 15446, 14732, 14010, 13279,
+    12539, 11793, 11039, 10278, 9512, 8739, 7962, 7179,
+    6393, 5602, 4808, 4011, 3212, 2410, 1608, 804,
+    0, -804, -1608, -2410, -3212, -4011, -4808, -5602,
+    -6393, -7179, -7962, -8739, -9512, -10278, -11039, -11793,
+    -12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530,
+    -18204, -18868, -19519, -20159, -20787, -21403, -22005, -22594,
+    -23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790,
+    -27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956,
+    -30273, -30571, -30852, -31113, -31356, -31580, -31785, -31971,
+    -32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757,
+    -32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285,
+    -32137, -31971, -31785, -31580, -31356, -31113, -30852, -30571,
+    -30273, -29956, -29621, -29268, -28898, -28510, -28105, -27683,
+    -27245, -26790, -26319, -25832, -25329, -24811, -24279, -23731,
+    -23170, -22594, -22005, -21403, -20787, -20159, -19519, -18868,
+    -18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+    -12539, -11793, -11039, -10278, -9512, -8739, -7962, -7179,
+    -6393, -5602, -4808, -4011, -3212, -2410, -1608, -804,
+};
+
+const int16_t *const synth_tables[3] = {square_table.s, saw_table.s,
+                                        sine_table};
+
+// Attack length cap; long enough to avoid a click at note start
+#define ATTACK_MS 5
+
+void synth_note_on(synth_voice *v, synth_wave wave, uint32_t freq,
+                   uint32_t frames, uint32_t rate, int16_t amp) {
+  v->table = synth_tables[wave];
+  v->phase = 0;
+  v->phase_inc = (uint32_t)(((uint64_t)freq << 32) / rate);
+  v->frames_left = frames;
+
+  uint32_t peak = freq ? (uint32_t)amp << 17 : 0;
+  uint32_t attack = rate * ATTACK_MS / 1000;
+  if (attack > frames / 8)
+    attack = frames / 8;
+  uint32_t decay = frames - attack;
+
+  v->attack_left = attack;
+  v->attack_step = attack ? peak / attack : 0;
+  v->level = attack ? 0 : peak;
+  v->decay_step = decay ? peak / decay : peak;
+}
+
+uint32_t synth_render_song(const Note *song, uint32_t unit_us,
+                           uint32_t gap_us, synth_wave wave, int16_t amp,
+                           uint32_t rate, int16_t *out, uint32_t max) {
+  uint32_t offset = 0;
+  uint32_t gap = (uint32_t)((uint64_t)gap_us * rate / 1000000);
+  synth_voice v;
+
+  for (int n = 0; song[n].duration != 0 && offset < max; n++) {
+    uint32_t frames =
+        (uint32_t)((uint64_t)song[n].duration * unit_us * rate / 1000000);
+    if (frames > max - offset)
+      frames = max - offset;
+
+    synth_note_on(&v, wave, song[n].freq, frames, rate, amp);
+    while (v.frames_left)
+      out[offset++] = (int16_t)synth_next(&v);
+
+    for (uint32_t i = 0; i < gap && offset < max; i++)
+      out[offset++] = 0;
+  }
+  return offset;
+}
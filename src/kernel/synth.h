@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+
+#define SYNTH_TABLE_BITS 8
+#define SYNTH_TABLE_SIZE (1 << SYNTH_TABLE_BITS)
+
+// A song is an array of notes terminated by a zero duration.
+// freq 0 with a duration is a rest.
+struct Note {
+  int freq;
+  int duration; // in the song's time unit
+};
+
+enum synth_wave { WAVE_SQUARE, WAVE_SAW, WAVE_SINE };
+
+extern const int16_t *const synth_tables[3];
+
+// Wavetable oscillator with an attack/decay envelope. Pitch is a 32-bit
+// phase increment, so every per-sample update is an add and a shift; the
+// divisions happen once per note in synth_note_on().
+struct synth_voice {
+  const int16_t *table;
+  uint32_t phase;
+  uint32_t phase_inc;
+  uint32_t level; // Envelope, peak at (amp << 17)
+  uint32_t attack_step;
+  uint32_t decay_step;
+  uint32_t attack_left;
+  uint32_t frames_left;
+};
+
+void synth_note_on(synth_voice *v, synth_wave wave, uint32_t freq,
+                   uint32_t frames, uint32_t rate, int16_t amp);
+
+static inline int32_t synth_next(synth_voice *v) {
+  int32_t s = v->table[v->phase >> (32 - SYNTH_TABLE_BITS)];
+  v->phase += v->phase_inc;
+  int32_t out = (s * (int32_t)(v->level >> 16)) >> 16;
+  if (v->attack_left) {
+    v->attack_left--;
+    v->level += v->attack_step;
+  } else if (v->level > v->decay_step) {
+    v->level -= v->decay_step;
+  } else {
+    v->level = 0;
+  }
+  v->frames_left--;
+  return out;
+}
+
+// Renders a song into mono samples at `rate`, with `gap_us` of silence
+// after each note. Returns the number of samples written.
+uint32_t synth_render_song(const Note *song, uint32_t unit_us,
+                           uint32_t gap_us, synth_wave wave, int16_t amp,
+                           uint32_t rate, int16_t *out, uint32_t max);
@@ -0,0 +1,62 @@
+#include "syscall.h"
+#include "cpu.h"
+#include "gdt.h"
+#include "pit.h"
+#include "process.h"
+#include "syscall_abi.h"
+#include "term.h"
+
+extern "C" void syscall_entry();
+
+uint64_t syscall_kernel_rsp = 0;
+
+typedef int64_t (*syscall_fn)(uint64_t a0, uint64_t a1, uint64_t a2,
+                              uint64_t a3, uint64_t a4);
+
+static int64_t sys_exit(uint64_t status, uint64_t, uint64_t, uint64_t,
+                        uint64_t) {
+  process_exit((int64_t)status);
+}
+
+static int64_t sys_write(uint64_t buf, uint64_t len, uint64_t, uint64_t,
+                         uint64_t) {
+  if (!process_user_range(buf, len, false))
+    return -1;
+  const char *s = (const char *)buf;
+  for (uint64_t i = 0; i < len; i++)
+    term_putc(s[i]);
+  return len;
+}
+
+static int64_t sys_nop(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t) {
+  return 0;
+}
+
+static int64_t sys_ticks(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t) {
+  return pit_ticks;
+}
+
+static const syscall_fn syscall_table[SYS_COUNT] = {
+    sys_exit,
+    sys_write,
+    sys_nop,
+    sys_ticks,
+};
+
+// Called from syscall_entry in syscall.asm with interrupts disabled
+extern "C" int64_t syscall_dispatch(uint64_t a0, uint64_t a1, uint64_t a2,
+                                    uint64_t a3, uint64_t a4, uint64_t nr) {
+  if (nr >= SYS_COUNT)
+    return -1;
+  return syscall_table[nr](a0, a1, a2, a3, a4);
+}
+
+void syscall_init() {
+  wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_SCE);
+  // SYSCALL loads CS from bits 32..47 and SS = CS + 8. SYSRET loads
+  // SS = base + 8 and CS = base + 16 from bits 48..63, with RPL 3.
+  wrmsr(MSR_STAR, ((uint64_t)(GDT_USER_DATA - 8) << 48) |
+                      ((uint64_t)GDT_KERNEL_CODE << 32));
+  wrmsr(MSR_LSTAR, (uint64_t)syscall_entry);
+  wrmsr(MSR_SFMASK, RFLAGS_IF | RFLAGS_DF | RFLAGS_TF | RFLAGS_AC);
+}
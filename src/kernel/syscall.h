@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+// Enables SYSCALL/SYSRET: segment bases in MSR_STAR, the entry point in
+// MSR_LSTAR and the RFLAGS bits cleared on entry in MSR_SFMASK
+void syscall_init();
+
+// Stack syscall_entry switches to, set by process_run()
+extern "C" uint64_t syscall_kernel_rsp;
@@ -0,0 +1,11 @@
+#pragma once
+
+// System call numbers, shared with the programs in src/user.
+// The number goes in rax and up to five arguments in rdi, rsi, rdx, r10
+// and r8; the result comes back in rax. SYSCALL/SYSRET clobber rcx and
+// r11, every other register is preserved.
+#define SYS_EXIT 0  // (status)
+#define SYS_WRITE 1 // (buf, len): prints to the console, returns len or -1
+#define SYS_NOP 2   // Returns 0 at once, for timing the round trip
+#define SYS_TICKS 3 // Milliseconds since boot
+#define SYS_COUNT 4
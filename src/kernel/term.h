@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+// VGA text console (main.cpp)
+#define COLOR_DEFAULT 0x07 // Light Gray on Black
+#define COLOR_PROMPT 0x0B  // Cyan on Black
+#define COLOR_LOGO 0x0E    // Yellow on Black
+#define COLOR_SUCCESS 0x0A // Light Green on Black
+#define COLOR_ERROR 0x0C   // Light Red on Black
+
+void term_putc(char c, uint8_t color = COLOR_DEFAULT);
+void term_puts(const char *s, uint8_t color = COLOR_DEFAULT);
+void term_put_uint(uint64_t n, uint8_t color = COLOR_DEFAULT);
+void term_put_hex(uint64_t n, uint8_t color = COLOR_DEFAULT);
+// term_put_uint() right-aligned in `width` columns, for tables
+void term_put_column(uint64_t n, int width);
+void clear_screen();
+
+// Frees the console lock for a panic message, in case the fault hit while
+// it was held
+void term_break_lock();
+
+#define TERM_WIDTH 80
+#define TERM_HEIGHT 25
+
+// Fills `count` text cells from `start` with `cell` (character | color << 8)
+void vga_fill(int start, int count, uint16_t cell);
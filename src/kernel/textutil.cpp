@@ -0,0 +1,170 @@
+#include "block.h"
+#include "cmd.h"
+#include "fs.h"
+#include "paging.h"
+#include "pipe.h"
+#include "term.h"
+
+// Text commands built for pipelines: `cat` produces, the rest filter.
+
+static void cmd_cat(char *name) {
+  char dir[FS_PATH_MAX];
+  fs_current_dir(dir);
+  MockFile f;
+  if (!fs_get_file(find_file(name, dir), &f)) {
+    term_puts("Error: File not found in current directory.\n", COLOR_ERROR);
+    return;
+  }
+  if (f.data_size == 0) {
+    term_puts(f.content);
+    return;
+  }
+  // Read the extent straight into pipe pages when there is a reader
+  uint32_t left = f.data_size;
+  uint32_t lba = f.data_lba;
+  uint16_t sector[FS_SECTOR_SIZE / 2];
+  while (left) {
+    uint8_t *page = pipe_page();
+    uint32_t len = left < PAGE_SIZE ? left : PAGE_SIZE;
+    uint32_t sectors = (len + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+    if (page) {
+      if (!blk_transfer(lba, sectors, page, false)) {
+        term_puts("Error: Disk read failed.\n", COLOR_ERROR);
+        return;
+      }
+      pipe_commit(len);
+    }
+    for (uint32_t s = 0; !page && s < sectors; s++) {
+      if (!blk_transfer(lba + s, 1, sector, false)) {
+        term_puts("Error: Disk read failed.\n", COLOR_ERROR);
+        return;
+      }
+      uint32_t n = len - s * FS_SECTOR_SIZE;
+      if (n > FS_SECTOR_SIZE)
+        n = FS_SECTOR_SIZE;
+      for (uint32_t i = 0; i < n; i++)
+        term_putc(((char *)sector)[i]);
+    }
+    lba += sectors;
+    left -= len;
+  }
+}
+
+COMMAND(cat, "cat <file>", "Print a file, including its data", 1, 1,
+        cmd_cat);
+
+// --- wc ---
+struct wc_state {
+  uint32_t lines, words, bytes;
+  bool in_word;
+};
+
+static const cmd_filter wc_filter = {
+    [](void *, char *) {},
+    [](void *state, const uint8_t *buf, uint32_t len) {
+      wc_state *s = (wc_state *)state;
+      s->bytes += len;
+      for (uint32_t i = 0; i < len; i++) {
+        char c = buf[i];
+        if (c == '\n')
+          s->lines++;
+        if (c == ' ' || c == '\n' || c == '\t') {
+          s->in_word = false;
+        } else if (!s->in_word) {
+          s->in_word = true;
+          s->words++;
+        }
+      }
+    },
+    [](void *state) {
+      wc_state *s = (wc_state *)state;
+      term_put_uint(s->lines);
+      term_putc(' ');
+      term_put_uint(s->words);
+      term_putc(' ');
+      term_put_uint(s->bytes);
+      term_putc('\n');
+    }};
+
+FILTER_COMMAND(wc, "wc", "Count lines, words and bytes of its input", 0, 0,
+               wc_filter);
+
+// --- grep ---
+#define GREP_PATTERN_MAX 64
+
+struct grep_state {
+  char pattern[GREP_PATTERN_MAX];
+  uint32_t line_len;
+  char line[]; // Rest of the state page; longer lines are cut
+};
+
+#define GREP_LINE_MAX (PAGE_SIZE - sizeof(grep_state))
+
+static bool contains(const char *line, uint32_t len, const char *pattern) {
+  for (uint32_t i = 0; i < len; i++) {
+    uint32_t j = 0;
+    while (pattern[j] && i + j < len && line[i + j] == pattern[j])
+      j++;
+    if (pattern[j] == '\0')
+      return true;
+  }
+  return pattern[0] == '\0';
+}
+
+static void grep_line(grep_state *s) {
+  if (contains(s->line, s->line_len, s->pattern)) {
+    for (uint32_t i = 0; i < s->line_len; i++)
+      term_putc(s->line[i]);
+    term_putc('\n');
+  }
+  s->line_len = 0;
+}
+
+static const cmd_filter grep_filter = {
+    [](void *state, char *args) {
+      grep_state *s = (grep_state *)state;
+      for (int i = 0; args[i] && i < GREP_PATTERN_MAX - 1; i++)
+        s->pattern[i] = args[i];
+    },
+    [](void *state, const uint8_t *buf, uint32_t len) {
+      grep_state *s = (grep_state *)state;
+      for (uint32_t i = 0; i < len; i++) {
+        if (buf[i] == '\n')
+          grep_line(s);
+        else if (s->line_len < GREP_LINE_MAX)
+          s->line[s->line_len++] = buf[i];
+      }
+    },
+    [](void *state) {
+      grep_state *s = (grep_state *)state;
+      if (s->line_len)
+        grep_line(s);
+    }};
+
+FILTER_COMMAND(grep, "grep <text>", "Print input lines containing text", 1,
+               CMD_ARGS_ANY, grep_filter);
+
+// --- head ---
+struct head_state {
+  uint32_t left; // Lines still to print
+};
+
+static const cmd_filter head_filter = {
+    [](void *state, char *args) {
+      head_state *s = (head_state *)state;
+      s->left = 0;
+      for (; *args >= '0' && *args <= '9'; args++)
+        s->left = s->left * 10 + (*args - '0');
+    },
+    [](void *state, const uint8_t *buf, uint32_t len) {
+      head_state *s = (head_state *)state;
+      for (uint32_t i = 0; i < len && s->left; i++) {
+        term_putc(buf[i]);
+        if (buf[i] == '\n')
+          s->left--;
+      }
+    },
+    [](void *) {}};
+
+FILTER_COMMAND(head, "head <lines>", "Print the first lines of its input",
+               1, 1, head_filter);
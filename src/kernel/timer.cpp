@@ -0,0 +1,232 @@
+#include "timer.h"
+#include "cmd.h"
+#include "lock.h"
+#include "pit.h"
+#include "softirq.h"
+#include "term.h"
+#include "vdso.h"
+
+#define LEVEL_SHIFT(l) ((l) * TIMER_SLOT_BITS)
+// Ticks the wheel covers. A timer due later sits in the top level and is
+// placed again when the wheel reaches its slot.
+#define WHEEL_SPAN (1ull << LEVEL_SHIFT(TIMER_LEVELS))
+// Assumed before tsc_calibrate(); high, so early waits err long
+#define TSC_HZ_FALLBACK 4000000000ull
+
+static timer *wheel[TIMER_LEVELS][TIMER_SLOTS];
+// Next tick to process; the slots of earlier ticks have run
+static uint64_t wheel_next;
+static uint32_t pending;
+static bool running; // timer_run() is between ticks' callbacks
+
+struct timer_stats {
+  uint64_t started;
+  uint64_t cancelled;
+  uint64_t fired;
+  uint64_t cascaded; // Moves to a lower level
+};
+
+static timer_stats stats;
+
+// Guards the wheel. Callbacks run without it.
+DEFINE_SPINLOCK(timer_lock);
+
+static void link(timer *t) {
+  uint64_t expires = t->expires;
+  if ((int64_t)(expires - wheel_next) < 0)
+    expires = wheel_next;
+  uint64_t delta = expires - wheel_next;
+  if (delta >= WHEEL_SPAN) {
+    delta = WHEEL_SPAN - 1;
+    expires = wheel_next + delta;
+  }
+  int level = 0;
+  while (delta >> LEVEL_SHIFT(level + 1))
+    level++;
+
+  timer **head =
+      &wheel[level][(expires >> LEVEL_SHIFT(level)) & (TIMER_SLOTS - 1)];
+  t->next = *head;
+  if (t->next)
+    t->next->pprev = &t->next;
+  *head = t;
+  t->pprev = head;
+  pending++;
+}
+
+static void unlink(timer *t) {
+  *t->pprev = t->next;
+  if (t->next)
+    t->next->pprev = t->pprev;
+  t->pprev = nullptr;
+  pending--;
+}
+
+// Places the timers of the level's current slot again, which moves each
+// to a lower level now that it is due within that level's reach
+static void cascade(int level) {
+  timer **slot =
+      &wheel[level][(wheel_next >> LEVEL_SHIFT(level)) & (TIMER_SLOTS - 1)];
+  timer *t = *slot;
+  *slot = nullptr;
+  while (t) {
+    timer *next = t->next;
+    pending--;
+    link(t);
+    stats.cascaded++;
+    t = next;
+  }
+}
+
+// Processes tick wheel_next. Called with the lock held; drops it around
+// each callback.
+static void run_tick(uint64_t *flags, uint64_t now) {
+  for (int l = 1; l < TIMER_LEVELS; l++) {
+    if (wheel_next & ((1ull << LEVEL_SHIFT(l)) - 1))
+      break;
+    cascade(l);
+  }
+
+  // Callbacks may change the slot, so take one timer at a time
+  timer **slot = &wheel[0][wheel_next & (TIMER_SLOTS - 1)];
+  while (timer *t = *slot) {
+    unlink(t);
+    if (t->period) {
+      // Runs missed while the bottom half was held off are dropped
+      t->expires += t->period;
+      if ((int64_t)(t->expires - now) <= 0)
+        t->expires = now + t->period;
+      link(t);
+    }
+    stats.fired++;
+    spin_unlock_irqrestore(&timer_lock, *flags);
+    t->fn(t);
+    *flags = spin_lock_irqsave(&timer_lock);
+  }
+  wheel_next++;
+}
+
+static void timer_run(irq_work *) {
+  uint64_t flags = spin_lock_irqsave(&timer_lock);
+  running = true;
+  uint64_t now = pit_ticks;
+  while ((int64_t)(now - wheel_next) >= 0) {
+    if (!pending) {
+      wheel_next = now + 1;
+      break;
+    }
+    run_tick(&flags, now);
+  }
+  running = false;
+  spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+static irq_work timer_work = IRQ_WORK_INIT(timer_run, 0);
+
+// An empty wheel doesn't need the bottom half every tick
+static void timer_tick(interrupt_frame *) {
+  if (__atomic_load_n(&pending, __ATOMIC_RELAXED))
+    irq_work_queue(&timer_work);
+}
+
+void timer_init() {
+  wheel_next = pit_ticks + 1;
+  pit_add_tick_hook(timer_tick);
+}
+
+static void start(timer *t, uint64_t ticks, uint32_t period) {
+  uint64_t flags = spin_lock_irqsave(&timer_lock);
+  if (t->pprev)
+    unlink(t);
+  // Ticks that passed while the wheel was empty need no processing
+  if (!pending && !running)
+    wheel_next = pit_ticks + 1;
+  t->expires = pit_ticks + (ticks ? ticks : 1);
+  t->period = period;
+  link(t);
+  stats.started++;
+  spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+static uint64_t ms_to_ticks(uint64_t ms) {
+  return (ms * PIT_TICK_HZ + 999) / 1000;
+}
+
+void timer_start(timer *t, uint32_t ms) { start(t, ms_to_ticks(ms), 0); }
+
+void timer_start_periodic(timer *t, uint32_t period_ms) {
+  uint64_t ticks = ms_to_ticks(period_ms);
+  start(t, ticks, ticks ? ticks : 1);
+}
+
+void timer_start_wall(timer *t, uint64_t unix_secs) {
+  uint32_t seq;
+  int64_t delta_ns;
+  do {
+    seq = vdso_read_begin(vdso);
+    uint64_t now_ns = vdso_ns_at(vdso, rdtsc());
+    int64_t secs = (int64_t)(unix_secs - vdso->rtc_unix);
+    delta_ns = secs * (int64_t)VDSO_NS_PER_SEC +
+               (int64_t)(vdso->rtc_ns - now_ns);
+  } while (vdso_read_retry(vdso, seq));
+
+  uint64_t ns_per_tick = VDSO_NS_PER_SEC / PIT_TICK_HZ;
+  start(t, delta_ns > 0 ? (delta_ns + ns_per_tick - 1) / ns_per_tick : 0,
+        0);
+}
+
+bool timer_cancel(timer *t) {
+  uint64_t flags = spin_lock_irqsave(&timer_lock);
+  bool was_pending = t->pprev;
+  if (was_pending) {
+    unlink(t);
+    stats.cancelled++;
+  }
+  spin_unlock_irqrestore(&timer_lock, flags);
+  return was_pending;
+}
+
+uint64_t deadline_us(uint64_t us) {
+  uint64_t hz = tsc_hz ? tsc_hz : TSC_HZ_FALLBACK;
+  return rdtsc() + us * (hz / 1000000);
+}
+
+void udelay(uint64_t us) {
+  uint64_t deadline = deadline_us(us);
+  while (!deadline_passed(deadline))
+    cpu_relax();
+}
+
+static void cmd_timers(char *) {
+  uint32_t per_level[TIMER_LEVELS];
+  uint64_t flags = spin_lock_irqsave(&timer_lock);
+  for (int l = 0; l < TIMER_LEVELS; l++) {
+    per_level[l] = 0;
+    for (int s = 0; s < TIMER_SLOTS; s++)
+      for (timer *t = wheel[l][s]; t; t = t->next)
+        per_level[l]++;
+  }
+  timer_stats snap = stats;
+  uint32_t count = pending;
+  spin_unlock_irqrestore(&timer_lock, flags);
+
+  term_puts("Pending:   ");
+  term_put_uint(count);
+  term_puts(" (by level:");
+  for (int l = 0; l < TIMER_LEVELS; l++) {
+    term_putc(' ');
+    term_put_uint(per_level[l]);
+  }
+  term_puts(")\nStarted:   ");
+  term_put_uint(snap.started);
+  term_puts("\nFired:     ");
+  term_put_uint(snap.fired);
+  term_puts("\nCancelled: ");
+  term_put_uint(snap.cancelled);
+  term_puts("\nCascaded:  ");
+  term_put_uint(snap.cascaded);
+  term_putc('\n');
+}
+
+COMMAND(timers, "timers", "Show timer wheel occupancy and counts", 0, 0,
+        cmd_timers);
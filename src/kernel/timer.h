@@ -0,0 +1,56 @@
+#pragma once
+#include "cpu.h"
+#include <stdint.h>
+
+// Kernel timers on a hierarchical timing wheel advanced by the PIT tick
+// (1 ms). Level 0 has one slot per tick for the next 64 ticks; each level
+// above has slots 64 times as wide. Starting and cancelling a timer is a
+// list insert or unlink. A timer due beyond level 0 is moved down a level
+// each time the wheel reaches its slot, at most TIMER_LEVELS - 1 times.
+//
+// Callbacks run in a bottom half (softirq.h), with interrupts enabled.
+// A callback may start or cancel any timer, its own included.
+
+#define TIMER_LEVELS 5
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+
+struct timer {
+  timer *next;
+  timer **pprev;    // Link pointing at this timer, or nullptr when idle
+  uint64_t expires; // Tick it is due on
+  uint32_t period;  // Ticks between runs; 0 for a one-shot timer
+  void (*fn)(timer *t);
+};
+
+#define TIMER_INIT(fn) {nullptr, nullptr, 0, 0, fn}
+
+// Hooks the wheel to the PIT tick; needs pit_init() first
+void timer_init();
+
+// (Re)starts `t` to run once after `ms`, at least one tick from now
+void timer_start(timer *t, uint32_t ms);
+// (Re)starts `t` to run every `period_ms`, the first time one period
+// from now
+void timer_start_periodic(timer *t, uint32_t period_ms);
+// (Re)starts `t` to run once when the wall clock reaches `unix_secs`.
+// A time in the past runs it on the next tick.
+void timer_start_wall(timer *t, uint64_t unix_secs);
+
+// Stops `t`; returns false if it wasn't pending
+bool timer_cancel(timer *t);
+
+static inline bool timer_pending(const timer *t) { return t->pprev; }
+
+// --- Deadlines for short waits that poll a device, timed with the TSC.
+// They work with interrupts off and before timer_init(). ---
+
+// TSC value `us` microseconds from now
+uint64_t deadline_us(uint64_t us);
+
+static inline bool deadline_passed(uint64_t deadline) {
+  return (int64_t)(rdtsc() - deadline) >= 0;
+}
+
+// Spins for at least `us` microseconds
+void udelay(uint64_t us);
@@ -0,0 +1,177 @@
+#include "tlb.h"
+#include "cmd.h"
+#include "cpu.h"
+#include "term.h"
+
+#define PCID_COUNT 4096
+
+static bool pcid_on = false;
+static bool invpcid_ok = false;
+
+// PCIDs handed out; 0 belongs to the kernel's tables
+static uint64_t pcid_used[PCID_COUNT / 64] = {1};
+// PCIDs that may still have entries from a previous owner
+static uint64_t pcid_stale[PCID_COUNT / 64];
+static uint16_t pcid_next = 1;
+
+struct tlb_stats {
+  uint64_t switches;
+  uint64_t switches_kept; // Loaded with CR3_NOFLUSH
+  uint64_t pages;         // Single-page invalidations
+  uint64_t space_flushes; // Whole address space dropped at once
+  uint64_t batches;       // Shootdown rounds
+};
+
+static tlb_stats stats;
+
+static bool bit_test(const uint64_t *map, uint16_t n) {
+  return map[n / 64] & (1ull << (n % 64));
+}
+
+static void bit_set(uint64_t *map, uint16_t n, bool on) {
+  if (on)
+    map[n / 64] |= 1ull << (n % 64);
+  else
+    map[n / 64] &= ~(1ull << (n % 64));
+}
+
+void tlb_init() {
+  uint32_t a, b, c, d;
+  write_cr4(read_cr4() | CR4_PGE);
+
+  cpuid(1, 0, &a, &b, &c, &d);
+  if (!(c & CPUID_1_ECX_PCID))
+    return;
+  uint32_t max_leaf;
+  cpuid(0, 0, &max_leaf, &b, &c, &d);
+  if (max_leaf >= 7) {
+    cpuid(7, 0, &a, &b, &c, &d);
+    invpcid_ok = b & CPUID_7_EBX_INVPCID;
+  }
+  write_cr4(read_cr4() | CR4_PCIDE);
+  pcid_on = true;
+}
+
+uint16_t pcid_alloc() {
+  if (!pcid_on)
+    return 0;
+  for (int i = 0; i < PCID_COUNT; i++) {
+    uint16_t pcid = pcid_next;
+    pcid_next = pcid_next % (PCID_COUNT - 1) + 1;
+    if (!bit_test(pcid_used, pcid)) {
+      bit_set(pcid_used, pcid, true);
+      return pcid;
+    }
+  }
+  return 0; // All taken: share the kernel's, which always flushes
+}
+
+void pcid_free(uint16_t pcid) {
+  if (!pcid)
+    return;
+  bit_set(pcid_used, pcid, false);
+  if (invpcid_ok) {
+    invpcid(INVPCID_CONTEXT, pcid, 0);
+    stats.space_flushes++;
+  } else {
+    bit_set(pcid_stale, pcid, true);
+  }
+}
+
+void tlb_switch(uint64_t cr3) {
+  uint16_t pcid = cr3 & CR3_PCID_MASK;
+  stats.switches++;
+  // PCID 0 is also the fallback when they run out, so it never keeps
+  // entries across a switch
+  if (pcid_on && pcid && !bit_test(pcid_stale, pcid)) {
+    write_cr3(cr3 | CR3_NOFLUSH);
+    stats.switches_kept++;
+    return;
+  }
+  bit_set(pcid_stale, pcid, false);
+  write_cr3(cr3);
+}
+
+// Toggling PGE drops every entry of every PCID. Before tlb_init() there
+// are no global pages and no PCIDs, so a CR3 load does the same.
+void tlb_flush_all() {
+  uint64_t cr4 = read_cr4();
+  if (cr4 & CR4_PGE) {
+    write_cr4(cr4 & ~CR4_PGE);
+    write_cr4(cr4);
+  } else {
+    write_cr3(read_cr3());
+  }
+}
+
+void tlb_batch_init(tlb_batch *b, uint64_t cr3) {
+  b->cr3 = cr3;
+  b->count = 0;
+}
+
+void tlb_batch_add(tlb_batch *b, uint64_t virt) {
+  if (b->count < TLB_BATCH_MAX)
+    b->pages[b->count] = virt;
+  b->count++;
+}
+
+// Drops every entry of the space
+static void flush_space(uint64_t cr3) {
+  uint16_t pcid = cr3 & CR3_PCID_MASK;
+  uint64_t current = read_cr3();
+  stats.space_flushes++;
+  if ((current & ~CR3_PCID_MASK) == (cr3 & ~CR3_PCID_MASK))
+    write_cr3(current); // No NOFLUSH: drops the current PCID's entries
+  else if (invpcid_ok)
+    invpcid(INVPCID_CONTEXT, pcid, 0);
+  else
+    bit_set(pcid_stale, pcid, true);
+}
+
+void tlb_batch_flush(tlb_batch *b) {
+  if (!b->count)
+    return;
+  stats.batches++;
+  uint64_t current = read_cr3();
+  bool loaded = (current & ~CR3_PCID_MASK) == (b->cr3 & ~CR3_PCID_MASK);
+  uint16_t pcid = b->cr3 & CR3_PCID_MASK;
+
+  // Without PCIDs a space that isn't loaded has nothing cached
+  if (!loaded && !pcid_on) {
+    b->count = 0;
+    return;
+  }
+  if (b->count > TLB_BATCH_MAX || (!loaded && !invpcid_ok)) {
+    flush_space(b->cr3);
+  } else {
+    for (uint32_t i = 0; i < b->count; i++) {
+      if (loaded)
+        invlpg(b->pages[i]);
+      else
+        invpcid(INVPCID_ADDRESS, pcid, b->pages[i]);
+    }
+    stats.pages += b->count;
+  }
+  b->count = 0;
+}
+
+static void cmd_tlb(char *) {
+  term_puts("PCID: ", COLOR_DEFAULT);
+  term_puts(pcid_on ? "on" : "off", COLOR_DEFAULT);
+  term_puts(", INVPCID: ", COLOR_DEFAULT);
+  term_puts(invpcid_ok ? "yes" : "no", COLOR_DEFAULT);
+  term_puts("\nSwitches:      ", COLOR_DEFAULT);
+  term_put_uint(stats.switches);
+  term_puts(" (", COLOR_DEFAULT);
+  term_put_uint(stats.switches_kept);
+  term_puts(" kept their entries)", COLOR_DEFAULT);
+  term_puts("\nBatches:       ", COLOR_DEFAULT);
+  term_put_uint(stats.batches);
+  term_puts("\nPage flushes:  ", COLOR_DEFAULT);
+  term_put_uint(stats.pages);
+  term_puts("\nSpace flushes: ", COLOR_DEFAULT);
+  term_put_uint(stats.space_flushes);
+  term_putc('\n');
+}
+
+COMMAND(tlb, "tlb", "Show PCID use and TLB flush counts", 0, 0, cmd_tlb);
@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+
+// TLB management. Kernel mappings are global, so they survive address
+// space switches. With PCIDs, each address space also tags its own entries
+// (CR3 bits 0-11), so switching back to a space finds its translations
+// still cached. Without PCIDs, every switch flushes the user half.
+//
+// Address spaces are named by their CR3 value: the PML4's physical address
+// plus its PCID (0 when PCIDs are off, and for the kernel's own tables).
+
+#define CR3_PCID_MASK 0xFFFull
+#define CR3_NOFLUSH (1ull << 63) // Keep the PCID's entries on a CR3 load
+
+// Pages a batch can name before it falls back to flushing the whole space
+#define TLB_BATCH_MAX 32
+
+// Enables global pages and, where the CPU has them, PCIDs. Must run on
+// page tables whose CR3 has PCID 0.
+void tlb_init();
+
+// Returns a PCID for a new address space, or 0 if PCIDs are off
+uint16_t pcid_alloc();
+
+// Releases a PCID. Its entries are dropped now if the CPU has INVPCID,
+// otherwise on the first load of whichever space reuses it.
+void pcid_free(uint16_t pcid);
+
+// Loads the address space `cr3`
+void tlb_switch(uint64_t cr3);
+
+// Flushes everything, global kernel entries included
+void tlb_flush_all();
+
+// Invalidations for one address space, collected while its page tables
+// are edited and issued together by tlb_batch_flush(). On SMP this is
+// where one shootdown round would cover the whole batch; the kernel runs
+// on one CPU, so the round is local.
+struct tlb_batch {
+  uint64_t cr3;
+  uint32_t count; // Pages queued; above TLB_BATCH_MAX, the whole space
+  uint64_t pages[TLB_BATCH_MAX];
+};
+
+void tlb_batch_init(tlb_batch *b, uint64_t cr3);
+void tlb_batch_add(tlb_batch *b, uint64_t virt);
+void tlb_batch_flush(tlb_batch *b);
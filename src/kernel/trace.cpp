@@ -0,0 +1,135 @@
+#include "trace.h"
+#include "cmd.h"
+#include "cpu.h"
+#include "serial.h"
+#include "term.h"
+
+// Bounds of the .tacos_trace section, from linker.ld
+extern "C" tracepoint trace_table_start[], trace_table_end[];
+
+#define TRACE_RING_RECORDS 4096 // Power of two
+#define TRACE_NAME_BYTES 32
+
+// Dump header, followed by one TRACE_NAME_BYTES name per tracepoint and
+// then the records, oldest first
+struct trace_dump_header {
+  char magic[8]; // "TACOSTR1"
+  uint32_t record_size;
+  uint32_t event_count;
+  uint64_t tsc_hz;
+  uint64_t record_count;
+};
+
+// Writers reserve a slot with one atomic add, so an interrupt handler
+// tracing in the middle of another record just takes the next slot. The
+// oldest records are overwritten. One CPU, one ring.
+struct trace_ring {
+  trace_record rec[TRACE_RING_RECORDS];
+  uint64_t head; // Records ever reserved
+};
+
+static trace_ring ring;
+
+void trace_emit(tracepoint *tp, uint8_t phase, uint32_t arg0,
+                uint64_t arg1) {
+  uint64_t slot = __atomic_fetch_add(&ring.head, 1, __ATOMIC_RELAXED);
+  trace_record *r = &ring.rec[slot % TRACE_RING_RECORDS];
+  r->tsc = rdtsc();
+  r->event = tp - trace_table_start;
+  r->phase = phase;
+  r->cpu = 0;
+  r->arg0 = arg0;
+  r->arg1 = arg1;
+}
+
+static bool name_is(const char *a, const char *b) {
+  while (*a && *a == *b) {
+    a++;
+    b++;
+  }
+  return *a == *b;
+}
+
+// Enables or disables the tracepoint `name`, or all of them if it's empty
+static bool set_enabled(const char *name, bool on) {
+  bool found = false;
+  for (tracepoint *tp = trace_table_start; tp < trace_table_end; tp++) {
+    if (name[0] == '\0' || name_is(tp->name, name)) {
+      tp->enabled = on;
+      found = true;
+    }
+  }
+  return found;
+}
+
+static void trace_list() {
+  for (tracepoint *tp = trace_table_start; tp < trace_table_end; tp++) {
+    term_puts(tp->enabled ? "  on   " : "  off  ");
+    term_puts(tp->name);
+    term_putc('\n');
+  }
+  uint64_t head = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+  term_put_uint(head < TRACE_RING_RECORDS ? head : TRACE_RING_RECORDS);
+  term_puts(" records buffered, ");
+  term_put_uint(head);
+  term_puts(" recorded\n");
+}
+
+static void trace_dump() {
+  if (!serial_present()) {
+    term_puts("Error: No serial port.\n", COLOR_ERROR);
+    return;
+  }
+  // Recording stops so the ring holds still while it is sent
+  set_enabled("", false);
+  int events = trace_table_end - trace_table_start;
+
+  uint64_t head = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+  uint64_t count = head < TRACE_RING_RECORDS ? head : TRACE_RING_RECORDS;
+  trace_dump_header hdr = {{'T', 'A', 'C', 'O', 'S', 'T', 'R', '1'},
+                           sizeof(trace_record),
+                           (uint32_t)events,
+                           tsc_hz,
+                           count};
+  serial_write(&hdr, sizeof(hdr));
+  for (tracepoint *tp = trace_table_start; tp < trace_table_end; tp++) {
+    char name[TRACE_NAME_BYTES] = {};
+    for (int i = 0; tp->name[i] && i < TRACE_NAME_BYTES - 1; i++)
+      name[i] = tp->name[i];
+    serial_write(name, sizeof(name));
+  }
+  for (uint64_t i = head - count; i < head; i++)
+    serial_write(&ring.rec[i % TRACE_RING_RECORDS], sizeof(trace_record));
+  // A handler that saw its tracepoint enabled before set_enabled() may
+  // still be reserving; with interrupts off none is halfway through
+  uint64_t flags = irq_save();
+  __atomic_store_n(&ring.head, 0, __ATOMIC_RELAXED);
+  irq_restore(flags);
+
+  term_puts("Sent ");
+  term_put_uint(count);
+  term_puts(" records over COM1; tracing is now off\n");
+}
+
+static void cmd_trace(char *args) {
+  char *name = args;
+  while (*name && *name != ' ')
+    name++;
+  if (*name)
+    *name++ = '\0';
+
+  if (name_is(args, "on") || name_is(args, "off")) {
+    if (!set_enabled(name, args[1] == 'n'))
+      term_puts("Error: No such tracepoint.\n", COLOR_ERROR);
+  } else if (name_is(args, "list") && !*name) {
+    trace_list();
+  } else if (name_is(args, "dump") && !*name) {
+    trace_dump();
+  } else {
+    term_puts("Usage: trace on|off [event], trace list|dump\n",
+              COLOR_ERROR);
+  }
+}
+
+COMMAND(trace, "trace <action>", "Record events: on, off, list, dump", 1, 2,
+        cmd_trace);
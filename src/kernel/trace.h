@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+
+// Static tracepoints. TRACEPOINT() declares one in the .tacos_trace
+// section; TRACE() and TRACE_SCOPE() record events into a ring of
+// fixed-size records while it is enabled. A disabled tracepoint costs one
+// predictable branch. `trace dump` sends the ring over COM1, and
+// tools/trace2json.py turns the capture into Chrome trace JSON.
+
+struct tracepoint {
+  const char *name;
+  volatile bool enabled;
+};
+
+#define TRACE_INSTANT 0
+#define TRACE_BEGIN 1
+#define TRACE_END 2
+
+// One binary record; the layout is part of the dump format
+struct trace_record {
+  uint64_t tsc;
+  uint16_t event; // Index of the tracepoint in .tacos_trace
+  uint8_t phase;
+  uint8_t cpu;
+  uint32_t arg0;
+  uint64_t arg1;
+};
+
+static_assert(sizeof(trace_record) == 24, "dump format");
+
+#define TRACEPOINT(name)                                                     \
+  [[gnu::used, gnu::section(".tacos_trace"), gnu::aligned(16)]]              \
+  static tracepoint tp_##name = {#name, false}
+
+void trace_emit(tracepoint *tp, uint8_t phase, uint32_t arg0, uint64_t arg1);
+
+#define TRACE(name, arg0, arg1)                                              \
+  do {                                                                       \
+    if (__builtin_expect(tp_##name.enabled, 0))                              \
+      trace_emit(&tp_##name, TRACE_INSTANT, arg0, arg1);                     \
+  } while (0)
+
+// Records a begin event now and the matching end when the scope exits
+struct trace_scope {
+  tracepoint *tp; // nullptr if disabled at the start of the scope
+
+  trace_scope(tracepoint *t, uint32_t arg0, uint64_t arg1)
+      : tp(__builtin_expect(t->enabled, 0) ? t : nullptr) {
+    if (tp)
+      trace_emit(tp, TRACE_BEGIN, arg0, arg1);
+  }
+  ~trace_scope() {
+    if (tp)
+      trace_emit(tp, TRACE_END, 0, 0);
+  }
+};
+
+#define TRACE_SCOPE(name, arg0, arg1)                                        \
+  trace_scope trace_scope_##name(&tp_##name, arg0, arg1)
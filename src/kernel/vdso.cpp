@@ -0,0 +1,43 @@
+#include "vdso.h"
+#include "cpu.h"
+#include "paging.h"
+
+// A whole page, so mapping it to user space exposes nothing else
+alignas(PAGE_SIZE) static uint8_t vdso_page[PAGE_SIZE];
+
+vdso_data *const vdso = (vdso_data *)vdso_page;
+
+static void write_begin() {
+  vdso->seq = vdso->seq + 1;
+  asm volatile("" : : : "memory"); // x86 keeps stores in order
+}
+
+static void write_end() {
+  asm volatile("" : : : "memory");
+  vdso->seq = vdso->seq + 1;
+}
+
+void vdso_init(uint64_t mem_pages) {
+  write_begin();
+  vdso->tsc_hz = tsc_hz;
+  vdso->tsc_base = rdtsc();
+  vdso->ns_base = 0;
+  vdso->mult = tsc_hz ? (VDSO_NS_PER_SEC << VDSO_SHIFT) / tsc_hz : 0;
+  vdso->mem_pages = mem_pages;
+  const char *name = "TacosOS v0.1.0";
+  for (int i = 0; name[i]; i++)
+    vdso->os_name[i] = name[i];
+  write_end();
+}
+
+void vdso_set_wall(uint64_t unix_secs, bool at_boot) {
+  uint64_t ns = vdso_ns_at(vdso, rdtsc());
+  write_begin();
+  if (at_boot)
+    vdso->boot_unix = unix_secs - ns / VDSO_NS_PER_SEC;
+  vdso->rtc_unix = unix_secs;
+  vdso->rtc_ns = ns;
+  write_end();
+}
+
+uint64_t vdso_phys() { return virt_to_phys(vdso_page); }
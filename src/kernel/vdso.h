@@ -0,0 +1,86 @@
+#pragma once
+#include <stdint.h>
+
+// Kernel-maintained data page, mapped read-only into every process at
+// VDSO_USER_ADDR and read by the kernel directly. Readers get the time
+// without a syscall or port I/O: the TSC is converted to nanoseconds with
+// a multiply and a shift, and the wall clock is the last RTC sample plus
+// the time elapsed since it was taken.
+//
+// Shared with the programs in src/user, so everything here is inline.
+
+#define VDSO_USER_ADDR 0x00007FFFFFFFF000ull
+#define VDSO_SHIFT 32
+#define VDSO_NS_PER_SEC 1000000000ull
+
+struct vdso_data {
+  volatile uint32_t seq; // Odd while the kernel is writing
+  uint32_t reserved;
+  uint64_t tsc_hz;
+  uint64_t tsc_base;  // TSC when ns_base was taken
+  uint64_t ns_base;   // Nanoseconds since boot at tsc_base
+  uint64_t mult;      // ns = ns_base + ((tsc - tsc_base) * mult >> 32)
+  uint64_t boot_unix; // Wall clock at boot, seconds since 1970
+  uint64_t rtc_unix;  // Last RTC sample, seconds since 1970
+  uint64_t rtc_ns;    // Boot-relative time the sample was taken
+  uint64_t mem_pages; // Usable 4K pages of RAM
+  char os_name[32];
+};
+
+// Seqlock read side: retry while a write is in progress or happened
+// during the read. x86 doesn't reorder loads with other loads, so only
+// the compiler needs a barrier.
+static inline uint32_t vdso_read_begin(const vdso_data *v) {
+  uint32_t seq;
+  while ((seq = v->seq) & 1)
+    asm volatile("pause");
+  asm volatile("" : : : "memory");
+  return seq;
+}
+
+static inline bool vdso_read_retry(const vdso_data *v, uint32_t seq) {
+  asm volatile("" : : : "memory");
+  return v->seq != seq;
+}
+
+static inline uint64_t vdso_ns_at(const vdso_data *v, uint64_t tsc) {
+  uint64_t delta = tsc - v->tsc_base;
+  return v->ns_base +
+         (uint64_t)(((unsigned __int128)delta * v->mult) >> VDSO_SHIFT);
+}
+
+// Nanoseconds since boot
+static inline uint64_t vdso_clock_ns(const vdso_data *v) {
+  uint32_t seq;
+  uint64_t ns;
+  do {
+    seq = vdso_read_begin(v);
+    ns = vdso_ns_at(v, __builtin_ia32_rdtsc());
+  } while (vdso_read_retry(v, seq));
+  return ns;
+}
+
+// Seconds since 1970
+static inline uint64_t vdso_time_unix(const vdso_data *v) {
+  uint32_t seq;
+  uint64_t secs;
+  do {
+    seq = vdso_read_begin(v);
+    uint64_t ns = vdso_ns_at(v, __builtin_ia32_rdtsc());
+    secs = v->rtc_unix + (ns - v->rtc_ns) / VDSO_NS_PER_SEC;
+  } while (vdso_read_retry(v, seq));
+  return secs;
+}
+
+// Kernel side (vdso.cpp). Declarations only, so user programs can still
+// include this header.
+extern vdso_data *const vdso;
+
+// Fills in the clock conversion; needs tsc_calibrate() first
+void vdso_init(uint64_t mem_pages);
+
+// Publishes an RTC sample taken just now. The first one, at boot, also
+// sets boot_unix.
+void vdso_set_wall(uint64_t unix_secs, bool at_boot);
+
+uint64_t vdso_phys();
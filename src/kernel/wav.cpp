@@ -0,0 +1,361 @@
+#include "wav.h"
+#include "block.h"
+#include "cmd.h"
+#include "fs.h"
+#include "idle.h"
+#include "kbd.h"
+#include "kstring.h"
+#include "mixer.h"
+#include "term.h"
+
+// Prefetch queue between the disk and the mixer's stream ring. The disk
+// stage fills whole blocks with PIO reads while playback runs from DMA and
+// IRQ5, then the decode stage converts them into 16-bit samples.
+#define WAV_BLOCK_SECTORS 8
+#define WAV_BLOCK_BYTES (WAV_BLOCK_SECTORS * FS_SECTOR_SIZE)
+#define WAV_QUEUE_BLOCKS 8
+#define WAV_DECODE_CHUNK 256
+
+struct PrefetchBlock {
+  uint8_t data[WAV_BLOCK_BYTES];
+  uint32_t len;  // Valid bytes
+  uint32_t used; // Bytes already decoded
+};
+
+static PrefetchBlock queue[WAV_QUEUE_BLOCKS];
+static uint32_t queue_head; // Next block to fill
+static uint32_t queue_tail; // Next block to decode
+
+static uint32_t read_le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read_le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static bool tag_is(const uint8_t *p, const char *tag) {
+  return p[0] == tag[0] && p[1] == tag[1] && p[2] == tag[2] && p[3] == tag[3];
+}
+
+bool wav_parse(const uint8_t *buf, uint32_t len, wav_format *fmt) {
+  if (len < 12 || !tag_is(buf, "RIFF") || !tag_is(buf + 8, "WAVE"))
+    return false;
+
+  bool have_fmt = false;
+  uint32_t off = 12;
+  while (off + 8 <= len) {
+    uint32_t size = read_le32(buf + off + 4);
+    const uint8_t *body = buf + off + 8;
+    if (tag_is(buf + off, "fmt ")) {
+      if (off + 8 + 16 > len || read_le16(body) != 1) // PCM only
+        return false;
+      fmt->channels = read_le16(body + 2);
+      fmt->sample_rate = read_le32(body + 4);
+      fmt->bits = read_le16(body + 14);
+      have_fmt = true;
+    } else if (tag_is(buf + off, "data")) {
+      if (!have_fmt)
+        return false;
+      fmt->data_offset = off + 8;
+      fmt->data_size = size;
+      return (fmt->channels == 1 || fmt->channels == 2) &&
+             (fmt->bits == 8 || fmt->bits == 16) && fmt->sample_rate > 0;
+    }
+    // A chunk running past the buffer ends the scan; its size could
+    // otherwise wrap `off` back to where it was
+    if (size > len - off - 8)
+      break;
+    off += 8 + size + (size & 1); // Chunks are word aligned
+  }
+  return false;
+}
+
+static bool read_block(uint32_t lba, uint32_t sectors, uint8_t *dst) {
+  return blk_transfer(lba, sectors, dst, false);
+}
+
+// Converts up to `max` samples from the block into 16-bit signed
+static uint32_t decode(PrefetchBlock *b, uint16_t bits, int16_t *out,
+                       uint32_t max) {
+  uint32_t n = 0;
+  if (bits == 8) {
+    while (n < max && b->used < b->len)
+      out[n++] = (int16_t)((b->data[b->used++] - 128) << 8);
+  } else {
+    while (n < max && b->used + 1 < b->len) {
+      out[n++] = (int16_t)read_le16(b->data + b->used);
+      b->used += 2;
+    }
+  }
+  return n;
+}
+
+static void print_stat(const char *label, uint64_t value, const char *unit) {
+  term_puts(label, COLOR_DEFAULT);
+  term_put_uint(value);
+  term_puts(unit, COLOR_DEFAULT);
+}
+
+static void cmd_play(const char *name) {
+  char dir[FS_PATH_MAX];
+  fs_current_dir(dir);
+  MockFile f;
+  if (!fs_get_file(find_file(name, dir), &f)) {
+    term_puts("Error: File not found in current directory.\n", COLOR_ERROR);
+    return;
+  }
+  if (f.data_size == 0) {
+    term_puts("Error: File has no audio data.\n", COLOR_ERROR);
+    return;
+  }
+
+  // The header is parsed from the first block
+  PrefetchBlock *first = &queue[0];
+  uint32_t first_sectors = (f.data_size + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+  if (first_sectors > WAV_BLOCK_SECTORS)
+    first_sectors = WAV_BLOCK_SECTORS;
+  wav_format fmt;
+  if (!read_block(f.data_lba, first_sectors, first->data) ||
+      !wav_parse(first->data, first_sectors * FS_SECTOR_SIZE, &fmt) ||
+      fmt.data_offset >= first_sectors * FS_SECTOR_SIZE) {
+    term_puts("Error: Not a supported PCM WAV file.\n", COLOR_ERROR);
+    return;
+  }
+
+  // Byte range of the samples within the file
+  uint32_t end = fmt.data_offset + fmt.data_size;
+  if (end > f.data_size)
+    end = f.data_size;
+  uint32_t file_pos = first_sectors * FS_SECTOR_SIZE;
+  first->len = file_pos < end ? file_pos : end;
+  first->used = fmt.data_offset;
+  queue_head = 1;
+  queue_tail = 0;
+
+  int voice = mixer_stream_start(fmt.sample_rate, fmt.channels,
+                                 MIXER_VOL_MAX, MIXER_PAN_CENTER);
+  if (voice < 0) {
+    term_puts("Error: Audio mixer not available.\n", COLOR_ERROR);
+    return;
+  }
+  term_puts("Playing (ESC to stop)...\n", COLOR_SUCCESS);
+
+  uint32_t blocks_read = 1;
+  uint32_t fill_min = WAV_QUEUE_BLOCKS, fill_max = 0;
+  uint64_t fill_sum = 0, stream_sum = 0, samples_taken = 0;
+  uint32_t stream_min = MIXER_STREAM_SAMPLES;
+  bool io_error = false, stopped = false;
+  int16_t chunk[WAV_DECODE_CHUNK];
+  uint32_t pending = 0, pending_off = 0; // Decoded but not yet queued
+
+  while (1) {
+    uint8_t scancode;
+    if (kbd_poll(&scancode) && scancode == 0x01) {
+      stopped = true;
+      break;
+    }
+
+    bool progress = false;
+
+    // Disk stage: one block per pass so the decode stage keeps up
+    if (queue_head - queue_tail < WAV_QUEUE_BLOCKS && file_pos < end) {
+      PrefetchBlock *b = &queue[queue_head % WAV_QUEUE_BLOCKS];
+      uint32_t sectors = (end - file_pos + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+      if (sectors > WAV_BLOCK_SECTORS)
+        sectors = WAV_BLOCK_SECTORS;
+      if (!read_block(f.data_lba + file_pos / FS_SECTOR_SIZE, sectors,
+                      b->data)) {
+        io_error = true;
+        break;
+      }
+      uint32_t bytes = sectors * FS_SECTOR_SIZE;
+      b->len = end - file_pos < bytes ? end - file_pos : bytes;
+      b->used = 0;
+      file_pos += bytes;
+      queue_head++;
+      blocks_read++;
+      progress = true;
+    }
+
+    // Decode stage: move samples into the stream ring while it has room
+    while (1) {
+      if (pending == 0 && queue_tail != queue_head) {
+        PrefetchBlock *b = &queue[queue_tail % WAV_QUEUE_BLOCKS];
+        pending = decode(b, fmt.bits, chunk, WAV_DECODE_CHUNK);
+        pending_off = 0;
+        if (b->used + (fmt.bits / 8) > b->len)
+          queue_tail++; // Block consumed
+      }
+      if (pending == 0)
+        break;
+      uint32_t n = mixer_stream_write(chunk + pending_off, pending);
+      if (n == 0)
+        break;
+      pending -= n;
+      pending_off += n;
+      progress = true;
+    }
+
+    // Fill levels, sampled once per pass
+    uint32_t fill = queue_head - queue_tail;
+    uint32_t queued = mixer_stream_queued();
+    fill_sum += fill;
+    stream_sum += queued;
+    samples_taken++;
+    if (fill < fill_min)
+      fill_min = fill;
+    if (fill > fill_max)
+      fill_max = fill;
+    if (queued < stream_min)
+      stream_min = queued;
+
+    if (file_pos >= end && queue_tail == queue_head && pending == 0) {
+      mixer_stream_end();
+      break;
+    }
+    if (!progress)
+      cpu_idle(); // Stream ring is full: wait for the next IRQ
+  }
+
+  if (stopped || io_error)
+    mixer_stop(voice);
+  else
+    wait_until([&] { return !mixer_voice_active(voice); });
+
+  if (io_error)
+    term_puts("Error: Disk read failed.\n", COLOR_ERROR);
+  print_stat("Blocks read: ", blocks_read, "");
+  print_stat(" x ", WAV_BLOCK_BYTES, " bytes\n");
+  print_stat("Underruns: ", mixer_stream_underruns, "\n");
+  print_stat("Prefetch fill (blocks): min ", fill_min, "");
+  print_stat(", avg ", samples_taken ? fill_sum / samples_taken : 0, "");
+  print_stat(", max ", fill_max, "");
+  print_stat(" of ", WAV_QUEUE_BLOCKS, "\n");
+  print_stat("Stream ring (samples): min ", stream_min, "");
+  print_stat(", avg ", samples_taken ? stream_sum / samples_taken : 0, "");
+  print_stat(" of ", MIXER_STREAM_SAMPLES, "\n");
+}
+
+COMMAND(play, "play <file>", "Stream a WAV file to the SB16", 1, 1,
+        [](char *args) { cmd_play(args); });
+
+#define WAVGEN_RATE 22050
+#define WAVGEN_GAP_MS 20
+#define WAV_HEADER_BYTES 44
+// Sectors the generator buffers per write
+#define WAVGEN_WRITE_SECTORS 16
+
+static void put_le32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static void put_le16(uint8_t *p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static void put_tag(uint8_t *p, const char *tag) {
+  for (int i = 0; i < 4; i++)
+    p[i] = tag[i];
+}
+
+// Writer for the generated file, through the block queue a buffer at a
+// time
+struct SectorWriter {
+  uint8_t buf[WAVGEN_WRITE_SECTORS * FS_SECTOR_SIZE];
+  uint32_t fill;
+  uint32_t lba;
+  bool ok;
+};
+
+// Writes out what is buffered, padding the last sector with zeros
+static void writer_flush(SectorWriter *w) {
+  if (w->fill == 0)
+    return;
+  uint32_t sectors = (w->fill + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+  for (uint32_t i = w->fill; i < sectors * FS_SECTOR_SIZE; i++)
+    w->buf[i] = 0;
+  w->ok &= blk_transfer(w->lba, sectors, w->buf, true);
+  w->lba += sectors;
+  w->fill = 0;
+}
+
+static void writer_put16(SectorWriter *w, int16_t v) {
+  put_le16(w->buf + w->fill, (uint16_t)v);
+  w->fill += 2;
+  if (w->fill == sizeof(w->buf))
+    writer_flush(w);
+}
+
+void cmd_wavgen(const char *name, const Note *song, uint32_t unit_ms) {
+  uint32_t gap = WAVGEN_RATE * WAVGEN_GAP_MS / 1000;
+  uint32_t frames = 0;
+  for (int n = 0; song[n].duration != 0; n++)
+    frames += song[n].duration * unit_ms * WAVGEN_RATE / 1000 + gap;
+
+  uint32_t data_bytes = frames * 2;
+  uint32_t total = WAV_HEADER_BYTES + data_bytes;
+  uint32_t sectors = (total + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+
+  char dir[FS_PATH_MAX];
+  fs_current_dir(dir);
+  int idx = find_file(name, dir);
+  if (idx == -1)
+    idx = fs_create(name, dir);
+  if (idx == -1) {
+    term_puts("Error: File system full.\n", COLOR_ERROR);
+    return;
+  }
+  uint32_t lba = fs_alloc_data(sectors);
+  if (lba == 0) {
+    term_puts("Error: No disk space for audio data.\n", COLOR_ERROR);
+    return;
+  }
+
+  static SectorWriter w; // Too big for the stack
+  w.fill = WAV_HEADER_BYTES;
+  w.lba = lba;
+  w.ok = true;
+  uint8_t *h = w.buf;
+  put_tag(h, "RIFF");
+  put_le32(h + 4, total - 8);
+  put_tag(h + 8, "WAVE");
+  put_tag(h + 12, "fmt ");
+  put_le32(h + 16, 16);
+  put_le16(h + 20, 1); // PCM
+  put_le16(h + 22, 1); // Mono
+  put_le32(h + 24, WAVGEN_RATE);
+  put_le32(h + 28, WAVGEN_RATE * 2);
+  put_le16(h + 32, 2);
+  put_le16(h + 34, 16);
+  put_tag(h + 36, "data");
+  put_le32(h + 40, data_bytes);
+
+  synth_voice v;
+  for (int n = 0; song[n].duration != 0; n++) {
+    synth_note_on(&v, WAVE_SQUARE, song[n].freq,
+                  song[n].duration * unit_ms * WAVGEN_RATE / 1000,
+                  WAVGEN_RATE, 6000);
+    while (v.frames_left)
+      writer_put16(&w, (int16_t)synth_next(&v));
+    for (uint32_t i = 0; i < gap; i++)
+      writer_put16(&w, 0);
+  }
+  writer_flush(&w);
+
+  MockFile f;
+  if (fs_get_file(idx, &f)) {
+    f.data_lba = lba;
+    f.data_size = total;
+    kstrcpy(f.content, "WAV audio, 22050Hz 16-bit mono");
+    fs_set_file(idx, &f);
+  }
+  fs_save();
+
+  if (!w.ok)
+    term_puts("Error: Disk write failed.\n", COLOR_ERROR);
+  else
+    print_stat("WAV written: ", total, " bytes\n");
+}
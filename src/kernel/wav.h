@@ -0,0 +1,18 @@
+#pragma once
+#include "synth.h"
+#include <stdint.h>
+
+struct wav_format {
+  uint16_t channels;
+  uint16_t bits;
+  uint32_t sample_rate;
+  uint32_t data_offset; // Byte offset of the sample data in the file
+  uint32_t data_size;
+};
+
+// Parses a RIFF/WAVE header. Only uncompressed 8/16-bit mono or stereo
+// PCM is accepted.
+bool wav_parse(const uint8_t *buf, uint32_t len, wav_format *fmt);
+
+// wavgen <file>: renders a song into a new 16-bit mono WAV file
+void cmd_wavgen(const char *name, const Note *song, uint32_t unit_ms);
@@ -0,0 +1,46 @@
+#include "usys.h"
+
+// Reads the time from the vDSO page and compares the cost of doing so
+// with a syscall that returns the tick count
+#define CALLS 100000
+
+static void print2(uint64_t n) {
+  if (n < 10)
+    print("0");
+  print_uint(n);
+}
+
+int main() {
+  const vdso_data *v = vdso_page();
+
+  uint64_t now = vdso_time_unix(v);
+  uint64_t secs = now % 86400;
+  print(v->os_name);
+  print(", time ");
+  print2(secs / 3600);
+  print(":");
+  print2(secs % 3600 / 60);
+  print(":");
+  print2(secs % 60);
+  print(", up ");
+  print_uint(now - v->boot_unix);
+  print(" s\n");
+
+  uint64_t sink = 0;
+  uint64_t start = vdso_clock_ns(v);
+  for (int i = 0; i < CALLS; i++)
+    sink += vdso_clock_ns(v);
+  uint64_t vdso_ns = vdso_clock_ns(v) - start;
+
+  start = vdso_clock_ns(v);
+  for (int i = 0; i < CALLS; i++)
+    sink += sys_ticks();
+  uint64_t sys_ns = vdso_clock_ns(v) - start;
+
+  print("vDSO clock read: ");
+  print_uint(vdso_ns / CALLS);
+  print(" ns, SYS_TICKS: ");
+  print_uint(sys_ns / CALLS);
+  print(" ns\n");
+  return sink == 0; // Keeps the loops from being optimized out
+}
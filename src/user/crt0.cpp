@@ -0,0 +1,13 @@
+#include "usys.h"
+
+// The kernel enters at _start with rsp at the 16-byte aligned stack top.
+// The call leaves main's frame aligned the way the ABI expects.
+asm(".section .text._start, \"ax\"\n"
+    ".global _start\n"
+    "_start:\n"
+    "  xor %ebp, %ebp\n"
+    "  call start_main\n"
+    "  ud2\n"
+    ".previous\n");
+
+extern "C" [[noreturn]] void start_main() { sys_exit(main()); }
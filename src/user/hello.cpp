@@ -0,0 +1,8 @@
+#include "usys.h"
+
+int main() {
+  print("Hello from ring 3! Uptime: ");
+  print_uint(sys_ticks());
+  print(" ms\n");
+  return 0;
+}
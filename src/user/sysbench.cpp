@@ -0,0 +1,31 @@
+#include "usys.h"
+
+// SYS_NOP round trips: SYSCALL, the entry stub, the dispatch table and
+// SYSRET, with nothing done in between
+#define BATCHES 16
+#define CALLS_PER_BATCH 4096
+
+int main() {
+  for (int i = 0; i < 1024; i++) // Warm up caches and the TLB
+    sys_nop();
+
+  uint64_t total = 0, best = ~0ull;
+  for (int b = 0; b < BATCHES; b++) {
+    uint64_t start = rdtsc();
+    for (int i = 0; i < CALLS_PER_BATCH; i++)
+      sys_nop();
+    uint64_t cycles = rdtsc() - start;
+    total += cycles;
+    if (cycles < best)
+      best = cycles;
+  }
+
+  print("SYSCALL round trip: ");
+  print_uint(total / (BATCHES * CALLS_PER_BATCH));
+  print(" cycles avg, ");
+  print_uint(best / CALLS_PER_BATCH);
+  print(" cycles best batch (");
+  print_uint(BATCHES * CALLS_PER_BATCH);
+  print(" calls)\n");
+  return 0;
+}
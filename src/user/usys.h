@@ -0,0 +1,63 @@
+#pragma once
+#include "kernel/syscall_abi.h"
+#include "kernel/vdso.h"
+#include <stdint.h>
+
+// System call wrappers and console helpers for user programs
+
+static inline int64_t syscall0(uint64_t nr) {
+  int64_t ret;
+  asm volatile("syscall" : "=a"(ret) : "a"(nr) : "rcx", "r11", "memory");
+  return ret;
+}
+
+static inline int64_t syscall2(uint64_t nr, uint64_t a0, uint64_t a1) {
+  int64_t ret;
+  asm volatile("syscall"
+               : "=a"(ret)
+               : "a"(nr), "D"(a0), "S"(a1)
+               : "rcx", "r11", "memory");
+  return ret;
+}
+
+[[noreturn]] static inline void sys_exit(int64_t status) {
+  syscall2(SYS_EXIT, status, 0);
+  __builtin_unreachable();
+}
+
+static inline int64_t sys_write(const char *buf, uint64_t len) {
+  return syscall2(SYS_WRITE, (uint64_t)buf, len);
+}
+
+static inline int64_t sys_nop() { return syscall0(SYS_NOP); }
+static inline uint64_t sys_ticks() { return syscall0(SYS_TICKS); }
+
+static inline const vdso_data *vdso_page() {
+  return (const vdso_data *)VDSO_USER_ADDR;
+}
+
+static inline uint64_t rdtsc() {
+  uint32_t lo, hi;
+  asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void print(const char *s) {
+  uint64_t len = 0;
+  while (s[len])
+    len++;
+  sys_write(s, len);
+}
+
+static inline void print_uint(uint64_t n) {
+  char buf[21];
+  int i = sizeof(buf);
+  do {
+    buf[--i] = (n % 10) + '0';
+    n /= 10;
+  } while (n > 0);
+  sys_write(buf + i, sizeof(buf) - i);
+}
+
+// Defined by each program; its return value is the exit status
+int main();
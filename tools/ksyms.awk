@@ -0,0 +1,46 @@
+# Turns `nm -n -C --defined-only` output for the kernel into a nasm source
+# for the .ksyms section: a count, then (address, name) pairs sorted by
+# address, then the names. Only functions are kept, and the argument
+# lists are dropped to keep the table small.
+
+BEGIN { count = 0 }
+
+$2 ~ /^[tTwW]$/ {
+  name = $3
+  for (i = 4; i <= NF; i++)
+    name = name " " $i
+  sub(/ \[clone [^]]*\]$/, "", name)
+  sub(/ const$/, "", name)
+  # Cut the argument list at the '(' matching the final ')'
+  if (name ~ /\)$/) {
+    depth = 0
+    for (i = length(name); i > 0; i--) {
+      c = substr(name, i, 1)
+      if (c == ")")
+        depth++
+      else if (c == "(" && --depth == 0)
+        break
+    }
+    if (i > 1)
+      name = substr(name, 1, i - 1)
+  }
+  # Shell command lambdas read better as their descriptor's name
+  sub(/::\{lambda\(.*\)#[0-9]+\}::_FUN$/, "", name)
+  gsub(/"/, "'", name)
+  addr = "0x" $1
+  if (count > 0 && addr == addrs[count - 1])
+    next # Aliases such as constructor variants
+  addrs[count] = addr
+  names[count] = name
+  count++
+}
+
+END {
+  print "; Generated by tools/ksyms.awk; do not edit"
+  print "section .ksyms progbits alloc noexec nowrite align=8"
+  print "    dq " count
+  for (i = 0; i < count; i++)
+    print "    dq " addrs[i] ", name_" i
+  for (i = 0; i < count; i++)
+    print "name_" i ": db \"" names[i] "\", 0"
+}
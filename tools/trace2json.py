@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""Converts a TacosOS `trace dump` capture into Chrome trace JSON.
+
+Capture COM1 with QEMU, e.g. `-serial file:trace.bin`, run `trace dump`
+in the shell, then:
+
+    tools/trace2json.py trace.bin > trace.json
+
+and load trace.json in chrome://tracing or Perfetto. Anything else the
+serial port carried before the dump is skipped.
+"""
+
+import json
+import struct
+import sys
+
+MAGIC = b"TACOSTR1"
+HEADER = struct.Struct("<8sIIQQ")
+RECORD = struct.Struct("<QHBBIQ")
+NAME_BYTES = 32
+PHASES = {0: "i", 1: "B", 2: "E"}
+
+
+def decode(data):
+    start = data.rfind(MAGIC)
+    if start < 0:
+        raise ValueError("no trace dump found")
+    magic, record_size, event_count, tsc_hz, count = HEADER.unpack_from(
+        data, start)
+    if record_size != RECORD.size:
+        raise ValueError("record size %d, expected %d" %
+                         (record_size, RECORD.size))
+    pos = start + HEADER.size
+    names = []
+    for _ in range(event_count):
+        raw = data[pos:pos + NAME_BYTES]
+        names.append(raw.split(b"\0", 1)[0].decode("ascii", "replace"))
+        pos += NAME_BYTES
+
+    records = []
+    for _ in range(count):
+        if pos + RECORD.size > len(data):
+            break  # Capture cut short
+        records.append(RECORD.unpack_from(data, pos))
+        pos += RECORD.size
+    records.sort(key=lambda r: r[0])
+
+    base = records[0][0] if records else 0
+    events = []
+    for tsc, event, phase, cpu, arg0, arg1 in records:
+        e = {
+            "name": names[event] if event < len(names) else "event%d" % event,
+            "ph": PHASES.get(phase, "i"),
+            "ts": (tsc - base) * 1e6 / tsc_hz if tsc_hz else tsc - base,
+            "pid": 0,
+            "tid": cpu,
+        }
+        if phase == 0:
+            e["s"] = "t"
+        if phase != 2:
+            e["args"] = {"arg0": arg0, "arg1": "0x%x" % arg1}
+        events.append(e)
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write("usage: %s <capture>\n" % sys.argv[0])
+        return 2
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    try:
+        trace = decode(data)
+    except ValueError as e:
+        sys.stderr.write("%s: %s\n" % (sys.argv[1], e))
+        return 1
+    json.dump(trace, sys.stdout)
+    sys.stdout.write("\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())